@@ -0,0 +1,308 @@
+/*!
+  @file   awg_composite.cpp
+  @brief  Definitions of the AWG_Composite methods.
+*/
+
+#include "awg_composite.h"
+#include "Streaming.h"
+#include "debug.h"
+
+
+template <typename F> void AWG_Composite::each_backend ( F visit )
+{
+  for ( int c = 1; c <= max_awg_channels; c++ )
+  {
+    bool  b_seen = ( m_lanes[c].task == NULL );
+
+    for ( int earlier = 1; earlier < c && ! b_seen; earlier++ )
+    {
+      b_seen = ( m_lanes[earlier].task == m_lanes[c].task );
+    }
+
+    if ( ! b_seen )
+    {
+      visit(*m_lanes[c].task);
+    }
+  }
+}
+
+
+bool AWG_Composite::attach ( uint32_t channel, AWG_Task & task, uint32_t backend_channel )
+{
+  if ( channel < 1 || channel > max_awg_channels || backend_channel < 1 || backend_channel > task.awg().channels() )
+  {
+    return false;
+  }
+
+  m_lanes[channel].task = &task;
+  m_lanes[channel].channel = backend_channel;
+
+  return true;
+}
+
+
+uint32_t AWG_Composite::channels ()
+{
+  uint32_t  count = 0;
+
+  while ( count < max_awg_channels && m_lanes[count+1].task != NULL )
+  {
+    count++;
+  }
+
+  return count;
+}
+
+
+uint32_t AWG_Composite::baud_rate ()
+{
+  return m_lanes[1].task ? m_lanes[1].task->awg().baud_rate() : AWG_Server::baud_rate();
+}
+
+
+bool AWG_Composite::set ( uint32_t channel, uint32_t param_id, double value )
+{
+  if ( channel < 1 || channel > channels() || param_id >= scpi::parameter_count )
+  {
+    return false;     // invalid channel or parameter
+  }
+
+  lane &  l = m_lanes[channel];
+
+  remember(channel, param_id, value);     // for BSWV?
+
+  if ( aborted() )
+  {
+    return false;
+  }
+
+  /*  A threaded backend applies the command in its own time, in
+      parallel with the others; settled() tells when it is done.  */
+
+  if ( l.task->threaded() )
+  {
+    l.task->push(l.channel, param_id, value);
+    return true;
+  }
+
+  return l.task->awg().set(l.channel, param_id, value);
+}
+
+
+bool AWG_Composite::get ( uint32_t channel, uint32_t param_id, double & value )
+{
+  bool    b_ok;
+
+  if ( channel < 1 || channel > channels() )
+  {
+    return false;     // invalid channel
+  }
+
+  lane &  l = m_lanes[channel];
+
+  b_ok = l.task->claim() && l.task->awg().get(l.channel, param_id, value);
+  l.task->release();
+
+  return b_ok;
+}
+
+
+void AWG_Composite::report ( Print & out )
+{
+  AWG_Server::report(out);
+
+  for ( int c = 1; c <= (int) channels(); c++ )
+  {
+    out << "  Channel " << c << " = channel " << m_lanes[c].channel << " of " << m_lanes[c].task->awg().id()
+        << " (" << ( m_lanes[c].task->threaded() ? "own thread" : "inline" ) << ")\n";
+  }
+
+  // a threaded backend is claimed, so that it does not update what is reported meanwhile
+
+  each_backend([&]( AWG_Task & task )
+    {
+      task.claim();
+      task.awg().report(out);
+      task.release();
+    });
+}
+
+
+void AWG_Composite::identify ( bool b_probe )
+{
+  // each backend identifies itself on its own serial line
+
+  each_backend([&]( AWG_Task & task )
+    {
+      if ( task.claim() )
+      {
+        task.awg().identify(b_probe);
+      }
+
+      task.release();
+    });
+}
+
+
+bool AWG_Composite::begin_upload ( uint32_t channel, uint32_t slot, uint32_t points )
+{
+  if ( uploading() )
+  {
+    end_upload();
+  }
+
+  if ( channel < 1 || channel > channels() )
+  {
+    Debug.Error() << "Unable to upload wave " << slot << " for channel " << channel << "\n";
+    return false;
+  }
+
+  lane &  l = m_lanes[channel];
+
+  // the backend is claimed for the whole upload
+
+  if ( ! l.task->claim() )
+  {
+    l.task->release();
+    return false;
+  }
+
+  if ( ! l.task->awg().begin_upload(l.channel, slot, points) )
+  {
+    l.task->release();
+    return false;
+  }
+
+  m_upload_lane = &l;
+  m_uploading = true;
+
+  return true;
+}
+
+
+bool AWG_Composite::upload ( const uint8_t * data, uint32_t len )
+{
+  return m_upload_lane ? m_upload_lane->task->awg().upload(data, len) : false;
+}
+
+
+bool AWG_Composite::end_upload ()
+{
+  bool  b_ok;
+
+  if ( m_upload_lane == NULL )
+  {
+    return false;
+  }
+
+  b_ok = m_upload_lane->task->awg().end_upload();
+  m_upload_lane->task->release();
+
+  m_upload_lane = NULL;
+  m_uploading = false;
+
+  return b_ok;
+}
+
+
+void AWG_Composite::loop ()
+{
+  bool  b_available = true;
+
+  if ( m_uploading || m_lent )
+  {
+    return;
+  }
+
+  each_backend([&]( AWG_Task & task )
+    {
+      if ( ! task.threaded() )
+      {
+        task.awg().loop();
+      }
+
+      b_available = b_available && task.available();
+    });
+
+  m_health = b_available ? AWG_UP : AWG_DOWN;
+}
+
+
+bool AWG_Composite::settled ()
+{
+  bool  b_settled = true;
+
+  each_backend([&]( AWG_Task & task ) { b_settled = b_settled && task.completed(task.queue().pushed()); });
+
+  return b_settled;
+}
+
+
+void AWG_Composite::abort ()
+{
+  AWG_Server::abort();
+
+  each_backend([]( AWG_Task & task ) { task.abort(true); });
+}
+
+
+void AWG_Composite::clear_abort ()
+{
+  AWG_Server::clear_abort();
+
+  each_backend([]( AWG_Task & task ) { task.clear_abort(); });
+}
+
+
+void AWG_Composite::lend ( bool b_lent )
+{
+  AWG_Server::lend(b_lent);
+
+  each_backend([&]( AWG_Task & task )
+    {
+      if ( b_lent )
+      {
+        task.lend();
+      }
+      else
+      {
+        task.take_back();
+      }
+    });
+}
+
+
+uint32_t AWG_Composite::commands ()
+{
+  uint32_t  sum = 0;
+
+  each_backend([&]( AWG_Task & task ) { sum += task.awg().commands(); });
+
+  return sum;
+}
+
+
+uint32_t AWG_Composite::retries ()
+{
+  uint32_t  sum = 0;
+
+  each_backend([&]( AWG_Task & task ) { sum += task.awg().retries(); });
+
+  return sum;
+}
+
+
+uint32_t AWG_Composite::timeouts ()
+{
+  uint32_t  sum = 0;
+
+  each_backend([&]( AWG_Task & task ) { sum += task.awg().timeouts(); });
+
+  return sum;
+}
+
+
+const latency_histogram & AWG_Composite::ack_latency ()
+{
+  return m_lanes[1].task ? m_lanes[1].task->awg().ack_latency() : m_ack_latency;
+}
@@ -0,0 +1,112 @@
+#ifndef AWG_COMPOSITE_H
+#define AWG_COMPOSITE_H
+
+/*!
+  @file   awg_composite.h
+  @brief  Declaration of the AWG_Composite class.
+*/
+
+#include "awg_server.h"
+#include "awg_task.h"
+
+/*!
+  @brief  An AWG_Server made of other AWG_Servers, one per SCPI channel.
+
+  The oscilloscope sees a single two-channel AWG, but each of its
+  channels may be served by a different generator, e.g., an FY6900
+  for the stimulus on channel 1 and a second unit, on its own serial
+  line, for a reference on channel 2. Each channel is attached to a
+  channel of a backend AWG_Server, through the AWG_Task of that
+  backend (see attach()); two channels may share a backend.
+
+  The commands for a backend whose AWG_Task is threaded are queued
+  to it, and set() returns at once, so the commands for different
+  generators are sent in parallel, each in the order received; the
+  composite is settled() once every backend has applied its commands
+  and settled. The commands for a backend whose AWG_Task is inline
+  are applied by set() itself, as with a single AWG. For the backend
+  tasks, the caller of set() is the network side.
+
+  The composite forwards an abort, an upload and the lending of the
+  serial line (see lend()) to the backends, monitors them in loop()
+  (for inline backends; a threaded task monitors its own), and is
+  available() only while every backend is. The counters for the
+  /metrics endpoint are the sums over the backends; the ack latency
+  is that of the channel 1 backend. The retry, settling and trace
+  settings belong to each backend, not to the composite.
+*/
+class AWG_Composite : public AWG_Server
+{
+  public:
+
+    /*!
+      @brief  Constructor starts with no channel attached.
+    */
+    AWG_Composite ()
+      : AWG_Server(0), m_upload_lane(NULL)
+      { for ( auto & l : m_lanes ) { l.task = NULL; l.channel = 0; } }
+
+    /*!
+      @brief  Route a SCPI channel to a channel of a backend.
+
+      @param  channel           The SCPI channel (1 to max_awg_channels)
+      @param  task              The AWG_Task of the backend (see AWG_Task::awg())
+      @param  backend_channel   The channel of the backend
+
+      @return False if the channel is not valid.
+    */
+    bool      attach ( uint32_t channel, AWG_Task & task, uint32_t backend_channel );
+
+    /*!
+      @brief  Indicate the number of channels attached, from channel 1 on.
+    */
+    virtual uint32_t      channels ();
+
+    /*!
+      @brief  Indicate the baud rate of the channel 1 backend.
+    */
+    virtual uint32_t      baud_rate ();
+
+    virtual bool    set ( uint32_t channel, uint32_t param_id, double value );
+    virtual bool    get ( uint32_t channel, uint32_t param_id, double & value );
+    virtual void    report ( Print & out );
+    virtual void    identify ( bool b_probe );
+
+    virtual bool    begin_upload ( uint32_t channel, uint32_t slot, uint32_t points );
+    virtual bool    upload ( const uint8_t * data, uint32_t len );
+    virtual bool    end_upload ();
+
+    virtual void    loop ();
+    virtual bool    settled ();
+    virtual void    abort ();
+    virtual void    clear_abort ();
+    virtual void    lend ( bool b_lent );
+
+    virtual uint32_t  commands ();
+    virtual uint32_t  retries ();
+    virtual uint32_t  timeouts ();
+    virtual const latency_histogram & ack_latency ();
+
+  private:
+
+    /*!
+      @brief  Where the commands of a SCPI channel go.
+    */
+    struct lane
+    {
+      AWG_Task *  task;       ///< The AWG_Task of the backend, or NULL if the channel is not attached
+      uint32_t    channel;    ///< The channel of the backend
+    };
+
+    /*!
+      @brief  Call a function once for each backend (even if it serves several channels).
+
+      @param  visit   Called with the AWG_Task of each backend
+    */
+    template <typename F> void  each_backend ( F visit );
+
+    lane        m_lanes[max_awg_channels+1];  ///< The lane of each SCPI channel (index = channel)
+    lane *      m_upload_lane;                ///< The lane of the upload in progress, or NULL
+};
+
+#endif
@@ -23,9 +23,29 @@ char  fy_codes[] =  { 'N',    ///< 0 = OUTP (off)
                       'F',    ///< 3 = FRQ
                       'A',    ///< 4 = AMP
                       'O',    ///< 5 = OFST
-                      'P'     ///< 6 = PHSE
+                      'P',    ///< 6 = PHSE
+                      0,      ///< 7 = TIME (the sweep parameters use fy_sweep_codes)
+                      0,      ///< 8 = START
+                      0,      ///< 9 = STOP
+                      0,      ///< 10 = SWMD
+                      0       ///< 11 = STATE
                     };   
 
+/*!
+  @brief  Commands used to set the FeelTech sweep.
+
+  The table contains the FeelTech sweep commands indexed to
+  match the SWWV parameters (see scpi::parameter_id), starting
+  at scpi::SWWV_TIME. Unlike the other commands, they take no
+  channel: the sweep runs on the main channel.
+*/
+const char * const fy_sweep_codes[] = { "STI",    ///< TIME: sweep time in seconds
+                                        "SST",    ///< START: start frequency
+                                        "SEN",    ///< STOP: end frequency
+                                        "SMO",    ///< SWMD: 0 = linear, 1 = logarithmic
+                                        "SBE"     ///< STATE: 1 = begin, 0 = end
+                                      };
+
 /*!
   @brief  Letters used to indicate FeelTech channels.
 
@@ -39,25 +59,91 @@ char  fy_channels[] = { 'M',    ///< shouldn't encounter channel = 0, but just i
                         'F',    ///< Channel 2
                       };   
 
+/*!
+  @brief  A Print that collects a command line for the AWG.
+
+  AWG_FY::set() formats its command with the same stream operators
+  as before, into this buffer, so that the line is written to the
+  port with a single call (and its length is known for the trace).
+*/
+class Line_Print : public Print
+{
+  public:
+
+    Line_Print ()
+      : index(0)
+      { buffer[0] = 0; }
+
+    virtual size_t  write ( uint8_t byte )
+      { if ( index >= sizeof(buffer) - 1 ) return 0;
+        buffer[index++] = byte;
+        buffer[index] = 0;
+        return 1; }
+
+    using Print::write;
+
+    const char *  text ()       ///< @return The line, null-terminated
+      { return buffer; }
+
+    size_t        length ()     ///< @return The length of the line
+      { return index; }
+
+  private:
+
+    char      buffer[32];     ///< The line (the longest FY command is about 16 characters)
+    size_t    index;          ///< Position for the next character
+};
+
 bool AWG_FY::set ( uint32_t channel, uint32_t param_id, double value )
 {
   param_translator *  pt = get_pt();
   int                 retries = retry();
   char                command[] = "WMF";
-  double              p10, set_value;
-  bool                b_validate, b_ok = true;
+  const char *        name = command;
+  double              p10 = 1, set_value;
+  bool                b_validate, b_ok = true, b_acked = false;
   int                 width = 0, precision = 0;
+  uint32_t            ack_start, ack_us = 0;
+  uint32_t            start = micros(), sent = 0, attempts = 0;
 
   /*  Test channel and parameter to make sure they are valid.
       Note that channel is 1-based, not 0-based.  */
 
-  if ( channel > channels() || param_id > scpi::parameter_count )
+  if ( channel > channels() || param_id >= scpi::parameter_count )
   {
     return false;     // invalid channel or parameter
   }
 
-  command[1] = fy_channels[channel];
-  command[2] = fy_codes[param_id];
+  if ( param_id >= scpi::SWWV_TIME )
+  {
+    if ( channel > 1 )
+    {
+      Debug.Error() << "The FY sweep runs on channel 1 only; " << scpi::parameters[param_id] << " ignored\n";
+      return false;
+    }
+
+    name = fy_sweep_codes[param_id - scpi::SWWV_TIME];
+  }
+  else
+  {
+    command[1] = fy_channels[channel];
+    command[2] = fy_codes[param_id];
+  }
+
+  /*  Remember the requested value so that it can be restored
+      if the AWG goes down; while it is down, fail immediately.  */
+
+  remember(channel, param_id, value);
+
+  if ( ! available() || uploading() || aborted() )
+  {
+    if ( trace() )
+    {
+      trace()->awg(channel, param_id, value, 0, start, 0, 0, false);    // not sent
+    }
+
+    return false;
+  }
 
   if ( param_id == scpi::WAVE )
   {
@@ -68,14 +154,14 @@ bool AWG_FY::set ( uint32_t channel, uint32_t param_id, double value )
     width = pt[param_id].set_width;
     precision = pt[param_id].set_precision;
 
-    p10 = pow10(precision);
-    value = ((uint64_t)(value * p10 + 0.5)) / p10;  // limit value to set_precision
-
     p10 = pow10(pt[param_id].set_exponent);
     set_value = value * p10;                          // adjust value to desired units
+
+    set_value = floor(set_value * pow10(precision) + 0.5) / pow10(precision);  // limit value to set_precision (rounding half up, also below zero)
+    value = set_value / p10;                          // (in the units sent)
   }
 
-  b_validate = ( retries > 0 );
+  b_validate = ( retries > 0 && param_id < scpi::SWWV_TIME );   // the sweep cannot be read back
 
   /*!
     @todo Separate the serial communication into an asynchronous operation
@@ -83,97 +169,179 @@ bool AWG_FY::set ( uint32_t channel, uint32_t param_id, double value )
           such as abort or destroy_link.
   */
 
-  do
+  /*  The command line is the same for every attempt, so it is
+      formatted once, then written to the port in one piece.  */
+
+  Line_Print  line;
+
+  line << name;
+
+  switch ( pt[param_id].set_type )
+  {
+    case pt_BOOL:
+
+      set_value = ( value == 0 ) ? 0 : 1;
+
+      // fall through to send this as an INT
+
+    case pt_INT:
+
+      if ( width )
+      {
+        line << _WIDTH((long int)(set_value), width);
+      }
+      else
+      {
+        line << (long int)(set_value);
+      }
+
+      break;
+
+    case pt_DOUBLE:
+
+      if ( width )
+      {
+        line << _WIDTH(_FLOAT(set_value,precision),width);
+      }
+      else
+      {
+        line << _FLOAT(set_value,precision);
+      }
+
+      break;
+
+    default:
+
+      break;
+  }
+
+  line << "\n";     // complete the line
+
+  flush_input();
+
+  /*  Before the sweep begins, make sure that it sweeps the frequency,
+      driven by the internal timer (the FY can also sweep amplitude,
+      offset or duty, or follow the VCO input).  */
+
+  if ( param_id == scpi::SWWV_STATE && value != 0 && ! ( send_command("SOB0\n", param_id) && send_command("SXY0\n", param_id) ) )
   {
-    Serial << command;
-    Debug.Serial_IO() << command;
-  
-    switch ( pt[param_id].set_type )
+    Debug.Error() << "Unable to set up the FY sweep; not started\n";
+
+    if ( trace() )
     {
-      case pt_BOOL:
-
-        set_value = ( value == 0 ) ? 0 : 1;
-
-        // fall through to send this as an INT
-
-      case pt_INT:
-
-        if ( width )
-        {
-          Serial << _WIDTH((long int)(set_value), width);
-          Debug.Serial_IO() << _WIDTH((long int)(set_value), width);
-        }
-        else
-        {
-          Serial << (long int)(set_value);
-          Debug.Serial_IO() << (long int)(set_value);
-        }
-
-        break;
-
-      case pt_DOUBLE:
-
-        if ( width )
-        {
-          Serial << _WIDTH(_FLOAT(set_value,precision),width);
-          Debug.Serial_IO() << _WIDTH(_FLOAT(set_value,precision),width);
-        }
-        else if ( precision )
-        {
-          Serial << _FLOAT(set_value,precision);
-          Debug.Serial_IO() << _FLOAT(set_value,precision);
-        }
-        else
-        {
-          Serial << set_value;
-          Debug.Serial_IO() << set_value;
-        }
-
-        break;
-
-      default:
-
-        break;
+      trace()->awg(channel, param_id, value, 0, start, 0, 0, false);    // not sent
     }
 
-    Serial << "\n";     // complete the line
-    Debug.Serial_IO() << "\n";
+    return false;
+  }
+
+  do
+  {
+    port().write((const uint8_t *) line.text(), line.length());
+    Debug.Serial_IO() << line.text();
+
+    sent += line.length();
+    attempts++;
 
     /*  wait for the AWG to respond (it should send back a single '\n')
         and discard the response. This will also clear any left-over
-        input from the AWG.
+        input from the AWG. Rather than waiting forever, the wait is
+        limited to a timeout learned from the previous responses to
+        the same command; if it expires, the command is retried.
     */
 
-    wait_for_serial(true);
+    ack_start = micros();
+
+    b_ok = wait_response(true, m_set_latency[param_id].timeout());
+
+    ack_us = micros() - ack_start;
+
+    if ( b_ok )
+    {
+      m_set_latency[param_id].sample(ack_us);
+      m_ack_latency.sample(ack_us);
+      response_ok();
+    }
+    else if ( aborted() )
+    {
+      Debug.Error() << "Aborted while waiting for AWG to acknowledge " << name << "\n";
+    }
+    else
+    {
+      m_set_latency[param_id].timed_out();
+      count_timeout();    // the health is judged once all the attempts are done
+
+      Debug.Error() << "Timeout waiting for AWG to acknowledge " << name << "\n";
+    }
+
+    b_acked |= b_ok;
 
-    if ( b_validate )
+    if ( b_ok && b_validate )
     {
-      b_ok = ( value == get(channel, param_id) );
+      /*  Compare in the units sent, to the precision sent: the value
+          read back is scaled by other powers of ten (e.g., micro-Hz in
+          the legacy tables), so it may differ from value in the last bit.  */
+
+      double  read_back, scale = pow10(precision);
+
+      b_ok = get(channel, param_id, read_back) && floor(read_back * p10 * scale + 0.5) == floor(set_value * scale + 0.5);
     }
   }
-  while ( ! b_ok && retries-- > 0 );
+  while ( ! b_ok && available() && ! aborted() && retries-- > 0 );
+
+  if ( ! b_acked && ! aborted() )
+  {
+    command_failed();
+  }
 
   if ( ! b_ok ) {
     Debug.Error() << "Unable to verify " << scpi::parameters[param_id] << "\n";
   }
+
+  /*  Keep track of the frequency (it selects the settle band), learn
+      from the ack time if requested, and start the settle period.  */
+
+  if ( param_id == scpi::FREQUENCY )
+  {
+    m_frequency[channel] = value;
+  }
+
+  int band = settle_band_index(m_frequency[channel]);
+
+  if ( m_learn_settle && band >= 0 )
+  {
+    // running average over roughly the last 8 acks
+
+    m_learned_us[band] = ( m_learned_us[band] == 0 ) ? ack_us : m_learned_us[band] - m_learned_us[band] / 8 + ack_us / 8;
+  }
+
+  start_settle(settle_time(channel, param_id));
+  command_sent(attempts);
+
+  if ( trace() )
+  {
+    trace()->awg(channel, param_id, value, sent, start, ack_us, attempts - 1, b_ok);
+  }
+
   return b_ok;
 }
 
-double AWG_FY::get ( uint32_t channel, uint32_t param_id )
+bool AWG_FY::get ( uint32_t channel, uint32_t param_id, double & value )
 {
   param_translator *  pt = get_pt();
   char                command[] = "RMF\n";
   char                response[awg_response_length+1];
-  double              p10, value = -1.23;
+  double              p10, read;
   int                 len;
+  uint32_t            ack_start;
 
   /*  Test channel and parameter to make sure they are valid.
       Note that channel is 1-based, not 0-based.
   */
 
-  if ( channel > channels() || param_id > scpi::parameter_count )
+  if ( channel > channels() || param_id >= scpi::SWWV_TIME )
   {
-    return false;     // invalid channel or parameter
+    return false;     // invalid channel or parameter (the sweep cannot be read back)
   }
 
   command[1] = fy_channels[channel];
@@ -181,29 +349,318 @@ double AWG_FY::get ( uint32_t channel, uint32_t param_id )
 
   p10 = pow10(pt[param_id].get_exponent);
 
-  Serial << command << "\n";
+  if ( aborted() )
+  {
+    return false;
+  }
+
+  flush_input();
+
+  port() << command << "\n";
   Debug.Serial_IO() << command << "\n";
 
-  // wait until the AWG responds
+  // wait until the AWG responds (or the learned timeout expires)
 
-  wait_for_serial();
+  ack_start = micros();
 
-  len = Serial.readBytesUntil('\n', response, awg_response_length);
+  if ( ! wait_response(false, m_get_latency[param_id].timeout()) )
+  {
+    if ( aborted() )
+    {
+      return false;
+    }
+
+    m_get_latency[param_id].timed_out();
+    response_timeout();
+
+    Debug.Error() << "Timeout waiting for AWG to respond to " << command << "\n";
+
+    return false;
+  }
+
+  m_get_latency[param_id].sample(micros() - ack_start);
+  response_ok();
+
+  len = port().readBytesUntil('\n', response, awg_response_length);
 
   response[len] = 0;
 
   Debug.Serial_IO() << response << "\n";
 
-  sscanf(response, "%lf", &value);
+  if ( sscanf(response, "%lf", &read) != 1 )
+  {
+    Debug.Error() << "Unexpected response to " << command << ": " << response << "\n";
+    return false;
+  }
 
-  value *= p10;
+  read *= p10;
 
   if ( pt[param_id].get_type == pt_BOOL )
   {
-    value = ( value == 0 ) ? 0 : 1;
+    read = ( read == 0 ) ? 0 : 1;
+  }
+
+  value = read;
+
+  return true;
+}
+
+void AWG_FY::probe ()
+{
+  /*  Reading the wave type of the main channel is about the cheapest
+      request the FY AWGs answer. The wait is capped so that probing a
+      dead AWG never holds up the other servers for long.  */
+
+  uint32_t  timeout = std::min(m_get_latency[scpi::WAVE].timeout(), probe_timeout_us);
+
+  port() << "RMW\n";
+  Debug.Serial_IO() << "RMW (probe)\n";
+
+  if ( wait_response(true, timeout) )
+  {
+    response_ok();
+  }
+  else
+  {
+    response_timeout();
+  }
+}
+
+void AWG_FY::report ( Print & out )
+{
+  AWG_Server::report(out);
+
+  /*  One line per parameter, showing the learned latency (average
+      and deviation), the timeout currently derived from it, and the
+      number of samples and timeouts, for both set and get commands.  */
+
+  out << "AWG latency (us): param set:avg/dev/timeout/n/timeouts get:avg/dev/timeout/n/timeouts\n";
+
+  for ( int i = 0; i < scpi::parameter_count; i++ )
+  {
+    latency_tracker & s = m_set_latency[i];
+    latency_tracker & g = m_get_latency[i];
+
+    out << "  " << scpi::parameters[i]
+        << " set:" << s.average() << "/" << s.deviation() << "/" << s.timeout() << "/" << s.samples() << "/" << s.timeouts()
+        << " get:" << g.average() << "/" << g.deviation() << "/" << g.timeout() << "/" << g.samples() << "/" << g.timeouts() << "\n";
+  }
+}
+
+bool AWG_FY::begin_upload ( uint32_t channel, uint32_t slot, uint32_t points )
+{
+  if ( uploading() )
+  {
+    end_upload();
+  }
+
+  if ( channel < 1 || channel > channels() || slot < 1 || slot > fy_arb_slots || ! available() )
+  {
+    Debug.Error() << "Unable to upload wave " << slot << " for channel " << channel << "\n";
+    return false;
+  }
+
+  /*  The AWG answers DDS_WAVE with "W" once it is ready
+      to receive the points.  */
+
+  port() << "DDS_WAVE" << slot << "\n";
+  Debug.Serial_IO() << "DDS_WAVE" << slot << "\n";
+
+  if ( ! wait_response(true, upload_timeout_us) )
+  {
+    if ( aborted() )
+    {
+      return false;
+    }
+
+    response_timeout();
+
+    Debug.Error() << "Timeout waiting for AWG to accept DDS_WAVE" << slot << "\n";
+
+    return false;
+  }
+
+  response_ok();
+
+  m_upload_points = ( points > 0 ) ? points : fy_arb_points;
+  m_upload_in = 0;
+  m_upload_out = 0;
+  m_upload_last = 8192;     // mid-scale, in case no points arrive at all
+  m_upload_byte = -1;
+  m_uploading = true;
+
+  return true;
+}
+
+bool AWG_FY::upload ( const uint8_t * data, uint32_t len )
+{
+  if ( ! uploading() )
+  {
+    return false;
+  }
+
+  for ( uint32_t i = 0; i < len; i++ )
+  {
+    if ( m_upload_byte < 0 )
+    {
+      m_upload_byte = data[i];
+    }
+    else
+    {
+      upload_point((int16_t)( m_upload_byte | ( data[i] << 8 ) ));
+      m_upload_byte = -1;
+    }
+  }
+
+  return true;
+}
+
+bool AWG_FY::end_upload ()
+{
+  bool  b_ok;
+
+  if ( ! uploading() )
+  {
+    return false;
+  }
+
+  // the AWG will not finish until it has all of its points
+
+  while ( m_upload_out < fy_arb_points )
+  {
+    send_point(m_upload_last);
+  }
+
+  m_uploading = false;
+
+  // the AWG answers "HN" once the wave has been stored
+
+  b_ok = wait_response(true, upload_timeout_us, false);   // even if aborted, the AWG must finish
+
+  if ( b_ok )
+  {
+    response_ok();
+  }
+  else
+  {
+    response_timeout();
+
+    Debug.Error() << "Timeout waiting for AWG to store the wave\n";
+  }
+
+  Debug.Progress() << "Wave upload complete: " << m_upload_in << " points received\n";
+
+  return b_ok;
+}
+
+void AWG_FY::flush_input ()
+{
+  /*  A command that was aborted (or timed out) may still be
+      answered late; discard that answer so that it is not
+      taken for the response to the next command.  */
+
+  while ( port().available() )
+  {
+    port().read();
+  }
+}
+
+bool AWG_FY::send_command ( const char * line, uint32_t param_id )
+{
+  port() << line;
+  Debug.Serial_IO() << line;
+
+  if ( wait_response(true, m_set_latency[param_id].timeout()) )
+  {
+    response_ok();
+    return true;
+  }
+
+  if ( ! aborted() )
+  {
+    response_timeout();
+  }
+
+  return false;
+}
+
+void AWG_FY::upload_point ( int16_t point )
+{
+  uint16_t  value = (uint16_t)( (int32_t)point + 32768 ) >> 2;   // 16-bit signed to 14-bit unsigned
+
+  if ( m_upload_in >= m_upload_points )
+  {
+    return;     // more points than announced; ignore the extra
+  }
+
+  /*  Send every FY point that maps to this point of the wave;
+      FY point j takes wave point floor(j * points / fy_arb_points).  */
+
+  while ( m_upload_out < fy_arb_points && (uint64_t)m_upload_out * m_upload_points / fy_arb_points <= m_upload_in )
+  {
+    send_point(value);
+  }
+
+  m_upload_in++;
+}
+
+void AWG_FY::send_point ( uint16_t value )
+{
+  port().write((uint8_t)( value & 0xff ));
+  port().write((uint8_t)( value >> 8 ));
+
+  m_upload_last = value;
+  m_upload_out++;
+}
+
+settle_band * AWG_FY::get_st ()
+{
+  return NULL;
+}
+
+int AWG_FY::settle_band_index ( double frequency )
+{
+  settle_band * st = get_st();
+  int           i = 0;
+
+  if ( st == NULL )
+  {
+    return -1;
+  }
+
+  // the last row (max_frequency = 0) covers any frequency above the others
+
+  while ( i < max_settle_bands - 1 && st[i].max_frequency != 0 && frequency > st[i].max_frequency )
+  {
+    i++;
+  }
+
+  return i;
+}
+
+uint32_t AWG_FY::settle_time ( uint32_t channel, uint32_t param_id )
+{
+  settle_band * st = get_st();
+  int           band = settle_band_index(m_frequency[channel]);
+  uint32_t      settle_us;
+
+  /*  Only changes that disturb the output need to settle; wave type
+      and phase are either fixed (sine) or irrelevant to a Bode plot,
+      and a sweep never settles.  */
+
+  if ( band < 0 || param_id == scpi::WAVE || param_id == scpi::PHASE || param_id == scpi::OUTPUT_OFF || param_id >= scpi::SWWV_TIME )
+  {
+    return 0;
+  }
+
+  settle_us = std::max(st[band].settle_us, m_learn_settle ? m_learned_us[band] : 0);
+
+  if ( st[band].settle_cycles > 0 && m_frequency[channel] > 0 )
+  {
+    settle_us += (uint32_t) std::min(st[band].settle_cycles * 1e6 / m_frequency[channel], (double) max_settle_us);
   }
 
-  return value;
+  return std::min(settle_us, max_settle_us);
 }
 
 #ifdef USE_ALTERNATIVE_TRANSLATE_WAVE
@@ -214,7 +671,7 @@ double AWG_FY::get ( uint32_t channel, uint32_t param_id )
 
   uint32_t AWG_FY::translate_wave ( uint32_t wave, bool direction )
   {
-    return ( direction == siglent::from_sig ) ? fy::Sine : siglent::Sine;
+    return ( direction == siglent::from_sig ) ? (uint32_t) fy::Sine : (uint32_t) siglent::Sine;
   }
 
 #endif
\ No newline at end of file
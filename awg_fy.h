@@ -7,9 +7,20 @@
 */
 
 #include "awg_server.h"
+#include "utilities.h"
+
+extern char  fy_codes[];      ///< FeelTech parameter letters, indexed by scpi::parameter_id (defined in awg_fy.cpp)
+extern char  fy_channels[];   ///< FeelTech channel letters, indexed by channel number (defined in awg_fy.cpp)
+extern const char * const fy_sweep_codes[];   ///< FeelTech sweep commands, indexed by scpi::parameter_id - scpi::SWWV_TIME (defined in awg_fy.cpp)
 
 const int  awg_response_length = 20;  ///< Maximum length of any line received from an FY-series AWG
 
+const uint32_t  probe_timeout_us = 100000;  ///< Longest wait (us) for the response to a health probe
+
+const uint32_t  fy_arb_points = 8192;         ///< Number of points in an FY arbitrary wave
+const uint32_t  fy_arb_slots = 64;            ///< Number of arbitrary wave memory slots in the FY AWGs
+const uint32_t  upload_timeout_us = 2000000;  ///< Longest wait (us) for the AWG to acknowledge an upload step
+
 /*!
   @brief  The structure used to translate parameters for sending to and receiving from FY-series AWGs.
 
@@ -20,18 +31,48 @@ const int  awg_response_length = 20;  ///< Maximum length of any line received f
   10). When setting parameters, precision and total width can also be supplied, or left as 0
   to accept the default. Note that the AWG_FY class does not provide a default table; instead,
   it expects a descendant class to override the pure virtual get_pt() method to provide the
-  table suitable for a specific variant of the FY-series AWGs.
+  table suitable for a specific variant of the FY-series AWGs. The rows of the sweep parameters
+  (scpi::SWWV_TIME and on) describe the values of the FY sweep commands (see fy_sweep_codes).
 */
 struct param_translator
 {
   uint8_t   set_type;       ///< type of value to send to AWG; see param_translator_types
   int8_t    set_exponent;   ///< multiply value by 10^exponent before sending
-  uint8_t   set_precision;  ///< if type = double, how many decimal places to include
+  uint8_t   set_precision;  ///< if type = double, how many decimal places to include (after the exponent is applied)
   uint8_t   set_width;      ///< if width != 0, indicates need to zero-fill to achieve width
   uint8_t   get_type;       ///< type of value read from AWG; see param_translator_types
   int8_t    get_exponent;   ///< value read from AWG must be multiplied by 10^exponent
 };
 
+/*!
+  @brief  The structure used to describe how long the AWG output needs to settle.
+
+  After a change of frequency, amplitude, offset, or output state, the FY output
+  needs some time before it can be trusted for a measurement. The AWG_FY class
+  looks up the settle time in a "settle table" of settle_band rows, selected
+  by the current frequency of the channel. Rows must be listed in order of
+  increasing max_frequency; the last row must have max_frequency = 0, which
+  means "any higher frequency." As with the param_translator table, a
+  descendant class supplies the table suitable for a specific variant of
+  the FY-series AWGs (see get_st()).
+*/
+struct settle_band
+{
+  double    max_frequency;  ///< upper limit (Hz) of the band; 0 = no upper limit (last row)
+  uint32_t  settle_us;      ///< fixed settle time in microseconds
+  uint8_t   settle_cycles;  ///< additional number of periods of the output frequency to wait
+};
+
+/*!
+  @brief  Maximum number of rows in a settle table (including the last row).
+*/
+const int  max_settle_bands = 8;
+
+/*!
+  @brief  Longest settle time (us), however low the frequency (a few periods of 1 mHz would be an hour).
+*/
+const uint32_t  max_settle_us = 1000000;
+
 /*!
   @brief  The types of values used to send values to or receive values from the AWG.
 */
@@ -52,6 +93,14 @@ enum  param_translator_types
   scpi::parameter_id enumeration). Each descendant of AWG_FY must
   override the virtual get_pt() member function to provide access to
   its particular translation table.
+
+  The Siglent SWWV parameters are mapped onto the built-in frequency
+  sweep of the FY AWGs, which runs on the main channel only: each one
+  is sent as its FY sweep command (e.g., START as SST), and setting
+  STATE to ON first selects the frequency as the object of the sweep
+  and the internal timer as its source. The AWG then sweeps on its
+  own, with no serial traffic until the sweep is changed. The sweep
+  parameters cannot be read back, so they are not verified.
 */
 class AWG_FY : public AWG_Server
 {
@@ -61,8 +110,32 @@ class AWG_FY : public AWG_Server
       @brief  Constructor merely passes the optional retries setting to the AWG_Server constructor.
     */
     AWG_FY ( uint32_t retries = 0 )
-      : AWG_Server(retries)
-      {}
+      : AWG_Server(retries), m_learn_settle(false),
+        m_upload_points(0), m_upload_in(0), m_upload_out(0), m_upload_last(0), m_upload_byte(-1)
+      { for ( int i = 0; i <= max_awg_channels; i++ ) m_frequency[i] = 0;
+        for ( int i = 0; i < max_settle_bands; i++ ) m_learned_us[i] = 0; }
+
+    /*!
+      @brief  Enable or disable learning of settle times from ack timing.
+
+      If enabled, the time the AWG takes to acknowledge each setting is
+      averaged per settle band, and the settle time used for that band
+      becomes the larger of the table value and the learned value. The
+      ack time is noticeably longer when, for example, the AWG switches
+      its output range, so the learned value tracks the slow transitions.
+
+      @param  enable  True to learn from ack timing.
+    */
+    void      learn_settle ( bool enable )
+      { m_learn_settle = enable; }
+
+    /*!
+      @brief  Read the current learn_settle setting.
+
+      @return True if settle times are learned from ack timing.
+    */
+    bool      learn_settle ()
+      { return m_learn_settle; }
 
     /*!
       @brief  Format and send a command to set the specified AWG parameter.
@@ -89,9 +162,51 @@ class AWG_FY : public AWG_Server
       @param  channel   1 or 2 to indicate Channel 1 or Channel 2
       @param  param_id  The id of the parameter to be set (see scpi::parameter_id)
 
-      @return The value read from the AWG for the specified parameter.
+      @param  value     Receives the value read from the AWG for the specified parameter.
+
+      @return False if the AWG did not answer, or its answer was not a number.
     */
-    virtual double  get ( uint32_t channel, uint32_t param_id );
+    virtual bool    get ( uint32_t channel, uint32_t param_id, double & value );
+
+    /*!
+      @brief  Write the status report, including the learned AWG latencies.
+
+      @param  out   The Print object (e.g., Telnet) to which to write the report.
+    */
+    virtual void    report ( Print & out );
+
+    /*!
+      @brief  Start the upload of an arbitrary wave with the DDS_WAVE command.
+
+      The FY AWGs expect exactly fy_arb_points 14-bit points; if a
+      different number of points is announced, the wave is resampled
+      as it is sent (each FY point takes the nearest earlier point of
+      the wave). If points = 0, the points are sent one for one.
+
+      @param  channel   1 or 2 (the FY memory slots are shared by both channels)
+      @param  slot      The arbitrary wave memory slot (1 to fy_arb_slots)
+      @param  points    The number of points that will be sent, or 0 if unknown
+
+      @return True if the AWG is ready to receive the wave data.
+    */
+    virtual bool    begin_upload ( uint32_t channel, uint32_t slot, uint32_t points );
+
+    /*!
+      @brief  Convert and send the next piece of wave data.
+
+      @param  data      16-bit signed little-endian points (a point may be split between calls)
+      @param  len       The length of the data in bytes
+
+      @return True if the data was accepted.
+    */
+    virtual bool    upload ( const uint8_t * data, uint32_t len );
+
+    /*!
+      @brief  Pad the wave to fy_arb_points (repeating the last point) and wait for the AWG to confirm.
+
+      @return True if the AWG confirmed the upload.
+    */
+    virtual bool    end_upload ();
 
   protected:
 
@@ -120,6 +235,83 @@ class AWG_FY : public AWG_Server
       @return A pointer to the translation table.
     */
     virtual param_translator *  get_pt () = 0;
+
+    /*!
+      @brief  Provide a pointer to the settle_band table used after set().
+
+      The default implementation returns NULL, meaning that no settle
+      time is needed. A descendant class can override this method to
+      provide the appropriate table.
+
+      @return A pointer to the settle table, or NULL.
+    */
+    virtual settle_band *       get_st ();
+
+    /*!
+      @brief  Check that the AWG responds by reading the main channel wave type.
+    */
+    virtual void      probe ();
+
+    /*!
+      @brief  Find the row of the settle table that covers a frequency.
+
+      @param  frequency The output frequency in Hz.
+
+      @return The index of the row, or -1 if there is no settle table.
+    */
+    int       settle_band_index ( double frequency );
+
+    /*!
+      @brief  Determine how long the output needs to settle after a set().
+
+      @param  channel   1 or 2 to indicate Channel 1 or Channel 2
+      @param  param_id  The id of the parameter that was set (see scpi::parameter_id)
+
+      @return The settle time in microseconds.
+    */
+    uint32_t  settle_time ( uint32_t channel, uint32_t param_id );
+
+    /*!
+      @brief  Discard any input waiting from the AWG.
+    */
+    void      flush_input ();
+
+    /*!
+      @brief  Send a command line that takes no value, and wait for its ack.
+
+      @param  line      The command, ending with a newline
+      @param  param_id  The parameter whose latency sets the timeout
+
+      @return True if the AWG acknowledged the command.
+    */
+    bool      send_command ( const char * line, uint32_t param_id );
+
+    /*!
+      @brief  Send one point of the wave being uploaded.
+
+      @param  point   The point as a 16-bit signed value.
+    */
+    void      upload_point ( int16_t point );
+
+    /*!
+      @brief  Send a 14-bit point to the AWG (little-endian).
+
+      @param  value   The point, 0 to 16383.
+    */
+    void      send_point ( uint16_t value );
+
+    latency_tracker m_set_latency[scpi::parameter_count];  ///< Latency of the ack to each type of set command
+    latency_tracker m_get_latency[scpi::parameter_count];  ///< Latency of the response to each type of get command
+
+    double    m_frequency[max_awg_channels+1];  ///< Most recent frequency set on each channel (index = channel)
+    uint32_t  m_learned_us[max_settle_bands];   ///< Learned (averaged) ack time per settle band
+    bool      m_learn_settle;                   ///< True if settle times are learned from ack timing
+
+    uint32_t  m_upload_points;                  ///< Number of points announced for the upload
+    uint32_t  m_upload_in;                      ///< Number of points received so far
+    uint32_t  m_upload_out;                     ///< Number of points sent to the AWG so far
+    uint16_t  m_upload_last;                    ///< Most recent point sent to the AWG
+    int16_t   m_upload_byte;                    ///< Low byte of a point split between calls to upload(), or -1
 };
 
 /*!
@@ -19,7 +19,10 @@
   phase are returned as integers multiplied by 10^4 (amplitude) or 10^3 (offset
   and phase). On/Off are represented by integers, where 0 = off and non-zero = on;
   wave type is represented by an integer representing the id of the wave type
-  (see fy::wave_types).
+  (see fy::wave_types). The sweep time is set in seconds, and the start and
+  stop frequencies in Hz, as for FRQ; the sweep mode (0 = linear, 1 = log)
+  and state (0 = end, 1 = begin) are integers. The sweep parameters are never
+  read back.
 */
 param_translator  pt6900[] =
   { { pt_BOOL, 0, 0, 0, pt_BOOL, 0 },      // OFF
@@ -28,10 +31,59 @@ param_translator  pt6900[] =
     { pt_DOUBLE, 0, 6, 0, pt_DOUBLE, 0 },  // FRQ
     { pt_DOUBLE, 0, 4, 0, pt_INT, -4 },    // AMP
     { pt_DOUBLE, 0, 3, 0, pt_INT, -3 },    // OFST
-    { pt_DOUBLE, 0, 3, 0, pt_INT, -3 }     // PHSE
+    { pt_DOUBLE, 0, 3, 0, pt_INT, -3 },    // PHSE
+    { pt_DOUBLE, 0, 2, 0, pt_DOUBLE, 0 },  // TIME
+    { pt_DOUBLE, 0, 6, 0, pt_DOUBLE, 0 },  // START
+    { pt_DOUBLE, 0, 6, 0, pt_DOUBLE, 0 },  // STOP
+    { pt_INT, 0, 0, 0, pt_INT, 0 },        // SWMD
+    { pt_BOOL, 0, 0, 0, pt_BOOL, 0 }       // STATE
+  };
+
+/*!
+  @brief  The translation table needed for FY6600 and FY6800 AWGs, and for FY6900 AWGs with older (< 1.4) firmware.
+
+  The older firmware differs from the recent one only in the frequency,
+  which is set and read back as an integer number of micro-Hz. The sweep frequencies are sent
+  as in the recent firmware.
+*/
+param_translator  pt6900_legacy[] =
+  { { pt_BOOL, 0, 0, 0, pt_BOOL, 0 },      // OFF
+    { pt_BOOL, 0, 0, 0, pt_BOOL, 0 },      // ON
+    { pt_INT, 0, 0, 0, pt_INT, 0 },        // WVTP
+    { pt_DOUBLE, 6, 0, 0, pt_DOUBLE, -6 }, // FRQ
+    { pt_DOUBLE, 0, 4, 0, pt_INT, -4 },    // AMP
+    { pt_DOUBLE, 0, 3, 0, pt_INT, -3 },    // OFST
+    { pt_DOUBLE, 0, 3, 0, pt_INT, -3 },    // PHSE
+    { pt_DOUBLE, 0, 2, 0, pt_DOUBLE, 0 },  // TIME
+    { pt_DOUBLE, 0, 6, 0, pt_DOUBLE, 0 },  // START
+    { pt_DOUBLE, 0, 6, 0, pt_DOUBLE, 0 },  // STOP
+    { pt_INT, 0, 0, 0, pt_INT, 0 },        // SWMD
+    { pt_BOOL, 0, 0, 0, pt_BOOL, 0 }       // STATE
   };
 
 param_translator * AWG_FY6900::get_pt ()
 {
   return pt6900;
-}
\ No newline at end of file
+}
+
+/*!
+  @brief  The settle table for FY6900 AWGs.
+
+  The table is based on the settle_band structure defined in awg_fy.h. Each
+  row covers the frequencies up to max_frequency (the last row covers all
+  higher frequencies). The settle time is the fixed time plus the given
+  number of periods of the output frequency. The values are deliberately
+  conservative; setting learn_settle() allows the AWG_FY class to extend
+  them from the observed ack timing.
+*/
+settle_band  st6900[] =
+  { { 100, 2000, 3 },         // up to 100 Hz: 2 ms + 3 periods
+    { 10000, 2000, 2 },       // up to 10 kHz: 2 ms + 2 periods
+    { 1000000, 1000, 0 },     // up to 1 MHz: 1 ms
+    { 0, 500, 0 }             // above 1 MHz: 0.5 ms
+  };
+
+settle_band * AWG_FY6900::get_st ()
+{
+  return st6900;
+}
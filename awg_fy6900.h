@@ -8,6 +8,10 @@
 
 #include "awg_fy.h"
 
+extern param_translator  pt6900[];          ///< Translation table for FY6900 firmware >= 1.4 (defined in awg_fy6900.cpp)
+extern param_translator  pt6900_legacy[];   ///< Translation table for FY6600, FY6800, and FY6900 firmware < 1.4 (defined in awg_fy6900.cpp)
+extern settle_band       st6900[];          ///< Settle table for the FY AWGs (defined in awg_fy6900.cpp)
+
 /*!
   @brief  Supplies the translation table needed for the
           AWG_FY class to serve FY6900 AWGs with recent
@@ -32,6 +36,13 @@ class AWG_FY6900 : public AWG_FY
       @return A pointer to the translation table.
     */
     virtual param_translator *  get_pt ();
+
+    /*!
+      @brief  Supplies a pointer to the settle table for FY6900 AWGs.
+
+      @return A pointer to the settle table.
+    */
+    virtual settle_band *       get_st ();
 };
 
 #endif
\ No newline at end of file
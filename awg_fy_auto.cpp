@@ -0,0 +1,198 @@
+/*!
+  @file   awg_fy_auto.cpp
+  @brief  Defines the registry of FY models and the methods of the AWG_FY_Auto class.
+*/
+
+#include <EEPROM.h>
+#include "awg_fy_auto.h"
+#include "awg_fy6900.h"
+#include "Streaming.h"
+#include "debug.h"
+
+/*!
+  @brief  The registry of FY models.
+
+  The first row is the default, used when the model is unknown or
+  the AWG does not answer; the other rows may be in any order. The
+  FY6900 changed its frequency format with firmware 1.4; the FY6600
+  and FY6800 use the older format (see pt6900_legacy).
+*/
+fy_model  fy_models[] =
+  { { "FY6900", 104, pt6900, st6900 },
+    { "FY6900", 0, pt6900_legacy, st6900 },
+    { "FY6800", 0, pt6900_legacy, st6900 },
+    { "FY6600", 0, pt6900_legacy, st6900 },
+    { NULL, 0, NULL, NULL }
+  };
+
+/*!
+  @brief  Names of the identity_source values, for report().
+*/
+const char * const identity_sources[] = { "default", "EEPROM", "probe" };
+
+fy_model * AWG_FY_Auto::lookup ( const char * name, uint16_t firmware )
+{
+  fy_model *  best = NULL;
+
+  for ( fy_model * row = fy_models; row->name; row++ )
+  {
+    if ( strcmp(row->name, name) == 0 && row->firmware <= firmware && ( best == NULL || row->firmware > best->firmware ) )
+    {
+      best = row;
+    }
+  }
+
+  return best ? best : fy_models;
+}
+
+void AWG_FY_Auto::identify ( bool b_probe )
+{
+  uint32_t  start = micros();
+
+  if ( ! b_probe && load_identity() )
+  {
+    m_source = FROM_EEPROM;
+  }
+  else if ( probe_identity() )
+  {
+    m_source = FROM_PROBE;
+    save_identity();
+  }
+  else
+  {
+    Debug.Error() << "The AWG did not identify itself; assuming " << fy_models[0].name << "\n";
+
+    m_name[0] = 0;
+    m_firmware = 0;
+    m_source = FROM_DEFAULT;
+  }
+
+  m_model = ( m_source == FROM_DEFAULT ) ? fy_models : lookup(m_name, m_firmware);
+
+  Debug.Progress() << "AWG identified in " << ( micros() - start ) / 1000 << " ms; using the tables for "
+                   << m_model->name << " firmware >= " << m_model->firmware / 100 << "." << m_model->firmware % 100 << "\n";
+}
+
+void AWG_FY_Auto::report ( Print & out )
+{
+  AWG_FY::report(out);
+
+  out << "AWG model: " << ( m_name[0] ? m_name : "unknown" ) << " firmware " << m_firmware / 100 << "." << m_firmware % 100
+      << " (from " << identity_sources[m_source] << "); tables: " << m_model->name << " >= "
+      << m_model->firmware / 100 << "." << m_model->firmware % 100 << "\n";
+}
+
+bool AWG_FY_Auto::ask ( const char * command, char * response )
+{
+  int   len;
+
+  flush_input();
+
+  port() << command;
+  Debug.Serial_IO() << command;
+
+  if ( ! wait_response(false, probe_timeout_us) )
+  {
+    return false;
+  }
+
+  response_ok();
+
+  len = port().readBytesUntil('\n', response, awg_response_length);
+  response[len] = 0;
+
+  Debug.Serial_IO() << response << "\n";
+
+  return len > 0;
+}
+
+bool AWG_FY_Auto::probe_identity ()
+{
+  char          response[awg_response_length+1];
+  const char *  digits;
+  unsigned      major = 0, minor = 0;
+
+  // the model, e.g., FY6900-60M
+
+  if ( ! ask("UMO\n", response) )
+  {
+    return false;
+  }
+
+  response[strcspn(response, "-\r")] = 0;
+  strncpy(m_name, response, fy_model_name_length - 1);
+  m_name[fy_model_name_length-1] = 0;
+
+  // the firmware version, e.g., V1.5.2
+
+  if ( ! ask("UVE\n", response) )
+  {
+    return false;
+  }
+
+  digits = response + strcspn(response, "0123456789");
+  sscanf(digits, "%u.%u", &major, &minor);
+  m_firmware = major * 100 + minor;
+
+  return true;
+}
+
+uint16_t AWG_FY_Auto::checksum ( const identity_record & record )
+{
+  uint16_t  sum = record.firmware;
+
+  for ( int i = 0; i < fy_model_name_length; i++ )
+  {
+    sum += (uint8_t) record.name[i];
+  }
+
+  return sum;
+}
+
+bool AWG_FY_Auto::load_identity ()
+{
+  identity_record   record;
+
+  if ( ( m_slot + 1 ) * sizeof(record) > fy_eeprom_size )
+  {
+    return false;
+  }
+
+  EEPROM.begin(fy_eeprom_size);
+  EEPROM.get(m_slot * sizeof(record), record);
+  EEPROM.end();
+
+  if ( record.magic != fy_identity_magic || record.checksum != checksum(record) || record.name[fy_model_name_length-1] != 0 )
+  {
+    return false;
+  }
+
+  strcpy(m_name, record.name);
+  m_firmware = record.firmware;
+
+  return true;
+}
+
+void AWG_FY_Auto::save_identity ()
+{
+  identity_record   record;
+
+  if ( ( m_slot + 1 ) * sizeof(record) > fy_eeprom_size )
+  {
+    return;
+  }
+
+  memset(&record, 0, sizeof(record));
+  record.magic = fy_identity_magic;
+  strcpy(record.name, m_name);
+  record.firmware = m_firmware;
+  record.checksum = checksum(record);
+
+  EEPROM.begin(fy_eeprom_size);
+  EEPROM.put(m_slot * sizeof(record), record);
+
+  if ( ! EEPROM.end() )
+  {
+    Debug.Error() << "Unable to save the identity of the AWG\n";
+  }
+}
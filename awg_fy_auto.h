@@ -0,0 +1,177 @@
+#ifndef AWG_FY_AUTO_H
+#define AWG_FY_AUTO_H
+
+/*!
+  @file   awg_fy_auto.h
+  @brief  Declares the AWG_FY_Auto class and the registry of FY models.
+*/
+
+#include "awg_fy.h"
+
+const int       fy_model_name_length = 16;    ///< Longest model name (including the terminating null)
+const uint32_t  fy_identity_magic = 0x46594944; ///< Marks a saved identity ("FYID")
+const int       fy_eeprom_size = 128;         ///< Bytes of EEPROM used for the saved identities
+
+/*!
+  @brief  A row of the registry of FY models (see fy_models).
+
+  Each row gives the tables that serve a model from a given firmware
+  version on; the row used for a connected AWG is the one of its model
+  with the highest version that is not above its firmware.
+*/
+struct fy_model
+{
+  const char *        name;       ///< The model, as reported by the AWG (e.g., FY6900), or NULL to end the registry
+  uint16_t            firmware;   ///< The first firmware version served, as major * 100 + minor
+  param_translator *  pt;         ///< The translation table (see AWG_FY::get_pt())
+  settle_band *       st;         ///< The settle table (see AWG_FY::get_st())
+};
+
+extern fy_model  fy_models[];     ///< The registry of FY models (defined in awg_fy_auto.cpp)
+
+/*!
+  @brief  Serves whichever FY-series AWG is connected.
+
+  The tables that suit an FY AWG depend on its model and firmware (see
+  awg_fy6900.cpp). Rather than fixing them at compile time, identify()
+  asks the AWG for its model (UMO) and firmware version (UVE), and looks
+  up the tables in the registry of models (see fy_models). Each request
+  waits at most probe_timeout_us, so the probe takes no more than a
+  couple of hundred milliseconds, even with no AWG connected.
+
+  The identity of the AWG is saved in the EEPROM (the flash, on the
+  ESP8266), so that the next boot skips the probe; the identity rather
+  than the tables is saved, so that an update of the registry applies
+  at once. A new probe (e.g., after a firmware upgrade of the AWG) can
+  be requested through Telnet (see DETECT). If the AWG does not answer,
+  the tables for an FY6900 with recent firmware are used, and nothing
+  is saved.
+*/
+class AWG_FY_Auto : public AWG_FY
+{
+  public:
+
+    /*!
+      @brief  Where the identity of the AWG came from.
+    */
+    enum identity_source {
+      FROM_DEFAULT  = 0,    ///< Not identified; the default row is used
+      FROM_EEPROM   = 1,    ///< Saved at an earlier boot
+      FROM_PROBE    = 2     ///< Reported by the AWG
+    };
+
+    /*!
+      @brief  Constructor selects the default row until identify() is called.
+
+      @param  retries   Passed along to the AWG_FY constructor
+    */
+    AWG_FY_Auto ( uint32_t retries = 0 )
+      : AWG_FY(retries), m_model(fy_models), m_firmware(0), m_source(FROM_DEFAULT), m_slot(0)
+      { m_name[0] = 0; }
+
+    /*!
+      @brief  Select the place in the EEPROM where the identity is saved.
+
+      Each AWG served by the same espBode needs a slot of its own.
+
+      @param  slot  The slot (0 = the first)
+    */
+    void      cache_slot ( uint8_t slot )
+      { m_slot = slot; }
+
+    /*!
+      @brief  Identify the AWG, and select the tables that suit it.
+
+      @param  b_probe   True to ask the AWG even if its identity was saved at an earlier boot.
+    */
+    virtual void    identify ( bool b_probe );
+
+    /*!
+      @brief  Write the status report, including the identity of the AWG.
+
+      @param  out   The Print object (e.g., Telnet) to which to write the report.
+    */
+    virtual void    report ( Print & out );
+
+    const char *    model ()        ///< @return The model of the AWG, or an empty string if unknown
+      { return m_name; }
+
+    uint16_t        firmware ()     ///< @return The firmware version of the AWG (major * 100 + minor), or 0 if unknown
+      { return m_firmware; }
+
+    identity_source source ()       ///< @return Where the identity came from
+      { return m_source; }
+
+    /*!
+      @brief  Find the row of the registry that serves a model and firmware.
+
+      @param  name      The model
+      @param  firmware  The firmware version (major * 100 + minor)
+
+      @return The row; if the model is unknown, the first row.
+    */
+    static fy_model *   lookup ( const char * name, uint16_t firmware );
+
+  protected:
+
+    virtual param_translator *  get_pt ()
+      { return m_model->pt; }
+
+    virtual settle_band *       get_st ()
+      { return m_model->st; }
+
+  private:
+
+    /*!
+      @brief  The identity saved in the EEPROM.
+    */
+    struct identity_record
+    {
+      uint32_t  magic;                        ///< fy_identity_magic
+      char      name[fy_model_name_length];   ///< The model
+      uint16_t  firmware;                     ///< The firmware version
+      uint16_t  checksum;                     ///< Sum of the bytes of the name and firmware
+    };
+
+    /*!
+      @brief  Send a request and read the line the AWG answers.
+
+      @param  command   The request, ending with a newline
+      @param  response  Receives the answer (awg_response_length + 1 characters)
+
+      @return False if the AWG did not answer in time.
+    */
+    bool      ask ( const char * command, char * response );
+
+    /*!
+      @brief  Ask the AWG for its model and firmware version.
+
+      @return False if the AWG did not answer.
+    */
+    bool      probe_identity ();
+
+    /*!
+      @brief  Read the identity saved in the EEPROM.
+
+      @return False if none is saved (or it is corrupt).
+    */
+    bool      load_identity ();
+
+    /*!
+      @brief  Save the identity in the EEPROM.
+    */
+    void      save_identity ();
+
+    /*!
+      @brief  Compute the checksum of a saved identity.
+    */
+    static uint16_t   checksum ( const identity_record & record );
+
+    fy_model *      m_model;                        ///< The row of the registry in use
+    char            m_name[fy_model_name_length];   ///< The model of the AWG
+    uint16_t        m_firmware;                     ///< The firmware version of the AWG
+    identity_source m_source;                       ///< Where the identity came from
+    uint8_t         m_slot;                         ///< The slot of the EEPROM in which the identity is saved
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef AWG_QUEUE_H
+#define AWG_QUEUE_H
+
+/*!
+  @file   awg_queue.h
+  @brief  Declaration and definition of the AWG_Queue class
+          and the awg_command structure.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/*!
+  @brief  A single, already-validated command for the AWG.
+
+  The awg_command structure holds the same three values that
+  are passed to AWG_Server::set(), so that a parsed SCPI command
+  can be stored and applied to the AWG at a later time, plus the
+  time at which it was queued (for the latency telemetry). It is
+  kept to 16 bytes, so that a slot is written in a few stores.
+*/
+struct awg_command
+{
+  double    value;        ///< The value to which the parameter should be set
+  uint32_t  queued_us;    ///< Time (micros) at which the command was queued
+  uint8_t   channel;      ///< The AWG channel (1-based)
+  uint8_t   param_id;     ///< The id of the parameter (see scpi::parameter_id)
+};
+
+/*!
+  @brief  Number of commands that the AWG_Queue can hold.
+
+  A single BSWV line from the oscilloscope generates at most
+  five commands (WVTP, FRQ, AMP, OFST, PHSE), so 16 entries
+  allow roughly three lines to be pending at once. It must be
+  a power of two, so that the counters may wrap around.
+*/
+const size_t  AWG_QUEUE_SIZE = 16;
+
+static_assert(( AWG_QUEUE_SIZE & ( AWG_QUEUE_SIZE - 1 ) ) == 0, "AWG_QUEUE_SIZE must be a power of two");
+
+/*!
+  @brief  Fixed-size, single-producer / single-consumer FIFO of
+          awg_command entries.
+
+  The AWG_Queue allows the VXI_Server to acknowledge a write
+  request before the (slow) serial communication with the AWG
+  has been completed. The commands are stored in a circular
+  buffer and removed in the order in which they were added.
+
+  One side (the producer, i.e., the VXI_Server) only adds
+  commands, and the other (the consumer, see AWG_Task) only
+  removes them, so the two may run in different threads or on
+  different cores without a lock: tail is written only by the
+  producer and head only by the consumer, each with a release
+  store that the other side reads with an acquire load. No
+  read-modify-write operation is used, so every method is
+  wait-free and compiles to plain loads and stores (with
+  barriers) even on the ESP8266. The methods are marked with
+  the side that may call them.
+
+  head and tail count the commands removed and added so far,
+  so they also serve as sequence numbers: the command added
+  as number n has been taken by the consumer once popped()
+  has passed n.
+*/
+class AWG_Queue
+{
+  public:
+
+    /*!
+      @brief  Constructor starts with an empty queue.
+    */
+    AWG_Queue ()
+      : head(0), tail(0), m_high_water(0)
+      {}
+
+    /*!
+      @brief  Return the number of commands currently in the queue (either side).
+    */
+    size_t    count ()
+      { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+
+    /*!
+      @brief  Return true if the queue holds no commands (either side).
+    */
+    bool      empty ()
+      { return count() == 0; }
+
+    /*!
+      @brief  Return true if no more commands can be added (producer).
+    */
+    bool      full ()
+      { return count() >= AWG_QUEUE_SIZE; }
+
+    /*!
+      @brief  Return the number of commands added so far (producer).
+    */
+    uint32_t  pushed ()
+      { return tail.load(std::memory_order_relaxed); }
+
+    /*!
+      @brief  Return the number of commands removed so far (either side).
+    */
+    uint32_t  popped ()
+      { return head.load(std::memory_order_acquire); }
+
+    /*!
+      @brief  Add a command to the end of the queue (producer).
+
+      @param  command The command to add.
+
+      @return False if the queue is full (the command is not added).
+    */
+    bool      push ( const awg_command & command )
+      { uint32_t  t = tail.load(std::memory_order_relaxed);
+        uint32_t  depth = t - head.load(std::memory_order_acquire);
+        if ( depth >= AWG_QUEUE_SIZE ) return false;
+        commands[t % AWG_QUEUE_SIZE] = command;
+        tail.store(t + 1, std::memory_order_release);
+        if ( depth + 1 > m_high_water ) m_high_water = depth + 1;
+        return true; }
+
+    /*!
+      @brief  Remove the command at the front of the queue (consumer).
+
+      @param  command Receives the command removed from the queue.
+
+      @return False if the queue is empty (command is left unchanged).
+    */
+    bool      pop ( awg_command & command )
+      { uint32_t  h = head.load(std::memory_order_relaxed);
+        if ( h == tail.load(std::memory_order_acquire) ) return false;
+        command = commands[h % AWG_QUEUE_SIZE];
+        head.store(h + 1, std::memory_order_release);
+        return true; }
+
+    /*!
+      @brief  Discard the commands added before a given point (consumer).
+
+      @param  until   The value of pushed() at that point.
+    */
+    void      discard ( uint32_t until )
+      { if ( (int32_t)( until - head.load(std::memory_order_relaxed) ) > 0 ) head.store(until, std::memory_order_release); }
+
+    /*!
+      @brief  Check whether a command for the given channel is pending (producer).
+
+      Only the commands added before <before> are examined; this
+      allows the caller to ignore commands that it has just added
+      itself. The slots between head and tail are never written
+      while they are in the queue, so this is safe while the
+      consumer is removing commands.
+
+      @param  channel The AWG channel to look for.
+      @param  before  The value of pushed() before the commands to ignore were added.
+      @param  until   Receives the value of popped() once the last such command has been removed.
+
+      @return True if one of the examined commands is for the channel (otherwise until is left unchanged).
+    */
+    bool      pending ( uint32_t channel, uint32_t before, uint32_t & until )
+      { bool  b_found = false;
+        for ( uint32_t i = head.load(std::memory_order_acquire); (int32_t)( before - i ) > 0; i++ ) {
+          if ( commands[i % AWG_QUEUE_SIZE].channel == channel ) { until = i + 1; b_found = true; }
+        }
+        return b_found; }
+
+    uint32_t  high_water ()   ///< @return The largest number of commands that have been in the queue at once
+      { return m_high_water; }
+
+  protected:
+
+    awg_command             commands[AWG_QUEUE_SIZE];   ///< Circular buffer of commands
+    std::atomic<uint32_t>   head;                       ///< Count of commands removed so far (written by the consumer only)
+    std::atomic<uint32_t>   tail;                       ///< Count of commands added so far (written by the producer only)
+    uint32_t                m_high_water;               ///< Largest depth seen by push() (producer only)
+};
+
+#endif
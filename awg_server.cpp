@@ -4,6 +4,22 @@
 */
 
 #include "awg_server.h"
+#include "Streaming.h"
+#include "debug.h"
+
+/*!
+  @brief  How long (ms) the AWG may be quiet before it is probed, indexed by awg_health.
+
+  A healthy AWG is probed only when idle; a suspect AWG is probed
+  soon, to decide quickly whether it is really down; a down AWG
+  is probed as often, so that the commands fail for no longer than
+  needed once it returns.
+*/
+const uint32_t  probe_interval[] = { 10000, 250, 250 };
+
+const uint32_t  awg_down_failures = 3;  ///< Number of failed commands in a row after which the AWG is down
+
+const char * const health_names[] = { "UP", "SUSPECT", "DOWN" };   ///< Names of the awg_health values for reports
 
 AWG_Server::~AWG_Server ()
 {
@@ -23,3 +39,155 @@ const char * AWG_Server::id ()
 {
   return "IDN-SGLT-PRI SDG1062X";
 }
+
+void AWG_Server::report ( Print & out )
+{
+  out << "AWG: " << id() << "; channels = " << channels() << "; baud rate = " << baud_rate()
+      << "; retries = " << retry() << "; settling = " << ( settling() ? "ON" : "OFF" )
+      << "; health = " << health_names[m_health] << "\n";
+}
+
+void AWG_Server::loop ()
+{
+  uint32_t  now = millis();
+  uint32_t  interval = probe_interval[m_health];
+
+  if ( m_uploading || m_lent )
+  {
+    return;     // the AWG is busy receiving wave data, or someone else is talking to it
+  }
+
+  if ( m_resync_needed )
+  {
+    resync();
+  }
+  else if ( now - m_last_response >= interval && now - m_last_probe >= interval )
+  {
+    m_last_probe = now;
+    probe();
+  }
+}
+
+void AWG_Server::probe ()
+{
+}
+
+bool AWG_Server::wait_response ( bool b_consume, uint32_t timeout_us, bool b_abortable )
+{
+  uint32_t  start = micros();
+
+  while ( ! m_port->available() )
+  {
+    if ( ( m_aborted && b_abortable ) || ( timeout_us > 0 && ( micros() - start ) >= timeout_us ) )
+    {
+      return false;
+    }
+
+    if ( m_wait_hook )
+    {
+      m_wait_hook();
+    }
+
+    yield();
+  }
+
+  if ( b_consume )
+  {
+    while ( m_port->available() )
+    {
+      m_port->read();
+    }
+  }
+
+  return true;
+}
+
+bool AWG_Server::begin_upload ( uint32_t channel, uint32_t slot, uint32_t points )
+{
+  Debug.Error() << "Wave upload is not supported by this AWG\n";
+
+  return false;
+}
+
+bool AWG_Server::upload ( const uint8_t * data, uint32_t len )
+{
+  return false;
+}
+
+bool AWG_Server::end_upload ()
+{
+  m_uploading = false;
+
+  return false;
+}
+
+void AWG_Server::remember ( uint32_t channel, uint32_t param_id, double value )
+{
+  if ( channel > max_awg_channels || param_id >= scpi::parameter_count )
+  {
+    return;
+  }
+
+  /*  OUTP OFF and OUTP ON both set the same AWG setting, so both
+      are remembered as OUTPUT_ON with a value of 0 or 1.  */
+
+  if ( param_id == scpi::OUTPUT_OFF )
+  {
+    param_id = scpi::OUTPUT_ON;
+  }
+
+  m_shadow[channel][param_id] = value;
+  m_shadow_valid[channel][param_id] = true;
+}
+
+void AWG_Server::response_ok ()
+{
+  m_last_response = millis();
+
+  if ( m_health == AWG_DOWN )
+  {
+    Debug.Progress() << "AWG is responding again; restoring its settings\n";
+
+    m_resync_needed = true;
+  }
+
+  m_failures = 0;
+  m_health = AWG_UP;
+}
+
+void AWG_Server::command_failed ()
+{
+  m_failures++;
+
+  if ( m_health == AWG_UP )
+  {
+    m_health = AWG_SUSPECT;
+  }
+  else if ( m_health == AWG_SUSPECT && m_failures >= awg_down_failures )
+  {
+    Debug.Error() << "AWG is not responding; commands will fail until it returns\n";
+
+    m_health = AWG_DOWN;
+  }
+}
+
+void AWG_Server::resync ()
+{
+  m_resync_needed = false;
+
+  /*  Send the output state last, so that the output is only
+      switched on once the wave parameters are in place.  */
+
+  for ( uint32_t channel = 1; channel <= channels() && channel <= max_awg_channels; channel++ )
+  {
+    for ( uint32_t param_id = scpi::OUTPUT_ON + 1; param_id <= scpi::parameter_count; param_id++ )
+    {
+      uint32_t  p = ( param_id == scpi::parameter_count ) ? scpi::OUTPUT_ON : param_id;
+
+      if ( m_shadow_valid[channel][p] && available() )
+      {
+        set(channel, p, m_shadow[channel][p]);
+      }
+    }
+  }
+}
@@ -6,8 +6,16 @@
   @brief  Declares the AWG_Server class.
 */
 
+#include <Arduino.h>
 #include <stdint.h>
 #include "scpi.h"
+#include "trace_recorder.h"
+#include "utilities.h"
+
+/*!
+  @brief  Largest number of channels that any AWG_Server is expected to offer.
+*/
+const int  max_awg_channels = 2;
 
 /*!
   @brief  This is the base class for any AWG that will be
@@ -18,10 +26,32 @@
   scpi.h. The set() and get() methods in this class are pure
   virtual methods that must be overridden in the descendant
   class. The other virtual methods provide default versions
-  which will satisfy most needs but can be overriden if needed.
+  which will satisfy most needs but can be overriden if needed
+  (e.g., by the AWG_Composite, which passes the commands on to
+  other AWG_Servers).
 */
 class AWG_Server
 {
+  public:
+
+    /*!
+      @brief  The health of the connection to the AWG.
+
+      The health is driven by the responses (or lack of responses)
+      reported by the descendant class; see response_ok() and
+      response_timeout(). A command counts as failed only once all
+      its attempts have timed out, and the AWG is only taken for
+      down after awg_down_failures failed commands in a row, so that
+      one late ack does not stop the commands. While the AWG is down,
+      set() should fail immediately rather than wait for a response
+      that will not come.
+    */
+    enum awg_health {
+      AWG_UP      = 0,    ///< The AWG is responding normally
+      AWG_SUSPECT = 1,    ///< The AWG has missed a response
+      AWG_DOWN    = 2     ///< The AWG has failed successive commands; commands fail fast
+    };
+
   public:
 
     /*!
@@ -30,8 +60,10 @@ class AWG_Server
       @param  retries   Retry count. See the retry() method for additional details.
     */
     AWG_Server ( uint32_t retries = 0 )
-      : m_retry_count(retries)
-      {}
+      : m_retry_count(retries), m_settling(false), m_settle_start(0), m_settle_us(0),
+        m_uploading(false), m_lent(false), m_aborted(false), m_wait_hook(NULL), m_trace(NULL), m_port(&Serial), m_health(AWG_UP), m_resync_needed(false), m_failures(0), m_last_response(0), m_last_probe(0),
+        m_commands(0), m_retries(0), m_timeouts(0)
+      { memset(m_shadow_valid, 0, sizeof(m_shadow_valid)); }
 
     /*!
       @brief  Base class destructor does nothing, but it is
@@ -40,6 +72,25 @@ class AWG_Server
     */
     virtual ~AWG_Server ();
 
+    /*!
+      @brief  Set the serial connection (the transport) to the AWG.
+
+      The default is the Arduino Serial port. Another Stream can be
+      used instead, e.g., a USB-serial device on a Linux host.
+
+      @param  port  The Stream connected to the AWG.
+    */
+    void      transport ( Stream & port )
+      { m_port = &port; }
+
+    /*!
+      @brief  Read the serial connection (the transport) to the AWG.
+
+      @return The Stream connected to the AWG.
+    */
+    Stream &  port ()
+      { return *m_port; }
+
     /*!
       @brief  Set the retry count.
 
@@ -72,6 +123,133 @@ class AWG_Server
     bool      validate ()
       { return m_retry_count > 0; }
 
+    /*!
+      @brief  Enable or disable settle-aware completion.
+
+      If settling is enabled, a descendant class may start a settle
+      period after each set() (see start_settle()), and callers such
+      as the VXI_Server will use wait_settled() so that the response
+      to a write is not sent until the AWG output is stable.
+
+      @param  enable  True to wait for the output to settle.
+    */
+    void      settling ( bool enable )
+      { m_settling = enable; }
+
+    /*!
+      @brief  Read the current settling setting.
+
+      @return True if settle-aware completion is enabled.
+    */
+    bool      settling ()
+      { return m_settling; }
+
+    /*!
+      @brief  Check whether the most recent settle period has elapsed.
+
+      @return True if no settle period is in progress.
+    */
+    virtual bool  settled ()
+      { return ( micros() - m_settle_start ) >= m_settle_us; }
+
+    /*!
+      @brief  Block until the most recent settle period has elapsed.
+    */
+    void      wait_settled ()
+      { while ( ! settled() && ! m_aborted ) { if ( m_wait_hook ) m_wait_hook(); yield(); } }
+
+    /*!
+      @brief  Set a function to be called repeatedly while waiting for the AWG.
+
+      The function allows other work to be done while a command is
+      blocked waiting for the AWG; in particular, the VXI_Server uses
+      it to watch for a device_abort, which can then call abort().
+
+      @param  hook  The function to call, or NULL.
+    */
+    void      wait_hook ( void (*hook)() )
+      { m_wait_hook = hook; }
+
+    /*!
+      @brief  Set the Trace_Recorder to which each command sent is added.
+
+      @param  trace   The recorder, or NULL to record nothing.
+    */
+    void      trace ( Trace_Recorder * trace )
+      { m_trace = trace; }
+
+    Trace_Recorder *  trace ()    ///< @return The Trace_Recorder in use, or NULL
+      { return m_trace; }
+
+    /*  Counters of the commands sent, for the /metrics endpoint (see
+        Metrics_Server). They are written by the side that sends the
+        commands only, so another task may read them (see AWG_Task).  */
+
+    virtual uint32_t  commands ()   ///< @return The number of commands sent by set()
+      { return m_commands.load(std::memory_order_relaxed); }
+
+    virtual uint32_t  retries ()    ///< @return The number of times a command was sent again
+      { return m_retries.load(std::memory_order_relaxed); }
+
+    virtual uint32_t  timeouts ()   ///< @return The number of responses that timed out
+      { return m_timeouts.load(std::memory_order_relaxed); }
+
+    virtual const latency_histogram & ack_latency ()   ///< @return The ack latency of the commands sent
+      { return m_ack_latency; }
+
+    /*!
+      @brief  Cancel the command in progress.
+
+      Any wait for the AWG (a response or the settle period) ends
+      at once, and further commands fail immediately until
+      clear_abort() is called.
+    */
+    virtual void  abort ()
+      { m_aborted = true; }
+
+    /*!
+      @brief  Allow commands to be sent again after abort().
+    */
+    virtual void  clear_abort ()
+      { m_aborted = false; }
+
+    /*!
+      @brief  Check whether the command in progress has been aborted.
+
+      @return True between abort() and clear_abort().
+    */
+    bool      aborted ()
+      { return m_aborted; }
+
+    /*!
+      @brief  Read the current health of the connection to the AWG.
+
+      @return AWG_UP, AWG_SUSPECT, or AWG_DOWN
+    */
+    awg_health  health ()
+      { return m_health; }
+
+    /*!
+      @brief  Check whether commands can be sent to the AWG.
+
+      @return False if the AWG is down.
+    */
+    bool      available ()
+      { return m_health != AWG_DOWN; }
+
+    /*!
+      @brief  Call this at least once per main loop to monitor the AWG.
+
+      If the AWG has been quiet for a while (or is suspect or down),
+      loop() sends a cheap probe (see probe()). When an AWG that was
+      down responds again, loop() re-sends the last value set for
+      each parameter on each channel, so that the AWG is back in the
+      state that the oscilloscope expects. Nothing is sent while an
+      upload is in progress, or while the serial line is lent (see
+      lend()).
+    */
+    virtual void  loop ();
+
     /*!
       @brief  Provide a valid Siglent AWG id.
 
@@ -132,14 +310,240 @@ class AWG_Server
 
       @param  channel   The AWG channel for which to read the parameter.
       @param  parameter The id of the parameter that should be read (see the scpi::parameter_id enumeration).
+      @param  value     Receives the value returned by the AWG for the given parameter and channel.
 
-      @return The value returned by the AWG for the given parameter and channel.
+      @return False if the value could not be read (e.g., the AWG did not answer); value is then unchanged.
     */
-    virtual double  get ( uint32_t channel, uint32_t parameter ) = 0;
+    virtual bool    get ( uint32_t channel, uint32_t parameter, double & value ) = 0;
+
+    /*!
+      @brief  Write a human-readable status report.
+
+      The base class reports the id and the basic settings. A descendant
+      can override this method to add its own information, typically
+      after calling the base class version.
+
+      @param  out   The Print object (e.g., Telnet) to which to write the report.
+    */
+    virtual void    report ( Print & out );
+
+    /*!
+      @brief  Find out which variant of the AWG is connected.
+
+      A descendant that serves several models or firmware versions
+      can override this to select the right commands for the one that
+      is connected (see AWG_FY_Auto). It is called once at boot, before
+      any command is sent; the base class version does nothing.
+
+      @param  b_probe   True to ask the AWG even if the answer was saved at an earlier boot.
+    */
+    virtual void    identify ( bool b_probe )
+      {}
+
+    /*!
+      @brief  Look up the last value requested for a parameter.
+
+      This returns the value remembered from set() (see remember()),
+      without asking the AWG, so it is cheap enough to use when
+      answering a query such as BSWV?.
+
+      @param  channel   The AWG channel (1-based)
+      @param  param_id  The id of the parameter (see scpi::parameter_id)
+      @param  value     Receives the value, if one has been requested
+
+      @return False if no value has been requested for the parameter.
+    */
+    bool      recall ( uint32_t channel, uint32_t param_id, double & value )
+      { if ( channel > max_awg_channels || param_id >= scpi::parameter_count || ! m_shadow_valid[channel][param_id] ) return false;
+        value = m_shadow[channel][param_id];
+        return true; }
+
+    /*!
+      @brief  Forget the values remembered from set().
+
+      Afterwards, recall() fails until each value is set again, and
+      resync() has nothing to restore; a resync already due is dropped.
+    */
+    void      forget ()
+      { memset(m_shadow_valid, 0, sizeof(m_shadow_valid));
+        m_resync_needed = false; }
+
+    /*!
+      @brief  Start the upload of an arbitrary wave to the AWG.
+
+      The wave is sent in pieces via upload() and completed by
+      end_upload(), so that it never needs to be held in memory
+      all at once. While an upload is in progress, no other
+      command should be sent to the AWG. The base class does not
+      support uploads; a descendant class can override the three
+      upload methods to provide them.
+
+      @param  channel   The AWG channel for which the wave is intended.
+      @param  slot      The AWG memory slot (1-based) in which to store the wave.
+      @param  points    The number of points that will be sent, or 0 if unknown.
+
+      @return True if the AWG is ready to receive the wave data.
+    */
+    virtual bool    begin_upload ( uint32_t channel, uint32_t slot, uint32_t points );
+
+    /*!
+      @brief  Send the next piece of wave data.
+
+      @param  data      The wave data (16-bit signed little-endian points; a point may be split between calls).
+      @param  len       The length of the data in bytes.
+
+      @return True if the data was accepted.
+    */
+    virtual bool    upload ( const uint8_t * data, uint32_t len );
+
+    /*!
+      @brief  Complete the upload, even if fewer points were sent than expected.
+
+      @return True if the AWG confirmed the upload.
+    */
+    virtual bool    end_upload ();
+
+    /*!
+      @brief  Check whether an upload is in progress.
+
+      @return True between begin_upload() and end_upload().
+    */
+    bool      uploading ()
+      { return m_uploading; }
+
+    /*!
+      @brief  Lend the serial line to another user (e.g., the Serial_Bridge), or take it back.
+
+      While the line is lent, loop() sends nothing, as during an
+      upload. Use AWG_Task::lend() rather than calling this directly.
+      Whoever borrowed the line may have changed the settings of the
+      AWG, so when it is taken back, the remembered values are
+      forgotten (see forget()).
+
+      @param  b_lent  True while the line is lent.
+    */
+    virtual void  lend ( bool b_lent )
+      { if ( m_lent && ! b_lent ) forget();
+        m_lent = b_lent; }
+
+    bool      lent ()     ///< @return True while the serial line is lent
+      { return m_lent; }
 
   protected:
 
+    /*!
+      @brief  Send a cheap request to check that the AWG responds.
+
+      The descendant class should report the outcome via response_ok()
+      or response_timeout(). The base class version does nothing.
+    */
+    virtual void    probe ();
+
+    /*!
+      @brief  Record the value requested for a parameter.
+
+      A descendant class should call this from set() so that the
+      state of the AWG can be restored after it has been down.
+
+      @param  channel   The AWG channel (1-based)
+      @param  param_id  The id of the parameter (see scpi::parameter_id)
+      @param  value     The value requested
+    */
+    void      remember ( uint32_t channel, uint32_t param_id, double value );
+
+    /*!
+      @brief  Report that the AWG responded to a command.
+    */
+    void      response_ok ();
+
+    /*!
+      @brief  Report that the AWG failed to respond to a command.
+
+      This counts the timeout and the failed command (see command_failed()).
+    */
+    void      response_timeout ()
+      { count_timeout();
+        command_failed(); }
+
+    /*!
+      @brief  Count an attempt that timed out, without judging the health
+              (e.g., one that is retried; see command_failed()).
+    */
+    void      count_timeout ()
+      { m_timeouts.store(m_timeouts.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+    /*!
+      @brief  Report that every attempt of a command went unanswered.
+    */
+    void      command_failed ();
+
+    /*!
+      @brief  Count a command sent by set(), for commands() and retries().
+
+      @param  attempts  The number of times it was sent
+    */
+    void      command_sent ( uint32_t attempts )
+      { m_commands.store(m_commands.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if ( attempts > 1 ) m_retries.store(m_retries.load(std::memory_order_relaxed) + attempts - 1, std::memory_order_relaxed); }
+
+    /*!
+      @brief  Re-send the remembered state of every channel to the AWG.
+    */
+    void      resync ();
+
+    /*!
+      @brief  Wait for serial input from the AWG.
+
+      This waits for input on the transport (see port()). It calls the
+      wait hook while waiting, and it gives up if the command is aborted.
+
+      @param  b_consume   If true, read all available input and discard it.
+      @param  timeout_us  Maximum time to wait in microseconds; 0 = wait forever.
+      @param  b_abortable If false, the wait continues even if the command is aborted.
+
+      @return True if input became available; false if the wait timed out or was aborted.
+    */
+    bool      wait_response ( bool b_consume, uint32_t timeout_us, bool b_abortable = true );
+
+    /*!
+      @brief  Start (or extend) a settle period beginning now.
+
+      If settling is disabled, this does nothing. If a settle period
+      is already in progress and ends later than the new one would,
+      the existing period is kept.
+
+      @param  settle_us The length of the settle period in microseconds.
+    */
+    void      start_settle ( uint32_t settle_us )
+      { if ( ! m_settling ) return;
+        uint32_t  now = micros();
+        uint32_t  remaining = settled() ? 0 : m_settle_us - ( now - m_settle_start );
+        if ( settle_us > remaining ) { m_settle_start = now; m_settle_us = settle_us; } }
+
     uint32_t  m_retry_count;
+    bool      m_settling;         ///< True if settle-aware completion is enabled
+    uint32_t  m_settle_start;     ///< Time (micros) at which the current settle period started
+    uint32_t  m_settle_us;        ///< Length of the current settle period in microseconds
+    bool      m_uploading;        ///< True while an arbitrary wave upload is in progress
+    bool      m_lent;             ///< True while the serial line is lent (see lend())
+    bool      m_aborted;          ///< True if the command in progress has been aborted
+    void      (*m_wait_hook)();   ///< Function called while waiting for the AWG, or NULL
+    Trace_Recorder *  m_trace;    ///< Records each command sent, or NULL
+    Stream *  m_port;             ///< The serial connection to the AWG
+
+    awg_health  m_health;         ///< Current health of the connection to the AWG
+    bool        m_resync_needed;  ///< True if the AWG has come back up and needs its state restored
+    uint32_t    m_failures;       ///< Number of commands failed in a row
+    uint32_t    m_last_response;  ///< Time (millis) of the most recent response from the AWG
+    uint32_t    m_last_probe;     ///< Time (millis) of the most recent probe
+
+    std::atomic<uint32_t>   m_commands;     ///< Number of commands sent by set()
+    std::atomic<uint32_t>   m_retries;      ///< Number of times a command was sent again
+    std::atomic<uint32_t>   m_timeouts;     ///< Number of responses that timed out
+    latency_histogram       m_ack_latency;  ///< Ack latency of the commands acknowledged
+
+    double      m_shadow[max_awg_channels+1][scpi::parameter_count];        ///< Last value requested per channel and parameter
+    bool        m_shadow_valid[max_awg_channels+1][scpi::parameter_count];  ///< True if a value has been requested
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,305 @@
+/*!
+  @file   awg_task.cpp
+  @brief  Definitions of the AWG_Task methods.
+*/
+
+#include "awg_task.h"
+#include "Streaming.h"
+
+
+void AWG_Task::push ( uint32_t channel, uint32_t param_id, double value )
+{
+  awg_command command = { value, (uint32_t) micros(), (uint8_t) channel, (uint8_t) param_id };
+
+  if ( ! m_queue.push(command) )
+  {
+    uint32_t  start = micros();
+
+    m_stalls++;
+
+    while ( ! m_queue.push(command) )
+    {
+      if ( ! m_threaded )
+      {
+        step();     // make room by applying the oldest command
+      }
+      else
+      {
+        notify();
+
+        if ( m_wait_hook )
+        {
+          m_wait_hook();
+        }
+
+        yield();
+      }
+    }
+
+    m_stall_us += micros() - start;
+  }
+
+  notify();
+}
+
+
+void AWG_Task::complete ( uint32_t until )
+{
+  uint32_t  start = micros();
+
+  if ( ! m_threaded )
+  {
+    while ( (int32_t)( until - m_queue.popped() ) > 0 && step() );
+
+    m_awg.wait_settled();
+  }
+  else if ( (int32_t)( until - m_settled.load(std::memory_order_acquire) ) > 0 )
+  {
+    notify();
+
+    while ( (int32_t)( until - m_settled.load(std::memory_order_acquire) ) > 0 && ! m_aborted )
+    {
+      if ( m_wait_hook )
+      {
+        m_wait_hook();
+      }
+
+      yield();
+    }
+  }
+  else
+  {
+    return;
+  }
+
+  m_waits++;
+  m_wait_us += micros() - start;
+}
+
+
+void AWG_Task::abort ( bool b_in_progress )
+{
+  if ( ! m_threaded )
+  {
+    m_queue.discard(m_queue.pushed());
+
+    if ( b_in_progress )
+    {
+      m_awg.abort();
+    }
+
+    return;
+  }
+
+  if ( b_in_progress )
+  {
+    m_aborted = true;
+
+    if ( claimed() )
+    {
+      m_awg.abort();    // the network side is using the AWG itself
+    }
+  }
+
+  /*  The consumer discards what was queued up to this point, and
+      cancels the command in progress if it is one of those.  */
+
+  m_abort_to.store(m_queue.pushed(), std::memory_order_relaxed);
+  m_aborts.store(m_aborts.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+  notify();
+}
+
+
+void AWG_Task::clear_abort ()
+{
+  if ( ! m_threaded || claimed() )
+  {
+    m_awg.clear_abort();
+  }
+
+  m_aborted = false;
+}
+
+
+bool AWG_Task::claim ()
+{
+  complete(m_queue.pushed());
+
+  if ( m_threaded )
+  {
+    uint32_t  claim = m_claim.load(std::memory_order_relaxed) + 1;
+
+    m_claim.store(claim, std::memory_order_release);
+    notify();
+
+    while ( m_parked.load(std::memory_order_acquire) != claim )
+    {
+      if ( m_wait_hook )
+      {
+        m_wait_hook();
+      }
+
+      yield();
+    }
+  }
+
+  return ! aborted();
+}
+
+
+void AWG_Task::release ()
+{
+  if ( m_threaded && ( m_claim.load(std::memory_order_relaxed) & 1 ) )
+  {
+    m_claim.store(m_claim.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    notify();
+  }
+}
+
+
+bool AWG_Task::lend ()
+{
+  if ( m_awg.lent() )
+  {
+    return true;
+  }
+
+  if ( m_awg.uploading() || ( m_claim.load(std::memory_order_relaxed) & 1 ) )
+  {
+    return false;
+  }
+
+  claim();
+  m_awg.lend(true);
+
+  return true;
+}
+
+
+void AWG_Task::take_back ()
+{
+  if ( m_awg.lent() )
+  {
+    m_awg.lend(false);
+    release();
+  }
+}
+
+
+bool AWG_Task::step ()
+{
+  awg_command command;
+
+  if ( ! m_queue.pop(command) )
+  {
+    return false;
+  }
+
+  uint32_t  latency = micros() - command.queued_us;
+
+  if ( latency > m_max_latency_us.load(std::memory_order_relaxed) )
+  {
+    m_max_latency_us.store(latency, std::memory_order_relaxed);
+  }
+
+  m_queue_latency.sample(latency);
+
+  m_awg.set(command.channel, command.param_id, command.value);
+
+  m_applied.store(m_applied.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+  return true;
+}
+
+
+void AWG_Task::handle_abort ()
+{
+  uint32_t  aborts = m_aborts.load(std::memory_order_acquire);
+
+  if ( aborts != m_aborts_seen )
+  {
+    m_queue.discard(m_abort_to.load(std::memory_order_relaxed));
+    m_aborts_seen = aborts;
+    m_awg.clear_abort();
+  }
+}
+
+
+void AWG_Task::loop ()
+{
+  uint32_t  claim = m_claim.load(std::memory_order_acquire);
+
+  if ( claim & 1 )
+  {
+    m_parked.store(claim, std::memory_order_release);     // leave the AWG to the network side
+    return;
+  }
+
+  /*  Apply the queued commands; once there are none, wait for the
+      output to settle, but go on at once if another one arrives.  */
+
+  for ( ;; )
+  {
+    handle_abort();
+
+    if ( step() )
+    {
+      continue;
+    }
+
+    if ( m_awg.settled() || m_awg.aborted() || ( m_claim.load(std::memory_order_acquire) & 1 ) )
+    {
+      break;
+    }
+
+    poll();
+    yield();
+  }
+
+  handle_abort();     // in case the wait ended with an abort
+
+  if ( m_queue.empty() && ! m_awg.aborted() )
+  {
+    m_settled.store(m_queue.popped(), std::memory_order_release);
+  }
+
+  m_awg.loop();
+
+  m_available.store(m_awg.available(), std::memory_order_release);
+}
+
+
+void AWG_Task::poll ()
+{
+  if ( ! m_threaded || claimed() )
+  {
+    if ( m_wait_hook )
+    {
+      m_wait_hook();      // called on the network side
+    }
+
+    return;
+  }
+
+  //  cancel the command in progress if it was queued before an abort
+
+  if ( m_aborts.load(std::memory_order_acquire) != m_aborts_seen
+       && (int32_t)( m_abort_to.load(std::memory_order_relaxed) - m_queue.popped() ) >= 0 )
+  {
+    m_awg.abort();
+  }
+}
+
+
+void AWG_Task::report ( Print & out )
+{
+  out << "AWG task: " << ( m_threaded ? "own thread" : "inline" )
+      << "; queued = " << (uint32_t) m_queue.count() << " of " << (uint32_t) AWG_QUEUE_SIZE
+      << " (high water " << m_queue.high_water() << ")"
+      << "; applied = " << m_applied.load(std::memory_order_relaxed)
+      << "; longest in queue = " << m_max_latency_us.load(std::memory_order_relaxed) << " us\n";
+
+  out << "AWG task: stalls (queue full) = " << m_stalls << " (" << m_stall_us << " us)"
+      << "; waits for the AWG = " << m_waits << " (" << m_wait_us << " us)\n";
+}
@@ -0,0 +1,292 @@
+#ifndef AWG_TASK_H
+#define AWG_TASK_H
+
+/*!
+  @file   awg_task.h
+  @brief  Declaration of the AWG_Task class.
+*/
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <atomic>
+#include "awg_server.h"
+#include "awg_queue.h"
+#include "utilities.h"
+
+/*!
+  @brief  The stage that applies queued commands to the AWG.
+
+  espBode is a pipeline of two stages: the network side (the
+  VXI_Server) parses SCPI into awg_command records and adds them
+  to the AWG_Queue, and the AWG side takes them from the queue and
+  sends them over the (slow) serial line. The AWG_Task is the AWG
+  side, and the link between the two.
+
+  By default the AWG_Task runs inline: the VXI_Server calls step()
+  from its own loop() whenever it has nothing else to do, as on the
+  ESP8266, where there is only one thread. With threaded(true),
+  the consumer methods (loop(), step(), and poll()) are called only
+  by a task of their own, e.g., a thread on Linux or a task pinned
+  to the second core of a dual-core target, and the network side
+  no longer calls the AWG_Server at all, except while it has
+  claimed the AWG (see claim()). The two sides then share only the
+  AWG_Queue and a few counters, each written by one side alone,
+  so no lock is needed; the network side waits for the AWG only
+  where the protocol requires it (e.g., a write without write-
+  behind, or a read).
+
+  The methods are marked with the side that may call them.
+
+  The task also keeps the telemetry for the STATUS report: the
+  depth of the queue, how often and how long the network side was
+  stalled by a full queue or waited for the AWG to catch up, and
+  how long commands waited in the queue.
+*/
+class AWG_Task
+{
+  public:
+
+    /*!
+      @brief  Constructor starts inline, with an empty queue.
+
+      @param  awg   The AWG_Server to which the commands are applied
+    */
+    AWG_Task ( AWG_Server & awg )
+      : m_awg(awg), m_threaded(false), m_wait_hook(NULL), m_notify_hook(NULL),
+        m_aborted(false), m_abort_to(0), m_aborts(0), m_claim(0), m_stalls(0), m_stall_us(0), m_waits(0), m_wait_us(0),
+        m_settled(0), m_available(true), m_aborts_seen(0), m_parked(0), m_applied(0), m_max_latency_us(0)
+      {}
+
+    /*!
+      @brief  Select whether the consumer runs in a task of its own.
+
+      Set this before the VXI_Server starts, and before the consumer
+      task is started.
+
+      @param  enable  True if loop() is called by another task.
+    */
+    void      threaded ( bool enable )
+      { m_threaded = enable; }
+
+    bool      threaded ()       ///< @return True if the consumer runs in a task of its own
+      { return m_threaded; }
+
+    /*!
+      @brief  Set a function to be called while the network side waits for the AWG.
+
+      In threaded mode, the VXI_Server uses this to watch for a
+      device_abort while it waits (see complete() and claim()).
+
+      @param  hook  The function to call, or NULL.
+    */
+    void      wait_hook ( void (*hook)() )
+      { m_wait_hook = hook; }
+
+    /*!
+      @brief  Set a function that wakes the consumer task.
+
+      It is called by the network side whenever it has added work
+      for the consumer, so that the consumer task may sleep while
+      the queue is empty (e.g., a write to an eventfd on Linux, or
+      a task notification on a dual-core target).
+
+      @param  hook  The function to call, or NULL.
+    */
+    void      notify_hook ( void (*hook)() )
+      { m_notify_hook = hook; }
+
+    /*!
+      @brief  Return the queue (e.g., for pending() and pushed()).
+    */
+    AWG_Queue & queue ()
+      { return m_queue; }
+
+    AWG_Server & awg ()     ///< @return The AWG to which the commands are applied
+      { return m_awg; }
+
+    // --- network side ---
+
+    /*!
+      @brief  Add a command to the queue (network side).
+
+      If the queue is full, this waits for room: inline, by applying
+      the oldest command; threaded, by waiting for the consumer. The
+      time spent is counted as a stall.
+    */
+    void      push ( uint32_t channel, uint32_t param_id, double value );
+
+    /*!
+      @brief  Wait until the commands added before a given point have
+              been applied and the AWG output has settled (network side).
+
+      @param  until   The value of queue().pushed() at that point.
+    */
+    void      complete ( uint32_t until );
+
+    /*!
+      @brief  Check, without waiting, whether complete() would return at once (network side).
+
+      @param  until   The value of queue().pushed() at that point.
+    */
+    bool      completed ( uint32_t until )
+      { return m_threaded ? (int32_t)( until - m_settled.load(std::memory_order_acquire) ) <= 0
+                          : (int32_t)( until - m_queue.popped() ) <= 0 && m_awg.settled(); }
+
+    /*!
+      @brief  Discard the queued commands and cancel the one in progress (network side).
+
+      @param  b_in_progress   True if a request of the network side is in progress;
+                              it then reports an abort (see aborted()).
+    */
+    void      abort ( bool b_in_progress );
+
+    /*!
+      @brief  Check whether the request in progress has been aborted (network side).
+    */
+    bool      aborted ()
+      { return m_threaded ? m_aborted : m_awg.aborted(); }
+
+    /*!
+      @brief  Allow commands to be sent again after abort() (network side).
+    */
+    void      clear_abort ();
+
+    /*!
+      @brief  Check whether commands can be sent to the AWG (network side).
+
+      @return False if the AWG is down.
+    */
+    bool      available ()
+      { return m_threaded ? m_available.load(std::memory_order_acquire) : m_awg.available(); }
+
+    /*!
+      @brief  Take the AWG for direct use by the network side (e.g., an upload).
+
+      The queued commands are completed first; in threaded mode, this
+      then waits until the consumer has stopped between commands. The
+      network side may then call the AWG_Server until release().
+
+      @return False if the request was aborted meanwhile.
+    */
+    bool      claim ();
+
+    /*!
+      @brief  Give the AWG back to the consumer after claim() (network side).
+    */
+    void      release ();
+
+    /*!
+      @brief  Lend the AWG to another user of the serial line, e.g., the Serial_Bridge (network side).
+
+      This is the arbitration between the VXI_Server and such a user:
+      the AWG is claimed (see claim()), so that the queued commands
+      are completed and, threaded, the consumer stops between
+      commands; the VXI_Server then leaves its requests waiting, and
+      the AWG health monitor sends nothing, until take_back(). So the
+      two never interleave commands to the AWG.
+
+      @return False if the AWG cannot be lent now (an upload is in
+              progress, or the AWG is claimed by the network side).
+    */
+    bool      lend ();
+
+    /*!
+      @brief  Take the AWG back after lend() (network side).
+    */
+    void      take_back ();
+
+    /*!
+      @brief  Check whether the AWG is lent (network side).
+    */
+    bool      lent ()
+      { return m_awg.lent(); }
+
+    // --- AWG side ---
+
+    /*!
+      @brief  Apply the oldest queued command, if any (AWG side).
+
+      @return False if the queue was empty.
+    */
+    bool      step ();
+
+    /*!
+      @brief  The main loop of the consumer task (threaded mode only).
+
+      Handles an abort, applies the queued commands, waits for the
+      output to settle (unless more commands arrive meanwhile), and
+      runs the AWG health monitor; then returns, so that the task
+      can sleep until it is notified or the next health check.
+      While the AWG is claimed, it does nothing.
+    */
+    void      loop ();
+
+    /*!
+      @brief  Wait hook for the AWG_Server in threaded mode.
+
+      Set this as the AWG_Server wait hook when threaded: on the
+      consumer task, it cancels the command in progress when it has
+      been aborted; while the network side has claimed the AWG, it
+      calls the wait hook of the network side instead.
+    */
+    void      poll ();
+
+    /*!
+      @brief  Write the queue and stall telemetry.
+
+      @param  out   The Print object (e.g., Telnet) to which to write the report.
+    */
+    void      report ( Print & out );
+
+    /*!
+      @brief  Return the histogram of the time from push to the start of set() (either side).
+    */
+    const latency_histogram & queue_latency ()
+      { return m_queue_latency; }
+
+  private:
+
+    /*!
+      @brief  Check whether the network side holds the AWG (either side).
+    */
+    bool      claimed ()
+      { uint32_t  claim = m_claim.load(std::memory_order_acquire);
+        return ( claim & 1 ) && m_parked.load(std::memory_order_acquire) == claim; }
+
+    void      notify ()
+      { if ( m_notify_hook ) m_notify_hook(); }
+
+    /*!
+      @brief  Discard the commands cut off by an abort (AWG side).
+    */
+    void      handle_abort ();
+
+    AWG_Server &            m_awg;              ///< The AWG to which the commands are applied
+    AWG_Queue               m_queue;            ///< The commands waiting for the AWG
+    bool                    m_threaded;         ///< True if the consumer runs in a task of its own
+    void                    (*m_wait_hook)();   ///< Called while the network side waits, or NULL
+    void                    (*m_notify_hook)(); ///< Called to wake the consumer task, or NULL
+
+    // written by the network side only
+
+    bool                    m_aborted;          ///< True if the request in progress has been aborted (threaded)
+    std::atomic<uint32_t>   m_abort_to;         ///< Commands added before this point are discarded by the abort
+    std::atomic<uint32_t>   m_aborts;           ///< Number of aborts requested
+    std::atomic<uint32_t>   m_claim;            ///< Odd while the network side claims the AWG
+    uint32_t                m_stalls;           ///< Number of pushes that found the queue full
+    uint32_t                m_stall_us;         ///< Total time spent waiting for room in the queue
+    uint32_t                m_waits;            ///< Number of waits in complete()
+    uint32_t                m_wait_us;          ///< Total time spent in complete()
+
+    // written by the AWG side only
+
+    std::atomic<uint32_t>   m_settled;          ///< Value of popped() when the AWG last finished and settled
+    std::atomic<bool>       m_available;        ///< Health of the AWG, as seen by the consumer
+    uint32_t                m_aborts_seen;      ///< Number of aborts handled
+    std::atomic<uint32_t>   m_parked;           ///< Value of m_claim acknowledged by the consumer
+    std::atomic<uint32_t>   m_applied;          ///< Number of commands applied
+    std::atomic<uint32_t>   m_max_latency_us;   ///< Longest time from push to the start of set()
+    latency_histogram       m_queue_latency;    ///< Time from push to the start of set()
+};
+
+#endif
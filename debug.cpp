@@ -6,7 +6,7 @@
 */
 
 #ifdef INSTANTIATE_DEBUG
-  DEBUG     Debug;    ///< Global instance of DEBUG, instantiated in debug.cpp if INSTANTIATE_DEBUG is defined
+  BENCH_LOCAL DEBUG Debug;    ///< Global instance of DEBUG (one per bench), instantiated in debug.cpp if INSTANTIATE_DEBUG is defined
 #endif
 
 DEBUG & DEBUG::Dump ( uint8_t * buffer, int len )
@@ -7,6 +7,7 @@
 */
 
 #include "Streaming.h"
+#include "utilities.h"
 #include "telnet_server.h"
 
 /*!
@@ -66,7 +67,7 @@ class DEBUG : public Print
       @param  filter  NONE, ERROR, PROGRESS, etc. (or any combination)
     */
     DEBUG ( db_channel channel = VIA_SERIAL, db_filter filter = ERROR )
-      : m_channel(channel), m_filter(filter), m_output_type(NONE), index(0)
+      : index(0), m_channel(channel), m_filter(filter), m_output_type(NONE)
       {}
 
     /*!
@@ -310,7 +311,7 @@ inline DEBUG & operator << ( Print & pstream, DEBUG & debug_arg )
 */
 
 #ifdef INSTANTIATE_DEBUG
-  extern DEBUG Debug;
+  extern BENCH_LOCAL DEBUG Debug;
 #endif
 
 #endif
\ No newline at end of file
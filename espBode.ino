@@ -5,7 +5,6 @@
 
 #include <ESP8266WiFi.h>
 #include <WiFiUdp.h>
-#include "ESPTelnet.h"
 #include "Streaming.h"
 #include "wifi_config.h"
 #include "credentials.h"
@@ -13,14 +12,23 @@
 #include "rpc_bind_server.h"
 #include "vxi_server.h"
 #include "telnet_server.h"
-#include "awg_fy6900.h"
+#include "metrics_server.h"
+#include "heap_monitor.h"
+#include "serial_bridge.h"
+#include "scpi_server.h"
+#include "awg_fy_auto.h"
 
 // global variables
 
-AWG_FY6900      awg;                          ///< Use the FY6900 variant of the AWG_Server class
+Trace_Recorder  trace_recorder;               ///< Records the latest VXI requests and AWG commands
+Heap_Monitor    heap_monitor;                 ///< Samples the heap and the stack of the main loop
+AWG_FY_Auto     awg;                          ///< Serves whichever FY-series AWG is connected (see identify())
 VXI_Server      vxi_server(awg);              ///< The VXI_Server
 RPC_Bind_Server rpc_bind_server(vxi_server);  ///< The RPC_Bind_Server
-Telnet_Server   telnet_server;                ///< The Telnet_Server
+Telnet_Server   telnet_server(awg, &vxi_server.awg_task(), &trace_recorder, &heap_monitor);   ///< The Telnet_Server
+Metrics_Server  metrics_server(vxi_server, rpc_bind_server, awg, &heap_monitor);  ///< Serves /metrics for Prometheus
+Serial_Bridge   serial_bridge(awg, vxi_server.awg_task());  ///< Bridges TCP port 2217 to the AWG serial line
+SCPI_Server     scpi_server(awg, vxi_server.awg_task());    ///< Serves SCPI on the raw socket port 5025
 
 /*!
   @brief  Set up the WiFi connection.
@@ -128,24 +136,50 @@ void setup()
   setup_WiFi();
 
   /*  Initiailize the various servers - telnet_server,
-      rpc_bind_server, and vxi_server.
+      rpc_bind_server, vxi_server, metrics_server, serial_bridge,
+      and scpi_server.
   */
 
   awg.retry(2);               // validate settings with up to 2 retries
+  awg.settling(true);         // do not complete a write until the AWG output has settled
+  awg.learn_settle(false);    // true = extend the settle table from the measured ack timing
+  awg.trace(&trace_recorder);         // record each AWG command and VXI request (see Telnet TRACE)
+  vxi_server.trace(&trace_recorder);
+  vxi_server.write_behind(false);   // true = acknowledge writes before the AWG has been updated
+  scpi_server.write_behind(false);  // true = read the next SCPI line before the AWG has been updated
+  awg.wait_hook([]() { vxi_server.poll_abort(); });   // answer a device_abort while waiting for the AWG
+  awg.identify(false);        // select the tables for the AWG model and firmware (true = probe even if saved)
+  serial_bridge.baud_hook([]( uint32_t baud ) { Serial.updateBaudRate(baud); return true; });   // RFC 2217 clients may set the rate
   vxi_server.begin();
   rpc_bind_server.begin();
   telnet_server.begin();
+  metrics_server.begin();
+  serial_bridge.begin();
+  scpi_server.begin();
+  heap_monitor.sample_now(Heap_Monitor::SETUP);
 }
 
 /*!
   @brief  Standard Arduino main loop
 
-  The main loop simply calls the loop() method of each of the servers,
-  allowing them to do any processing they need to do before passing
-  control to the next server.
+  The main loop simply calls the loop() method of the AWG (to monitor
+  its health) and of each of the servers, allowing them to do any
+  processing they need to do before passing control to the next server.
+  After each, the heap monitor may take a sample (see Heap_Monitor).
 */
 void loop() {
+  awg.loop();
+  heap_monitor.sample(Heap_Monitor::AWG);
   telnet_server.loop();
+  heap_monitor.sample(Heap_Monitor::TELNET);
   rpc_bind_server.loop();
+  heap_monitor.sample(Heap_Monitor::BIND);
   vxi_server.loop();
+  heap_monitor.sample(Heap_Monitor::VXI);
+  metrics_server.loop();
+  heap_monitor.sample(Heap_Monitor::METRICS);
+  serial_bridge.loop();
+  heap_monitor.sample(Heap_Monitor::BRIDGE);
+  scpi_server.loop();
+  heap_monitor.sample(Heap_Monitor::SCPI);
 }
@@ -0,0 +1,87 @@
+/*!
+  @file   heap_monitor.cpp
+  @brief  Definitions of the Heap_Monitor methods.
+*/
+
+#include "heap_monitor.h"
+#include "Streaming.h"
+#include "debug.h"
+#include "packet_pool.h"
+
+const char * Heap_Monitor::server_name ( uint32_t server )
+{
+  static const char * const   names[SERVER_COUNT] = { "setup", "awg", "telnet", "bind", "vxi", "metrics", "bridge", "scpi" };
+
+  return ( server < SERVER_COUNT ) ? names[server] : "unknown";
+}
+
+
+void Heap_Monitor::sample_now ( heap_server after )
+{
+  heap_sample   s;
+
+  s.time_ms = millis();
+  s.free_heap = ESP.getFreeHeap();
+  s.largest_block = ESP.getMaxFreeBlockSize();
+  s.free_stack = ESP.getFreeContStack();
+  s.fragmentation = ESP.getHeapFragmentation();
+  s.server = after;
+
+  if ( m_samples++ == 0 )
+  {
+    m_lowest_heap = m_lowest_block = m_most_fragmented = m_lowest_stack = s;
+  }
+
+  m_last = s;
+
+  if ( s.free_heap < m_lowest_heap.free_heap )
+  {
+    m_lowest_heap = s;
+  }
+
+  if ( s.largest_block < m_lowest_block.largest_block )
+  {
+    m_lowest_block = s;
+  }
+
+  if ( s.fragmentation > m_most_fragmented.fragmentation )
+  {
+    m_most_fragmented = s;
+  }
+
+  if ( s.free_stack < m_lowest_stack.free_stack )
+  {
+    m_lowest_stack = s;
+  }
+
+  if ( ! m_b_low && s.free_heap < HEAP_LOW_BYTES )
+  {
+    Debug.Error() << "Free heap is low: " << s.free_heap << " bytes (largest block " << s.largest_block
+                  << ") after " << server_name(after) << "; returning the idle packet buffers\n";
+
+    packet_pool.trim();
+    m_b_low = true;
+  }
+  else if ( m_b_low && s.free_heap >= 2 * HEAP_LOW_BYTES )
+  {
+    m_b_low = false;
+  }
+}
+
+
+void Heap_Monitor::report ( Print & out )
+{
+  if ( m_samples == 0 )
+  {
+    out << "Heap: not sampled yet\n";
+    return;
+  }
+
+  out << "Heap: free = " << m_last.free_heap << " (lowest " << m_lowest_heap.free_heap << " after " << server_name(m_lowest_heap.server)
+      << "); largest block = " << m_last.largest_block << " (lowest " << m_lowest_block.largest_block << " after "
+      << server_name(m_lowest_block.server) << "); fragmentation = " << (uint32_t) m_last.fragmentation << "% (highest "
+      << (uint32_t) m_most_fragmented.fragmentation << "% after " << server_name(m_most_fragmented.server) << ")\n";
+
+  out << "Stack: never used = " << m_lowest_stack.free_stack << " bytes (reached after " << server_name(m_lowest_stack.server)
+      << "); samples = " << m_samples << " every " << m_period_ms << " ms\n";
+}
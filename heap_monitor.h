@@ -0,0 +1,152 @@
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+/*!
+  @file   heap_monitor.h
+  @brief  Declaration of the Heap_Monitor class.
+*/
+
+#include <Arduino.h>
+#include <stdint.h>
+
+/*!
+  @brief  Free heap below which an error is reported and the packet pool trimmed (once, until it recovers).
+*/
+const uint32_t  HEAP_LOW_BYTES = 4096;
+
+/*!
+  @brief  Samples the heap and the stack of the main loop, and keeps their low-water marks.
+
+  On a long session, the heap of the ESP-01 may fragment (e.g., through
+  the String objects of the Telnet library) until lwIP can no longer
+  allocate a packet, and the device falls over in the middle of a
+  sweep. The Heap_Monitor watches for this: the main loop calls
+  sample() after the loop() of each server, and once per period it
+  reads
+
+    - the free heap,
+    - the largest free block (the largest allocation that can succeed),
+    - the fragmentation of the heap (0 - 100 %), and
+    - the free stack of the main loop: the part that has never been
+      used since the start (a high-water mark, not the current depth).
+
+  Each sample is tagged with the server whose loop() ran just before
+  it, and for each figure the worst sample since the start is kept, so
+  that a leak or a deep call can be traced to a server. The figures are
+  reported by the Telnet STATUS command and served by the /metrics
+  endpoint (see Metrics_Server). If the free heap falls below
+  HEAP_LOW_BYTES, an error is written to Debug, and the idle packet
+  buffers are given back to the heap (see Packet_Pool::trim()).
+*/
+class Heap_Monitor
+{
+  public:
+
+    /*!
+      @brief  The server whose loop() ran just before a sample.
+    */
+    enum heap_server {
+      SETUP         = 0,    ///< Before the main loop
+      AWG           = 1,    ///< AWG_Server::loop() (the health monitor)
+      TELNET        = 2,    ///< Telnet_Server
+      BIND          = 3,    ///< RPC_Bind_Server
+      VXI           = 4,    ///< VXI_Server
+      METRICS       = 5,    ///< Metrics_Server
+      BRIDGE        = 6,    ///< Serial_Bridge
+      SCPI          = 7,    ///< SCPI_Server
+      SERVER_COUNT  = 8
+    };
+
+    /*!
+      @brief  One reading of the heap and the stack.
+    */
+    struct heap_sample
+    {
+      uint32_t  time_ms;          ///< Time (millis) of the sample
+      uint32_t  free_heap;        ///< Free heap in bytes
+      uint32_t  largest_block;    ///< Largest free block in bytes
+      uint32_t  free_stack;       ///< Stack of the main loop never used, in bytes
+      uint8_t   fragmentation;    ///< Fragmentation of the heap in percent
+      uint8_t   server;           ///< The heap_server that ran just before the sample
+    };
+
+    /*!
+      @brief  Constructor sets the sampling period; nothing is sampled until sample() is called.
+
+      @param  period_ms   Time between samples in milliseconds
+    */
+    Heap_Monitor ( uint32_t period_ms = 500 )
+      : m_period_ms(period_ms), m_samples(0), m_b_low(false)
+      {}
+
+    /*!
+      @brief  Set the sampling period.
+
+      @param  period_ms   Time between samples in milliseconds
+    */
+    void      period ( uint32_t period_ms )
+      { m_period_ms = period_ms; }
+
+    uint32_t  period ()     ///< @return The sampling period in milliseconds
+      { return m_period_ms; }
+
+    /*!
+      @brief  Take a sample if the period has elapsed since the last one.
+
+      Call this after the loop() of each server.
+
+      @param  after   The server whose loop() has just run
+    */
+    void      sample ( heap_server after )
+      { if ( m_samples == 0 || millis() - m_last.time_ms >= m_period_ms ) sample_now(after); }
+
+    /*!
+      @brief  Take a sample now.
+
+      @param  after   The server whose loop() has just run
+    */
+    void      sample_now ( heap_server after );
+
+    uint32_t  samples ()    ///< @return The number of samples taken
+      { return m_samples; }
+
+    const heap_sample & last ()             ///< @return The latest sample
+      { return m_last; }
+
+    const heap_sample & lowest_heap ()      ///< @return The sample with the least free heap
+      { return m_lowest_heap; }
+
+    const heap_sample & lowest_block ()     ///< @return The sample with the smallest largest free block
+      { return m_lowest_block; }
+
+    const heap_sample & most_fragmented ()  ///< @return The sample with the highest fragmentation
+      { return m_most_fragmented; }
+
+    const heap_sample & lowest_stack ()     ///< @return The sample with the least free stack
+      { return m_lowest_stack; }
+
+    /*!
+      @brief  Return the name of a heap_server (e.g., "vxi").
+    */
+    static const char * server_name ( uint32_t server );
+
+    /*!
+      @brief  Write the latest figures and their low-water marks.
+
+      @param  out   The Print object (e.g., Telnet) to which to write the report.
+    */
+    void      report ( Print & out );
+
+  private:
+
+    uint32_t      m_period_ms;        ///< Time between samples
+    uint32_t      m_samples;          ///< Number of samples taken
+    bool          m_b_low;            ///< True while the free heap is below HEAP_LOW_BYTES
+    heap_sample   m_last;             ///< The latest sample
+    heap_sample   m_lowest_heap;      ///< The sample with the least free heap
+    heap_sample   m_lowest_block;     ///< The sample with the smallest largest free block
+    heap_sample   m_most_fragmented;  ///< The sample with the highest fragmentation
+    heap_sample   m_lowest_stack;     ///< The sample with the least free stack
+};
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+/*!
+  @file   Arduino.h
+  @brief  The part of the Arduino core used by espBode, implemented for Linux.
+
+  When espBode is built as a Linux daemon (see Makefile), this header
+  takes the place of the Arduino core. It provides the timing functions,
+  the Print and Stream classes, a minimal String, and a Serial object.
+  Note that on Linux, Serial is the console (used for Debug output);
+  the AWG is reached through a Serial_Port (see serial_port.h) given
+  to AWG_Server::transport().
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+
+using std::min;
+using std::max;
+
+#define LOW           0
+#define HIGH          1
+#define INPUT         0
+#define OUTPUT        1
+#define LED_BUILTIN   2
+
+#define DEC           10
+#define HEX           16
+
+/*  Timing functions. The values wrap at 32 bits, as on the ESP8266,
+    so that the usual ( now - start ) arithmetic works unchanged.  */
+
+uint32_t  millis ();
+uint32_t  micros ();
+void      delay ( unsigned long ms );
+void      yield ();
+
+/*  There are no pins on a Linux host.  */
+
+inline void pinMode ( int pin, int mode ) {}
+inline void digitalWrite ( int pin, int value ) {}
+inline int  digitalRead ( int pin ) { return LOW; }
+
+/*!
+  @brief  Minimal replacement for the Arduino String class.
+*/
+class String
+{
+  public:
+
+    String ( const char * text = "" )
+      : m_text(text ? text : "")
+      {}
+
+    String ( const std::string & text )
+      : m_text(text)
+      {}
+
+    const char *  c_str () const
+      { return m_text.c_str(); }
+
+    unsigned int  length () const
+      { return m_text.length(); }
+
+    void          trim ()
+      { size_t first = m_text.find_first_not_of(" \t\r\n");
+        size_t last = m_text.find_last_not_of(" \t\r\n");
+        m_text = ( first == std::string::npos ) ? "" : m_text.substr(first, last - first + 1); }
+
+    void          toUpperCase ()
+      { for ( char & c : m_text ) c = toupper((unsigned char) c); }
+
+    bool          operator== ( const char * text ) const
+      { return m_text == text; }
+
+    bool          operator== ( const String & other ) const
+      { return m_text == other.m_text; }
+
+    String &      operator+= ( char c )
+      { m_text += c; return *this; }
+
+  private:
+
+    std::string   m_text;
+};
+
+/*!
+  @brief  Base class for anything that can be printed to.
+
+  As in the Arduino core, a descendant needs only to provide
+  write(uint8_t); the print methods format their argument and
+  pass it on to write().
+*/
+class Print
+{
+  public:
+
+    virtual ~Print ()
+      {}
+
+    virtual size_t  write ( uint8_t byte ) = 0;
+
+    virtual size_t  write ( const uint8_t * buffer, size_t len )
+      { size_t n = 0;
+        while ( len-- > 0 ) n += write(*buffer++);
+        return n; }
+
+    size_t          write ( const char * text )
+      { return write((const uint8_t *) text, strlen(text)); }
+
+    size_t          write ( const char * buffer, size_t len )
+      { return write((const uint8_t *) buffer, len); }
+
+    virtual int     availableForWrite ()
+      { return 0; }
+
+    virtual void    flush ()
+      {}
+
+    size_t  printf ( const char * format, ... ) __attribute__ ((format (printf, 2, 3)));
+
+    size_t  print ( const char * text )             { return write(text); }
+    size_t  print ( const String & text )           { return write(text.c_str()); }
+    size_t  print ( char c )                        { return write((uint8_t) c); }
+    size_t  print ( unsigned char n, int base = DEC )       { return print((unsigned long) n, base); }
+    size_t  print ( int n, int base = DEC )                 { return print((long) n, base); }
+    size_t  print ( unsigned int n, int base = DEC )        { return print((unsigned long) n, base); }
+    size_t  print ( long n, int base = DEC );
+    size_t  print ( unsigned long n, int base = DEC );
+    size_t  print ( long long n, int base = DEC )           { return print((long) n, base); }
+    size_t  print ( unsigned long long n, int base = DEC )  { return print((unsigned long) n, base); }
+    size_t  print ( double n, int digits = 2 );
+
+    size_t  println ()
+      { return write("\r\n"); }
+
+    template <typename T>
+    size_t  println ( T value )
+      { size_t n = print(value);
+        return n + println(); }
+};
+
+/*!
+  @brief  Base class for anything that can be read from and printed to.
+
+  readBytes() and readBytesUntil() wait up to the timeout (default
+  1 second) for each byte, as in the Arduino core.
+*/
+class Stream : public Print
+{
+  public:
+
+    Stream ()
+      : m_timeout(1000)
+      {}
+
+    virtual int     available () = 0;
+    virtual int     read () = 0;
+
+    virtual int     peek ()
+      { return -1; }
+
+    void    setTimeout ( unsigned long timeout )
+      { m_timeout = timeout; }
+
+    size_t  readBytes ( uint8_t * buffer, size_t len );
+
+    size_t  readBytes ( char * buffer, size_t len )
+      { return readBytes((uint8_t *) buffer, len); }
+
+    size_t  readBytesUntil ( char terminator, char * buffer, size_t len );
+
+  protected:
+
+    int     timedRead ();
+
+    unsigned long   m_timeout;    ///< Time (ms) to wait for each byte
+};
+
+/*!
+  @brief  The console, standing in for the Arduino Serial port.
+
+  Output goes to stderr (so that it can be captured by a service
+  manager); there is no input.
+*/
+class HardwareSerial : public Stream
+{
+  public:
+
+    void    begin ( unsigned long baud )
+      {}
+
+    virtual int     available ()
+      { return 0; }
+
+    virtual int     read ()
+      { return -1; }
+
+    virtual size_t  write ( uint8_t byte )
+      { return fwrite(&byte, 1, 1, stderr); }
+
+    virtual size_t  write ( const uint8_t * buffer, size_t len )
+      { return fwrite(buffer, 1, len, stderr); }
+
+    virtual int     availableForWrite ()
+      { return 1024; }
+
+    using Print::write;
+};
+
+extern HardwareSerial Serial;   ///< The console, defined in arduino.cpp
+
+/*!
+  @brief  The part of the ESP8266 system interface used by espBode.
+
+  The heap figures come from malloc: the free heap is the free space
+  that malloc holds, and the largest free block is the free space at
+  the top of the heap, which can be allocated without asking the
+  system for more memory; the fragmentation is the part of the free
+  heap outside that block.
+
+  The ESP8266 reports how much of the 4 kB stack of the main loop has
+  never been used. The stack of a Linux thread has no such limit, so
+  the same figure is measured against a budget of cont_stack_size
+  bytes below the frame of the first call to getFreeContStack(): the
+  budget is filled with a pattern then, and the part that still holds
+  the pattern has never been used. Call it from one thread only.
+*/
+class EspClass
+{
+  public:
+
+    uint32_t  getFreeHeap ();
+    uint32_t  getMaxFreeBlockSize ();
+    uint8_t   getHeapFragmentation ();
+    uint32_t  getFreeContStack ();
+
+    static const size_t   cont_stack_size = 65536;    ///< Stack budget measured by getFreeContStack()
+};
+
+extern EspClass ESP;            ///< The system interface, defined in arduino.cpp
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+
+/*!
+  @file   EEPROM.h
+  @brief  The EEPROM class used by espBode, implemented for Linux.
+
+  On the ESP8266, the EEPROM library keeps a copy of a sector of the
+  flash in RAM; commit() writes it back. Here the copy is kept in a
+  file instead: the file named by the ESPBODE_EEPROM environment
+  variable, or espbode.eeprom in the current directory.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+/*!
+  @brief  The emulated EEPROM, read by begin() and written by commit().
+*/
+class EEPROMClass
+{
+  public:
+
+    /*!
+      @brief  Read the first <size> bytes of the file (0xFF where there are none).
+    */
+    void      begin ( size_t size );
+
+    /*!
+      @brief  Write the bytes back to the file, if any has changed.
+
+      @return False if the file could not be written.
+    */
+    bool      commit ();
+
+    /*!
+      @brief  Commit, and release the copy.
+    */
+    bool      end ()
+      { bool b_ok = commit(); m_data.clear(); return b_ok; }
+
+    uint8_t   read ( int address )
+      { return ( address >= 0 && address < (int) m_data.size() ) ? m_data[address] : 0xFF; }
+
+    void      write ( int address, uint8_t value )
+      { if ( address >= 0 && address < (int) m_data.size() && m_data[address] != value ) { m_data[address] = value; m_b_dirty = true; } }
+
+    template <typename T> T &  get ( int address, T & value )
+      { for ( size_t i = 0; i < sizeof(T); i++ ) ((uint8_t *) &value)[i] = read(address + i);
+        return value; }
+
+    template <typename T> const T &  put ( int address, const T & value )
+      { for ( size_t i = 0; i < sizeof(T); i++ ) write(address + i, ((const uint8_t *) &value)[i]);
+        return value; }
+
+  private:
+
+    /*!
+      @brief  Return the name of the file.
+    */
+    static const char *   file ();
+
+    std::vector<uint8_t>  m_data;             ///< The copy of the EEPROM
+    bool                  m_b_dirty = false;  ///< True if the copy has changed since begin() or commit()
+};
+
+extern EEPROMClass  EEPROM;     ///< The EEPROM, defined in eeprom.cpp
+
+#endif
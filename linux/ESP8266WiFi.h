@@ -0,0 +1,158 @@
+#ifndef ESP8266WIFI_H
+#define ESP8266WIFI_H
+
+/*!
+  @file   ESP8266WiFi.h
+  @brief  The WiFiClient and WiFiServer classes used by espBode, implemented for Linux.
+
+  The classes keep the Arduino interface (non-blocking accept(),
+  available(), readBytes() with a timeout, copyable clients) on top
+  of ordinary non-blocking POSIX sockets. Every socket is registered
+  with the event_loop, so that the daemon can sleep until one of them
+  has input.
+*/
+
+#include "Arduino.h"
+#include <memory>
+
+/*!
+  @brief  An IPv4 address.
+*/
+class IPAddress
+{
+  public:
+
+    IPAddress ( uint32_t address = 0 )    ///< @param address The address in network byte order
+      : m_address(address)
+      {}
+
+    IPAddress ( uint8_t a, uint8_t b, uint8_t c, uint8_t d )
+      : m_address((uint32_t) a | ( (uint32_t) b << 8 ) | ( (uint32_t) c << 16 ) | ( (uint32_t) d << 24 ))
+      {}
+
+    operator uint32_t () const    ///< @return The address in network byte order
+      { return m_address; }
+
+    String  toString () const;
+
+    /*!
+      @brief  Parse an address in dotted-decimal form.
+
+      @param  text  The address, e.g., "192.168.1.20"
+
+      @return True if the text is a valid address.
+    */
+    bool    fromString ( const char * text );
+
+  private:
+
+    uint32_t  m_address;    ///< The address in network byte order
+};
+
+/*!
+  @brief  A TCP connection.
+
+  As in the Arduino core, copies of a WiFiClient share the same
+  connection, which is closed by stop() or when the last copy is
+  destroyed. Received data are buffered so that reading one byte
+  at a time does not cost a system call per byte.
+*/
+class WiFiClient : public Stream
+{
+  public:
+
+    WiFiClient ()     ///< Constructor creates a client with no connection
+      {}
+
+    explicit WiFiClient ( int fd );
+
+    virtual int     available ();
+    virtual int     read ();
+    virtual int     peek ();
+    virtual size_t  write ( uint8_t byte );
+    virtual size_t  write ( const uint8_t * buffer, size_t len );
+    virtual int     availableForWrite ();
+
+    using Print::write;
+
+    /*!
+      @brief  Check whether the connection is open or still has data to read.
+    */
+    uint8_t   connected ();
+
+    operator bool ()
+      { return connected(); }
+
+    void      stop ();
+
+    void      setNoDelay ( bool nodelay );
+
+    IPAddress remoteIP ();
+    uint16_t  remotePort ();
+
+  private:
+
+    /*!
+      @brief  The state shared by all copies of a WiFiClient.
+    */
+    struct connection
+    {
+      int       fd;             ///< The socket, or -1 once closed
+      uint8_t   buffer[1460];   ///< Received data not yet read
+      size_t    head;           ///< Position of the next byte to read
+      size_t    tail;           ///< Position after the last byte received
+
+      connection ( int s )
+        : fd(s), head(0), tail(0)
+        {}
+
+      ~connection ();
+
+      void      close ();
+      bool      fill ();
+    };
+
+    std::shared_ptr<connection>   m_connection;   ///< The connection, or NULL
+};
+
+/*!
+  @brief  A TCP listening socket.
+*/
+class WiFiServer
+{
+  public:
+
+    WiFiServer ( uint16_t port )
+      : m_port(port), m_fd(-1)
+      {}
+
+    ~WiFiServer ()
+      { stop(); }
+
+    void        begin ()
+      { begin(m_port); }
+
+    void        begin ( uint16_t port );
+
+    void        stop ();
+
+    /*!
+      @brief  Accept a waiting connection, if any, without blocking.
+
+      @return The new connection, or a WiFiClient with no connection.
+    */
+    WiFiClient  accept ();
+
+    WiFiClient  available ()      ///< Older name for accept()
+      { return accept(); }
+
+    void        setNoDelay ( bool nodelay )
+      {}
+
+  private:
+
+    uint16_t  m_port;   ///< The port on which to listen
+    int       m_fd;     ///< The listening socket, or -1
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+/*!
+  @file   Streaming.h
+  @brief  The part of the Streaming library used by espBode, implemented for Linux.
+
+  Provides the << operator for any Print object, along with
+  the _FLOAT and _WIDTH manipulators.
+*/
+
+#include "Arduino.h"
+
+/*!
+  @brief  Print any value that Print::print() accepts.
+*/
+template <typename T>
+inline Print & operator<< ( Print & obj, T arg )
+  { obj.print(arg); return obj; }
+
+/*!
+  @brief  A floating point value with a given number of decimal places.
+*/
+struct _FLOAT
+{
+  double  val;      ///< The value
+  int     digits;   ///< The number of decimal places
+
+  _FLOAT ( double v, int d = 2 )
+    : val(v), digits(d)
+    {}
+};
+
+inline Print & operator<< ( Print & obj, const _FLOAT & arg )
+  { obj.print(arg.val, arg.digits); return obj; }
+
+/*!
+  @brief  A value printed right-aligned in a field of a given width.
+*/
+template <typename T>
+struct _WIDTH_T
+{
+  T       val;      ///< The value
+  int     width;    ///< The width of the field
+};
+
+template <typename T>
+inline _WIDTH_T<T> _WIDTH ( T val, int width )
+  { return { val, width }; }
+
+/*!
+  @brief  Helper that counts the characters of a value as it is printed.
+*/
+class Print_Counter : public Print
+{
+  public:
+
+    size_t  count = 0;    ///< Characters counted so far
+
+    virtual size_t  write ( uint8_t byte )
+      { count++; return 1; }
+};
+
+template <typename T>
+inline Print & operator<< ( Print & obj, const _WIDTH_T<T> & arg )
+  { Print_Counter counter;
+    counter << arg.val;
+    for ( int i = (int) counter.count; i < arg.width; i++ ) obj.print(' ');
+    obj << arg.val;
+    return obj; }
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef WIFIUDP_H
+#define WIFIUDP_H
+
+/*!
+  @file   WiFiUdp.h
+  @brief  The WiFiUDP class used by espBode, implemented for Linux.
+*/
+
+#include "ESP8266WiFi.h"
+
+/*!
+  @brief  A UDP socket that receives and sends one packet at a time.
+*/
+class WiFiUDP : public Stream
+{
+  public:
+
+    WiFiUDP ()
+      : m_fd(-1), m_rx_len(0), m_rx_pos(0), m_tx_len(0), m_remote_ip(0), m_remote_port(0), m_tx_ip(0), m_tx_port(0)
+      {}
+
+    ~WiFiUDP ()
+      { stop(); }
+
+    uint8_t   begin ( uint16_t port );
+    void      stop ();
+
+    /*!
+      @brief  Receive the next packet, if any, without blocking.
+
+      @return The size of the packet, or 0 if none has arrived.
+    */
+    int       parsePacket ();
+
+    int       read ( uint8_t * buffer, size_t len );
+
+    virtual int     available ()
+      { return m_rx_len - m_rx_pos; }
+
+    virtual int     read ()
+      { return ( m_rx_pos < m_rx_len ) ? m_rx_buffer[m_rx_pos++] : -1; }
+
+    int       beginPacket ( IPAddress ip, uint16_t port );
+    int       endPacket ();
+
+    virtual size_t  write ( uint8_t byte )
+      { return write(&byte, 1); }
+
+    virtual size_t  write ( const uint8_t * buffer, size_t len );
+
+    using Print::write;
+
+    IPAddress remoteIP ()
+      { return m_remote_ip; }
+
+    uint16_t  remotePort ()
+      { return m_remote_port; }
+
+  private:
+
+    int       m_fd;                 ///< The socket, or -1
+    uint8_t   m_rx_buffer[1472];    ///< The packet received by parsePacket()
+    size_t    m_rx_len;             ///< The length of the packet received
+    size_t    m_rx_pos;             ///< Position of the next byte to read
+    uint8_t   m_tx_buffer[1472];    ///< The packet being assembled for endPacket()
+    size_t    m_tx_len;             ///< The length of the packet being assembled
+    IPAddress m_remote_ip;          ///< Sender of the packet received
+    uint16_t  m_remote_port;        ///< Port of the sender of the packet received
+    IPAddress m_tx_ip;              ///< Destination of the packet being assembled
+    uint16_t  m_tx_port;            ///< Port of the destination of the packet being assembled
+};
+
+#endif
@@ -0,0 +1,214 @@
+/*!
+  @file   arduino.cpp
+  @brief  Definitions of the Arduino core functions and methods declared in Arduino.h.
+*/
+
+#include "Arduino.h"
+#include "event_loop.h"
+#include <malloc.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+HardwareSerial  Serial;     ///< The console
+EspClass        ESP;        ///< The system interface
+
+/*!
+  @brief  Read the monotonic clock in microseconds.
+*/
+static uint64_t clock_us ()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t millis ()
+{
+  return (uint32_t)( clock_us() / 1000 );
+}
+
+uint32_t micros ()
+{
+  return (uint32_t) clock_us();
+}
+
+void delay ( unsigned long ms )
+{
+  usleep(ms * 1000);
+}
+
+/*!
+  The code shared with the ESP8266 calls yield() while it is
+  waiting (for the AWG, a settle period, or network data). On
+  Linux, this gives up the processor until an event arrives on
+  one of the sockets or the serial port, or for at most a short
+  time, so that the waits do not spin.
+*/
+void yield ()
+{
+  event_loop.wait_us(200);
+}
+
+size_t Print::printf ( const char * format, ... )
+{
+  char    buffer[256];
+  va_list args;
+  int     len;
+
+  va_start(args, format);
+  len = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+
+  if ( len < 0 )
+  {
+    return 0;
+  }
+
+  return write((const uint8_t *) buffer, std::min((size_t) len, sizeof(buffer) - 1));
+}
+
+size_t Print::print ( long n, int base )
+{
+  char  buffer[24];
+
+  if ( base == HEX )
+  {
+    snprintf(buffer, sizeof(buffer), "%lx", n);
+  }
+  else
+  {
+    snprintf(buffer, sizeof(buffer), "%ld", n);
+  }
+
+  return write(buffer);
+}
+
+size_t Print::print ( unsigned long n, int base )
+{
+  char  buffer[24];
+
+  snprintf(buffer, sizeof(buffer), ( base == HEX ) ? "%lx" : "%lu", n);
+
+  return write(buffer);
+}
+
+size_t Print::print ( double n, int digits )
+{
+  char  buffer[48];
+
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+
+  return write(buffer);
+}
+
+int Stream::timedRead ()
+{
+  uint32_t  start = millis();
+
+  do
+  {
+    int c = read();
+
+    if ( c >= 0 )
+    {
+      return c;
+    }
+
+    yield();
+  }
+  while ( millis() - start < m_timeout );
+
+  return -1;
+}
+
+size_t Stream::readBytes ( uint8_t * buffer, size_t len )
+{
+  size_t  n = 0;
+
+  while ( n < len )
+  {
+    int c = timedRead();
+
+    if ( c < 0 )
+    {
+      break;
+    }
+
+    buffer[n++] = (uint8_t) c;
+  }
+
+  return n;
+}
+
+size_t Stream::readBytesUntil ( char terminator, char * buffer, size_t len )
+{
+  size_t  n = 0;
+
+  while ( n < len )
+  {
+    int c = timedRead();
+
+    if ( c < 0 || c == terminator )
+    {
+      break;
+    }
+
+    buffer[n++] = (char) c;
+  }
+
+  return n;
+}
+
+uint32_t EspClass::getFreeHeap ()
+{
+  return (uint32_t) std::min(mallinfo2().fordblks, (size_t) UINT32_MAX);
+}
+
+uint32_t EspClass::getMaxFreeBlockSize ()
+{
+  return (uint32_t) std::min(mallinfo2().keepcost, (size_t) UINT32_MAX);
+}
+
+uint8_t EspClass::getHeapFragmentation ()
+{
+  struct mallinfo2  info = mallinfo2();
+
+  return info.fordblks ? (uint8_t)( 100 - 100 * info.keepcost / info.fordblks ) : 0;
+}
+
+static uintptr_t  stack_bottom = 0;    ///< Lowest address of the stack budget, once painted
+
+/*!
+  @brief  Fill the stack budget below the caller with a pattern.
+*/
+static __attribute__((noinline)) void paint_stack ()
+{
+  volatile uint32_t   area[EspClass::cont_stack_size / 4];
+
+  for ( size_t i = 0; i < EspClass::cont_stack_size / 4; i++ )
+  {
+    area[i] = 0xa5a5a5a5;
+  }
+
+  stack_bottom = (uintptr_t) area;
+}
+
+uint32_t EspClass::getFreeContStack ()
+{
+  size_t    free = 0;
+
+  if ( ! stack_bottom )
+  {
+    paint_stack();
+  }
+
+  while ( free < cont_stack_size / 4 && ( (volatile uint32_t *) stack_bottom )[free] == 0xa5a5a5a5 )
+  {
+    free++;
+  }
+
+  return free * 4;
+}
@@ -0,0 +1,212 @@
+/*!
+  @file   bench.cpp
+  @brief  Definitions of the Bench and Bench_Bind_Server methods.
+*/
+
+#include "bench.h"
+#include "event_loop.h"
+#include "rpc_enums.h"
+#include <pthread.h>
+#include <sched.h>
+
+/*!
+  @brief  Longest time (ms) a worker thread sleeps without an event.
+
+  As in main.cpp, the health monitor and write-behind queue need
+  the loop to run now and then even when nothing arrives.
+*/
+const int   bench_idle_timeout_ms = 10;
+
+/*!
+  @brief  Time (ms) after which a port taken by a scope that never connected is offered again.
+*/
+const uint32_t  bench_offer_timeout_ms = 1000;
+
+thread_local Bench *  Bench::current = NULL;
+
+
+Bench::Bench ( int index, const char * device, IPAddress client )
+  : m_index(index),
+    m_client(client),
+    m_transport(&m_port),
+    m_vxi_server(m_awg,
+                 rpc::VXI_PORT_START + index * bench_port_stride,
+                 rpc::VXI_PORT_END + index * bench_port_stride,
+                 rpc::VXI_ABORT_PORT + index * bench_port_stride),
+    m_running(false),
+    m_offer(0),
+    m_offered(0),
+    m_taken(0),
+    m_taken_ms(0)
+{
+  snprintf(m_device, sizeof(m_device), "%s", device ? device : "");
+
+  m_awg.trace(&m_trace);
+  m_vxi_server.trace(&m_trace);
+}
+
+void Bench::start ( int cpu, DEBUG::db_filter filter )
+{
+  if ( m_running )
+  {
+    return;
+  }
+
+  m_running = true;
+  m_thread = std::thread(&Bench::run, this, filter);
+
+  if ( cpu >= 0 )
+  {
+    cpu_set_t   cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+
+    if ( pthread_setaffinity_np(m_thread.native_handle(), sizeof(cpus), &cpus) != 0 )
+    {
+      fprintf(stderr, "Unable to pin bench %d to cpu %d\n", m_index, cpu);
+    }
+  }
+}
+
+void Bench::stop ()
+{
+  m_running = false;
+
+  if ( m_thread.joinable() )
+  {
+    m_thread.join();
+  }
+
+  m_offer = 0;
+  m_offered = 0;
+}
+
+void Bench::offer ()
+{
+  uint32_t  port = m_vxi_server.allocate();
+
+  if ( m_offered != 0 && m_offer.load(std::memory_order_acquire) != m_offered )
+  {
+    m_taken = m_offered;    // handed out by the bind side
+    m_taken_ms = millis();
+    m_offered = 0;
+  }
+
+  /*  The port taken is not offered again until the link on it has
+      been served (when the VXI_Server moves on to its next port),
+      unless the scope that took it does not come.  */
+
+  if ( port == m_taken && millis() - m_taken_ms < bench_offer_timeout_ms )
+  {
+    port = 0;
+  }
+
+  if ( port != m_offered )
+  {
+    uint32_t  expected = m_offered;
+
+    // only the bind side changes the offer meanwhile, and only by taking it
+
+    if ( m_offer.compare_exchange_strong(expected, port, std::memory_order_acq_rel) )
+    {
+      m_offered = port;
+    }
+    else
+    {
+      m_taken = m_offered;
+      m_taken_ms = millis();
+      m_offered = 0;
+    }
+  }
+}
+
+void Bench::poll_abort ()
+{
+  if ( current )
+  {
+    current->m_vxi_server.poll_abort();
+  }
+}
+
+/*!
+  Everything that opens a socket or the serial device is done
+  here, so that the descriptors belong to the event_loop of this
+  thread. The rest follows setup() and loop() in espBode.ino.
+*/
+void Bench::run ( DEBUG::db_filter filter )
+{
+  current = this;
+
+  Debug.Via_Serial();
+  Debug.Filter(filter);
+
+  if ( m_transport == &m_port && ! m_port.open(m_device, m_awg.baud_rate()) )
+  {
+    // the Serial_Port keeps trying to re-open the device
+
+    Debug.Error() << "Bench " << m_index << ": AWG on " << m_device << " not yet available\n";
+  }
+
+  m_awg.transport(*m_transport);
+  m_awg.wait_hook(poll_abort);    // answer a device_abort while waiting for the AWG
+  m_vxi_server.begin();
+
+  Debug.Progress() << "Bench " << m_index << " running for " << ( (uint32_t) m_client ? m_client.toString() : String("any scope") ) << "\n";
+
+  while ( m_running )
+  {
+    offer();
+
+    event_loop.wait(bench_idle_timeout_ms);
+
+    m_awg.loop();
+    m_vxi_server.loop();
+  }
+
+  m_offer = 0;
+
+  current = NULL;
+}
+
+
+bool Bench_Bind_Server::available ()
+{
+  for ( Bench * bench : m_benches )
+  {
+    if ( bench->offered() )
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+uint32_t Bench_Bind_Server::allocate ( IPAddress client )
+{
+  // a bench assigned to the client takes precedence over one that serves any client
+
+  for ( int b_exact = 1; b_exact >= 0; b_exact-- )
+  {
+    for ( Bench * bench : m_benches )
+    {
+      if ( bench->serves(client, b_exact) )
+      {
+        uint32_t  port = bench->allocate();
+
+        if ( port == 0 )
+        {
+          Debug.Error() << "bench " << bench->index() << " is busy; ";
+        }
+
+        return port;
+      }
+    }
+  }
+
+  Debug.Error() << "no bench for " << client.toString() << "; ";
+
+  return 0;
+}
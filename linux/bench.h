@@ -0,0 +1,196 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*!
+  @file   bench.h
+  @brief  Declaration of the Bench and Bench_Bind_Server classes.
+*/
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "Arduino.h"
+#include "ESP8266WiFi.h"
+#include "serial_port.h"
+#include "debug.h"
+#include "rpc_bind_server.h"
+#include "vxi_server.h"
+#include "awg_fy6900.h"
+
+/*!
+  @brief  Distance between the port blocks of consecutive benches.
+
+  Bench n uses abort port rpc::VXI_ABORT_PORT + n * bench_port_stride
+  and VXI ports rpc::VXI_PORT_START .. rpc::VXI_PORT_END plus the same
+  offset, so that bench 0 uses the same ports as the ESP-01.
+*/
+const uint32_t  bench_port_stride = 20;
+
+/*!
+  @brief  One scope / AWG pair served by its own worker thread.
+
+  A Bench holds everything that espBode.ino creates for its single
+  pair: the AWG_Server, the serial device it is reached through, and
+  the VXI_Server with its own block of ports. start() runs the bench
+  in a worker thread, optionally pinned to one processor, with its
+  own event_loop, Debug, and packet_pool (see BENCH_LOCAL in
+  utilities.h); nothing is shared with the other benches, so no
+  locks are needed.
+
+  The only state shared with another thread is the port offered for
+  the next link (see allocate()), which the RPC_Bind_Server on the
+  main thread hands out to the scope whose address matches client().
+  An offer is good for one link: the bind side takes it, and the
+  worker offers a port again once that link has been served (or
+  after bench_offer_timeout_ms, if the scope never connected).
+
+  The AWG and VXI_Server may be configured (e.g., retry(), settling(),
+  write_behind()) through awg() and vxi_server() before start().
+*/
+class Bench
+{
+  public:
+
+    /*!
+      @brief  Constructor sets up the bench; nothing is opened until start().
+
+      @param  index   Number of the bench (from 0), which selects its port block
+      @param  device  The serial device of the AWG, e.g., /dev/ttyUSB0 (NULL if transport() is used)
+      @param  client  Address of the scope served by this bench (0 = any scope not served by another bench)
+    */
+    Bench ( int index, const char * device, IPAddress client );
+
+    /*!
+      @brief  Destructor stops the worker thread.
+    */
+    ~Bench ()
+      { stop(); }
+
+    /*!
+      @brief  Reach the AWG through a Stream other than a serial device (e.g., an emulator).
+
+      @param  port  The Stream to use; it is used only by the worker thread.
+    */
+    void          transport ( Stream & port )
+      { m_transport = &port; }
+
+    /*!
+      @brief  Start the worker thread.
+
+      @param  cpu     Processor to pin the thread to, or -1 to let it run on any
+      @param  filter  The Debug filter to use in the worker thread
+    */
+    void          start ( int cpu, DEBUG::db_filter filter );
+
+    /*!
+      @brief  Stop the worker thread and wait for it to end.
+    */
+    void          stop ();
+
+    /*!
+      @brief  Take the port offered for a new link to this bench.
+
+      The port is handed out only once (see offered()). This and
+      offered() are the only methods that may be called from
+      another thread while the bench is running.
+
+      @return The VXI port if the bench is free, else 0.
+    */
+    uint32_t      allocate ()
+      { return m_offer.exchange(0, std::memory_order_acq_rel); }
+
+    /*!
+      @brief  Check whether the bench offers a port, without taking it.
+    */
+    bool          offered ()
+      { return m_offer.load(std::memory_order_acquire) != 0; }
+
+    /*!
+      @brief  Check whether this bench serves a given scope.
+
+      @param  scope   The address of the scope
+      @param  b_exact True to match only a bench assigned to that address
+    */
+    bool          serves ( IPAddress scope, bool b_exact )
+      { return (uint32_t) m_client == (uint32_t) scope || ( ! b_exact && (uint32_t) m_client == 0 ); }
+
+    int           index ()          ///< @return The number of the bench
+      { return m_index; }
+
+    IPAddress     client ()         ///< @return The address of the scope served (0 = any)
+      { return m_client; }
+
+    AWG_FY6900 &  awg ()            ///< @return The AWG of the bench (configure before start())
+      { return m_awg; }
+
+    VXI_Server &  vxi_server ()     ///< @return The VXI_Server of the bench (configure before start())
+      { return m_vxi_server; }
+
+  private:
+
+    /*!
+      @brief  The main loop of the worker thread.
+    */
+    void          run ( DEBUG::db_filter filter );
+
+    static void   poll_abort ();
+
+    /*!
+      @brief  Offer the port of the VXI_Server for the next link, if it is ready (worker side).
+    */
+    void          offer ();
+
+    static thread_local Bench *   current;    ///< The bench served by the calling thread (for the AWG wait hook)
+
+    int                     m_index;          ///< Number of the bench
+    char                    m_device[64];     ///< The serial device of the AWG
+    IPAddress               m_client;         ///< Address of the scope served (0 = any)
+    Serial_Port             m_port;           ///< The serial connection to the AWG
+    Stream *                m_transport;      ///< The Stream through which the AWG is reached
+    Trace_Recorder          m_trace;          ///< The trace of the bench (summarized at each DESTROY_LINK)
+    AWG_FY6900              m_awg;            ///< The AWG
+    VXI_Server              m_vxi_server;     ///< The VXI_Server, with the port block of this bench
+    std::thread             m_thread;         ///< The worker thread
+    std::atomic<bool>       m_running;        ///< Cleared to end the worker thread
+    std::atomic<uint32_t>   m_offer;          ///< Port offered for the next link, or 0 if busy or taken
+    uint32_t                m_offered;        ///< The port last offered (worker side), or 0
+    uint32_t                m_taken;          ///< The port last taken by a bind request (worker side), or 0
+    uint32_t                m_taken_ms;       ///< Time (millis) at which m_taken was taken
+};
+
+/*!
+  @brief  An RPC_Bind_Server that routes each scope to its own bench.
+
+  A request is routed by the address it comes from: to the bench
+  assigned to that address if there is one, else to a bench that
+  serves any address. As on the ESP-01, requests are left waiting
+  (not read) while every bench is busy; since the address is only
+  known once a request has been read, a request whose bench is busy
+  while another is free fails instead, and the scope will try again.
+  The same holds if no bench serves the address.
+*/
+class Bench_Bind_Server : public RPC_Bind_Server
+{
+  public:
+
+    /*!
+      @brief  Add a bench to which requests can be routed.
+    */
+    void    add ( Bench & bench )
+      { m_benches.push_back(&bench); }
+
+  protected:
+
+    /*!
+      @brief  Check whether any bench offers a port for the next link (see Bench::offered()).
+    */
+    virtual bool      available ();
+
+    virtual uint32_t  allocate ( IPAddress client );
+
+  private:
+
+    std::vector<Bench *>  m_benches;    ///< The benches, in the order added
+};
+
+#endif
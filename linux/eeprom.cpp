@@ -0,0 +1,61 @@
+/*!
+  @file   eeprom.cpp
+  @brief  Definitions of the EEPROMClass methods for Linux.
+*/
+
+#include "EEPROM.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+EEPROMClass   EEPROM;
+
+
+const char * EEPROMClass::file ()
+{
+  const char *  name = getenv("ESPBODE_EEPROM");
+
+  return name ? name : "espbode.eeprom";
+}
+
+
+void EEPROMClass::begin ( size_t size )
+{
+  FILE *  f = fopen(file(), "rb");
+
+  m_data.assign(size, 0xFF);    // as erased flash
+  m_b_dirty = false;
+
+  if ( f )
+  {
+    size_t  n = fread(m_data.data(), 1, size, f);
+
+    (void) n;     // a short file leaves the rest erased
+    fclose(f);
+  }
+}
+
+
+bool EEPROMClass::commit ()
+{
+  FILE *  f;
+  bool    b_ok;
+
+  if ( ! m_b_dirty )
+  {
+    return true;
+  }
+
+  f = fopen(file(), "wb");
+
+  if ( f == NULL )
+  {
+    return false;
+  }
+
+  b_ok = ( fwrite(m_data.data(), 1, m_data.size(), f) == m_data.size() );
+  b_ok = ( fclose(f) == 0 ) && b_ok;
+
+  m_b_dirty = ! b_ok;
+
+  return b_ok;
+}
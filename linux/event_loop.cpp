@@ -0,0 +1,152 @@
+/*!
+  @file   event_loop.cpp
+  @brief  Definitions of the Event_Loop methods.
+*/
+
+#include "event_loop.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+thread_local Event_Loop  event_loop;    ///< Instance of Event_Loop used by the sockets and serial port opened in each thread
+
+const int   max_events = 16;    ///< Largest number of events taken from epoll at once
+
+
+Event_Loop::~Event_Loop ()
+{
+  if ( m_epoll >= 0 )
+  {
+    close(m_epoll);
+  }
+}
+
+bool Event_Loop::open ()
+{
+  if ( m_epoll < 0 )
+  {
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+
+    if ( m_epoll < 0 )
+    {
+      perror("epoll_create1");
+    }
+  }
+
+  return m_epoll >= 0;
+}
+
+void Event_Loop::add ( int fd )
+{
+  struct epoll_event  event = {};
+
+  if ( ! open() )
+  {
+    return;
+  }
+
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+
+  epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event);
+}
+
+void Event_Loop::remove ( int fd )
+{
+  if ( m_epoll >= 0 )
+  {
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, NULL);
+  }
+}
+
+void Event_Loop::wait ( int timeout_ms )
+{
+  struct epoll_event  events[max_events];
+
+  if ( ! open() )
+  {
+    return;
+  }
+
+  /*  The events themselves are not needed: each server checks its
+      own sockets when its loop() runs.  */
+
+  epoll_wait(m_epoll, events, max_events, m_wake ? 0 : timeout_ms);
+
+  m_wake = false;
+}
+
+void Event_Loop::wait_us ( uint32_t timeout_us )
+{
+  struct pollfd   pfd;
+  struct timespec timeout;
+
+  if ( m_wake || ! open() )
+  {
+    m_wake = false;
+    return;
+  }
+
+  /*  epoll_wait() counts only whole milliseconds, so wait on the
+      epoll descriptor itself (which becomes readable when any of
+      the watched descriptors has input) with ppoll() instead.  */
+
+  pfd.fd = m_epoll;
+  pfd.events = POLLIN;
+
+  timeout.tv_sec = timeout_us / 1000000;
+  timeout.tv_nsec = ( timeout_us % 1000000 ) * 1000;
+
+  ppoll(&pfd, 1, &timeout, NULL);
+}
+
+
+Doorbell::Doorbell ()
+{
+  m_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if ( m_fd < 0 )
+  {
+    perror("eventfd");
+  }
+}
+
+Doorbell::~Doorbell ()
+{
+  if ( m_fd >= 0 )
+  {
+    close(m_fd);
+  }
+}
+
+void Doorbell::attach ()
+{
+  if ( m_fd >= 0 )
+  {
+    event_loop.add(m_fd);
+  }
+}
+
+void Doorbell::ring ()
+{
+  uint64_t  one = 1;
+
+  if ( m_fd >= 0 && write(m_fd, &one, sizeof(one)) < 0 )
+  {
+    // the counter is already non-zero, so the thread will wake anyway
+  }
+}
+
+void Doorbell::clear ()
+{
+  uint64_t  count;
+
+  if ( m_fd >= 0 && read(m_fd, &count, sizeof(count)) < 0 )
+  {
+    // nothing was rung
+  }
+}
@@ -0,0 +1,138 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+/*!
+  @file   event_loop.h
+  @brief  Declaration of the Event_Loop class.
+*/
+
+#include <stdint.h>
+
+/*!
+  @brief  Waits for input on any of the daemon's file descriptors.
+
+  espBode is written as a set of servers whose loop() methods poll
+  for work. On the ESP8266, the main loop simply runs continuously.
+  On Linux, every socket and the serial port is registered with an
+  epoll instance, and the main loop (and yield()) waits in epoll
+  until one of them has input or a timeout expires, so that the
+  daemon sleeps while there is nothing to do.
+
+  Descriptors are watched for input only (level-triggered); the
+  servers still do the actual reading when their loop() runs. Since
+  the sockets and the serial port read ahead into their own buffers
+  (e.g., a request that arrives while the previous response is being
+  sent), they call wake() when they do, so that the next wait does
+  not sleep while input is waiting in a buffer instead of in the
+  kernel.
+
+  Each thread has its own event_loop, so that a bench served by a
+  worker thread (see bench.h) waits only for its own sockets and
+  serial port; a descriptor belongs to the loop of the thread that
+  opened it.
+*/
+class Event_Loop
+{
+  public:
+
+    /*!
+      @brief  Constructor does not create the epoll instance until it is first needed.
+    */
+    Event_Loop ()
+      : m_epoll(-1), m_wake(false)
+      {}
+
+    ~Event_Loop ();
+
+    /*!
+      @brief  Start watching a file descriptor for input.
+
+      @param  fd    The file descriptor (a socket or the serial port).
+    */
+    void  add ( int fd );
+
+    /*!
+      @brief  Stop watching a file descriptor.
+
+      A descriptor is removed automatically when it is closed, so this
+      is needed only if it stays open.
+
+      @param  fd    The file descriptor.
+    */
+    void  remove ( int fd );
+
+    /*!
+      @brief  Wait until input arrives or the timeout expires.
+
+      @param  timeout_ms  The longest time to wait in milliseconds.
+    */
+    void  wait ( int timeout_ms );
+
+    /*!
+      @brief  Wait until input arrives or the (short) timeout expires.
+
+      @param  timeout_us  The longest time to wait in microseconds.
+    */
+    void  wait_us ( uint32_t timeout_us );
+
+    /*!
+      @brief  Make the next wait return at once.
+
+      Called when input has been read into a buffer, where epoll
+      cannot see it.
+    */
+    void  wake ()
+      { m_wake = true; }
+
+  private:
+
+    /*!
+      @brief  Create the epoll instance if it does not yet exist.
+
+      @return True if the epoll instance exists.
+    */
+    bool  open ();
+
+    int   m_epoll;    ///< The epoll file descriptor, or -1
+    bool  m_wake;     ///< True if the next wait must not sleep
+};
+
+/*!
+  @brief  Wakes the event_loop of another thread.
+
+  A Doorbell is an eventfd that one thread watches in its event_loop
+  (see attach()) and any other thread may ring(), e.g., so that a
+  consumer task sleeping in its event_loop wakes up as soon as work
+  has been queued for it. The watching thread clear()s it before it
+  looks for the work.
+*/
+class Doorbell
+{
+  public:
+
+    Doorbell ();
+    ~Doorbell ();
+
+    /*!
+      @brief  Watch the doorbell in the event_loop of the calling thread.
+    */
+    void  attach ();
+
+    /*!
+      @brief  Wake the thread that watches the doorbell (any thread).
+    */
+    void  ring ();
+
+    /*!
+      @brief  Reset the doorbell, so that the next wait sleeps again.
+    */
+    void  clear ();
+
+  private:
+
+    int   m_fd;     ///< The eventfd, or -1
+};
+
+extern thread_local Event_Loop  event_loop;   ///< Instance of Event_Loop for each thread, defined in event_loop.cpp
+
+#endif
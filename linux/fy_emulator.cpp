@@ -0,0 +1,272 @@
+/*!
+  @file   fy_emulator.cpp
+  @brief  Definitions of the FY_Emulator methods.
+*/
+
+#include "fy_emulator.h"
+#include "Streaming.h"
+
+/*!
+  @brief  Number of bytes of wave data that follow DDS_WAVE (2 per point).
+*/
+const uint32_t  fy_wave_bytes = 2 * fy_arb_points;
+
+/*!
+  @brief  Multiplier applied to a value when it is read back, per parameter.
+
+  This follows the get_type and get_exponent columns of pt6900:
+  the frequency is answered as a floating point number (in micro-Hz,
+  as an integer, for the older firmware; see pt6900_legacy), the other
+  values as integers (amplitude in 10^-4 V, offset in 10^-3 V,
+  phase in 10^-3 degrees).
+*/
+const double    fy_read_scale[] = { 1, 1, 1, 1, 1e4, 1e3, 1e3 };
+
+
+void FY_Emulator::identity ( const char * model, const char * version )
+{
+  unsigned  major = 0, minor = 0;
+
+  m_model = model;
+  m_version = version;
+
+  sscanf(version + strcspn(version, "0123456789"), "%u.%u", &major, &minor);
+
+  m_b_legacy = ( strncmp(model, "FY6900", 6) != 0 || major * 100 + minor < 104 );
+}
+
+
+int FY_Emulator::lookup ( const char * table, int first, int count, char letter )
+{
+  for ( int i = first; i < count; i++ )
+  {
+    if ( table[i] == letter )
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+bool FY_Emulator::next_ready ( uint32_t & at )
+{
+  if ( m_reply.empty() )
+  {
+    return false;
+  }
+
+  at = m_reply.front().ready_us;
+
+  return true;
+}
+
+int FY_Emulator::available ()
+{
+  uint32_t  now = micros();
+  int       n = 0;
+
+  for ( const reply_byte & r : m_reply )
+  {
+    if ( (int32_t)( now - r.ready_us ) < 0 )
+    {
+      break;
+    }
+
+    n++;
+  }
+
+  return n;
+}
+
+int FY_Emulator::read ()
+{
+  int   c = peek();
+
+  if ( c >= 0 )
+  {
+    m_reply.pop_front();
+  }
+
+  return c;
+}
+
+int FY_Emulator::peek ()
+{
+  if ( m_reply.empty() || (int32_t)( micros() - m_reply.front().ready_us ) < 0 )
+  {
+    return -1;
+  }
+
+  return m_reply.front().byte;
+}
+
+size_t FY_Emulator::write ( uint8_t byte )
+{
+  uint32_t  now = micros();
+  uint32_t  elapsed = now - m_rx_at;
+
+  /*  The byte reaches the AWG once the bytes before it have crossed
+      the line, and it has crossed it itself. The backlog is kept
+      relative to the last write, so that it stays right however long
+      the line has been idle.  */
+
+  m_rx_backlog_us = ( elapsed < m_rx_backlog_us ) ? m_rx_backlog_us - elapsed : 0;
+  m_rx_backlog_us += (uint32_t) m_byte_us;
+  m_rx_at = now;
+
+  uint32_t  arrival = now + m_rx_backlog_us;
+
+  if ( m_wave_bytes > 0 )
+  {
+    if ( --m_wave_bytes == 0 )
+    {
+      m_waves++;
+      reply("HN\n", arrival);   // the wave has been stored
+    }
+
+    return 1;
+  }
+
+  if ( byte != '\n' )
+  {
+    if ( m_line_len < sizeof(m_line) - 1 )
+    {
+      m_line[m_line_len++] = byte;
+    }
+
+    return 1;
+  }
+
+  m_line[m_line_len] = 0;
+
+  if ( m_line_len > 0 )
+  {
+    command(arrival);
+  }
+
+  m_line_len = 0;
+
+  return 1;
+}
+
+void FY_Emulator::command ( uint32_t arrival_us )
+{
+  int     channel = ( m_line_len >= 3 ) ? lookup(fy_channels, 1, max_awg_channels + 1, m_line[1]) : -1;
+  int     param_id = ( m_line_len >= 3 ) ? lookup(fy_codes, 0, scpi::wave_parameter_count, m_line[2]) : -1;
+  char    answer[32];
+
+  m_commands++;
+
+  if ( strncmp(m_line, "DDS_WAVE", 8) == 0 )
+  {
+    m_wave_bytes = fy_wave_bytes;
+    reply("W\n", arrival_us);     // ready for the points
+    return;
+  }
+
+  /*  The sweep commands take no channel; their values are kept
+      on channel 1. The object (SOB) and source (SXY) are only
+      acknowledged.  */
+
+  for ( int i = scpi::SWWV_TIME; i < scpi::parameter_count; i++ )
+  {
+    if ( strncmp(m_line, fy_sweep_codes[i - scpi::SWWV_TIME], 3) == 0 )
+    {
+      m_value[1][i] = strtod(m_line + 3, NULL);
+      reply("\n", arrival_us);
+      return;
+    }
+  }
+
+  if ( strncmp(m_line, "SOB", 3) == 0 || strncmp(m_line, "SXY", 3) == 0 )
+  {
+    reply("\n", arrival_us);
+    return;
+  }
+
+  if ( strcmp(m_line, "UMO") == 0 || strcmp(m_line, "UVE") == 0 )
+  {
+    snprintf(answer, sizeof(answer), "%s\n", ( m_line[1] == 'M' ) ? m_model.c_str() : m_version.c_str());
+    reply(answer, arrival_us);
+    return;
+  }
+
+  if ( channel < 1 || param_id < 0 || ( m_line[0] != 'W' && m_line[0] != 'R' ) )
+  {
+    m_unknown++;
+    reply("\n", arrival_us);      // answered, so that the sender is not held up
+    return;
+  }
+
+  if ( m_line[0] == 'W' )
+  {
+    m_value[channel][param_id] = strtod(m_line + 3, NULL) / ( m_b_legacy && param_id == scpi::FREQUENCY ? 1e6 : 1 );
+    reply("\n", arrival_us);
+    return;
+  }
+
+  double  value = m_value[channel][param_id] * fy_read_scale[param_id];
+
+  if ( chance(m_wrong_percent) )
+  {
+    m_wrong++;
+    value += 1;     // off by one unit of the answer
+  }
+
+  if ( param_id == scpi::FREQUENCY && m_b_legacy )
+  {
+    snprintf(answer, sizeof(answer), "%.0f\n", value * 1e6);
+  }
+  else if ( param_id == scpi::FREQUENCY )
+  {
+    snprintf(answer, sizeof(answer), "%.6f\n", value);
+  }
+  else
+  {
+    snprintf(answer, sizeof(answer), "%ld\n", lround(value));
+  }
+
+  reply(answer, arrival_us);
+}
+
+void FY_Emulator::reply ( const char * text, uint32_t arrival_us )
+{
+  uint32_t  ready = arrival_us + m_ack_us;
+
+  if ( chance(m_drop_percent) )
+  {
+    m_drops++;
+    return;
+  }
+
+  if ( m_jitter_us > 0 )
+  {
+    ready += std::uniform_int_distribution<uint32_t>(0, m_jitter_us)(m_random);
+  }
+
+  if ( chance(m_slow_percent) )
+  {
+    m_slow++;
+    ready += m_slow_us;
+  }
+
+  // the reply goes out after the ack latency, once the line back is free
+
+  if ( ! m_reply.empty() && (int32_t)( m_reply.back().ready_us - ready ) > 0 )
+  {
+    ready = m_reply.back().ready_us;
+  }
+
+  for ( ; *text; text++ )
+  {
+    ready += (uint32_t) m_byte_us;
+    m_reply.push_back({ ready, (uint8_t) *text });
+  }
+}
+
+void FY_Emulator::report ( Print & out )
+{
+  out << "FY emulator: commands = " << m_commands << "; dropped = " << m_drops << "; wrong read-backs = " << m_wrong
+      << "; slow acks = " << m_slow << "; waves = " << m_waves << "; not understood = " << m_unknown << "\n";
+}
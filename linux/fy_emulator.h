@@ -0,0 +1,225 @@
+#ifndef FY_EMULATOR_H
+#define FY_EMULATOR_H
+
+/*!
+  @file   fy_emulator.h
+  @brief  Declaration of the FY_Emulator class.
+*/
+
+#include <deque>
+#include <random>
+#include <string>
+#include "Arduino.h"
+#include "awg_fy.h"
+#include "scpi.h"
+
+/*!
+  @brief  A software FY6900, for running espBode without the hardware.
+
+  The FY_Emulator answers the same serial protocol that AWG_FY::set()
+  and get() generate: W<channel><code><value> is acknowledged with a
+  newline, R<channel><code> is answered with the value in the format
+  of the FY6900 (>= 1.4 firmware, see pt6900 in awg_fy6900.cpp), and
+  DDS_WAVE<slot> is followed by the 8192 points of a wave, the
+  sweep commands (see fy_sweep_codes) are acknowledged, and UMO and
+  UVE are answered with the model and firmware (see identity()). The channel
+  and parameter letters are taken from fy_channels and fy_codes, and
+  the last value set is kept per channel and parameter, so that the
+  read-back matches (unless a wrong read-back is injected).
+
+  It is a Stream, so that an AWG_Server can use it in-process in
+  place of the serial port (see AWG_Server::transport()); the
+  fy_emulator tool serves it over a pty instead.
+
+  The timing of the real device can be imitated:
+
+    - the wire delay of each byte at the given baud rate, in
+      both directions (0 = no delay);
+    - the time the AWG takes to acknowledge a command: a fixed
+      time plus a uniformly distributed jitter, and now and then
+      (a given percentage of commands) a much slower ack, such as
+      the FY shows when it switches its output range.
+
+  Faults can be injected at a given percentage of commands: an ack
+  (or answer) that is never sent, and a read-back that does not
+  match the value set. A seed makes every run repeatable, so that
+  retries, timeouts and the learned latencies can be compared.
+
+  Replies become readable only when their time has come, so the
+  caller sees the delays through available(), as with a real port.
+*/
+class FY_Emulator : public Stream
+{
+  public:
+
+    /*!
+      @brief  Constructor starts an instant, fault-free FY6900 with all parameters 0.
+    */
+    FY_Emulator ()
+      : m_model("FY6900-60M"), m_version("V1.5.2"), m_b_legacy(false), m_byte_us(0), m_ack_us(0), m_jitter_us(0), m_slow_percent(0), m_slow_us(0),
+        m_drop_percent(0), m_wrong_percent(0), m_random(1), m_line_len(0), m_wave_bytes(0),
+        m_rx_at(0), m_rx_backlog_us(0), m_commands(0), m_drops(0), m_wrong(0), m_slow(0), m_waves(0), m_unknown(0)
+      { for ( int c = 0; c <= max_awg_channels; c++ )
+          for ( int p = 0; p < scpi::parameter_count; p++ ) m_value[c][p] = 0; }
+
+    /*!
+      @brief  Set what the emulator answers to UMO (model) and UVE (firmware version).
+
+      An FY6600 or FY6800, or an FY6900 with firmware before 1.4, takes
+      and answers the frequency in micro-Hz (see pt6900_legacy).
+
+      @param  model     The model, e.g., FY6900-60M
+      @param  version   The firmware version, e.g., V1.5.2
+    */
+    void    identity ( const char * model, const char * version );
+
+    /*!
+      @brief  Set the baud rate of the simulated serial line (0 = no wire delay).
+    */
+    void    baud_rate ( uint32_t baud )
+      { m_byte_us = baud ? 10000000.0 / baud : 0; }      // 10 bits (start, 8 data, stop) per byte
+
+    /*!
+      @brief  Set the time taken to acknowledge a command.
+
+      @param  ack_us      Fixed part of the time (microseconds)
+      @param  jitter_us   Largest random addition (uniformly distributed)
+    */
+    void    ack_latency ( uint32_t ack_us, uint32_t jitter_us = 0 )
+      { m_ack_us = ack_us;
+        m_jitter_us = jitter_us; }
+
+    /*!
+      @brief  Make some acks much slower than the rest.
+
+      @param  percent   Percentage of commands that are slow
+      @param  extra_us  Time added to the ack of a slow command
+    */
+    void    slow_acks ( double percent, uint32_t extra_us )
+      { m_slow_percent = percent;
+        m_slow_us = extra_us; }
+
+    /*!
+      @brief  Leave some commands unanswered (no ack for W, no value for R).
+
+      @param  percent   Percentage of commands whose answer is dropped
+    */
+    void    drop_acks ( double percent )
+      { m_drop_percent = percent; }
+
+    /*!
+      @brief  Answer some reads with a value other than the one set.
+
+      @param  percent   Percentage of R commands whose answer is wrong
+    */
+    void    wrong_readbacks ( double percent )
+      { m_wrong_percent = percent; }
+
+    /*!
+      @brief  Restart the random faults and delays from a given seed.
+    */
+    void    seed ( uint32_t seed )
+      { m_random.seed(seed); }
+
+    /*!
+      @brief  Read the value last set for a parameter (in the units of set(), e.g., Hz and V).
+    */
+    double  value ( uint32_t channel, uint32_t param_id )
+      { return ( channel <= max_awg_channels && param_id < scpi::parameter_count ) ? m_value[channel][param_id] : 0; }
+
+    /*!
+      @brief  Write the counters of commands and injected faults.
+
+      @param  out   The Print object to which to write the report.
+    */
+    void    report ( Print & out );
+
+    uint32_t  commands ()   ///< @return The number of commands received
+      { return m_commands; }
+
+    uint32_t  drops ()      ///< @return The number of answers dropped
+      { return m_drops; }
+
+    uint32_t  wrong ()      ///< @return The number of wrong read-backs sent
+      { return m_wrong; }
+
+    // Stream
+
+    virtual int     available ();
+    virtual int     read ();
+    virtual int     peek ();
+    virtual size_t  write ( uint8_t byte );
+
+    using Print::write;
+
+    /*!
+      @brief  Time (micros) at which the next byte of a reply becomes readable.
+
+      @return False if no reply is pending.
+    */
+    bool    next_ready ( uint32_t & at );
+
+  private:
+
+    /*!
+      @brief  A byte of a reply and the time at which it has crossed the wire.
+    */
+    struct reply_byte
+    {
+      uint32_t  ready_us;     ///< Time (micros) from which the byte may be read
+      uint8_t   byte;         ///< The byte
+    };
+
+    /*!
+      @brief  Act on a complete line that arrived at the given time.
+    */
+    void    command ( uint32_t arrival_us );
+
+    /*!
+      @brief  Queue a reply to be sent after the ack latency.
+    */
+    void    reply ( const char * text, uint32_t arrival_us );
+
+    /*!
+      @brief  Return true for the given percentage of calls.
+    */
+    bool    chance ( double percent )
+      { return percent > 0 && std::uniform_real_distribution<double>(0, 100)(m_random) < percent; }
+
+    /*!
+      @brief  Look up a letter in fy_channels (from 1) or fy_codes (from 0).
+
+      @return The channel number or parameter id, or -1 if unknown.
+    */
+    static int  lookup ( const char * table, int first, int count, char letter );
+
+    std::string       m_model;          ///< Answer to UMO
+    std::string       m_version;        ///< Answer to UVE
+    bool              m_b_legacy;       ///< True if the frequency is in micro-Hz
+    double            m_byte_us;        ///< Wire time of one byte (0 = none)
+    uint32_t          m_ack_us;         ///< Fixed part of the ack latency
+    uint32_t          m_jitter_us;      ///< Largest random part of the ack latency
+    double            m_slow_percent;   ///< Percentage of slow acks
+    uint32_t          m_slow_us;        ///< Extra time of a slow ack
+    double            m_drop_percent;   ///< Percentage of answers dropped
+    double            m_wrong_percent;  ///< Percentage of wrong read-backs
+    std::mt19937      m_random;         ///< Source of the random delays and faults
+
+    char              m_line[64];       ///< The command being received
+    size_t            m_line_len;       ///< Length of the command received so far
+    uint32_t          m_wave_bytes;     ///< Bytes of wave data still expected after DDS_WAVE
+    uint32_t          m_rx_at;          ///< Time (micros) of the last write
+    uint32_t          m_rx_backlog_us;  ///< Time the line to the AWG was still busy after the last write
+    std::deque<reply_byte>  m_reply;    ///< Reply bytes not yet read (the last one frees the line back)
+
+    double            m_value[max_awg_channels+1][scpi::parameter_count];   ///< Last value set per channel and parameter
+
+    uint32_t          m_commands;       ///< Number of commands received
+    uint32_t          m_drops;          ///< Number of answers dropped
+    uint32_t          m_wrong;          ///< Number of wrong read-backs
+    uint32_t          m_slow;           ///< Number of slow acks
+    uint32_t          m_waves;          ///< Number of waves received
+    uint32_t          m_unknown;        ///< Number of lines not understood
+};
+
+#endif
@@ -0,0 +1,457 @@
+/*!
+  @file   main.cpp
+  @brief  Main file of espBode as a Linux daemon.
+
+  This takes the place of espBode.ino: it creates the same servers,
+  but the AWG is reached through a USB-serial device instead of the
+  ESP-01 serial port, and the main loop sleeps in the event_loop
+  between passes instead of running continuously.
+
+  With one or more -b options, the daemon serves several benches
+  (scope / AWG pairs) instead: each runs in its own worker thread
+  (see bench.h), and the main thread only routes the bind requests.
+
+  With -T, the AWG_Task (see awg_task.h) runs in a thread of its own:
+  the main thread parses the SCPI commands and queues them, and the
+  AWG thread sends them to the AWG, so that the network side is never
+  held up by the serial line except where the protocol requires it.
+
+  With -c, channel 2 is served by a second AWG, on a serial device of
+  its own (see awg_composite.h): each AWG then has a thread of its own,
+  so that the commands for the two are sent in parallel.
+*/
+
+#include <getopt.h>
+#include <signal.h>
+#include "Arduino.h"
+#include "Streaming.h"
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "event_loop.h"
+#include "serial_port.h"
+#include "bench.h"
+#include "debug.h"
+#include "rpc_bind_server.h"
+#include "vxi_server.h"
+#include "telnet_server.h"
+#include "metrics_server.h"
+#include "heap_monitor.h"
+#include "serial_bridge.h"
+#include "scpi_server.h"
+#include "awg_fy_auto.h"
+#include "awg_composite.h"
+
+/*!
+  @brief  Longest time (ms) the main loop sleeps without an event.
+
+  The AWG_Server health monitor and the write-behind queue need
+  the loop to run now and then even when nothing arrives.
+*/
+const int   idle_timeout_ms = 10;
+
+// global variables
+
+Trace_Recorder  trace_recorder;               ///< Records the latest VXI requests and AWG commands
+Heap_Monitor    heap_monitor;                 ///< Samples the heap and the stack of the main loop
+AWG_FY_Auto     fy_awg[max_awg_channels];     ///< The FY AWG on -d, and the one on -c
+Serial_Port     awg_port[max_awg_channels];   ///< Their USB-serial connections
+AWG_Task        fy_task[max_awg_channels] = { fy_awg[0], fy_awg[1] };  ///< Apply the commands to each FY6900 (own thread with -c)
+Doorbell        fy_doorbell[max_awg_channels];    ///< Wake the thread of each FY6900 when commands are queued (-c)
+AWG_Composite   awg;                          ///< Routes each SCPI channel to its FY6900
+VXI_Server      vxi_server(awg);              ///< The VXI_Server
+RPC_Bind_Server rpc_bind_server(vxi_server);  ///< The RPC_Bind_Server
+Telnet_Server   telnet_server(awg, &vxi_server.awg_task(), &trace_recorder, &heap_monitor);   ///< The Telnet_Server
+Metrics_Server  metrics_server(vxi_server, rpc_bind_server, awg, &heap_monitor);  ///< Serves /metrics for Prometheus
+Serial_Bridge   serial_bridge(awg, vxi_server.awg_task());  ///< Bridges TCP port 2217 to the AWG serial line
+SCPI_Server     scpi_server(awg, vxi_server.awg_task());    ///< Serves SCPI on the raw socket port 5025
+Doorbell        awg_doorbell;                 ///< Wakes the AWG thread when commands are queued (-T)
+
+static volatile sig_atomic_t  running = 1;    ///< Cleared by SIGINT or SIGTERM to end the main loop
+
+/*!
+  @brief  Largest number of benches served by one daemon.
+
+  Each bench takes a block of bench_port_stride ports starting at 9009.
+*/
+const int   max_benches = 64;
+
+static void on_signal ( int signal )
+{
+  running = 0;
+}
+
+template <int n> static void ring_fy ()     ///< Notify hook of the AWG_Task of FY6900 n (-c)
+{
+  fy_doorbell[n].ring();
+}
+
+template <int n> static void poll_fy ()     ///< Wait hook of FY6900 n (-c)
+{
+  fy_doorbell[n].clear();
+  fy_task[n].poll();
+}
+
+static void usage ( const char * name )
+{
+  fprintf(stderr,
+          "Usage: %s [-d device [-c device] [-T] | -b device[@scope] ...] [-v level] [-w]\n"
+          "  -d device   serial device of the AWG (default /dev/ttyUSB0)\n"
+          "  -c device   serial device of a second AWG, which serves channel 2 (on its channel 1);\n"
+          "              each AWG is then sent its commands from a thread of its own\n"
+          "  -T          send the commands to the AWG from a thread of its own, fed through\n"
+          "              a lock-free queue (do not use the Telnet PASSTHROUGH command with -T)\n"
+          "  -b device[@scope]\n"
+          "              serve one more bench: the AWG on device, for the scope at\n"
+          "              address scope (or any scope not served by another bench);\n"
+          "              bench n uses ports 9009 + 20n (abort) and 9010-9019 + 20n (VXI-11),\n"
+          "              and runs in its own thread, pinned to cpu n (mod the number of cpus)\n"
+          "  -v level    debug output: 0 = none, 1 = errors (default), 2 = progress,\n"
+          "              3 = serial i/o, 4 = everything including packets\n"
+          "  -w          acknowledge writes (and read the next SCPI line) before the AWG has been\n"
+          "              updated (write-behind)\n"
+          "The AWG model and firmware are probed once and saved in the file named by $ESPBODE_EEPROM\n"
+          "(default ./espbode.eeprom); use the Telnet DETECT command to probe again.\n"
+          "Ports 111 (RPC bind), 9009 (abort), 9010-9019 (VXI-11), and, without -b, 23 (Telnet),\n"
+          "9110 (metrics), 2217 (serial bridge), and 5025 (SCPI) are used; binding to 111 and 23\n"
+          "needs root or CAP_NET_BIND_SERVICE, and rpcbind must not be running.\n",
+          name);
+}
+
+/*!
+  @brief  The main loop of an AWG thread (-T, or one per FY6900 with -c).
+
+  The serial device, if any, is opened here, so that it belongs to
+  the event_loop of this thread; whether it could be opened is
+  passed back through <opened>.
+*/
+static void run_awg_task ( AWG_Task * task, Doorbell * doorbell, Serial_Port * port, const char * device,
+                           std::promise<bool> * opened, DEBUG::db_filter filter )
+{
+  bool        b_open;
+
+  Debug.Via_Serial();
+  Debug.Filter(filter);
+
+  b_open = ( port == NULL ) || port->open(device, task->awg().baud_rate());
+  opened->set_value(b_open);
+
+  if ( ! b_open )
+  {
+    return;
+  }
+
+  doorbell->attach();
+
+  while ( running )
+  {
+    event_loop.wait(idle_timeout_ms);
+    doorbell->clear();
+
+    task->loop();
+  }
+}
+
+/*!
+  @brief  Start an AWG thread (see run_awg_task()).
+
+  @return False if its serial device could not be opened.
+*/
+static bool start_awg_task ( std::vector<std::thread> & threads, AWG_Task & task, Doorbell & doorbell,
+                             Serial_Port * port, const char * device )
+{
+  std::promise<bool>  opened;
+
+  threads.emplace_back(run_awg_task, &task, &doorbell, port, device, &opened, Debug.Filter());
+
+  return opened.get_future().get();
+}
+
+/*!
+  @brief  Stop the AWG threads.
+*/
+static void stop_awg_tasks ( std::vector<std::thread> & threads )
+{
+  running = 0;
+
+  awg_doorbell.ring();
+
+  for ( auto & doorbell : fy_doorbell )
+  {
+    doorbell.ring();
+  }
+
+  for ( auto & thread : threads )
+  {
+    thread.join();
+  }
+}
+
+/*!
+  @brief  Serve several benches, each in its own worker thread.
+
+  @param  benches         The -b arguments (device[@scope])
+  @param  b_write_behind  Whether the VXI_Servers use write-behind
+
+  @return The exit status.
+*/
+static int run_benches ( std::vector<char *> & benches, bool b_write_behind )
+{
+  std::vector<std::unique_ptr<Bench>>   bench;
+  Bench_Bind_Server                     bench_bind_server;
+  int                                   cpus = std::thread::hardware_concurrency();
+
+  for ( char * arg : benches )
+  {
+    char *      at = strchr(arg, '@');
+    IPAddress   scope;
+
+    if ( at )
+    {
+      *at = 0;
+
+      if ( ! scope.fromString(at + 1) )
+      {
+        fprintf(stderr, "Invalid scope address %s\n", at + 1);
+        return 2;
+      }
+    }
+
+    bench.emplace_back(new Bench(bench.size(), arg, scope));
+
+    /*  Configure the bench as in espBode.ino; the worker
+        thread opens the device and starts the VXI_Server.  */
+
+    bench.back()->awg().retry(2);
+    bench.back()->awg().settling(true);
+    bench.back()->awg().learn_settle(false);
+    bench.back()->vxi_server().write_behind(b_write_behind);
+    bench_bind_server.add(*bench.back());
+  }
+
+  for ( auto & b : bench )
+  {
+    b->start(cpus > 1 ? b->index() % cpus : -1, Debug.Filter());
+  }
+
+  bench_bind_server.begin();
+
+  Debug.Progress() << "espBode running " << (uint32_t) bench.size() << " benches\n";
+
+  while ( running )
+  {
+    event_loop.wait(idle_timeout_ms);
+
+    bench_bind_server.loop();
+  }
+
+  for ( auto & b : bench )
+  {
+    b->stop();
+  }
+
+  Debug.Progress() << "espBode stopped\n";
+
+  return 0;
+}
+
+int main ( int argc, char * argv[] )
+{
+  const char *              device = "/dev/ttyUSB0";
+  const char *              second_device = NULL;
+  std::vector<char *>       benches;
+  int                       level = 1;
+  bool                      b_write_behind = false;
+  bool                      b_threaded = false;
+  std::vector<std::thread>  awg_threads;
+  int                       option;
+
+  while ( ( option = getopt(argc, argv, "d:c:b:v:wTh") ) != -1 )
+  {
+    switch ( option )
+    {
+      case 'd':   device = optarg;              break;
+      case 'c':   second_device = optarg;       break;
+      case 'T':   b_threaded = true;            break;
+      case 'b':   benches.push_back(optarg);    break;
+      case 'v':   level = atoi(optarg);         break;
+      case 'w':   b_write_behind = true;        break;
+      default:    usage(argv[0]);               return 2;
+    }
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  /*  Debug output goes to the console (Serial, on Linux) rather than
+      to Telnet, so that it can be captured by a service manager.  */
+
+  Debug.Via_Serial();
+
+  switch ( level )
+  {
+    case 0:   Debug.Filter_None();        break;
+    case 1:   Debug.Filter_Error();       break;
+    case 2:   Debug.Filter_Progress();    break;
+    case 3:   Debug.Filter_Serial_IO();   break;
+    default:  Debug.Filter_All();         break;
+  }
+
+  if ( benches.size() > max_benches )
+  {
+    fprintf(stderr, "At most %d benches can be served\n", max_benches);
+    return 2;
+  }
+
+  if ( ! benches.empty() )
+  {
+    return run_benches(benches, b_write_behind);
+  }
+
+  /*  Initialize the AWG and the various servers, as in espBode.ino.
+      Both channels go to the FY6900 on -d, unless -c gives channel 2
+      an FY6900 of its own.  */
+
+  for ( int i = 0; i < max_awg_channels; i++ )
+  {
+    fy_awg[i].transport(awg_port[i]);
+    fy_awg[i].retry(2);               // validate settings with up to 2 retries
+    fy_awg[i].settling(true);         // do not complete a write until the AWG output has settled
+    fy_awg[i].learn_settle(false);    // true = extend the settle table from the measured ack timing
+    fy_awg[i].cache_slot(i);          // each AWG saves its identity in a slot of its own
+  }
+
+  /*  The AWG commands are recorded in a ring with a single writer, so
+      only the AWG on -d is traced; with -c, the one on channel 2 runs
+      in a thread of its own, and its commands are not recorded.  */
+
+  fy_awg[0].trace(&trace_recorder);   // record each AWG command and VXI request (see Telnet TRACE)
+
+  awg.attach(1, fy_task[0], 1);
+  awg.attach(2, second_device ? fy_task[1] : fy_task[0], second_device ? 1 : 2);
+  awg.transport(awg_port[0]);         // for the Serial_Bridge and the Telnet PASSTHROUGH command
+  vxi_server.trace(&trace_recorder);
+  vxi_server.write_behind(b_write_behind);
+  scpi_server.write_behind(b_write_behind);
+
+  if ( second_device )
+  {
+    /*  Each FY6900 takes its commands from the AWG_Composite through
+        an AWG_Task of its own, in a thread of its own.  */
+
+    fy_task[0].threaded(true);
+    fy_task[0].notify_hook(ring_fy<0>);
+    fy_awg[0].wait_hook(poll_fy<0>);
+    fy_task[1].threaded(true);
+    fy_task[1].notify_hook(ring_fy<1>);
+    fy_awg[1].wait_hook(poll_fy<1>);
+
+    if ( ! start_awg_task(awg_threads, fy_task[0], fy_doorbell[0], &awg_port[0], device)
+         || ! start_awg_task(awg_threads, fy_task[1], fy_doorbell[1], &awg_port[1], second_device) )
+    {
+      stop_awg_tasks(awg_threads);
+      return 1;
+    }
+  }
+
+  if ( b_threaded )
+  {
+    AWG_Task &          task = vxi_server.awg_task();
+
+    /*  The main thread waits for the AWG only through the AWG_Task;
+        both threads answer a device_abort (see AWG_Task::poll()).  */
+
+    task.threaded(true);
+    task.notify_hook([]() { awg_doorbell.ring(); });
+    task.wait_hook([]() { vxi_server.poll_abort(); });
+    awg.wait_hook([]() { awg_doorbell.clear(); vxi_server.awg_task().poll(); });
+
+    if ( ! second_device )
+    {
+      fy_awg[0].wait_hook([]() { awg_doorbell.clear(); vxi_server.awg_task().poll(); });
+    }
+
+    if ( ! start_awg_task(awg_threads, task, awg_doorbell, second_device ? NULL : &awg_port[0], device) )
+    {
+      stop_awg_tasks(awg_threads);
+      return 1;
+    }
+  }
+  else
+  {
+    if ( ! second_device )
+    {
+      if ( ! awg_port[0].open(device, fy_awg[0].baud_rate()) )
+      {
+        return 1;
+      }
+
+      fy_awg[0].wait_hook([]() { vxi_server.poll_abort(); });   // answer a device_abort while waiting for the AWG
+    }
+
+    awg.wait_hook([]() { vxi_server.poll_abort(); });
+  }
+
+  /*  Now that the serial devices are open, select the tables for
+      the model and firmware of each AWG (see AWG_FY_Auto).  */
+
+  if ( vxi_server.awg_task().claim() )
+  {
+    awg.identify(false);
+  }
+
+  vxi_server.awg_task().release();
+
+  serial_bridge.baud_hook([]( uint32_t baud ) { return awg_port[0].baud(baud); });
+
+  vxi_server.begin();
+  rpc_bind_server.begin();
+  telnet_server.begin();
+  metrics_server.begin();
+  serial_bridge.begin();
+  scpi_server.begin();
+  heap_monitor.sample_now(Heap_Monitor::SETUP);
+
+  Debug.Progress() << "espBode running; AWG on " << device;
+
+  if ( second_device )
+  {
+    Debug.Progress() << ", channel 2 on " << second_device;
+  }
+
+  Debug.Progress() << ( b_threaded ? " (own thread)" : "" ) << "\n";
+
+  while ( running )
+  {
+    /*  Wake up in time for the next step of a sweep.  */
+
+    event_loop.wait_us(std::min((uint32_t) idle_timeout_ms * 1000, scpi_server.sweep().due_us()));
+
+    if ( ! b_threaded )
+    {
+      awg.loop();     // else the AWG thread runs the health monitor
+      heap_monitor.sample(Heap_Monitor::AWG);
+    }
+
+    telnet_server.loop();
+    heap_monitor.sample(Heap_Monitor::TELNET);
+    rpc_bind_server.loop();
+    heap_monitor.sample(Heap_Monitor::BIND);
+    vxi_server.loop();
+    heap_monitor.sample(Heap_Monitor::VXI);
+    metrics_server.loop();
+    heap_monitor.sample(Heap_Monitor::METRICS);
+    serial_bridge.loop();
+    heap_monitor.sample(Heap_Monitor::BRIDGE);
+    scpi_server.loop();
+    heap_monitor.sample(Heap_Monitor::SCPI);
+  }
+
+  stop_awg_tasks(awg_threads);
+
+  Debug.Progress() << "espBode stopped\n";
+
+  return 0;
+}
@@ -0,0 +1,250 @@
+/*!
+  @file   serial_port.cpp
+  @brief  Definitions of the Serial_Port methods.
+*/
+
+#include "serial_port.h"
+#include "event_loop.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+const uint32_t  reopen_interval_ms = 1000;  ///< How often to try to re-open a failed device
+const int       write_timeout_ms = 1000;    ///< Longest wait for room to send
+
+/*!
+  @brief  Translate a baud rate into its termios speed.
+
+  @return The speed, or B0 if the baud rate is not supported.
+*/
+static speed_t termios_speed ( uint32_t baud )
+{
+  switch ( baud )
+  {
+    case 9600:    return B9600;
+    case 19200:   return B19200;
+    case 38400:   return B38400;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+    case 460800:  return B460800;
+    case 921600:  return B921600;
+    default:      return B0;
+  }
+}
+
+bool Serial_Port::open ( const char * device, uint32_t baud )
+{
+  struct termios  tio;
+  speed_t         speed = termios_speed(baud);
+
+  close();
+
+  snprintf(m_device, sizeof(m_device), "%s", device);
+  m_baud = baud;
+  m_last_attempt = millis();
+
+  if ( speed == B0 )
+  {
+    fprintf(stderr, "Unsupported baud rate %u for %s\n", baud, device);
+    return false;
+  }
+
+  m_fd = ::open(device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+  if ( m_fd < 0 )
+  {
+    fprintf(stderr, "Unable to open %s: %s\n", device, strerror(errno));
+    return false;
+  }
+
+  /*  8N1, no flow control, no echo or line editing: the AWG
+      protocol is plain bytes in both directions.  */
+
+  if ( tcgetattr(m_fd, &tio) < 0 )
+  {
+    fail("tcgetattr");
+    return false;
+  }
+
+  cfmakeraw(&tio);
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~( CSTOPB | CRTSCTS );
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+
+  if ( tcsetattr(m_fd, TCSANOW, &tio) < 0 )
+  {
+    fail("tcsetattr");
+    return false;
+  }
+
+  tcflush(m_fd, TCIOFLUSH);     // discard anything left over from before
+
+  event_loop.add(m_fd);
+
+  return true;
+}
+
+bool Serial_Port::baud ( uint32_t baud )
+{
+  struct termios  tio;
+  speed_t         speed = termios_speed(baud);
+
+  if ( speed == B0 )
+  {
+    return false;
+  }
+
+  m_baud = baud;    // also used if the device is re-opened
+
+  if ( m_fd < 0 )
+  {
+    return true;
+  }
+
+  if ( tcgetattr(m_fd, &tio) < 0 )
+  {
+    fail("tcgetattr");
+    return false;
+  }
+
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+
+  if ( tcsetattr(m_fd, TCSADRAIN, &tio) < 0 )
+  {
+    fail("tcsetattr");
+    return false;
+  }
+
+  return true;
+}
+
+void Serial_Port::close ()
+{
+  if ( m_fd >= 0 )
+  {
+    ::close(m_fd);    // this also removes it from the event_loop
+    m_fd = -1;
+  }
+
+  m_head = m_tail = 0;
+}
+
+void Serial_Port::fail ( const char * operation )
+{
+  fprintf(stderr, "%s on %s failed: %s\n", operation, m_device, strerror(errno));
+
+  close();
+}
+
+bool Serial_Port::fill ()
+{
+  if ( m_head < m_tail )
+  {
+    return true;
+  }
+
+  m_head = m_tail = 0;
+
+  if ( m_fd < 0 )
+  {
+    // try to re-open the device, but not too often
+
+    if ( m_device[0] == 0 || millis() - m_last_attempt < reopen_interval_ms || ! open(m_device, m_baud) )
+    {
+      return false;
+    }
+
+    fprintf(stderr, "%s re-opened\n", m_device);
+  }
+
+  ssize_t   n = ::read(m_fd, m_buffer, sizeof(m_buffer));
+
+  if ( n > 0 )
+  {
+    m_tail = n;
+    event_loop.wake();    // the data may not all be read before the next wait
+    return true;
+  }
+
+  if ( n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+  {
+    fail("read");
+  }
+
+  return false;
+}
+
+int Serial_Port::available ()
+{
+  return fill() ? m_tail - m_head : 0;
+}
+
+int Serial_Port::read ()
+{
+  return fill() ? m_buffer[m_head++] : -1;
+}
+
+int Serial_Port::peek ()
+{
+  return fill() ? m_buffer[m_head] : -1;
+}
+
+size_t Serial_Port::write ( uint8_t byte )
+{
+  return write(&byte, 1);
+}
+
+size_t Serial_Port::write ( const uint8_t * buffer, size_t len )
+{
+  size_t  sent = 0;
+
+  while ( m_fd >= 0 && sent < len )
+  {
+    ssize_t   n = ::write(m_fd, buffer + sent, len - sent);
+
+    if ( n > 0 )
+    {
+      sent += n;
+    }
+    else if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+    {
+      struct pollfd   pfd = { m_fd, POLLOUT, 0 };
+
+      if ( poll(&pfd, 1, write_timeout_ms) <= 0 )
+      {
+        break;
+      }
+    }
+    else if ( n < 0 && errno == EINTR )
+    {
+      continue;
+    }
+    else
+    {
+      fail("write");
+    }
+  }
+
+  return sent;
+}
+
+int Serial_Port::availableForWrite ()
+{
+  return ( m_fd >= 0 ) ? sizeof(m_buffer) : 0;
+}
+
+void Serial_Port::flush ()
+{
+  if ( m_fd >= 0 )
+  {
+    tcdrain(m_fd);
+  }
+}
@@ -0,0 +1,91 @@
+#ifndef SERIAL_PORT_H
+#define SERIAL_PORT_H
+
+/*!
+  @file   serial_port.h
+  @brief  Declaration of the Serial_Port class.
+*/
+
+#include "Arduino.h"
+
+/*!
+  @brief  A serial device (e.g., /dev/ttyUSB0) used as the transport to the AWG.
+
+  The device is opened in raw, non-blocking mode with termios, and
+  registered with the event_loop so that the daemon wakes up as soon
+  as the AWG responds. If the device fails (e.g., the USB adapter is
+  unplugged), it is closed, and available() tries to re-open it about
+  once per second; meanwhile the AWG_Server health monitor reports
+  the AWG as down, and restores its settings when it returns.
+*/
+class Serial_Port : public Stream
+{
+  public:
+
+    Serial_Port ()
+      : m_fd(-1), m_baud(0), m_last_attempt(0), m_head(0), m_tail(0)
+      { m_device[0] = 0; }
+
+    ~Serial_Port ()
+      { close(); }
+
+    /*!
+      @brief  Open the device.
+
+      @param  device  The path of the device, e.g., /dev/ttyUSB0
+      @param  baud    The baud rate (e.g., AWG_Server::baud_rate())
+
+      @return True if the device was opened and configured.
+    */
+    bool    open ( const char * device, uint32_t baud );
+
+    void    close ();
+
+    /*!
+      @brief  Change the baud rate of the open device (e.g., for the Serial_Bridge).
+
+      @return False if the rate is not supported or cannot be set.
+    */
+    bool    baud ( uint32_t baud );
+
+    bool    is_open ()
+      { return m_fd >= 0; }
+
+    virtual int     available ();
+    virtual int     read ();
+    virtual int     peek ();
+    virtual size_t  write ( uint8_t byte );
+    virtual size_t  write ( const uint8_t * buffer, size_t len );
+    virtual int     availableForWrite ();
+
+    /*!
+      @brief  Wait until all output has been transmitted.
+    */
+    virtual void    flush ();
+
+    using Print::write;
+
+  private:
+
+    /*!
+      @brief  Read whatever the device has received into the buffer.
+
+      @return True if the buffer holds data.
+    */
+    bool    fill ();
+
+    /*!
+      @brief  Close the device after an error, so that it can be re-opened.
+    */
+    void    fail ( const char * operation );
+
+    int       m_fd;               ///< The open device, or -1
+    char      m_device[64];       ///< The path of the device, kept for re-opening
+    uint32_t  m_baud;             ///< The baud rate, kept for re-opening
+    uint32_t  m_last_attempt;     ///< Time (millis) of the last attempt to re-open the device
+    uint8_t   m_buffer[256];      ///< Received data not yet read
+    size_t    m_head;             ///< Position of the next byte to read
+    size_t    m_tail;             ///< Position after the last byte received
+};
+
+#endif
@@ -0,0 +1,246 @@
+/*!
+  @file   bench_scaling.cpp
+  @brief  Measures how the multi-bench daemon scales with the number of benches.
+
+  For 1, 2, 4, ... benches (up to -n), this runs the benches as the
+  daemon does (one worker thread each, pinned to its own cpu, with
+  bind requests routed by source address), plus one client thread
+  per bench that plays the part of the scope: it asks the bind
+  server for its port from its own loopback address (127.0.0.10,
+  127.0.0.11, ...), creates a link, and sends DEV_WRITE and DEV_READ
+  requests as fast as they are answered for -t seconds.
+
+  The AWG of each bench is an FY_Emulator (see fy_emulator.h) with
+  no wire delay and no ack latency, which answers every command at
+  once, so that the serial line does not limit the rate and what is
+  measured is the work of the servers themselves.
+
+  Each bench needs two threads (worker and client), so the result
+  depends on the number of cpus; the efficiency is the total rate
+  divided by the rate of one bench times the number of benches.
+
+    bench_scaling [-n benches] [-t seconds] [-p bind_port]
+*/
+
+#include <getopt.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "Arduino.h"
+#include "event_loop.h"
+#include "debug.h"
+#include "bench.h"
+#include "vxi_client.h"
+#include "fy_emulator.h"
+
+/*!
+  @brief  Check whether a deadline (in millis) is still ahead.
+*/
+static bool before ( uint32_t deadline_ms )
+{
+  return (int32_t)( deadline_ms - millis() ) > 0;
+}
+
+/*!
+  @brief  Results of one client thread.
+*/
+struct client_result
+{
+  uint64_t  calls;        ///< Number of requests answered
+  uint64_t  errors;       ///< Number of requests that failed or returned an error
+  uint64_t  busy_us;      ///< Total time spent waiting for responses
+};
+
+/*!
+  @brief  Play the part of a scope against one bench until the deadline.
+*/
+static void run_client ( int index, uint16_t bind_port, uint32_t deadline_ms, client_result & result )
+{
+  VXI_Client  client;
+  char        source[32];
+  char        command[64];
+  char        response[128];
+  uint32_t    reason;
+  uint32_t    port = 0;
+  uint32_t    start;
+
+  result = {};
+
+  snprintf(source, sizeof(source), "127.0.0.%d", 10 + index);
+
+  // wait for the bench to start listening
+
+  while ( port == 0 && before(deadline_ms) )
+  {
+    port = client.get_port("127.0.0.1", bind_port, source);
+  }
+
+  if ( port == 0 || ! client.open("127.0.0.1", port, source) )
+  {
+    result.errors++;
+    return;
+  }
+
+  for ( uint32_t i = 0; before(deadline_ms); i++ )
+  {
+    bool  b_ok;
+
+    start = micros();
+
+    /*  A sweep step as the scope sends it: set the frequency,
+        and now and then read back the parameters.  */
+
+    if ( i % 4 == 3 )
+    {
+      b_ok = client.write("C1:BSWV?") && client.read(response, sizeof(response), reason) > 0;
+      result.calls++;
+    }
+    else
+    {
+      snprintf(command, sizeof(command), "C1:BSWV FRQ,%u", 100 + i % 1000);
+      b_ok = client.write(command);
+    }
+
+    result.busy_us += micros() - start;
+    result.calls++;
+
+    if ( ! b_ok || client.error() != rpc::NO_ERROR )
+    {
+      result.errors++;
+
+      if ( ! client.is_open() )
+      {
+        break;
+      }
+    }
+  }
+
+  client.close();
+}
+
+/*!
+  @brief  Run one step of the benchmark with a given number of benches.
+
+  @return The total number of requests answered per second.
+*/
+static double run_step ( int benches, int seconds, uint16_t bind_port, int cpus )
+{
+  std::vector<std::unique_ptr<Bench>>         bench;
+  std::vector<std::unique_ptr<FY_Emulator>>   awg;
+  std::vector<std::thread>                    clients;
+  std::vector<client_result>                  results(benches);
+  Bench_Bind_Server                           bind_server;
+  uint32_t                                    deadline_ms;
+  uint64_t                                    calls = 0, errors = 0, busy_us = 0;
+  double                                      rate;
+
+  for ( int i = 0; i < benches; i++ )
+  {
+    IPAddress   scope(127, 0, 0, 10 + i);
+
+    awg.emplace_back(new FY_Emulator());
+    bench.emplace_back(new Bench(i, NULL, scope));
+    bench.back()->transport(*awg.back());
+    bench.back()->awg().retry(0);           // no read-back: measure the servers, not the AWG protocol
+    bench.back()->awg().settling(false);
+    bind_server.add(*bench.back());
+  }
+
+  for ( int i = 0; i < benches; i++ )
+  {
+    bench[i]->start(( 2 * i ) % cpus, DEBUG::NONE);
+  }
+
+  bind_server.begin(bind_port);
+
+  deadline_ms = millis() + seconds * 1000;
+
+  for ( int i = 0; i < benches; i++ )
+  {
+    clients.emplace_back(run_client, i, bind_port, deadline_ms, std::ref(results[i]));
+
+    cpu_set_t   cpu;
+
+    CPU_ZERO(&cpu);
+    CPU_SET(( 2 * i + 1 ) % cpus, &cpu);
+    pthread_setaffinity_np(clients.back().native_handle(), sizeof(cpu), &cpu);
+  }
+
+  // the bind server runs on this thread, as in the daemon
+
+  while ( before(deadline_ms) )
+  {
+    event_loop.wait(10);
+    bind_server.loop();
+  }
+
+  for ( auto & client : clients )
+  {
+    client.join();
+  }
+
+  for ( auto & b : bench )
+  {
+    b->stop();
+  }
+
+  for ( auto & r : results )
+  {
+    calls += r.calls;
+    errors += r.errors;
+    busy_us += r.busy_us;
+  }
+
+  rate = (double) calls / seconds;
+
+  printf("%7d %12.0f %12.0f %10.1f %8llu\n",
+         benches, rate, rate / benches, calls ? (double) busy_us / calls : 0.0, (unsigned long long) errors);
+  fflush(stdout);
+
+  return rate;
+}
+
+int main ( int argc, char * argv[] )
+{
+  int       cpus = std::max(1u, std::thread::hardware_concurrency());
+  int       max_benches = std::max(1, cpus / 2);
+  int       seconds = 2;
+  uint16_t  bind_port = 10111;    // not 111, so that root is not needed
+  int       option;
+  double    single = 0;
+
+  while ( ( option = getopt(argc, argv, "n:t:p:h") ) != -1 )
+  {
+    switch ( option )
+    {
+      case 'n':   max_benches = std::max(1, atoi(optarg));    break;
+      case 't':   seconds = std::max(1, atoi(optarg));        break;
+      case 'p':   bind_port = atoi(optarg);                   break;
+      default:
+        fprintf(stderr, "Usage: %s [-n benches] [-t seconds] [-p bind_port]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  Debug.Filter_None();
+
+  printf("# %d cpus; %d s per step; requests = DEV_WRITE + DEV_READ round trips\n", cpus, seconds);
+  printf("%7s %12s %12s %10s %8s\n", "benches", "requests/s", "per bench", "mean us", "errors");
+
+  for ( int benches = 1; benches <= max_benches; benches = ( benches == max_benches ) ? benches + 1 : std::min(benches * 2, max_benches) )
+  {
+    double  rate = run_step(benches, seconds, bind_port, cpus);
+
+    if ( benches == 1 )
+    {
+      single = rate;
+    }
+    else if ( single > 0 )
+    {
+      printf("        scaling efficiency %.0f%%\n", 100 * rate / ( single * benches ));
+    }
+  }
+
+  return 0;
+}
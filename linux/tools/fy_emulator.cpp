@@ -0,0 +1,209 @@
+/*!
+  @file   fy_emulator.cpp
+  @brief  Serves an emulated FY6900 on a pseudo-terminal.
+
+  The FY_Emulator (see fy_emulator.h) is attached to the master side
+  of a pty; the slave side is a serial device that espBode (or any
+  other program) can open in place of the USB-serial port of a real
+  FY6900, e.g.:
+
+    build/fy_emulator -l /tmp/fy6900 -a 2000 -j 500 -d 1 &
+    ./espbode -d /tmp/fy6900
+
+  The options set the timing and the faults to inject:
+
+    -b baud         wire delay of the given baud rate (default 115200; 0 = none)
+    -a us           fixed ack latency (default 0)
+    -j us           largest random addition to the ack latency (default 0)
+    -s percent,us   percentage of slow acks, and their extra latency
+    -d percent      percentage of answers dropped
+    -w percent      percentage of wrong read-backs
+    -r seed         seed of the random delays and faults (default 1)
+    -m model,ver    answers to UMO and UVE (default FY6900-60M,V1.5.2)
+    -l path         also make path a symbolic link to the slave device
+
+  The name of the slave device is printed on the first line of the
+  output; the counters are printed when the emulator is stopped.
+*/
+
+#include <getopt.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "Arduino.h"
+#include "fy_emulator.h"
+
+static volatile sig_atomic_t  running = 1;    ///< Cleared by SIGINT or SIGTERM
+
+static void on_signal ( int signal )
+{
+  running = 0;
+}
+
+/*!
+  @brief  Open a pty whose slave side is in raw mode.
+
+  @param  master  Receives the master side
+  @param  slave   Receives the slave side, which is kept open so that
+                  the pty survives while no client has it open
+
+  @return The name of the slave device, or NULL on failure.
+*/
+static const char * open_pty ( int & master, int & slave )
+{
+  struct termios  tio;
+  const char *    name;
+
+  master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+
+  if ( master < 0 || grantpt(master) < 0 || unlockpt(master) < 0 || ( name = ptsname(master) ) == NULL )
+  {
+    perror("pty");
+    return NULL;
+  }
+
+  slave = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+
+  if ( slave < 0 || tcgetattr(slave, &tio) < 0 )
+  {
+    perror(name);
+    return NULL;
+  }
+
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+  return name;
+}
+
+int main ( int argc, char * argv[] )
+{
+  FY_Emulator   fy;
+  const char *  link = NULL;
+  const char *  name;
+  int           master, slave;
+  int           option;
+  double        percent;
+  unsigned      us;
+  uint32_t      ack_us = 0, jitter_us = 0;
+  char *        comma;
+
+  fy.baud_rate(115200);
+
+  while ( ( option = getopt(argc, argv, "b:a:j:s:d:w:r:l:m:h") ) != -1 )
+  {
+    switch ( option )
+    {
+      case 'b':   fy.baud_rate(atoi(optarg));             break;
+      case 'a':   ack_us = atoi(optarg);                  break;
+      case 'j':   jitter_us = atoi(optarg);               break;
+      case 'd':   fy.drop_acks(atof(optarg));             break;
+      case 'w':   fy.wrong_readbacks(atof(optarg));       break;
+      case 'r':   fy.seed(atoi(optarg));                  break;
+      case 'l':   link = optarg;                          break;
+
+      case 'm':
+
+        if ( ( comma = strchr(optarg, ',') ) == NULL )
+        {
+          fprintf(stderr, "-m needs model,version\n");
+          return 2;
+        }
+
+        *comma = 0;
+        fy.identity(optarg, comma + 1);
+        break;
+
+      case 's':
+
+        if ( sscanf(optarg, "%lf,%u", &percent, &us) != 2 )
+        {
+          fprintf(stderr, "-s needs percent,us\n");
+          return 2;
+        }
+
+        fy.slow_acks(percent, us);
+        break;
+
+      default:
+
+        fprintf(stderr, "Usage: %s [-b baud] [-a ack_us] [-j jitter_us] [-s percent,us] [-d percent] [-w percent] [-r seed] [-m model,version] [-l link]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  fy.ack_latency(ack_us, jitter_us);
+
+  if ( ( name = open_pty(master, slave) ) == NULL )
+  {
+    return 1;
+  }
+
+  if ( link )
+  {
+    unlink(link);
+
+    if ( symlink(name, link) < 0 )
+    {
+      perror(link);
+      return 1;
+    }
+  }
+
+  printf("%s\n", name);
+  fflush(stdout);
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  while ( running )
+  {
+    struct pollfd   pfd = { master, POLLIN, 0 };
+    struct timespec timeout = { 0, 100000000 };   // 100 ms when nothing is due
+    uint32_t        at;
+    uint8_t         buffer[256];
+    ssize_t         n;
+
+    // sleep until input arrives or the next reply byte is due
+
+    if ( fy.next_ready(at) )
+    {
+      int32_t   wait_us = std::max((int32_t)( at - micros() ), (int32_t) 0);
+
+      timeout = { wait_us / 1000000, ( wait_us % 1000000 ) * 1000 };
+    }
+
+    ppoll(&pfd, 1, &timeout, NULL);
+
+    while ( ( n = ::read(master, buffer, sizeof(buffer)) ) > 0 )
+    {
+      fy.write(buffer, n);
+    }
+
+    for ( n = 0; fy.available() > 0 && n < (ssize_t) sizeof(buffer); )
+    {
+      buffer[n++] = fy.read();
+    }
+
+    if ( n > 0 && ::write(master, buffer, n) < 0 )
+    {
+      perror("write");
+    }
+  }
+
+  if ( link )
+  {
+    unlink(link);
+  }
+
+  fy.report(Serial);
+
+  close(slave);
+  close(master);
+
+  return 0;
+}
@@ -0,0 +1,355 @@
+/*!
+  @file   microbench.cpp
+  @brief  Times the primitives on the hot path of a request, one by one.
+
+  The end-to-end tools (bench_scaling, vxi_load) show when a request
+  got slower, but not which part of it. This times each primitive
+  on its own, in a loop:
+
+    get_id                VXI_Server::get_id on the initiators and commands
+    parse_scpi            VXI_Server::parse_scpi on typical BSWV lines
+    process_parameters    VXI_Server::process_parameters on their parameters
+    pow10                 pow10 over its range
+    byteswap              byteswap
+    big_endian_32_t       a big_endian_32_t round trip (store and load)
+    fill_response_header  fill_response_header into a packet buffer
+    debug_dump            DEBUG::Dump of a 64-byte packet (to a DEBUG with no client)
+    awg_fy_set            AWG_FY6900::set of each parameter, with an FY_Emulator
+                          that answers at once in place of the serial port
+
+  parse_scpi and process_parameters apply the commands to an AWG
+  that does nothing, so that only the parsing is timed; since they
+  parse in place, each call first copies the line (a few ns).
+
+  Each benchmark is calibrated to run for about -t ms, then repeated
+  -r times; the output is CSV, one line per benchmark, with the best
+  and the median time per call:
+
+    benchmark,iterations,ns_min,ns_median
+
+  With -b baseline.csv (the output of an earlier run), two columns
+  are added (the best time of the baseline and the change in
+  percent), and the exit status is 1 if any benchmark is more than
+  -x percent slower than its baseline, so that a regression in one
+  primitive stands out before it shows up at the bench. The best
+  times are compared, as they are the least disturbed by the rest
+  of the system.
+
+    microbench [-t ms] [-r repeats] [-f filter] [-b baseline.csv [-x percent]]
+*/
+
+#include <getopt.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "debug.h"
+#include "utilities.h"
+#include "rpc_packets.h"
+#include "vxi_server.h"
+#include "awg_fy6900.h"
+#include "fy_emulator.h"
+
+/*!
+  @brief  Keep the compiler from optimizing away a value that is never used.
+*/
+template <typename T> static inline void keep ( const T & value )
+{
+  asm volatile ( "" : : "r,m" (value) : "memory" );
+}
+
+/*!
+  @brief  An AWG that accepts every command at once, so that the parser is timed alone.
+*/
+class Null_AWG : public AWG_Server
+{
+  public:
+
+    virtual bool    set ( uint32_t channel, uint32_t parameter, double value )
+      { keep(value); return true; }
+
+    virtual bool    get ( uint32_t channel, uint32_t parameter, double & value )
+      { value = 0; return true; }
+};
+
+/*!
+  @brief  Opens the parsing methods of the VXI_Server to the benchmarks.
+*/
+class VXI_Probe : public VXI_Server
+{
+  public:
+
+    VXI_Probe ( AWG_Server & awg )
+      : VXI_Server(awg)
+      {}
+
+    using VXI_Server::get_id;
+    using VXI_Server::parse_scpi;
+    using VXI_Server::process_parameters;
+
+    void  channel ( uint32_t c )      ///< Set the channel for process_parameters()
+      { rw_channel = c; }
+};
+
+/*!
+  @brief  The settings of a run.
+*/
+struct bench_settings
+{
+  double        target_ms;      ///< Time of each repeat
+  int           repeats;        ///< Number of repeats
+  const char *  filter;         ///< Run only the benchmarks whose name contains this, or NULL
+  std::map<std::string, double>   baseline;   ///< Best ns per call of an earlier run
+  double        threshold;      ///< Percent slower than the baseline that counts as a regression
+  int           regressions;    ///< Number of benchmarks slower than the threshold
+};
+
+/*!
+  @brief  Time a batch of calls, in ns per call.
+*/
+static double time_batch ( const std::function<void(uint32_t)> & body, uint64_t iterations )
+{
+  struct timespec start, end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for ( uint64_t i = 0; i < iterations; i++ )
+  {
+    body((uint32_t) i);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  return ( ( end.tv_sec - start.tv_sec ) * 1e9 + ( end.tv_nsec - start.tv_nsec ) ) / iterations;
+}
+
+/*!
+  @brief  Calibrate, repeat, and report one benchmark.
+
+  @param  name      Name of the benchmark (the first column)
+  @param  body      One call; its argument is the iteration number,
+                    to vary the input
+*/
+static void run ( bench_settings & settings, const char * name, const std::function<void(uint32_t)> & body )
+{
+  std::vector<double> ns;
+  uint64_t            iterations = 1;
+  double              per_call;
+
+  if ( settings.filter && ! strstr(name, settings.filter) )
+  {
+    return;
+  }
+
+  // grow the batch until it takes at least a tenth of the target, then scale to the target
+
+  while ( ( per_call = time_batch(body, iterations) ) * iterations < settings.target_ms * 1e5 )
+  {
+    iterations *= 10;
+  }
+
+  iterations = std::max((uint64_t) 1, (uint64_t)( settings.target_ms * 1e6 / per_call ));
+
+  for ( int r = 0; r < settings.repeats; r++ )
+  {
+    ns.push_back(time_batch(body, iterations));
+  }
+
+  std::sort(ns.begin(), ns.end());
+
+  double  median = ns[ns.size() / 2];
+
+  printf("%s,%llu,%.2f,%.2f", name, (unsigned long long) iterations, ns.front(), median);
+
+  if ( ! settings.baseline.empty() )
+  {
+    auto  base = settings.baseline.find(name);
+
+    if ( base != settings.baseline.end() && base->second > 0 )
+    {
+      double  change = 100 * ( ns.front() - base->second ) / base->second;
+
+      printf(",%.2f,%+.1f", base->second, change);
+
+      if ( change > settings.threshold )
+      {
+        settings.regressions++;
+      }
+    }
+    else
+    {
+      printf(",,");
+    }
+  }
+
+  printf("\n");
+  fflush(stdout);
+}
+
+/*!
+  @brief  Read the best time of each benchmark from the output of an earlier run.
+
+  @return False if the file could not be read.
+*/
+static bool read_baseline ( const char * path, std::map<std::string, double> & baseline )
+{
+  FILE *  file = fopen(path, "r");
+  char    line[256];
+
+  if ( ! file )
+  {
+    perror(path);
+    return false;
+  }
+
+  while ( fgets(line, sizeof(line), file) )
+  {
+    char    name[128];
+    double  ns_min, ns_median;
+
+    if ( sscanf(line, "%127[^,],%*u,%lf,%lf", name, &ns_min, &ns_median) == 3 )
+    {
+      baseline[name] = ns_min;
+    }
+  }
+
+  fclose(file);
+
+  return true;
+}
+
+int main ( int argc, char * argv[] )
+{
+  bench_settings  settings = { 200, 5, NULL, {}, 10, 0 };
+  int             option;
+
+  while ( ( option = getopt(argc, argv, "t:r:f:b:x:h") ) != -1 )
+  {
+    switch ( option )
+    {
+      case 't':   settings.target_ms = std::max(1.0, atof(optarg));   break;
+      case 'r':   settings.repeats = std::max(1, atoi(optarg));       break;
+      case 'f':   settings.filter = optarg;                           break;
+      case 'x':   settings.threshold = atof(optarg);                  break;
+
+      case 'b':
+
+        if ( ! read_baseline(optarg, settings.baseline) )
+        {
+          return 2;
+        }
+
+        break;
+
+      default:
+        fprintf(stderr, "Usage: %s [-t ms] [-r repeats] [-f filter] [-b baseline.csv [-x percent]]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  Debug.Filter_None();
+
+  printf("benchmark,iterations,ns_min,ns_median%s\n", settings.baseline.empty() ? "" : ",baseline_min,change_pct");
+
+  // --- the SCPI parser ---
+
+  Null_AWG    null_awg;
+  VXI_Probe   vxi(null_awg);
+
+  const char * const  words[] = { "C1", "C2", "IDN-SGLT-PRI?", "OUTP", "BSWV", "BSWV?", "ARWV", "WVDT" };
+  const char * const  lines[] = { "C1:BSWV FRQ,1000HZ",
+                                  "C1:BSWV WVTP,SINE,FRQ,1000HZ,AMP,2V,OFST,0V,PHSE,0",
+                                  "C2:OUTP ON",
+                                  "C1:BSWV?" };
+  const char * const  parameters[] = { "FRQ,1000HZ",
+                                       "WVTP,SINE,FRQ,1000HZ,AMP,2V,OFST,0V,PHSE,0",
+                                       "AMP,0.5V,OFST,-0.1V" };
+
+  run(settings, "get_id", [&] ( uint32_t i )
+  {
+    const char *  word = words[i % 8];
+
+    keep(vxi.get_id(word, word[0] == 'C' || word[0] == 'I' ? scpi::initiators : scpi::commands,
+                    word[0] == 'C' || word[0] == 'I' ? (size_t) scpi::initiator_id_cnt : (size_t) scpi::command_id_cnt));
+  });
+
+  run(settings, "parse_scpi", [&] ( uint32_t i )
+  {
+    char  line[80];
+
+    strcpy(line, lines[i % 4]);
+    vxi.parse_scpi(line);
+  });
+
+  vxi.channel(1);
+
+  run(settings, "process_parameters", [&] ( uint32_t i )
+  {
+    char  line[80];
+
+    strcpy(line, parameters[i % 3]);
+    vxi.process_parameters(line);
+  });
+
+  // --- the numeric and packet helpers ---
+
+  run(settings, "pow10", [&] ( uint32_t i )
+  {
+    keep(pow10((int)( i % 19 ) - 9));
+  });
+
+  run(settings, "byteswap", [&] ( uint32_t i )
+  {
+    keep(byteswap(i));
+  });
+
+  run(settings, "big_endian_32_t", [&] ( uint32_t i )
+  {
+    big_endian_32_t   value(i);
+
+    keep(value);
+    keep((uint32_t) value);
+  });
+
+  uint8_t   packet[PACKET_BLOCK_SIZE] = {};
+
+  run(settings, "fill_response_header", [&] ( uint32_t i )
+  {
+    fill_response_header(packet, i);
+    keep(packet);
+  });
+
+  DEBUG     dump_sink(DEBUG::VIA_TELNET, DEBUG::ALL);    // formats everything; Telnet discards it without a client
+
+  for ( int i = 0; i < 64; i++ )
+  {
+    packet[i] = i * 7;
+  }
+
+  run(settings, "debug_dump", [&] ( uint32_t i )
+  {
+    dump_sink.Packet().Dump(packet, 64);
+  });
+
+  // --- the FY command formatting, with the serial port mocked ---
+
+  FY_Emulator   fy;
+  AWG_FY6900    awg;
+  const double  values[][2] = { { scpi::FREQUENCY, 1000.5 }, { scpi::AMPLITUDE, 2.25 }, { scpi::OFFSET, -0.1 },
+                                { scpi::PHASE, 90 }, { scpi::WAVE, 0 }, { scpi::OUTPUT_ON, 1 } };
+
+  awg.transport(fy);
+  awg.retry(0);           // no read-back: time the formatting, not the protocol
+  awg.settling(false);
+
+  run(settings, "awg_fy_set", [&] ( uint32_t i )
+  {
+    const double *  v = values[i % 6];
+
+    keep(awg.set(1 + ( i / 6 ) % 2, (uint32_t) v[0], v[1] + ( i & 1 )));
+  });
+
+  return ( settings.regressions > 0 ) ? 1 : 0;
+}
@@ -0,0 +1,253 @@
+/*!
+  @file   vxi_load.cpp
+  @brief  Runs a number of simulated scopes against espBode at once.
+
+  Each scope (a thread with its own VXI_Client) plays a Bode plot
+  as fast as it is answered, one sweep point at a time, the way a
+  Siglent scope that connects for each point does:
+
+    GET_PORT          ask the bind server (UDP) for the VXI port
+    CREATE_LINK       connect to that port and create a link
+    DEV_WRITE         C1:BSWV FRQ,<frequency>
+    DEV_READ          which waits until the AWG has caught up
+    DESTROY_LINK      destroy the link and close the connection
+
+  Since the packets are built by the VXI_Client from the structures
+  in rpc_packets.h, the load generator follows any change to the
+  protocol that the servers make.
+
+  The throughput (sweep points per second) is printed each second,
+  and at the end the latency of a point (from GET_PORT to the end
+  of DESTROY_LINK) at several percentiles, together with the points
+  that could not be run and why:
+
+    bind refused      the bind server answered with an error or no
+                      port, or the connection to the port was refused
+                      (e.g., the VXI_Server is serving another scope)
+    bind timed out    no answer to GET_PORT (the bind server ignores
+                      requests while the VXI_Server is busy) or to
+                      CREATE_LINK, or the connection timed out
+    ports exhausted   the scope had no local port left to connect
+                      from (EADDRNOTAVAIL), typically because of the
+                      connections still in TIME_WAIT
+    request failed    DEV_WRITE or DEV_READ failed or returned an error
+
+    vxi_load [-n scopes] [-t seconds] [-H host] [-p bind_port] [-s source] [-w timeout_ms]
+
+  With -s, the scopes connect from consecutive addresses starting at
+  source (e.g., -s 127.0.0.10 for the benches of a multi-bench daemon
+  on loopback); otherwise they all connect from the default address.
+*/
+
+#include <getopt.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "Arduino.h"
+#include "vxi_client.h"
+
+/*!
+  @brief  Check whether a deadline (in millis) is still ahead.
+*/
+static bool before ( uint32_t deadline_ms )
+{
+  return (int32_t)( deadline_ms - millis() ) > 0;
+}
+
+/*!
+  @brief  Results of one simulated scope.
+*/
+struct scope_result
+{
+  std::vector<uint32_t>   latency_us;       ///< Latency of each point completed
+  uint64_t                refused;          ///< Binds refused
+  uint64_t                timed_out;        ///< Binds that timed out
+  uint64_t                exhausted;        ///< Connections without a local port
+  uint64_t                failed;           ///< Points whose DEV_WRITE or DEV_READ failed
+};
+
+/*!
+  @brief  Settings shared by the scopes.
+*/
+struct load_settings
+{
+  const char *  host;           ///< Address of espBode
+  uint16_t      bind_port;      ///< Port of the bind server
+  const char *  source;         ///< Address of the first scope, or NULL
+  int           timeout_ms;     ///< How long to wait for each response
+  uint32_t      deadline_ms;    ///< When to stop (millis)
+};
+
+static std::atomic<uint64_t>  points_done(0);     ///< Points completed by all scopes, for the progress lines
+
+/*!
+  @brief  Count a failure to get a port or to create a link.
+*/
+static void count_bind_failure ( scope_result & result, int error )
+{
+  switch ( error )
+  {
+    case EAGAIN:
+    case ETIMEDOUT:
+    case EINPROGRESS:       result.timed_out++;   break;
+
+    case EADDRNOTAVAIL:
+    case EADDRINUSE:        result.exhausted++;   break;
+
+    default:                result.refused++;     break;
+  }
+}
+
+/*!
+  @brief  Play the part of one scope until the deadline.
+*/
+static void run_scope ( int index, const load_settings & settings, scope_result & result )
+{
+  VXI_Client  client;
+  char        source[INET_ADDRSTRLEN] = "";
+  char        command[64];
+  char        response[128];
+  uint32_t    reason;
+
+  client.timeout(settings.timeout_ms);
+
+  if ( settings.source )
+  {
+    struct in_addr  address;
+
+    inet_pton(AF_INET, settings.source, &address);
+    address.s_addr = htonl(ntohl(address.s_addr) + index);
+    inet_ntop(AF_INET, &address, source, sizeof(source));
+  }
+
+  for ( uint32_t i = 0; before(settings.deadline_ms); i++ )
+  {
+    uint32_t  start = micros();
+    uint32_t  port = client.get_port(settings.host, settings.bind_port, settings.source ? source : NULL);
+
+    if ( port == 0 || ! client.open(settings.host, port, settings.source ? source : NULL) )
+    {
+      count_bind_failure(result, client.sys_error());
+
+      if ( client.sys_error() == EADDRNOTAVAIL )
+      {
+        delay(1);     // let some TIME_WAIT connections expire
+      }
+
+      continue;
+    }
+
+    // a sweep from 100 Hz to 100 kHz, a different point each time
+
+    snprintf(command, sizeof(command), "C1:BSWV FRQ,%u", 100 * ( 1 + ( index * 37 + i ) % 1000 ));
+
+    bool  b_ok = client.write(command) && client.error() == rpc::NO_ERROR
+                 && client.read(response, sizeof(response), reason) >= 0 && client.error() == rpc::NO_ERROR;
+
+    client.close();
+
+    if ( ! b_ok )
+    {
+      result.failed++;
+      continue;
+    }
+
+    result.latency_us.push_back(micros() - start);
+    points_done++;
+  }
+}
+
+/*!
+  @brief  Return a percentile of sorted latencies (in ms).
+*/
+static double percentile ( const std::vector<uint32_t> & sorted, double p )
+{
+  if ( sorted.empty() )
+  {
+    return 0;
+  }
+
+  return sorted[std::min(sorted.size() - 1, (size_t)( p / 100 * sorted.size() ))] / 1000.0;
+}
+
+int main ( int argc, char * argv[] )
+{
+  load_settings               settings = { "127.0.0.1", rpc::BIND_PORT, NULL, 2000, 0 };
+  int                         scopes = 4;
+  int                         seconds = 10;
+  int                         option;
+  std::vector<std::thread>    threads;
+  std::vector<scope_result>   results;
+  scope_result                total = {};
+  uint64_t                    last = 0;
+
+  while ( ( option = getopt(argc, argv, "n:t:H:p:s:w:h") ) != -1 )
+  {
+    switch ( option )
+    {
+      case 'n':   scopes = std::max(1, atoi(optarg));                 break;
+      case 't':   seconds = std::max(1, atoi(optarg));                break;
+      case 'H':   settings.host = optarg;                             break;
+      case 'p':   settings.bind_port = atoi(optarg);                  break;
+      case 's':   settings.source = optarg;                           break;
+      case 'w':   settings.timeout_ms = std::max(1, atoi(optarg));    break;
+      default:
+        fprintf(stderr, "Usage: %s [-n scopes] [-t seconds] [-H host] [-p bind_port] [-s source] [-w timeout_ms]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  printf("# %d scopes against %s (bind port %u) for %d s; point = GET_PORT, CREATE_LINK, DEV_WRITE, DEV_READ, DESTROY_LINK\n",
+         scopes, settings.host, settings.bind_port, seconds);
+  printf("%6s %10s\n", "second", "points/s");
+  fflush(stdout);
+
+  settings.deadline_ms = millis() + seconds * 1000;
+  results.resize(scopes);
+
+  for ( int i = 0; i < scopes; i++ )
+  {
+    threads.emplace_back(run_scope, i, std::cref(settings), std::ref(results[i]));
+  }
+
+  for ( int second = 1; second <= seconds; second++ )
+  {
+    delay(1000);
+
+    uint64_t  done = points_done;
+
+    printf("%6d %10llu\n", second, (unsigned long long)( done - last ));
+    fflush(stdout);
+    last = done;
+  }
+
+  for ( auto & thread : threads )
+  {
+    thread.join();
+  }
+
+  for ( auto & r : results )
+  {
+    total.latency_us.insert(total.latency_us.end(), r.latency_us.begin(), r.latency_us.end());
+    total.refused += r.refused;
+    total.timed_out += r.timed_out;
+    total.exhausted += r.exhausted;
+    total.failed += r.failed;
+  }
+
+  std::sort(total.latency_us.begin(), total.latency_us.end());
+
+  printf("points:          %zu (%.1f per second)\n", total.latency_us.size(), (double) total.latency_us.size() / seconds);
+  printf("latency ms:      p50 %.2f; p90 %.2f; p99 %.2f; p99.9 %.2f; max %.2f\n",
+         percentile(total.latency_us, 50), percentile(total.latency_us, 90), percentile(total.latency_us, 99),
+         percentile(total.latency_us, 99.9), percentile(total.latency_us, 100));
+  printf("bind refused:    %llu\n", (unsigned long long) total.refused);
+  printf("bind timed out:  %llu\n", (unsigned long long) total.timed_out);
+  printf("ports exhausted: %llu\n", (unsigned long long) total.exhausted);
+  printf("request failed:  %llu\n", (unsigned long long) total.failed);
+
+  return 0;
+}
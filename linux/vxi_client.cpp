@@ -0,0 +1,423 @@
+/*!
+  @file   vxi_client.cpp
+  @brief  Definitions of the VXI_Client methods.
+*/
+
+#include "vxi_client.h"
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+/*!
+  @brief  Length of an XDR opaque (data rounded up to a multiple of 4 bytes).
+*/
+static uint32_t xdr_length ( uint32_t len )
+{
+  return ( len + 3 ) & ~3;
+}
+
+/*!
+  @brief  Close a socket after a failure, keeping the errno of the failure.
+*/
+static void close_keeping_errno ( int fd )
+{
+  int   error = errno;
+
+  ::close(fd);
+  errno = error;
+}
+
+/*!
+  @brief  Create a socket, bound to a source address if one is given.
+
+  @return The socket, or -1 on failure.
+*/
+static int open_socket ( int type, const char * source, int timeout_ms )
+{
+  int             fd = socket(AF_INET, type | SOCK_CLOEXEC, 0);
+  struct timeval  tv = { timeout_ms / 1000, ( timeout_ms % 1000 ) * 1000 };
+
+  if ( fd < 0 )
+  {
+    return -1;
+  }
+
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  if ( source && *source )
+  {
+    struct sockaddr_in  address = {};
+
+    address.sin_family = AF_INET;
+
+    if ( inet_pton(AF_INET, source, &address.sin_addr) != 1 || bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0 )
+    {
+      close_keeping_errno(fd);
+      return -1;
+    }
+  }
+
+  return fd;
+}
+
+/*!
+  @brief  Fill in the address of espBode.
+
+  @return True if the host is a valid address.
+*/
+static bool server_address ( struct sockaddr_in & address, const char * host, uint16_t port )
+{
+  address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+
+  return inet_pton(AF_INET, host, &address.sin_addr) == 1;
+}
+
+/*!
+  @brief  Connect a TCP socket (with Nagle off, as a scope would send each request at once).
+
+  @return The socket, or -1 if it could not be connected.
+*/
+static int tcp_connect ( const char * host, uint16_t port, const char * source, int timeout_ms )
+{
+  struct sockaddr_in  address;
+  int                 fd = open_socket(SOCK_STREAM, source, timeout_ms);
+  int                 one = 1;
+
+  if ( fd < 0 )
+  {
+    return -1;
+  }
+
+  if ( ! server_address(address, host, port) || connect(fd, (struct sockaddr *) &address, sizeof(address)) < 0 )
+  {
+    close_keeping_errno(fd);
+    return -1;
+  }
+
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  return fd;
+}
+
+
+uint32_t VXI_Client::fill_request ( uint8_t * buffer, uint32_t program, uint32_t procedure )
+{
+  rpc_request_packet *  request = (rpc_request_packet *) buffer;
+
+  request->xid = ++m_xid;
+  request->msg_type = rpc::CALL;
+  request->rpc_version = 2;
+  request->program = program;
+  request->program_version = ( program == rpc::PORTMAP ) ? 2 : 1;
+  request->procedure = procedure;
+  request->credentials_l = 0;
+  request->credentials_h = 0;
+  request->verifier_l = 0;
+  request->verifier_h = 0;
+
+  return m_xid;
+}
+
+bool VXI_Client::send_all ( int fd, const uint8_t * data, uint32_t len )
+{
+  while ( len > 0 )
+  {
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+
+    if ( n <= 0 )
+    {
+      return false;
+    }
+
+    data += n;
+    len -= n;
+  }
+
+  return true;
+}
+
+bool VXI_Client::receive_all ( int fd, uint8_t * data, uint32_t len )
+{
+  while ( len > 0 )
+  {
+    ssize_t n = recv(fd, data, len, 0);
+
+    if ( n <= 0 )
+    {
+      errno = n ? errno : ECONNRESET;     // closed by the server
+      return false;
+    }
+
+    data += n;
+    len -= n;
+  }
+
+  return true;
+}
+
+uint32_t VXI_Client::call ( int fd, uint8_t * request, uint32_t len, uint8_t * response, uint32_t size )
+{
+  big_endian_32_t prefix(0x80000000 | len);
+  uint32_t        xid = ((rpc_request_packet *) request)->xid;
+  uint32_t        received = 0;
+  bool            b_last = false;
+
+  if ( ! send_all(fd, (uint8_t *) &prefix, 4) || ! send_all(fd, request, len) )
+  {
+    return 0;
+  }
+
+  /*  The response may come in several fragments; whatever
+      does not fit in the buffer is read and discarded.  */
+
+  while ( ! b_last )
+  {
+    uint32_t  fragment;
+
+    if ( ! receive_all(fd, (uint8_t *) &prefix, 4) )
+    {
+      return 0;
+    }
+
+    fragment = (uint32_t) prefix & 0x7fffffff;
+    b_last = ( (uint32_t) prefix & 0x80000000 ) != 0;
+
+    while ( fragment > 0 )
+    {
+      uint8_t   discard[256];
+      uint32_t  n = ( received < size ) ? std::min(fragment, size - received) : std::min(fragment, (uint32_t) sizeof(discard));
+
+      if ( ! receive_all(fd, received < size ? response + received : discard, n) )
+      {
+        return 0;
+      }
+
+      received += ( received < size ) ? n : 0;
+      fragment -= n;
+    }
+  }
+
+  rpc_response_packet * header = (rpc_response_packet *) response;
+
+  if ( received < sizeof(rpc_response_packet) || header->xid != xid
+       || header->reply_state != rpc::MSG_ACCEPTED || header->rpc_status != rpc::SUCCESS )
+  {
+    return 0;
+  }
+
+  return received;
+}
+
+
+uint32_t VXI_Client::get_port ( const char * host, uint16_t bind_port, const char * source )
+{
+  uint8_t               buffer[sizeof(bind_response_packet) + 32];
+  bind_request_packet * request = (bind_request_packet *) buffer;
+  struct sockaddr_in    address;
+  int                   fd = open_socket(SOCK_DGRAM, source, m_timeout_ms);
+  uint32_t              xid;
+  uint32_t              port = 0;
+
+  m_errno = ( fd < 0 ) ? errno : 0;
+
+  if ( fd < 0 )
+  {
+    return 0;
+  }
+
+  xid = fill_request(buffer, rpc::PORTMAP, rpc::GET_PORT);
+  request->getport_program = rpc::VXI_11_CORE;
+  request->getport_version = 1;
+  request->getport_protocol = 6;    // TCP
+  request->getport_port = 0;
+
+  if ( server_address(address, host, bind_port)
+       && sendto(fd, buffer, sizeof(bind_request_packet), 0, (struct sockaddr *) &address, sizeof(address)) == sizeof(bind_request_packet) )
+  {
+    bind_response_packet *  response = (bind_response_packet *) buffer;
+
+    ssize_t                 len = recv(fd, buffer, sizeof(buffer), 0);
+
+    if ( len < 0 )
+    {
+      m_errno = errno;      // e.g., EAGAIN if no answer came in time
+    }
+    else if ( len >= (ssize_t) sizeof(bind_response_packet) && response->xid == xid && response->rpc_status == rpc::SUCCESS )
+    {
+      port = response->vxi_port;
+    }
+  }
+  else
+  {
+    m_errno = errno;
+  }
+
+  ::close(fd);
+
+  return port;
+}
+
+bool VXI_Client::open ( const char * host, uint16_t port, const char * source )
+{
+  const char                instrument[] = "inst0";
+  uint8_t                   buffer[sizeof(create_request_packet) + 8];
+  create_request_packet *   request = (create_request_packet *) buffer;
+  create_response_packet *  response = (create_response_packet *) buffer;
+
+  close();
+
+  snprintf(m_host, sizeof(m_host), "%s", host);
+  snprintf(m_source, sizeof(m_source), "%s", source ? source : "");
+
+  m_fd = tcp_connect(host, port, source, m_timeout_ms);
+  m_errno = ( m_fd < 0 ) ? errno : 0;
+
+  if ( m_fd < 0 )
+  {
+    return false;
+  }
+
+  fill_request(buffer, rpc::VXI_11_CORE, rpc::VXI_11_CREATE_LINK);
+  request->client_id = 0;
+  request->lockDevice = 0;
+  request->lock_timeout = 0;
+  request->data_len = strlen(instrument);
+  memcpy(request->data, instrument, sizeof(instrument));
+
+  if ( call(m_fd, buffer, sizeof(create_request_packet) + xdr_length(strlen(instrument)), buffer, sizeof(buffer)) < sizeof(create_response_packet) )
+  {
+    m_errno = errno;
+    ::close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+
+  m_error = response->error;
+  m_link = response->link_id;
+  m_abort_port = response->abort_port;
+
+  return true;
+}
+
+void VXI_Client::close ()
+{
+  if ( m_fd >= 0 )
+  {
+    uint8_t                   buffer[sizeof(destroy_request_packet)];
+    destroy_request_packet *  request = (destroy_request_packet *) buffer;
+
+    fill_request(buffer, rpc::VXI_11_CORE, rpc::VXI_11_DESTROY_LINK);
+    request->link_id = m_link;
+
+    call(m_fd, buffer, sizeof(destroy_request_packet), buffer, sizeof(buffer));
+
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+
+bool VXI_Client::write ( const char * data, uint32_t len, bool b_end )
+{
+  std::vector<uint8_t>    buffer(sizeof(write_request_packet) + xdr_length(len), 0);
+  write_request_packet *  request = (write_request_packet *) buffer.data();
+  uint8_t                 received[sizeof(write_response_packet) + 32];
+  write_response_packet * response = (write_response_packet *) received;
+
+  if ( m_fd < 0 )
+  {
+    return false;
+  }
+
+  fill_request(buffer.data(), rpc::VXI_11_CORE, rpc::VXI_11_DEV_WRITE);
+  request->link_id = m_link;
+  request->io_timeout = m_timeout_ms;
+  request->lock_timeout = 0;
+  request->flags = b_end ? rpc::FLAG_END : 0;
+  request->data_len = len;
+  memcpy(request->data, data, len);
+
+  if ( call(m_fd, buffer.data(), buffer.size(), received, sizeof(received)) < sizeof(write_response_packet) )
+  {
+    ::close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+
+  m_error = response->error;
+
+  return true;
+}
+
+int32_t VXI_Client::read ( char * buffer, uint32_t size, uint32_t & reason )
+{
+  uint8_t                 packet[sizeof(read_request_packet) + 32];
+  read_request_packet *   request = (read_request_packet *) packet;
+  std::vector<uint8_t>    received(sizeof(read_response_packet) + xdr_length(size));
+  read_response_packet *  response = (read_response_packet *) received.data();
+  uint32_t                len;
+
+  if ( m_fd < 0 || size == 0 )
+  {
+    return -1;
+  }
+
+  fill_request(packet, rpc::VXI_11_CORE, rpc::VXI_11_DEV_READ);
+  request->link_id = m_link;
+  request->request_size = size - 1;
+  request->io_timeout = m_timeout_ms;
+  request->lock_timeout = 0;
+  request->flags = 0;
+  request->term_char = 0;
+
+  len = call(m_fd, packet, sizeof(read_request_packet), received.data(), received.size());
+
+  if ( len < sizeof(read_response_packet) )
+  {
+    ::close(m_fd);
+    m_fd = -1;
+    return -1;
+  }
+
+  m_error = response->error;
+  reason = response->reason;
+  len = std::min(std::min((uint32_t) response->data_len, len - (uint32_t) sizeof(read_response_packet)), size - 1);
+
+  memcpy(buffer, response->data, len);
+  buffer[len] = 0;
+
+  return len;
+}
+
+bool VXI_Client::abort ()
+{
+  uint8_t                 buffer[sizeof(abort_request_packet)];
+  abort_request_packet *  request = (abort_request_packet *) buffer;
+  int                     fd;
+  bool                    b_ok;
+
+  if ( m_fd < 0 || ( fd = tcp_connect(m_host, m_abort_port, m_source, m_timeout_ms) ) < 0 )
+  {
+    return false;
+  }
+
+  fill_request(buffer, rpc::VXI_11_ASYNC, rpc::VXI_11_DEVICE_ABORT);
+  request->link_id = m_link;
+
+  b_ok = call(fd, buffer, sizeof(abort_request_packet), buffer, sizeof(buffer)) >= sizeof(abort_response_packet);
+
+  if ( b_ok )
+  {
+    m_error = ((abort_response_packet *) buffer)->error;
+  }
+
+  ::close(fd);
+
+  return b_ok;
+}
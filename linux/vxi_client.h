@@ -0,0 +1,147 @@
+#ifndef VXI_CLIENT_H
+#define VXI_CLIENT_H
+
+/*!
+  @file   vxi_client.h
+  @brief  Declaration of the VXI_Client class.
+*/
+
+#include "Arduino.h"
+#include "rpc_packets.h"
+#include "rpc_enums.h"
+
+/*!
+  @brief  A blocking VXI-11 client, playing the part of the scope.
+
+  The host tools (e.g., the scaling benchmark) use this to drive
+  espBode the way a Siglent scope does: ask the bind server for the
+  port, create a link, then exchange DEV_WRITE and DEV_READ requests
+  over it. The packets are built with the same structures that the
+  servers use to parse them (see rpc_packets.h).
+
+  Each method returns false if the request could not be sent, or
+  no valid response was received; the connection is then closed.
+  The VXI-11 error code of the last response is kept in error().
+*/
+class VXI_Client
+{
+  public:
+
+    VXI_Client ()
+      : m_fd(-1), m_xid(0), m_link(0), m_abort_port(0), m_error(rpc::NO_ERROR), m_errno(0), m_timeout_ms(5000)
+      { m_host[0] = m_source[0] = 0; }
+
+    ~VXI_Client ()
+      { close(); }
+
+    /*!
+      @brief  Ask a bind server (over UDP) for the port of the VXI_Server.
+
+      @param  host      Address of espBode
+      @param  bind_port The port of the bind server (normally rpc::BIND_PORT)
+      @param  source    Address to send from (to select the bench), or NULL
+
+      @return The port, or 0 if none was given.
+    */
+    uint32_t  get_port ( const char * host, uint16_t bind_port, const char * source = NULL );
+
+    /*!
+      @brief  Connect to a VXI_Server and create a link.
+
+      @param  host      Address of espBode
+      @param  port      The port given by get_port()
+      @param  source    Address to connect from, or NULL
+
+      @return True if the link was created.
+    */
+    bool      open ( const char * host, uint16_t port, const char * source = NULL );
+
+    /*!
+      @brief  Destroy the link (if any) and close the connection.
+    */
+    void      close ();
+
+    /*!
+      @brief  Send data with DEV_WRITE.
+
+      @param  data    The data to send
+      @param  len     The length of the data
+      @param  b_end   True if this is the end of the message (the END flag)
+
+      @return True if a response was received (see error()).
+    */
+    bool      write ( const char * data, uint32_t len, bool b_end = true );
+
+    /*!
+      @brief  Send a (null-terminated) command with DEV_WRITE.
+    */
+    bool      write ( const char * command )
+      { return write(command, strlen(command)); }
+
+    /*!
+      @brief  Receive data with DEV_READ.
+
+      @param  buffer  Where to store the data; it is null-terminated
+      @param  size    The size of the buffer (request_size is one less)
+      @param  reason  Receives the reason the read ended (see rpc::reasons)
+
+      @return The length of the data, or -1 if no response was received.
+    */
+    int32_t   read ( char * buffer, uint32_t size, uint32_t & reason );
+
+    /*!
+      @brief  Send a device_abort on the abort channel.
+
+      @return True if a response was received (see error()).
+    */
+    bool      abort ();
+
+    bool      is_open ()        ///< @return True while a link is open
+      { return m_fd >= 0; }
+
+    uint32_t  error ()          ///< @return The error code of the last response (see rpc::errors)
+      { return m_error; }
+
+    int       sys_error ()      ///< @return The errno of the last failure to get a port or connect (0 if the server answered)
+      { return m_errno; }
+
+    void      timeout ( int ms ) ///< Set how long to wait for each response
+      { m_timeout_ms = ms; }
+
+  private:
+
+    /*!
+      @brief  Fill in the RPC header of a request.
+
+      @return The transaction id of the request.
+    */
+    uint32_t  fill_request ( uint8_t * buffer, uint32_t program, uint32_t procedure );
+
+    /*!
+      @brief  Send a request as one record and receive its response.
+
+      @param  fd        The connection
+      @param  request   The request (without the record prefix)
+      @param  len       The length of the request
+      @param  response  The buffer for the response
+      @param  size      The size of the response buffer
+
+      @return The length of the response, or 0 if none was received.
+    */
+    uint32_t  call ( int fd, uint8_t * request, uint32_t len, uint8_t * response, uint32_t size );
+
+    bool      send_all ( int fd, const uint8_t * data, uint32_t len );
+    bool      receive_all ( int fd, uint8_t * data, uint32_t len );
+
+    int       m_fd;           ///< The connection to the VXI_Server, or -1
+    char      m_host[64];     ///< Address of espBode (for the abort channel)
+    char      m_source[64];   ///< Address to connect from (empty = any)
+    uint32_t  m_xid;          ///< Transaction id of the last request
+    uint32_t  m_link;         ///< The link id given by CREATE_LINK
+    uint32_t  m_abort_port;   ///< The abort port given by CREATE_LINK
+    uint32_t  m_error;        ///< The error code of the last response
+    int       m_errno;        ///< The errno of the last failure of get_port() or open()
+    int       m_timeout_ms;   ///< How long to wait for each response
+};
+
+#endif
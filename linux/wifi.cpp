@@ -0,0 +1,440 @@
+/*!
+  @file   wifi.cpp
+  @brief  Definitions of the IPAddress, WiFiClient, WiFiServer, and WiFiUDP methods for Linux.
+*/
+
+#include "ESP8266WiFi.h"
+#include "WiFiUdp.h"
+#include "event_loop.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+const int   write_timeout_ms = 1000;    ///< Longest wait for room to send on a TCP connection
+
+/*!
+  @brief  Create a non-blocking socket bound to a port on all interfaces.
+
+  @param  type  SOCK_STREAM or SOCK_DGRAM
+  @param  port  The port to bind to.
+
+  @return The socket, or -1 (with the reason printed to stderr).
+*/
+static int bound_socket ( int type, uint16_t port )
+{
+  struct sockaddr_in  address = {};
+  int                 fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int                 on = 1;
+
+  if ( fd < 0 )
+  {
+    perror("socket");
+    return -1;
+  }
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+
+  if ( bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0 )
+  {
+    fprintf(stderr, "Unable to bind to port %u: %s\n", port, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+
+String IPAddress::toString () const
+{
+  struct in_addr  address;
+  char            text[INET_ADDRSTRLEN];
+
+  address.s_addr = m_address;
+
+  return String(inet_ntop(AF_INET, &address, text, sizeof(text)));
+}
+
+bool IPAddress::fromString ( const char * text )
+{
+  struct in_addr  address;
+
+  if ( inet_pton(AF_INET, text, &address) != 1 )
+  {
+    return false;
+  }
+
+  m_address = address.s_addr;
+
+  return true;
+}
+
+
+WiFiClient::connection::~connection ()
+{
+  close();
+}
+
+void WiFiClient::connection::close ()
+{
+  if ( fd >= 0 )
+  {
+    ::close(fd);    // this also removes it from the event_loop
+    fd = -1;
+  }
+}
+
+bool WiFiClient::connection::fill ()
+{
+  if ( head < tail )
+  {
+    return true;
+  }
+
+  head = tail = 0;
+
+  if ( fd < 0 )
+  {
+    return false;
+  }
+
+  ssize_t   n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+  if ( n > 0 )
+  {
+    tail = n;
+    event_loop.wake();    // the data may not all be read before the next wait
+    return true;
+  }
+
+  if ( n == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) )
+  {
+    close();    // the peer has closed the connection (or it failed)
+  }
+
+  return false;
+}
+
+WiFiClient::WiFiClient ( int fd )
+  : m_connection(std::make_shared<connection>(fd))
+{
+  event_loop.add(fd);
+}
+
+int WiFiClient::available ()
+{
+  if ( ! m_connection || ! m_connection->fill() )
+  {
+    return 0;
+  }
+
+  return m_connection->tail - m_connection->head;
+}
+
+int WiFiClient::read ()
+{
+  if ( ! m_connection || ! m_connection->fill() )
+  {
+    return -1;
+  }
+
+  return m_connection->buffer[m_connection->head++];
+}
+
+int WiFiClient::peek ()
+{
+  if ( ! m_connection || ! m_connection->fill() )
+  {
+    return -1;
+  }
+
+  return m_connection->buffer[m_connection->head];
+}
+
+size_t WiFiClient::write ( uint8_t byte )
+{
+  return write(&byte, 1);
+}
+
+size_t WiFiClient::write ( const uint8_t * buffer, size_t len )
+{
+  size_t  sent = 0;
+
+  while ( m_connection && m_connection->fd >= 0 && sent < len )
+  {
+    ssize_t   n = send(m_connection->fd, buffer + sent, len - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+    if ( n > 0 )
+    {
+      sent += n;
+    }
+    else if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+    {
+      struct pollfd   pfd = { m_connection->fd, POLLOUT, 0 };
+
+      if ( poll(&pfd, 1, write_timeout_ms) <= 0 )
+      {
+        break;    // the peer is not reading; give up on the rest
+      }
+    }
+    else if ( n < 0 && errno == EINTR )
+    {
+      continue;
+    }
+    else
+    {
+      m_connection->close();
+    }
+  }
+
+  return sent;
+}
+
+/*!
+  The room left in the send buffer of the socket, so that a caller
+  that writes no more than this is never held up by a slow peer.
+*/
+int WiFiClient::availableForWrite ()
+{
+  int         size = 0, queued = 0;
+  socklen_t   len = sizeof(size);
+
+  if ( ! m_connection || m_connection->fd < 0 )
+  {
+    return 0;
+  }
+
+  if ( getsockopt(m_connection->fd, SOL_SOCKET, SO_SNDBUF, &size, &len) < 0
+       || ioctl(m_connection->fd, SIOCOUTQ, &queued) < 0 )
+  {
+    return sizeof(m_connection->buffer);
+  }
+
+  return std::max(0, size / 2 - queued);    // the kernel doubles SO_SNDBUF for its bookkeeping
+}
+
+uint8_t WiFiClient::connected ()
+{
+  if ( ! m_connection )
+  {
+    return false;
+  }
+
+  if ( m_connection->head < m_connection->tail )
+  {
+    return true;    // unread data count as connected, as in the Arduino core
+  }
+
+  m_connection->fill();   // notices a closed connection
+
+  return m_connection->fd >= 0 || m_connection->head < m_connection->tail;
+}
+
+void WiFiClient::stop ()
+{
+  if ( m_connection )
+  {
+    m_connection->close();
+    m_connection.reset();
+  }
+}
+
+void WiFiClient::setNoDelay ( bool nodelay )
+{
+  int   on = nodelay ? 1 : 0;
+
+  if ( m_connection && m_connection->fd >= 0 )
+  {
+    setsockopt(m_connection->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+}
+
+IPAddress WiFiClient::remoteIP ()
+{
+  struct sockaddr_in  address = {};
+  socklen_t           len = sizeof(address);
+
+  if ( ! m_connection || m_connection->fd < 0 || getpeername(m_connection->fd, (struct sockaddr *) &address, &len) < 0 )
+  {
+    return IPAddress();
+  }
+
+  return IPAddress(address.sin_addr.s_addr);
+}
+
+uint16_t WiFiClient::remotePort ()
+{
+  struct sockaddr_in  address = {};
+  socklen_t           len = sizeof(address);
+
+  if ( ! m_connection || m_connection->fd < 0 || getpeername(m_connection->fd, (struct sockaddr *) &address, &len) < 0 )
+  {
+    return 0;
+  }
+
+  return ntohs(address.sin_port);
+}
+
+
+void WiFiServer::begin ( uint16_t port )
+{
+  stop();
+
+  m_port = port;
+  m_fd = bound_socket(SOCK_STREAM, port);
+
+  if ( m_fd < 0 )
+  {
+    return;
+  }
+
+  if ( listen(m_fd, 4) < 0 )
+  {
+    perror("listen");
+    stop();
+    return;
+  }
+
+  event_loop.add(m_fd);
+}
+
+void WiFiServer::stop ()
+{
+  if ( m_fd >= 0 )
+  {
+    close(m_fd);
+    m_fd = -1;
+  }
+}
+
+WiFiClient WiFiServer::accept ()
+{
+  int   fd;
+
+  if ( m_fd < 0 )
+  {
+    return WiFiClient();
+  }
+
+  fd = accept4(m_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+  if ( fd < 0 )
+  {
+    return WiFiClient();
+  }
+
+  int   on = 1;
+
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));   // responses are small and must not wait
+
+  return WiFiClient(fd);
+}
+
+
+uint8_t WiFiUDP::begin ( uint16_t port )
+{
+  stop();
+
+  m_fd = bound_socket(SOCK_DGRAM, port);
+
+  if ( m_fd < 0 )
+  {
+    return 0;
+  }
+
+  event_loop.add(m_fd);
+
+  return 1;
+}
+
+void WiFiUDP::stop ()
+{
+  if ( m_fd >= 0 )
+  {
+    close(m_fd);
+    m_fd = -1;
+  }
+}
+
+int WiFiUDP::parsePacket ()
+{
+  struct sockaddr_in  address = {};
+  socklen_t           len = sizeof(address);
+  ssize_t             n;
+
+  m_rx_len = m_rx_pos = 0;
+
+  if ( m_fd < 0 )
+  {
+    return 0;
+  }
+
+  n = recvfrom(m_fd, m_rx_buffer, sizeof(m_rx_buffer), MSG_DONTWAIT, (struct sockaddr *) &address, &len);
+
+  if ( n <= 0 )
+  {
+    return 0;
+  }
+
+  m_rx_len = n;
+  m_remote_ip = IPAddress(address.sin_addr.s_addr);
+  m_remote_port = ntohs(address.sin_port);
+
+  return n;
+}
+
+int WiFiUDP::read ( uint8_t * buffer, size_t len )
+{
+  size_t  n = std::min(len, m_rx_len - m_rx_pos);
+
+  memcpy(buffer, m_rx_buffer + m_rx_pos, n);
+  m_rx_pos += n;
+
+  return n;
+}
+
+int WiFiUDP::beginPacket ( IPAddress ip, uint16_t port )
+{
+  m_tx_ip = ip;
+  m_tx_port = port;
+  m_tx_len = 0;
+
+  return 1;
+}
+
+size_t WiFiUDP::write ( const uint8_t * buffer, size_t len )
+{
+  size_t  n = std::min(len, sizeof(m_tx_buffer) - m_tx_len);
+
+  memcpy(m_tx_buffer + m_tx_len, buffer, n);
+  m_tx_len += n;
+
+  return n;
+}
+
+int WiFiUDP::endPacket ()
+{
+  struct sockaddr_in  address = {};
+
+  if ( m_fd < 0 )
+  {
+    return 0;
+  }
+
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = m_tx_ip;
+  address.sin_port = htons(m_tx_port);
+
+  return sendto(m_fd, m_tx_buffer, m_tx_len, 0, (struct sockaddr *) &address, sizeof(address)) == (ssize_t) m_tx_len;
+}
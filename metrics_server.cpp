@@ -0,0 +1,387 @@
+/*!
+  @file   metrics_server.cpp
+  @brief  Definitions of the Metrics_Server methods.
+*/
+
+#include "metrics_server.h"
+#include <stdarg.h>
+#include "debug.h"
+
+const uint32_t  metrics_timeout_ms = 5000;    ///< Longest time a scrape may make no progress
+const int       pieces_per_loop = 8;          ///< Most pieces of the response rendered per loop()
+
+/*!
+  @brief  The stages whose latency is kept in a histogram.
+*/
+enum metrics_stage {
+  STAGE_VXI_REQUEST = 0,
+  STAGE_AWG_QUEUE   = 1,
+  STAGE_AWG_ACK     = 2,
+  STAGE_COUNT       = 3
+};
+
+const char * const  stage_names[STAGE_COUNT] = { "vxi_request", "awg_queue", "awg_ack" };
+
+const uint32_t  first_histogram_step = 14;                  ///< Steps before are the header and the counters
+const uint32_t  histogram_lines = LATENCY_BUCKETS + 3;      ///< Buckets (with +Inf), sum, and count per stage
+
+/*!
+  @brief  Format a time as seconds, without trailing zeros (e.g., 0.00025).
+
+  @param  text      Receives the text
+  @param  seconds   The whole seconds
+  @param  micro     The microseconds (0 - 999999)
+*/
+static void format_seconds ( char (&text)[24], uint32_t seconds, uint32_t micro )
+{
+  int   len = snprintf(text, sizeof(text), "%u.%06u", (unsigned) seconds, (unsigned) micro);
+
+  while ( len > 0 && text[len-1] == '0' )
+  {
+    len--;
+  }
+
+  if ( len > 0 && text[len-1] == '.' )
+  {
+    len--;
+  }
+
+  text[len] = 0;
+}
+
+
+void Metrics_Server::begin ( uint16_t port )
+{
+  m_server.begin(port);
+
+  Debug.Progress() << "Metrics server listening on port " << port << "\n";
+}
+
+
+void Metrics_Server::loop ()
+{
+  if ( m_state == IDLE )
+  {
+    m_client = m_server.accept();
+
+    if ( ! m_client )
+    {
+      return;
+    }
+
+    m_state = READING;
+    m_since = millis();
+    m_line_len = 0;
+    m_lines = 0;
+    m_b_found = false;
+  }
+
+  if ( m_state == READING )
+  {
+    if ( ! read_request() )
+    {
+      if ( ! m_client.connected() || millis() - m_since > metrics_timeout_ms )
+      {
+        close();
+      }
+
+      return;
+    }
+
+    m_state = SENDING;
+    m_step = 0;
+    m_chunk_len = 0;
+    m_chunk_sent = 0;
+  }
+
+  /*  Render a few pieces at a time, and write only what the
+      connection takes without waiting; the rest waits for the
+      next loop().  */
+
+  for ( int pieces = 0; pieces < pieces_per_loop; )
+  {
+    if ( m_chunk_sent == m_chunk_len )
+    {
+      if ( ! render() )
+      {
+        close();    // the response is complete
+        return;
+      }
+
+      pieces++;
+    }
+
+    int   room = m_client.availableForWrite();
+
+    if ( room <= 0 )
+    {
+      break;
+    }
+
+    size_t  n = m_client.write((const uint8_t *) m_chunk + m_chunk_sent, std::min((size_t) room, m_chunk_len - m_chunk_sent));
+
+    if ( n > 0 )
+    {
+      m_chunk_sent += n;
+      m_since = millis();
+    }
+
+    if ( m_chunk_sent < m_chunk_len )
+    {
+      break;
+    }
+  }
+
+  if ( ! m_client.connected() || millis() - m_since > metrics_timeout_ms )
+  {
+    close();
+  }
+}
+
+
+bool Metrics_Server::read_request ()
+{
+  /*  Only the start of the request line matters; the headers are
+      read and discarded up to the empty line that ends them.  */
+
+  while ( m_client.available() > 0 )
+  {
+    int c = m_client.read();
+
+    m_since = millis();
+
+    if ( c == '\r' )
+    {
+      continue;
+    }
+
+    if ( c != '\n' )
+    {
+      if ( m_lines == 0 && m_line_len < sizeof(m_line) - 1 )
+      {
+        m_line[m_line_len] = (char) c;
+      }
+
+      m_line_len++;
+      continue;
+    }
+
+    if ( m_lines == 0 )
+    {
+      m_line[std::min(m_line_len, sizeof(m_line) - 1)] = 0;
+      m_b_found = ( strncmp(m_line, "GET /metrics", 12) == 0 )
+                  && ( m_line[12] == ' ' || m_line[12] == '?' || m_line[12] == 0 );
+
+      Debug.Progress() << "Metrics request: " << m_line << "\n";
+    }
+
+    if ( m_line_len == 0 )
+    {
+      return true;    // the empty line after the headers
+    }
+
+    m_lines++;
+    m_line_len = 0;
+  }
+
+  return false;
+}
+
+
+bool Metrics_Server::render ()
+{
+  uint32_t  step = m_step++;
+
+  m_chunk_len = 0;
+  m_chunk_sent = 0;
+
+  if ( ! m_b_found )
+  {
+    if ( step == 0 )
+    {
+      append("HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\nOnly /metrics is served\n");
+    }
+
+    return ( step == 0 );
+  }
+
+  switch ( step )
+  {
+    case 0:
+      append("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n");
+      return true;
+
+    case 1:
+      family("espbode_vxi_links_created_total", "counter", "VXI-11 links created (CREATE_LINK)", m_vxi.links_created());
+      return true;
+
+    case 2:
+      family("espbode_vxi_links_destroyed_total", "counter", "VXI-11 links destroyed (DESTROY_LINK)", m_vxi.links_destroyed());
+      return true;
+
+    case 3:
+      append("# HELP espbode_bind_requests_total RPC bind (PORTMAP) requests received\n"
+             "# TYPE espbode_bind_requests_total counter\n"
+             "espbode_bind_requests_total{transport=\"udp\"} %u\n"
+             "espbode_bind_requests_total{transport=\"tcp\"} %u\n",
+             (unsigned) m_bind.requests(true), (unsigned) m_bind.requests(false));
+      return true;
+
+    case 4:
+      family("espbode_awg_commands_total", "counter", "Commands sent to the AWG", m_awg.commands());
+      return true;
+
+    case 5:
+      family("espbode_awg_retries_total", "counter", "Commands sent to the AWG again", m_awg.retries());
+      return true;
+
+    case 6:
+      family("espbode_awg_timeouts_total", "counter", "Responses from the AWG that timed out", m_awg.timeouts());
+      return true;
+
+    case 7:
+      family("espbode_heap_free_bytes", "gauge", "Free heap",
+             m_heap ? m_heap->last().free_heap : ESP.getFreeHeap());
+      return true;
+
+    case 8:
+      family("espbode_heap_largest_free_block_bytes", "gauge", "Largest block of the heap that can be allocated",
+             m_heap ? m_heap->last().largest_block : ESP.getMaxFreeBlockSize());
+      return true;
+
+    case 9:
+      if ( m_heap )
+      {
+        family("espbode_heap_fragmentation_percent", "gauge", "Fragmentation of the heap", m_heap->last().fragmentation);
+      }
+
+      return true;
+
+    case 10:
+      if ( m_heap )
+      {
+        low_water("espbode_heap_free_lowest_bytes", "Least free heap sampled", m_heap->lowest_heap(),
+                  m_heap->lowest_heap().free_heap);
+      }
+
+      return true;
+
+    case 11:
+      if ( m_heap )
+      {
+        low_water("espbode_heap_largest_free_block_lowest_bytes", "Smallest largest free block sampled", m_heap->lowest_block(),
+                  m_heap->lowest_block().largest_block);
+      }
+
+      return true;
+
+    case 12:
+      if ( m_heap )
+      {
+        low_water("espbode_heap_fragmentation_highest_percent", "Highest fragmentation of the heap sampled", m_heap->most_fragmented(),
+                  m_heap->most_fragmented().fragmentation);
+      }
+
+      return true;
+
+    case 13:
+      if ( m_heap )
+      {
+        low_water("espbode_stack_unused_bytes", "Stack of the main loop never used", m_heap->lowest_stack(),
+                  m_heap->lowest_stack().free_stack);
+      }
+
+      return true;
+
+    default:
+      break;
+  }
+
+  uint32_t  stage = ( step - first_histogram_step ) / histogram_lines;
+  uint32_t  line = ( step - first_histogram_step ) % histogram_lines;
+
+  switch ( stage )
+  {
+    case STAGE_VXI_REQUEST:   histogram_line(stage_names[stage], m_vxi.request_latency(), line);                break;
+    case STAGE_AWG_QUEUE:     histogram_line(stage_names[stage], m_vxi.awg_task().queue_latency(), line);       break;
+    case STAGE_AWG_ACK:       histogram_line(stage_names[stage], m_awg.ack_latency(), line);                    break;
+    default:                  return false;
+  }
+
+  return true;
+}
+
+
+void Metrics_Server::family ( const char * name, const char * type, const char * help, uint32_t value )
+{
+  append("# HELP %s %s\n# TYPE %s %s\n%s %u\n", name, help, name, type, name, (unsigned) value);
+}
+
+
+void Metrics_Server::low_water ( const char * name, const char * help, const Heap_Monitor::heap_sample & sample, uint32_t value )
+{
+  append("# HELP %s %s\n# TYPE %s gauge\n%s{server=\"%s\"} %u\n",
+         name, help, name, name, Heap_Monitor::server_name(sample.server), (unsigned) value);
+}
+
+
+void Metrics_Server::histogram_line ( const char * stage, const latency_histogram & h, int line )
+{
+  char  seconds[24];
+
+  if ( line == 0 )
+  {
+    m_cumulative = 0;
+
+    if ( stage == stage_names[0] )
+    {
+      append("# HELP espbode_stage_latency_seconds Latency of each stage of a sweep point\n"
+             "# TYPE espbode_stage_latency_seconds histogram\n");
+    }
+  }
+
+  if ( line < LATENCY_BUCKETS )
+  {
+    m_cumulative += h.bucket(line);
+    format_seconds(seconds, h.bound_us(line) / 1000000, h.bound_us(line) % 1000000);
+    append("espbode_stage_latency_seconds_bucket{stage=\"%s\",le=\"%s\"} %u\n", stage, seconds, (unsigned) m_cumulative);
+  }
+  else if ( line == LATENCY_BUCKETS )
+  {
+    m_cumulative += h.bucket(line);
+    append("espbode_stage_latency_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %u\n", stage, (unsigned) m_cumulative);
+  }
+  else if ( line == LATENCY_BUCKETS + 1 )
+  {
+    format_seconds(seconds, h.sum_ms() / 1000, ( h.sum_ms() % 1000 ) * 1000 + h.sum_us());
+    append("espbode_stage_latency_seconds_sum{stage=\"%s\"} %s\n", stage, seconds);
+  }
+  else
+  {
+    append("espbode_stage_latency_seconds_count{stage=\"%s\"} %u\n", stage, (unsigned) m_cumulative);   // the +Inf bucket
+  }
+}
+
+
+void Metrics_Server::append ( const char * format, ... )
+{
+  va_list   args;
+
+  va_start(args, format);
+
+  int   n = vsnprintf(m_chunk + m_chunk_len, sizeof(m_chunk) - m_chunk_len, format, args);
+
+  va_end(args);
+
+  if ( n > 0 )
+  {
+    m_chunk_len = std::min(m_chunk_len + n, sizeof(m_chunk) - 1);
+  }
+}
+
+
+void Metrics_Server::close ()
+{
+  m_client.stop();
+  m_state = IDLE;
+}
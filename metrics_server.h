@@ -0,0 +1,148 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+/*!
+  @file   metrics_server.h
+  @brief  Declaration of the Metrics_Server class.
+*/
+
+#include <ESP8266WiFi.h>
+#include "wifi_ext.h"
+#include "rpc_bind_server.h"
+#include "vxi_server.h"
+#include "awg_server.h"
+#include "heap_monitor.h"
+
+/*!
+  @brief  Port on which the Metrics_Server listens.
+*/
+const uint16_t  METRICS_PORT = 9110;
+
+/*!
+  @brief  Serves the counters and latency histograms over HTTP, for Prometheus.
+
+  A GET /metrics is answered with the metrics in the Prometheus text
+  format: the VXI-11 links created and destroyed, the bind requests
+  received on UDP and TCP, the AWG commands sent, retried, and timed
+  out, the heap and stack figures of the Heap_Monitor (with their
+  low-water marks, labelled with the server that ran just before
+  them; see Heap_Monitor::heap_server), and a histogram of the
+  latency of each stage a sweep point goes through:
+
+    vxi_request   time to serve a VXI-11 request (VXI_Server)
+    awg_queue     time a command waited in the AWG_Queue (AWG_Task)
+    awg_ack       time the AWG took to acknowledge a command (AWG_Server)
+
+  Anything else is answered with 404. One client is served at a time,
+  and nothing is allocated: the response is rendered a few lines at a
+  time into a small buffer, and each loop() writes only as much as the
+  connection can take without waiting, so that a slow scrape never
+  holds up a sweep. The values are read as they are rendered, so one
+  response may mix values from slightly different moments.
+*/
+class Metrics_Server
+{
+  public:
+
+    /*!
+      @brief  Constructor saves references to the servers whose metrics are served.
+
+      @param  vxi   The VXI_Server (and through it, the AWG_Task)
+      @param  bind  The RPC_Bind_Server
+      @param  awg   The AWG_Server
+      @param  heap  The Heap_Monitor whose figures are served, or NULL
+                    (the free heap and largest block are then read directly)
+    */
+    Metrics_Server ( VXI_Server & vxi, RPC_Bind_Server & bind, AWG_Server & awg, Heap_Monitor * heap = NULL )
+      : m_vxi(vxi), m_bind(bind), m_awg(awg), m_heap(heap), m_state(IDLE), m_since(0),
+        m_line_len(0), m_lines(0), m_b_found(false), m_step(0), m_cumulative(0), m_chunk_len(0), m_chunk_sent(0)
+      {}
+
+    /*!
+      @brief  Start listening.
+
+      @param  port  The port to listen on (normally METRICS_PORT)
+    */
+    void  begin ( uint16_t port = METRICS_PORT );
+
+    /*!
+      @brief  Call this at least once per main loop to serve the scrapes.
+    */
+    void  loop ();
+
+  private:
+
+    /*!
+      @brief  The progress of the connection being served.
+    */
+    enum metrics_state {
+      IDLE      = 0,    ///< No connection
+      READING   = 1,    ///< Reading the request, up to the empty line
+      SENDING   = 2     ///< Writing the response
+    };
+
+    /*!
+      @brief  Read the request as far as it has arrived.
+
+      @return True once the request is complete.
+    */
+    bool  read_request ();
+
+    /*!
+      @brief  Render the next piece of the response into m_chunk.
+
+      @return False when the response is complete.
+    */
+    bool  render ();
+
+    /*!
+      @brief  Render a counter or gauge with its HELP and TYPE lines.
+    */
+    void  family ( const char * name, const char * type, const char * help, uint32_t value );
+
+    /*!
+      @brief  Render a low-water mark of the Heap_Monitor, labelled with the server that ran before it.
+    */
+    void  low_water ( const char * name, const char * help, const Heap_Monitor::heap_sample & sample, uint32_t value );
+
+    /*!
+      @brief  Render a line of the latency histogram.
+
+      @param  stage   The label of the stage
+      @param  h       The histogram of the stage
+      @param  line    The line: a bucket (0 to LATENCY_BUCKETS), then the sum, then the count
+    */
+    void  histogram_line ( const char * stage, const latency_histogram & h, int line );
+
+    /*!
+      @brief  Append formatted text to m_chunk (as snprintf).
+    */
+    void  append ( const char * format, ... );
+
+    /*!
+      @brief  Drop the connection and wait for the next one.
+    */
+    void  close ();
+
+    VXI_Server &        m_vxi;            ///< Source of the VXI-11 metrics
+    RPC_Bind_Server &   m_bind;           ///< Source of the bind request counters
+    AWG_Server &        m_awg;            ///< Source of the AWG metrics
+    Heap_Monitor *      m_heap;           ///< Source of the heap and stack metrics, or NULL
+    WiFiServer_ext      m_server;         ///< Listens for scrapes
+    WiFiClient          m_client;         ///< The connection being served
+    metrics_state       m_state;          ///< Progress of the connection
+    uint32_t            m_since;          ///< Time (millis) of the last progress on the connection
+
+    char                m_line[24];       ///< Start of the request line (the rest is discarded)
+    size_t              m_line_len;       ///< Length of the current request line
+    uint32_t            m_lines;          ///< Number of request lines read
+    bool                m_b_found;        ///< True if the request line asked for /metrics
+
+    uint32_t            m_step;           ///< The next piece of the response to render
+    uint32_t            m_cumulative;     ///< Samples in the buckets rendered so far (histograms are cumulative)
+    char                m_chunk[256];     ///< The piece of the response being written
+    size_t              m_chunk_len;      ///< Length of m_chunk
+    size_t              m_chunk_sent;     ///< Part of m_chunk already written
+};
+
+#endif
@@ -0,0 +1,87 @@
+/*!
+  @file   packet_pool.cpp
+  @brief  Definitions of the Packet_Pool methods.
+*/
+
+#include "packet_pool.h"
+#include "Streaming.h"
+#include "debug.h"
+
+BENCH_LOCAL Packet_Pool  packet_pool;     ///< Global instance of Packet_Pool used for all packet buffers
+
+
+uint8_t * Packet_Pool::acquire ()
+{
+  uint8_t * block = NULL;
+
+  if ( free_list != NULL )
+  {
+    // re-use a block from the free list
+
+    block = (uint8_t *) free_list;
+    free_list = free_list->next;
+  }
+  else if ( m_allocated < PACKET_BLOCK_COUNT )
+  {
+    // take a new block from the heap
+
+    block = (uint8_t *) malloc(PACKET_BLOCK_SIZE);
+
+    if ( block != NULL )
+    {
+      m_allocated++;
+    }
+  }
+
+  if ( block == NULL )
+  {
+    m_failures++;
+
+    Debug.Error() << "No packet buffer available (" << m_in_use << " in use)\n";
+
+    return NULL;
+  }
+
+  m_in_use++;
+  m_high_water = std::max(m_high_water, m_in_use);
+
+  return block;
+}
+
+
+void Packet_Pool::release ( uint8_t * block )
+{
+  if ( block == NULL )
+  {
+    return;
+  }
+
+  free_block *  fb = (free_block *) block;
+
+  fb->next = free_list;
+  free_list = fb;
+
+  m_in_use--;
+}
+
+
+void Packet_Pool::trim ()
+{
+  while ( free_list != NULL )
+  {
+    free_block *  fb = free_list;
+
+    free_list = fb->next;
+    free(fb);
+
+    m_allocated--;
+  }
+}
+
+
+void Packet_Pool::report ( Print & out )
+{
+  out << "Packet buffers (" << PACKET_BLOCK_SIZE << " bytes): allocated = " << m_allocated
+      << "; in use = " << m_in_use << "; high water = " << m_high_water
+      << "; failures = " << m_failures << "\n";
+}
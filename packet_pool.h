@@ -0,0 +1,117 @@
+#ifndef PACKET_POOL_H
+#define PACKET_POOL_H
+
+/*!
+  @file   packet_pool.h
+  @brief  Declaration of the Packet_Pool class.
+*/
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "utilities.h"
+
+/*!
+  @brief  Size of each block handed out by the Packet_Pool.
+
+  Every block must be able to hold the largest packet
+  (a VXI request or response) including its 4-byte prefix.
+*/
+const size_t  PACKET_BLOCK_SIZE = 256;
+
+/*!
+  @brief  Largest number of blocks the Packet_Pool will allocate.
+
+  One request plus one response are needed per connection that
+  is being served; this allows the VXI link, a bind request, and
+  a device_abort (which arrives while a VXI request is still
+  being served) to be handled at the same time.
+*/
+const size_t  PACKET_BLOCK_COUNT = 6;
+
+/*!
+  @brief  Fixed-block allocator for packet buffers.
+
+  Instead of reserving a static buffer for every kind of packet,
+  the servers borrow a block from the Packet_Pool for the duration
+  of a request and give it back when the response has been sent
+  (see rpc_buffer in rpc_packets.h). Blocks are taken from the heap
+  only when first needed, and are then kept on a free list for
+  re-use, so that the memory in use follows the number of requests
+  actually being served, and the blocks are not freed and allocated
+  again for every link among the allocations of lwIP. trim() returns
+  the unused blocks to the heap; the Heap_Monitor calls it only when
+  the free heap runs low.
+
+  The pool also keeps statistics (blocks allocated, blocks in use,
+  high-water mark, and failed requests) for the STATUS report.
+*/
+class Packet_Pool
+{
+  public:
+
+    /*!
+      @brief  Constructor starts with no blocks allocated.
+    */
+    Packet_Pool ()
+      : free_list(NULL), m_allocated(0), m_in_use(0), m_high_water(0), m_failures(0)
+      {}
+
+    /*!
+      @brief  Borrow a block of PACKET_BLOCK_SIZE bytes.
+
+      @return Pointer to the block, or NULL if no block is available.
+    */
+    uint8_t * acquire ();
+
+    /*!
+      @brief  Give back a block obtained from acquire().
+
+      @param  block   Pointer to the block (NULL is ignored).
+    */
+    void      release ( uint8_t * block );
+
+    /*!
+      @brief  Return all unused blocks to the heap.
+    */
+    void      trim ();
+
+    /*!
+      @brief  Write the pool statistics.
+
+      @param  out   The Print object (e.g., Telnet) to which to write the report.
+    */
+    void      report ( Print & out );
+
+    uint32_t  allocated ()    ///< @return The number of blocks currently taken from the heap
+      { return m_allocated; }
+
+    uint32_t  in_use ()       ///< @return The number of blocks currently borrowed
+      { return m_in_use; }
+
+    uint32_t  high_water ()   ///< @return The largest number of blocks ever borrowed at once
+      { return m_high_water; }
+
+    uint32_t  failures ()     ///< @return The number of calls to acquire() that returned NULL
+      { return m_failures; }
+
+  private:
+
+    /*!
+      @brief  While a block is on the free list, its first bytes
+              hold the pointer to the next free block.
+    */
+    struct free_block
+    {
+      free_block *  next;
+    };
+
+    free_block *  free_list;      ///< Blocks available for re-use
+    uint32_t      m_allocated;    ///< Blocks currently taken from the heap
+    uint32_t      m_in_use;       ///< Blocks currently borrowed
+    uint32_t      m_high_water;   ///< Largest number of blocks borrowed at once
+    uint32_t      m_failures;     ///< Number of failed calls to acquire()
+};
+
+extern BENCH_LOCAL Packet_Pool  packet_pool;    ///< Global instance of Packet_Pool (one per bench), defined in packet_pool.cpp
+
+#endif
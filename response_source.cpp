@@ -0,0 +1,148 @@
+/*!
+  @file   response_source.cpp
+  @brief  Definitions of the Response_Source methods.
+*/
+
+#include "response_source.h"
+#include "siglent_waves.h"
+#include "scpi.h"
+
+/*!
+  @brief  The fields of the BSWV? response, in order, with their units.
+*/
+static const struct
+{
+  uint32_t      param_id;   ///< The id of the parameter (see scpi::parameter_id)
+  const char *  name;       ///< The name used in the response
+  const char *  unit;       ///< The unit appended to the value
+}
+bswv_fields[] = { { scpi::WAVE,      "WVTP", ""   },
+                  { scpi::FREQUENCY, "FRQ",  "HZ" },
+                  { scpi::AMPLITUDE, "AMP",  "V"  },
+                  { scpi::OFFSET,    "OFST", "V"  },
+                  { scpi::PHASE,     "PHSE", ""   }
+                };
+
+const uint32_t  bswv_field_count = sizeof(bswv_fields) / sizeof(bswv_fields[0]);
+
+static_assert(bswv_field_count == 5, "Parameter_Source::field_count must match bswv_fields");
+
+
+uint32_t Text_Source::read ( char * buffer, uint32_t len )
+{
+  uint32_t  n = 0;
+
+  while ( n < len && *m_text != 0 )
+  {
+    buffer[n++] = *m_text++;
+  }
+
+  m_done = ( *m_text == 0 );
+
+  return n;
+}
+
+
+void Parameter_Source::begin ( AWG_Server & awg, AWG_Task & task, uint32_t channel )
+{
+  // copy the values while the consumer of the AWG_Task is stopped
+
+  bool  b_claimed = task.claim();
+
+  for ( uint32_t i = 0; i < bswv_field_count; i++ )
+  {
+    m_valid[i] = b_claimed && awg.recall(channel, bswv_fields[i].param_id, m_values[i]);
+  }
+
+  task.release();
+
+  m_channel = channel;
+  m_step = 0;
+  m_first_field = true;
+  m_done = false;
+
+  next_field();
+}
+
+
+uint32_t Parameter_Source::read ( char * buffer, uint32_t len )
+{
+  uint32_t  n = 0;
+
+  while ( n < len && ! m_done )
+  {
+    uint32_t  count = std::min(len - n, m_field_len - m_field_pos);
+
+    memcpy(buffer + n, m_field + m_field_pos, count);
+
+    n += count;
+    m_field_pos += count;
+
+    if ( m_field_pos == m_field_len )
+    {
+      next_field();   // look ahead, so that done() is set as soon as the last byte is read
+    }
+  }
+
+  return n;
+}
+
+
+void Parameter_Source::next_field ()
+{
+  double  value;
+
+  m_field_len = 0;
+  m_field_pos = 0;
+
+  /*  Step 0 is the header, steps 1 to bswv_field_count are the
+      fields (skipping those with no value), and the step after
+      that ends the line.  */
+
+  while ( m_field_len == 0 )
+  {
+    uint32_t  step = m_step++;
+
+    if ( step == 0 )
+    {
+      m_field_len = snprintf(m_field, sizeof(m_field), "C%u:BSWV ", (unsigned) m_channel);
+    }
+    else if ( step <= bswv_field_count )
+    {
+      const char *  separator = m_first_field ? "" : ",";
+
+      if ( ! m_valid[step-1] )
+      {
+        continue;
+      }
+
+      value = m_values[step-1];
+
+      if ( bswv_fields[step-1].param_id == scpi::WAVE )
+      {
+        // only the sine wave is used for a Bode plot
+
+        m_field_len = ( value == siglent::Sine )
+                        ? snprintf(m_field, sizeof(m_field), "%s%s,SINE", separator, bswv_fields[step-1].name)
+                        : snprintf(m_field, sizeof(m_field), "%s%s,%d", separator, bswv_fields[step-1].name, (int) value);
+      }
+      else
+      {
+        m_field_len = snprintf(m_field, sizeof(m_field), "%s%s,%.10g%s", separator, bswv_fields[step-1].name, value, bswv_fields[step-1].unit);
+      }
+
+      m_first_field = false;
+    }
+    else if ( step == bswv_field_count + 1 )
+    {
+      m_field_len = snprintf(m_field, sizeof(m_field), "\n");
+    }
+    else
+    {
+      m_done = true;
+      return;
+    }
+
+    m_field_len = std::min(m_field_len, (uint32_t)( sizeof(m_field) - 1 ));
+  }
+}
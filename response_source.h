@@ -0,0 +1,132 @@
+#ifndef RESPONSE_SOURCE_H
+#define RESPONSE_SOURCE_H
+
+/*!
+  @file   response_source.h
+  @brief  Declaration of the Response_Source class and its descendants.
+*/
+
+#include <stdint.h>
+#include "awg_server.h"
+#include "awg_task.h"
+
+/*!
+  @brief  Base class for the generators of DEV_READ responses.
+
+  A response may be longer than a single DEV_READ can return
+  (the client sets the request_size, and the response must fit
+  in a packet buffer). Rather than building the whole response
+  in a staging buffer, the VXI_Server asks the Response_Source
+  for as many bytes as it can send, and asks again on the next
+  DEV_READ until the source is done.
+*/
+class Response_Source
+{
+  public:
+
+    Response_Source ()    ///< Constructor starts with nothing to send
+      : m_done(true)
+      {}
+
+    virtual ~Response_Source ()   ///< Virtual destructor does nothing
+      {}
+
+    /*!
+      @brief  Copy the next bytes of the response.
+
+      @param  buffer  Where to store the bytes.
+      @param  len     The most bytes to copy.
+
+      @return The number of bytes copied; less than len only if the response is done.
+    */
+    virtual uint32_t  read ( char * buffer, uint32_t len ) = 0;
+
+    /*!
+      @brief  Check whether the whole response has been read.
+
+      This becomes true as soon as the last byte has been copied,
+      so that the DEV_READ that sends it can also report END.
+    */
+    bool      done ()
+      { return m_done; }
+
+  protected:
+
+    bool      m_done;     ///< True once the last byte has been copied
+};
+
+/*!
+  @brief  Serves a constant string (e.g., the AWG id).
+*/
+class Text_Source : public Response_Source
+{
+  public:
+
+    Text_Source ()    ///< Constructor starts with no text
+      : m_text("")
+      {}
+
+    /*!
+      @brief  Start serving a string.
+
+      @param  text    The null-terminated string, which must remain valid until done.
+    */
+    void      begin ( const char * text )
+      { m_text = text; m_done = ( *m_text == 0 ); }
+
+    virtual uint32_t  read ( char * buffer, uint32_t len );
+
+  protected:
+
+    const char *  m_text;   ///< The part of the string not yet read
+};
+
+/*!
+  @brief  Serves the BSWV? response for one channel.
+
+  The response (e.g., C1:BSWV WVTP,SINE,FRQ,1000HZ,AMP,2V,OFST,0V,PHSE,0)
+  is generated one field at a time from the values remembered by the
+  AWG_Server (see AWG_Server::recall()); fields that have never been
+  set are left out. The values are copied when the response starts,
+  with the AWG claimed from its AWG_Task, since in threaded mode the
+  consumer remembers them as it applies the commands.
+*/
+class Parameter_Source : public Response_Source
+{
+  public:
+
+    Parameter_Source ()     ///< Constructor starts with nothing to send
+      : m_channel(0), m_step(0), m_first_field(true), m_field_len(0), m_field_pos(0)
+      {}
+
+    /*!
+      @brief  Start serving the parameters of a channel.
+
+      @param  awg       The AWG_Server holding the values.
+      @param  task      The AWG_Task through which the AWG is claimed while they are copied.
+      @param  channel   The AWG channel (1-based).
+    */
+    void      begin ( AWG_Server & awg, AWG_Task & task, uint32_t channel );
+
+    virtual uint32_t  read ( char * buffer, uint32_t len );
+
+  protected:
+
+    static const int  field_count = 5;    ///< Number of fields in the response (WVTP, FRQ, AMP, OFST, PHSE)
+
+    /*!
+      @brief  Generate the next field into m_field, or set m_done if there is none.
+    */
+    void      next_field ();
+
+    uint32_t      m_channel;      ///< The channel whose parameters are served
+    uint32_t      m_step;         ///< The next field to generate
+    bool          m_first_field;  ///< True until a field (other than the header) has been generated
+    double        m_values[field_count];  ///< The values of the fields, copied by begin()
+    bool          m_valid[field_count];   ///< True if the value of a field has been set
+    char          m_field[32];    ///< The current field
+    uint32_t      m_field_len;    ///< Length of the current field
+    uint32_t      m_field_pos;    ///< Bytes of the current field already read
+};
+
+#endif
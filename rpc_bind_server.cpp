@@ -9,24 +9,26 @@
 #include "rpc_enums.h"
 #include "debug.h"
 
-void RPC_Bind_Server::begin ()
+void RPC_Bind_Server::begin ( uint16_t port )
 {
   /*
     Initialize the UDP and TCP servers to listen on
-    the BIND_PORT port.
+    the bind port (normally BIND_PORT).
   */
 
-  udp.begin(rpc::BIND_PORT);
-  tcp.begin(rpc::BIND_PORT);
+  bind_port = port;
 
-  Debug.Progress() << "Listening for RPC_BIND requests on UDP and TCP port " << rpc::BIND_PORT << "\n";
+  udp.begin(bind_port);
+  tcp.begin(bind_port);
+
+  Debug.Progress() << "Listening for RPC_BIND requests on UDP and TCP port " << bind_port << "\n";
 }
 
 /*!
   The loop() member function should be called by
   the main loop of the program to process any UDP or
   TCP bind requests. It will only process requests if
-  the vxi_server is available. If so, it will hand off the
+  the vxi_server is available (see available()). If so, it will hand off the
   TCP or UDP request to process_request() for validation
   and response. The response will be assembled by
   process_request(), but it will be sent from loop() since
@@ -46,21 +48,27 @@ void RPC_Bind_Server::loop ()
       a vxi_server becomes available.
   */
 
-  if ( vxi_server.available() )
+  if ( available() )
   {
-    int       len;
+    int         len;
+    rpc_buffer  request, response;    // packet buffers, returned to the packet_pool when loop() ends
 
     if ( udp.parsePacket() > 0 )
     {
-      len = get_bind_packet(udp);
+      if ( ! request.acquire() || ! response.acquire() )
+      {
+        return;     // drop the request; the client will retry it
+      }
+
+      len = get_bind_packet(udp, request);
 
       if ( len > 0 )
       {
-        Debug.Packet() << "\nUDP packet received on port " << rpc::BIND_PORT << "\n";
+        Debug.Packet() << "\nUDP packet received on port " << bind_port << "\n";
 
-        process_request(true);
+        process_request(request, response, len, true, udp.remoteIP());
 
-        send_bind_packet(udp,sizeof(bind_response_packet));
+        send_bind_packet(udp, request, response, sizeof(bind_response_packet));
       }
     }
     else
@@ -71,15 +79,20 @@ void RPC_Bind_Server::loop ()
     
       if ( tcp_client )
       {
-        len = get_bind_packet(tcp_client);
+        if ( ! request.acquire() || ! response.acquire() )
+        {
+          return;   // the client will retry the request
+        }
+
+        len = get_bind_packet(tcp_client, request);
 
         if ( len )
         {
-          Debug.Packet() << "\nTCP packet received on port " << rpc::BIND_PORT << "\n";
+          Debug.Packet() << "\nTCP packet received on port " << bind_port << "\n";
 
-          process_request(false);
+          process_request(request, response, len, false, tcp_client.remoteIP());
 
-          send_bind_packet(tcp_client,sizeof(bind_response_packet));
+          send_bind_packet(tcp_client, request, response, sizeof(bind_response_packet));
         }
       }
     }
@@ -95,18 +108,30 @@ void RPC_Bind_Server::loop ()
   success or error code and the port passed by the VXI_Server.
   Actually sending the response is handled by the caller.
 
-  @param  onUDP   Indicates whether the server calling on this
-                  function is UDP or TCP.
+  @param  request   The buffer holding the request.
+  @param  response  The buffer in which to assemble the response.
+  @param  len       The length of the request received.
+  @param  onUDP     Indicates whether the server calling on this
+                    function is UDP or TCP.
+  @param  client    The address from which the request came.
 */
-void RPC_Bind_Server::process_request ( bool onUDP )
+void RPC_Bind_Server::process_request ( rpc_buffer & request, rpc_buffer & response, uint32_t len, bool onUDP, IPAddress client )
 {
   uint32_t  rc = rpc::SUCCESS;
-  uint32_t  port;
+  uint32_t  port = 0;
+
+  rpc_request_packet * rpc_request = request.as<rpc_request_packet>();
+  bind_response_packet * bind_response = response.as<bind_response_packet>();
 
-  rpc_request_packet * rpc_request = ( onUDP ? udp_request : tcp_request );
-  bind_response_packet * bind_response = ( onUDP ? udp_bind_response : tcp_bind_response );
+  ( onUDP ? udp_requests : tcp_requests )++;
 
-  if ( rpc_request->program != rpc::PORTMAP )
+  if ( ! valid_bind_request(request, len) )
+  {
+    rc = rpc::GARBAGE_ARGS;
+
+    Debug.Error() << "Invalid or truncated bind request (" << len << " bytes)\n";
+  }
+  else if ( rpc_request->program != rpc::PORTMAP )
   {
     rc = rpc::PROG_UNAVAIL;
 
@@ -121,9 +146,9 @@ void RPC_Bind_Server::process_request ( bool onUDP )
   }
   else  // i.e., if it is a valid PORTMAP request
   {
-    Debug.Progress() << "PORTMAP command received on " << ( onUDP ? "UDP" : "TCP" ) << " port " << rpc::BIND_PORT << "; ";
+    Debug.Progress() << "PORTMAP command received on " << ( onUDP ? "UDP" : "TCP" ) << " port " << bind_port << "; ";
 
-    port = vxi_server.allocate();
+    port = allocate(client);
 
     /*  The logic in the loop() routine should not allow
         the port returned to be zero, since we first checked
@@ -10,6 +10,8 @@
 #include <WiFiUdp.h>
 #include "vxi_server.h"
 #include "utilities.h"
+#include "rpc_packets.h"
+#include "rpc_enums.h"
 
 
 class VXI_Server;         // forward declaration
@@ -34,20 +36,22 @@ class RPC_Bind_Server {
       @param  vs  A reference to the VXI_Server
     */
     RPC_Bind_Server ( VXI_Server & vs )
-      : vxi_server(vs)
+      : vxi_server(&vs), bind_port(rpc::BIND_PORT), udp_requests(0), tcp_requests(0)
       {}
 
     /*!
       @brief  Destructor only needs to stop the listening services.
     */
-    ~RPC_Bind_Server ()
+    virtual ~RPC_Bind_Server ()
       { udp.stop(); tcp.stop(); };
 
     /*!
       @brief  Initializes the RPC_Bind_Server by setting up
               the TCP and UDP servers.
+
+      @param  port  The port to listen on (normally rpc::BIND_PORT)
     */
-    void  begin ();
+    void  begin ( uint16_t port = rpc::BIND_PORT );
 
     /*!
       @brief  Call this at least once per main loop to
@@ -55,13 +59,53 @@ class RPC_Bind_Server {
     */
     void  loop ();
 
+    /*!
+      @brief  Read the number of requests received, for the /metrics endpoint.
+
+      @param  onUDP   True for the requests on UDP, false for those on TCP
+    */
+    uint32_t  requests ( bool onUDP )
+      { return onUDP ? udp_requests : tcp_requests; }
+
   protected:
 
-    void  process_request ( bool onUDP );
+    /*!
+      @brief  Constructor for a subclass that routes the requests itself.
+    */
+    RPC_Bind_Server ()
+      : vxi_server(NULL), bind_port(rpc::BIND_PORT), udp_requests(0), tcp_requests(0)
+      {}
+
+    /*!
+      @brief  Check whether a request can be served now.
+
+      Until this returns true, incoming requests are left waiting
+      (not read).
+
+      @return True if the VXI_Server is available.
+    */
+    virtual bool      available ()
+      { return vxi_server->available(); }
+
+    /*!
+      @brief  Choose the port to which to direct a client.
+
+      @param  client  The address from which the request came
+
+      @return The port of the VXI_Server that will serve the client,
+              or 0 if none is available.
+    */
+    virtual uint32_t  allocate ( IPAddress client )
+      { return vxi_server->allocate(); }
+
+    void  process_request ( rpc_buffer & request, rpc_buffer & response, uint32_t len, bool onUDP, IPAddress client );
 
-    VXI_Server &    vxi_server;   ///< Reference to the VXI_Server
+    VXI_Server *    vxi_server;   ///< The VXI_Server (NULL if a subclass routes the requests)
+    uint16_t        bind_port;    ///< The port on which requests are received
     WiFiUDP         udp;          ///< UDP server
     WiFiServer_ext  tcp;          ///< TCP server
+    uint32_t        udp_requests; ///< Number of requests received on UDP
+    uint32_t        tcp_requests; ///< Number of requests received on TCP
 
 };
 
@@ -29,7 +29,8 @@ enum ports {
 
   BIND_PORT       = 111,    ///< Port to listen on for bind requests
   VXI_PORT_START  = 9010,   ///< Start of a block of ports to use for VXI transactions
-  VXI_PORT_END    = 9019    ///< End of a block of ports to use for VXI transactions
+  VXI_PORT_END    = 9019,   ///< End of a block of ports to use for VXI transactions
+  VXI_ABORT_PORT  = 9009    ///< Port to listen on for device_abort requests (the VXI-11 abort channel)
 };
 
 /*!
@@ -92,12 +93,13 @@ enum rpc_status {
 };
 
 /*!
-  @brief  espBode responds only to PORTMAP and VXI_11_CORE programs.
+  @brief  espBode responds only to PORTMAP, VXI_11_CORE, and VXI_11_ASYNC programs.
 */
 enum programs {
 
-  PORTMAP     = 0x186A0,    ///< Request for the port on which the VXI_Server is listening
-  VXI_11_CORE = 0x607AF     ///< Request for a VXI command to be executed
+  PORTMAP       = 0x186A0,    ///< Request for the port on which the VXI_Server is listening
+  VXI_11_CORE   = 0x607AF,    ///< Request for a VXI command to be executed
+  VXI_11_ASYNC  = 0x607B0     ///< Request to abort the VXI command in progress (on the abort channel)
 };
 
 /*!
@@ -105,6 +107,7 @@ enum programs {
 */
 enum procedures {
 
+  VXI_11_DEVICE_ABORT = 1,    ///< Abort the VXI command in progress (VXI_11_ASYNC program)
   GET_PORT            = 3,    ///< Return the port on which the VXI_Server is currently listening
   VXI_11_CREATE_LINK  = 10,   ///< Create a link to handle a series of requests
   VXI_11_DEV_WRITE    = 11,   ///< Write to the AWG
@@ -134,6 +137,16 @@ enum errors {
   DUPLICATE_CHANNEL = 29      ///< This channel is already in use (?)
 };
 
+/*!
+  @brief  Flags that can be set in VXI_11 write and read requests.
+*/
+enum flags {
+
+  FLAG_WAITLOCK   = 1,      ///< Wait for a lock held by another link
+  FLAG_END        = 8,      ///< The data of this write ends the message
+  FLAG_TERMCHRSET = 128     ///< A read should end at the terminating character
+};
+
 /*!
   @brief  Indicates the reason for ending the read of data.
 */
@@ -8,32 +8,45 @@
 #include "rpc_enums.h"
 #include "debug.h"
 
-/*  The definition of the buffers to hold packet data	*/
+/*!
+  @brief  Read and discard data from a TCP connection.
+
+  @param  tcp   The WiFiClient connection from which to read.
+  @param  len   The number of bytes to discard.
+*/
+static void discard ( WiFiClient & tcp, uint32_t len )
+{
+  uint8_t   scratch[32];
+
+  while ( len > 0 ) {
+    uint32_t  n = tcp.readBytes(scratch, std::min(len,(uint32_t)sizeof(scratch)));
 
-uint8_t  udp_read_buffer[UDP_READ_SIZE];      // only for udp bind requests
-uint8_t  udp_send_buffer[UDP_SEND_SIZE];      // only for udp bind responses
-uint8_t  tcp_read_buffer[TCP_READ_SIZE];      // only for tcp bind requests
-uint8_t  tcp_send_buffer[TCP_SEND_SIZE];      // only for tcp bind responses
-uint8_t  vxi_read_buffer[VXI_READ_SIZE];      // only for vxi requests
-uint8_t  vxi_send_buffer[VXI_SEND_SIZE];      // only for vxi responses
+    if ( n == 0 ) {
+      break;      // timed out; nothing more to read
+    }
+
+    len -= n;
+  }
+}
 
 /*!
   @brief  Receive an RPC bind request packet via UDP.
 
   This function is called only when the udp connection has
-  data available. It reads the data into the udp_read_buffer.
+  data available. It reads the data into the request buffer.
 
-  @param  udp		The WiFiUDP connection from which to read.
+  @param  udp		  The WiFiUDP connection from which to read.
+  @param  request The buffer into which to read the request.
 
   @return The length of data received.
 */
-uint32_t get_bind_packet ( WiFiUDP & udp )
+uint32_t get_bind_packet ( WiFiUDP & udp, rpc_buffer & request )
 {
-  uint32_t  len = udp.read(udp_request_packet_buffer, UDP_READ_SIZE);
+  uint32_t  len = udp.read(request.packet_buffer(), UDP_READ_SIZE);
 
   if ( len > 0 ) {
     Debug.Packet() << "\nReceived " << len << " bytes from " << udp.remoteIP().toString() << ":" << udp.remotePort() << "\n";
-    Debug.Packet() << Debug.Dump(udp_request_packet_buffer,len) << "\n";
+    Debug.Packet() << Debug.Dump(request.packet_buffer(),len) << "\n";
   }
 
   return len;
@@ -43,29 +56,32 @@ uint32_t get_bind_packet ( WiFiUDP & udp )
   @brief  Receive an RPC bind request packet via TCP.
 
   This function is called only when the tcp client has data
-  available. It reads the data into the tcp_read_buffer.
+  available. It reads the data into the request buffer.
 
-  @param  tcp   The WiFiClient connection from which to read.
+  @param  tcp     The WiFiClient connection from which to read.
+  @param  request The buffer into which to read the request.
   
   @return The length of data received.
 */
-uint32_t get_bind_packet ( WiFiClient & tcp )
+uint32_t get_bind_packet ( WiFiClient & tcp, rpc_buffer & request )
 {
   uint32_t  len;
 
-  tcp_request_prefix->length = 0;                     // set the length to zero in case the following read fails
+  request.prefix()->length = 0;                     // set the length to zero in case the following read fails
 
-  tcp.readBytes(tcp_request_prefix_buffer, 4);     // get the FRAG + LENGTH field
+  tcp.readBytes(request.prefix_buffer(), 4);        // get the FRAG + LENGTH field
 
-  len = ( tcp_request_prefix->length & 0x7fffffff );  // mask out the FRAG bit
+  len = ( request.prefix()->length & 0x7fffffff );  // mask out the FRAG bit
 
   if ( len > 4 ) {
-    len = std::min(len,(uint32_t)(TCP_READ_SIZE-4));              // do not read more than the buffer can hold
+    uint32_t  read_len = std::min(len,(uint32_t)(TCP_READ_SIZE-4));   // do not read more than the buffer can hold
+
+    tcp.readBytes(request.packet_buffer(),read_len);
 
-    tcp.readBytes(tcp_request_packet_buffer,len);
+    discard(tcp, len - read_len);
 
     Debug.Packet() << "\nReceived " << len+4 << " bytes from " << tcp.remoteIP().toString() << ":" << tcp.remotePort() << "\n";
-    Debug.Packet() << Debug.Dump(tcp_request_prefix_buffer,len+4) << "\n";
+    Debug.Packet() << Debug.Dump(request.prefix_buffer(),read_len+4) << "\n";
   }
 
   return len;
@@ -75,82 +91,186 @@ uint32_t get_bind_packet ( WiFiClient & tcp )
   @brief  Receive an RPC/VXI command request packet via TCP.
   
   This function is called only when the tcp client has data
-  available. It reads the data into the vxi_read_buffer.
+  available. It reads the data into the request buffer.
 
-  @param  tcp   The WiFiClient connection from which to read.
+  The request may be split into several fragments (see rpc_record);
+  these are combined in the buffer. If the record is longer than the
+  buffer can hold, only the beginning is read; the caller must either
+  stream the rest (see VXI_Server::write()) or skip it.
+
+  @param  tcp     The WiFiClient connection from which to read.
+  @param  request The buffer into which to read the request.
+  @param  record  Keeps track of the fragments of the record.
   
-  @return The length of data received.
+  @return The length of data read into the buffer.
 */
-uint32_t get_vxi_packet ( WiFiClient & tcp )
+uint32_t get_vxi_packet ( WiFiClient & tcp, rpc_buffer & request, rpc_record & record )
 {
-  uint32_t  len;
+  uint32_t  len = 0;
 
-  vxi_request_prefix->length = 0;                     // set the length to zero in case the following read fails
+  request.prefix()->length = 0;                     // set the length to zero in case the following read fails
 
-  tcp.readBytes(vxi_request_prefix_buffer, 4);     // get the FRAG + LENGTH field
+  if ( record.begin(tcp, request.prefix_buffer()) )
+  {
+    len = record.read(tcp, request.packet_buffer(), VXI_READ_SIZE-4);   // do not read more than the buffer can hold
+  }
 
-  len = ( vxi_request_prefix->length & 0x7fffffff );  // mask out the FRAG bit
+  if ( len > 0 ) {
+    Debug.Packet() << "\nReceived " << len+4 << ( record.complete() ? "" : " (partial)" ) << " bytes from " << tcp.remoteIP().toString() << ":" << tcp.remotePort() << "\n";
+    Debug.Packet() << Debug.Dump(request.prefix_buffer(),len+4) << "\n";
+  }
 
-  if ( len > 4 ) {
-    len = std::min(len,(uint32_t)(VXI_READ_SIZE-4));              // do not read more than the buffer can hold
+  return len;
+}
 
-    tcp.readBytes(vxi_request_packet_buffer, len);
+/*!
+  @brief  Check that a bind request is complete.
 
-    Debug.Packet() << "\nReceived " << len+4 << " bytes from " << tcp.remoteIP().toString() << ":" << tcp.remotePort() << "\n";
-    Debug.Packet() << Debug.Dump(vxi_request_prefix_buffer,len+4) << "\n";
+  @param  request The buffer holding the request.
+  @param  len     The length of the record received.
+
+  @return True if the request holds a complete bind request.
+*/
+bool valid_bind_request ( rpc_buffer & request, uint32_t len )
+{
+  return len >= sizeof(bind_request_packet) && len <= TCP_READ_SIZE - 4;
+}
+
+/*!
+  @brief  Check that a VXI request is complete and consistent.
+
+  The fixed part of the packet is checked according to the
+  procedure; for the packets that carry a string (CREATE_LINK and
+  DEV_WRITE), data_len is checked against the record length and
+  against the space left in the buffer, which must also leave
+  room for the null terminator that the VXI_Server adds.
+
+  If the record did not fit in the buffer (complete = false), only
+  a DEV_WRITE is acceptable, and its data will be streamed; in that
+  case data_len must extend beyond the buffer but not beyond
+  VXI_STREAM_SIZE.
+
+  @param  request   The buffer holding the request.
+  @param  len       The length of the data in the buffer.
+  @param  complete  False if the record continues beyond the buffer.
+
+  @return True if the request can be safely processed.
+*/
+bool valid_vxi_request ( rpc_buffer & request, uint32_t len, bool complete )
+{
+  const uint32_t  capacity = VXI_READ_SIZE - 4;   // space for the packet in the buffer
+  uint32_t        fixed, data_len = 0;
+
+  if ( len < sizeof(rpc_request_packet) || len > capacity )
+  {
+    return false;
   }
 
-  return len;
+  if ( ! complete )
+  {
+    fixed = offsetof(write_request_packet, data);
+
+    return (uint32_t)(request.as<rpc_request_packet>()->procedure) == rpc::VXI_11_DEV_WRITE
+           && len >= fixed
+           && (uint32_t)(request.as<write_request_packet>()->data_len) > len - fixed
+           && (uint32_t)(request.as<write_request_packet>()->data_len) <= VXI_STREAM_SIZE;
+  }
+
+  switch ( (uint32_t)(request.as<rpc_request_packet>()->procedure) )
+  {
+    case rpc::VXI_11_CREATE_LINK:
+
+      fixed = offsetof(create_request_packet, data);
+      data_len = ( len >= fixed ) ? (uint32_t)(request.as<create_request_packet>()->data_len) : 0;
+      break;
+
+    case rpc::VXI_11_DEV_WRITE:
+
+      fixed = offsetof(write_request_packet, data);
+      data_len = ( len >= fixed ) ? (uint32_t)(request.as<write_request_packet>()->data_len) : 0;
+      break;
+
+    case rpc::VXI_11_DEV_READ:
+
+      fixed = sizeof(read_request_packet);
+      break;
+
+    case rpc::VXI_11_DESTROY_LINK:
+
+      fixed = sizeof(destroy_request_packet);
+      break;
+
+    case rpc::VXI_11_DEVICE_ABORT:
+
+      fixed = sizeof(abort_request_packet);
+      break;
+
+    default:
+
+      fixed = sizeof(rpc_request_packet);   // the procedure will be rejected by the caller
+      break;
+  }
+
+  /*  data_len comes from the network, so compare it without
+      adding it to anything (which could overflow).  */
+
+  return len >= fixed && data_len <= len - fixed && data_len < capacity - fixed;
 }
 
 /*!
   @brief  Send an RPC bind response packet via UDP.
 
   This function is called to return the port number on which
-  the VXI_Server is listening. It uses the udp_send_buffer.
+  the VXI_Server is listening.
 
-  @param  udp   The udp connection on which to send.
-  @param  len	  The length of the response to send.
+  @param  udp       The udp connection on which to send.
+  @param  request   The request being answered (provides the xid).
+  @param  response  The buffer holding the response.
+  @param  len	      The length of the response to send.
 */
-void send_bind_packet ( WiFiUDP & udp, uint32_t len )
+void send_bind_packet ( WiFiUDP & udp, rpc_buffer & request, rpc_buffer & response, uint32_t len )
 {
-  fill_response_header(udp_response_packet_buffer, udp_request->xid);  // get the xid from the request
+  fill_response_header(response.packet_buffer(), request.as<rpc_request_packet>()->xid);  // get the xid from the request
 
   udp.beginPacket(udp.remoteIP(), udp.remotePort());
-  udp.write(udp_response_packet_buffer,len);
+  udp.write(response.packet_buffer(),len);
   udp.endPacket();
 
   Debug.Packet() << "\nSent " << len << " bytes to " << udp.remoteIP().toString() << ":" << udp.remotePort() << "\n";
-  Debug.Packet() << Debug.Dump(udp_response_packet_buffer,len) << "\n";
+  Debug.Packet() << Debug.Dump(response.packet_buffer(),len) << "\n";
 }
 
 /*!
   @brief  Send an RPC bind response packet via TCP.
 
   This function is called to return the port number on which
-  the VXI_Server is listening. It uses the tcp_send_buffer.
+  the VXI_Server is listening.
 
-  @param  tcp		The WiFiClient to which to send.
-  @param  len		The length of the response to send.
+  @param  tcp		    The WiFiClient to which to send.
+  @param  request   The request being answered (provides the xid).
+  @param  response  The buffer holding the response.
+  @param  len		    The length of the response to send.
 */
-void send_bind_packet ( WiFiClient & tcp, uint32_t len )
+void send_bind_packet ( WiFiClient & tcp, rpc_buffer & request, rpc_buffer & response, uint32_t len )
 {
-  fill_response_header(tcp_response_packet_buffer, tcp_request->xid);  // get the xid from the request
+  uint8_t * packet = response.packet_buffer();
+
+  fill_response_header(packet, request.as<rpc_request_packet>()->xid);  // get the xid from the request
 
   // adjust length to multiple of 4, appending 0's to fill the dword
 
   while ( (len & 3) > 0 ) {
-    tcp_response_packet_buffer[len++] = 0;
+    packet[len++] = 0;
   }
 
-  tcp_response_prefix->length = 0x80000000 | len;   // set the FRAG bit and the length;
+  response.prefix()->length = 0x80000000 | len;     // set the FRAG bit and the length;
 
   while ( tcp.availableForWrite() == 0 );           // wait for tcp to be available
 
-  tcp.write(tcp_response_prefix_buffer,len+4);      // add 4 to the length to accound for the tcp_response_prefix
+  tcp.write(response.prefix_buffer(),len+4);        // add 4 to the length to account for the prefix
 
   Debug.Packet() << "\nSent " << len << " bytes to " << tcp.remoteIP().toString() << ":" << tcp.remotePort() << "\n";
-  Debug.Packet() << Debug.Dump(tcp_response_prefix_buffer,len+4) << "\n";
+  Debug.Packet() << Debug.Dump(response.prefix_buffer(),len+4) << "\n";
 }
 
 /*!
@@ -159,30 +279,33 @@ void send_bind_packet ( WiFiClient & tcp, uint32_t len )
   This function is called to return the response to the
   previous command request; the packet includes at least
   the basic response header plus an error code, but may
-  include additional data as appropriate. It uses the
-  vxi_send_buffer.
+  include additional data as appropriate.
 
-  @param  tcp		The WiFiClient to which to send.
-  @param  len		The length of the response to send.
+  @param  tcp		    The WiFiClient to which to send.
+  @param  request   The request being answered (provides the xid).
+  @param  response  The buffer holding the response.
+  @param  len		    The length of the response to send.
 */
-void send_vxi_packet ( WiFiClient & tcp, uint32_t len )
+void send_vxi_packet ( WiFiClient & tcp, rpc_buffer & request, rpc_buffer & response, uint32_t len )
 {
-  fill_response_header(vxi_response_packet_buffer, vxi_request->xid);
+  uint8_t * packet = response.packet_buffer();
+
+  fill_response_header(packet, request.as<rpc_request_packet>()->xid);
 
   // adjust length to multiple of 4, appending 0's to fill the dword
 
   while ( (len & 3) > 0 ) {
-    vxi_response_packet_buffer[len++] = 0;
+    packet[len++] = 0;
   }
 
-  vxi_response_prefix->length = 0x80000000 | len;   // set the FRAG bit and the length;
+  response.prefix()->length = 0x80000000 | len;     // set the FRAG bit and the length;
 
   while ( tcp.availableForWrite() == 0 );           // wait for tcp to be available
 
-  tcp.write(vxi_response_prefix_buffer,len+4);      // add 4 to the length to account for the vxi_response_prefix
+  tcp.write(response.prefix_buffer(),len+4);        // add 4 to the length to account for the prefix
 
   Debug.Packet() << "\nSent " << len << " bytes to " << tcp.remoteIP().toString() << ":" << tcp.remotePort() << "\n";
-  Debug.Packet() << Debug.Dump(vxi_response_prefix_buffer,len+4) << "\n";
+  Debug.Packet() << Debug.Dump(response.prefix_buffer(),len+4) << "\n";
 }
 
 /*!
@@ -204,3 +327,73 @@ void fill_response_header ( uint8_t * buffer, uint32_t xid )
   rpc_response->verifier_l = 0;
   rpc_response->verifier_h = 0;
 }
+
+/*!
+  The prefix holds the length of the fragment in the lower 31 bits;
+  the most significant bit is set on the last fragment of the record.
+*/
+bool rpc_record::begin ( WiFiClient & tcp, uint8_t * prefix )
+{
+  tcp_prefix_packet * p = (tcp_prefix_packet *) prefix;
+
+  m_fragment = 0;
+  m_last = true;
+
+  if ( tcp.readBytes(prefix, 4) < 4 )
+  {
+    return false;
+  }
+
+  m_fragment = p->length & 0x7fffffff;
+  m_last = ( p->length & 0x80000000 ) != 0;
+
+  return true;
+}
+
+uint32_t rpc_record::read ( WiFiClient & tcp, uint8_t * buffer, uint32_t len )
+{
+  uint32_t  total = 0;
+
+  while ( total < len )
+  {
+    if ( m_fragment == 0 )
+    {
+      // the current fragment is used up; move to the next, if any
+
+      big_endian_32_t prefix(0);
+
+      if ( m_last || tcp.readBytes((uint8_t *) &prefix, 4) < 4 )
+      {
+        m_last = true;
+        break;
+      }
+
+      m_fragment = prefix & 0x7fffffff;
+      m_last = ( prefix & 0x80000000 ) != 0;
+      continue;
+    }
+
+    uint32_t  n = tcp.readBytes(buffer + total, std::min(len - total, m_fragment));
+
+    if ( n == 0 )
+    {
+      // the read timed out; abandon the rest of the record
+
+      m_fragment = 0;
+      m_last = true;
+      break;
+    }
+
+    total += n;
+    m_fragment -= n;
+  }
+
+  return total;
+}
+
+void rpc_record::skip ( WiFiClient & tcp )
+{
+  uint8_t   scratch[32];
+
+  while ( ! complete() && read(tcp, scratch, sizeof(scratch)) > 0 );
+}
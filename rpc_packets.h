@@ -9,25 +9,40 @@
 
 #include <ESP8266WiFi.h>
 #include <WiFiUdp.h>
+#include <stddef.h>
 #include "utilities.h"
+#include "packet_pool.h"
 
-/*  The get functions take the connection (UDP or TCP client),
-    read the available data, and return the length of data
-    received and stored in the data_buffer.
+class rpc_buffer;         // forward declaration
+class rpc_record;         // forward declaration
+
+/*  The get functions take the connection (UDP or TCP client)
+    and a request buffer (already acquired), read the available
+    data into the buffer, and return the length of data received.
+*/
+
+uint32_t get_bind_packet ( WiFiUDP & udp, rpc_buffer & request );
+uint32_t get_bind_packet ( WiFiClient & tcp, rpc_buffer & request );
+uint32_t get_vxi_packet ( WiFiClient & tcp, rpc_buffer & request, rpc_record & record );
+
+/*  The valid functions check, in a single pass, that a request
+    received with the given record length contains everything
+    that its type of packet requires, including any variable-
+    length data (plus room to add a null terminator).
 */
 
-uint32_t get_bind_packet ( WiFiUDP & udp );
-uint32_t get_bind_packet ( WiFiClient & tcp );
-uint32_t get_vxi_packet ( WiFiClient & tcp );
+bool valid_bind_request ( rpc_buffer & request, uint32_t len );
+bool valid_vxi_request ( rpc_buffer & request, uint32_t len, bool complete = true );
 
-/*  The send functions take the connection (UDP or TCP client)
+/*  The send functions take the connection (UDP or TCP client),
+    the request (for its transaction id), the response buffer,
     and the length of the data to send; they send the data
     and return void.
 */
 
-void send_bind_packet ( WiFiUDP & udp, uint32_t len );
-void send_bind_packet ( WiFiClient & tcp, uint32_t len );
-void send_vxi_packet ( WiFiClient & tcp, uint32_t len );
+void send_bind_packet ( WiFiUDP & udp, rpc_buffer & request, rpc_buffer & response, uint32_t len );
+void send_bind_packet ( WiFiClient & tcp, rpc_buffer & request, rpc_buffer & response, uint32_t len );
+void send_vxi_packet ( WiFiClient & tcp, rpc_buffer & request, rpc_buffer & response, uint32_t len );
 
 /*  The send functions call on fill_response_header to generate
     the "generic" data used in all responses.
@@ -36,10 +51,11 @@ void send_vxi_packet ( WiFiClient & tcp, uint32_t len );
 void fill_response_header ( uint8_t * buffer, uint32_t xid );
 
 /*!
-  @brief  Enumeration of the sizes of the various packet buffers.
+  @brief  Enumeration of the largest packet of each type.
 
-  The buffers must allow sufficient space to receive the longest
-  expected data for the type of packet involved.
+  The packet buffers (see rpc_buffer) are blocks of PACKET_BLOCK_SIZE
+  bytes borrowed from the Packet_Pool; these sizes limit how much of
+  a block is used for each type of packet.
 */
 enum packet_buffer_sizes
 {
@@ -47,38 +63,11 @@ enum packet_buffer_sizes
   UDP_SEND_SIZE = 32,     ///< The UDP bind response should be 28 bytes 
   TCP_READ_SIZE = 64,     ///< The TCP bind request should be 56 bytes + 4 bytes for prefix
   TCP_SEND_SIZE = 32,     ///< The TCP bind response should be 28 bytes + 4 bytes for prefix
-  VXI_READ_SIZE = 256,    ///< The VXI requests should never exceed 128 bytes, but extra allowed
-  VXI_SEND_SIZE = 256     ///< The VXI responses should never exceed 128 bytes, but extra allowed
+  VXI_READ_SIZE = PACKET_BLOCK_SIZE,  ///< The VXI requests should never exceed 128 bytes, but extra allowed
+  VXI_SEND_SIZE = PACKET_BLOCK_SIZE,  ///< The VXI responses should never exceed 128 bytes, but extra allowed
+  VXI_STREAM_SIZE = 0x8000            ///< Largest DEV_WRITE data accepted when streamed (e.g., a waveform upload)
 };
 
-/*  declaration of data buffers  */
-
-extern uint8_t  udp_read_buffer[];      ///< Buffer used to receive bind requests via UDP
-extern uint8_t  udp_send_buffer[];      ///< Buffer used to send bind responses via UDP
-extern uint8_t  tcp_read_buffer[];      ///< Buffer used to receive bind requests via tcp
-extern uint8_t  tcp_send_buffer[];      ///< Buffer used to send bind responses via tcp
-extern uint8_t  vxi_read_buffer[];      ///< Buffer used to receive vxi commands
-extern uint8_t  vxi_send_buffer[];      ///< Buffer used to send vxi responses
-
-/*  Constants to allow access to the portions of the data_buffers
-    that represent prefix or packet data for UDP and TCP communication.
-*/
-
-uint8_t * const udp_request_packet_buffer   = udp_read_buffer;      ///< The packet portion of a udp bind request
-uint8_t * const udp_response_packet_buffer  = udp_send_buffer;      ///< The packet portion of a udp bind response
-
-uint8_t * const tcp_request_prefix_buffer   = tcp_read_buffer;      ///< The prefix portion of a tcp bind request
-uint8_t * const tcp_request_packet_buffer   = tcp_read_buffer + 4;  ///< The packet portion of a tcp bind request
-
-uint8_t * const tcp_response_prefix_buffer  = tcp_send_buffer;      ///< The prefix portion of a tcp bind response
-uint8_t * const tcp_response_packet_buffer  = tcp_send_buffer + 4;  ///< The packet portion of a tcp bind response
-
-uint8_t * const vxi_request_prefix_buffer   = vxi_read_buffer;      ///< The prefix portion of a vxi command request
-uint8_t * const vxi_request_packet_buffer   = vxi_read_buffer + 4;  ///< The packet portion of a vxi command request
-
-uint8_t * const vxi_response_prefix_buffer  = vxi_send_buffer;      ///< The prefix portion of a vxi command response
-uint8_t * const vxi_response_packet_buffer  = vxi_send_buffer + 4;  ///< The packet portion of a vxi command response
-
 /*  Structures to allow description of / access to the data buffers
     according to the type of packet. Note that any 32-bit (i.e., non-
     character) data is sent and received in big-end format. The
@@ -274,6 +263,16 @@ struct destroy_response_packet
   big_endian_32_t  error;            ///< Error code (see rpc::errors)
 };
 
+/*!
+  @brief  Structure of the VXI_11_DEVICE_ABORT request and response packets.
+
+  The device_abort request (on the abort channel) carries only the
+  link id, and its response only the error code, exactly like the
+  DESTROY_LINK request and response.
+*/
+typedef destroy_request_packet  abort_request_packet;
+typedef destroy_response_packet abort_response_packet;
+
 /*!
   @brief  Structure of the VXI_11_DEV_READ request packet.
 
@@ -299,7 +298,7 @@ struct read_request_packet
   big_endian_32_t  io_timeout;       ///< How long to wait before timing out the data request (we will ignore)
   big_endian_32_t  lock_timeout;     ///< How long to wait before timing out a lock request (we will ignore)
   big_endian_32_t  flags;            ///< Used to indicate whether an "end" character is supplied (we will ignore)
-  char            term_char;        ///< The "end" character (we will ignore)
+  big_endian_32_t  term_char;        ///< The "end" character (XDR sends a char as a 4-byte integer; we will ignore)
 };
 
 /*!
@@ -369,39 +368,157 @@ struct write_response_packet
   big_endian_32_t  size;             ///< Number of bytes sent
 };
 
-/*  constant variables used to access the data buffers as the various structures defined above  */
+/*  Compile-time checks that the structures above match the XDR
+    encoding of the packets (every field is a 4-byte big-endian
+    value, with variable-length data following the fixed part).
+    If one of these fails, the structure no longer describes the
+    packet correctly.
+*/
+
+static_assert(sizeof(big_endian_32_t) == 4, "big_endian_32_t must occupy exactly 4 bytes");
+static_assert(sizeof(rpc_request_packet) == 40, "rpc_request_packet must be 40 bytes");
+static_assert(sizeof(rpc_response_packet) == 24, "rpc_response_packet must be 24 bytes");
+static_assert(sizeof(bind_request_packet) == 56, "bind_request_packet must be 56 bytes");
+static_assert(sizeof(bind_response_packet) == 28, "bind_response_packet must be 28 bytes");
+static_assert(offsetof(create_request_packet, data) == 56, "create_request_packet data must follow 14 fields");
+static_assert(sizeof(create_response_packet) == 40, "create_response_packet must be 40 bytes");
+static_assert(sizeof(destroy_request_packet) == 44, "destroy_request_packet must be 44 bytes");
+static_assert(sizeof(destroy_response_packet) == 28, "destroy_response_packet must be 28 bytes");
+static_assert(sizeof(read_request_packet) == 64, "read_request_packet must be 64 bytes");
+static_assert(offsetof(read_response_packet, data) == 36, "read_response_packet data must follow 9 fields");
+static_assert(offsetof(write_request_packet, data) == 60, "write_request_packet data must follow 15 fields");
+static_assert(sizeof(write_response_packet) == 32, "write_response_packet must be 32 bytes");
+
+/*!
+  @brief  A packet buffer borrowed from the Packet_Pool.
+
+  Each rpc_buffer holds one block from the packet_pool for as long
+  as it is needed - typically from the arrival of a request until
+  its response has been sent - and gives it back automatically when
+  it is released or destroyed. The first 4 bytes of the block hold
+  the TCP prefix (unused for UDP); the packet itself follows, and can
+  be accessed as any of the packet structures above, e.g.:
+  @code
+    create_request_packet * create_request = request.as<create_request_packet>();
+  @endcode
+*/
+class rpc_buffer
+{
+  public:
+
+    rpc_buffer ()     ///< Constructor does not yet borrow a block
+      : block(NULL)
+      {}
+
+    ~rpc_buffer ()    ///< Destructor gives back the block, if any
+      { release(); }
+
+    /*!
+      @brief  Borrow a block from the packet_pool (if not already done).
+
+      @return True if the buffer holds a block.
+    */
+    bool  acquire ()
+      { if ( block == NULL ) block = packet_pool.acquire();
+        return block != NULL; }
+
+    /*!
+      @brief  Give back the block to the packet_pool.
+    */
+    void  release ()
+      { packet_pool.release(block);
+        block = NULL; }
+
+    /*!
+      @brief  True if the buffer holds a block.
+    */
+    operator bool ()
+      { return block != NULL; }
+
+    uint8_t *           prefix_buffer ()    ///< @return The prefix portion of the block (TCP only)
+      { return block; }
+
+    uint8_t *           packet_buffer ()    ///< @return The packet portion of the block
+      { return block + 4; }
+
+    tcp_prefix_packet * prefix ()           ///< @return The prefix portion of the block as a tcp prefix
+      { return (tcp_prefix_packet *) block; }
+
+    /*!
+      @brief  Access the packet portion of the block as a packet structure.
+
+      @return Pointer to the packet as the requested type.
+    */
+    template <typename T>
+    T *                 as ()
+      { return (T *) ( block + 4 ); }
+
+  private:
+
+    rpc_buffer ( const rpc_buffer & );                ///< Not copyable (the block would be released twice)
+    rpc_buffer & operator = ( const rpc_buffer & );   ///< Not copyable (the block would be released twice)
+
+    uint8_t * block;    ///< The block borrowed from the packet_pool, or NULL
+};
+
+/*!
+  @brief  Reads an RPC record that may be split into fragments.
+
+  Over TCP, an RPC message (a "record") is sent as one or more
+  fragments, each preceded by a 4-byte prefix holding its length
+  and a flag marking the last fragment. The rpc_record class hides
+  the fragment boundaries: read() returns the record data as one
+  continuous stream, however it was fragmented. This allows the
+  beginning of a record to be read into a packet buffer and the
+  rest (e.g., the data of a large DEV_WRITE) to be streamed in
+  small pieces by the VXI_Server.
+*/
+class rpc_record
+{
+  public:
 
-rpc_request_packet      * const udp_request         = (rpc_request_packet *)      udp_request_packet_buffer;    ///< udp_request accesses the udp_request_packet_buffer as a generic rpc request
-rpc_response_packet     * const udp_response        = (rpc_response_packet *)     udp_response_packet_buffer;   ///< udp_response accesses the udp_response_packet_buffer as a generic rpc response
+    rpc_record ()     ///< Constructor starts with no record in progress
+      : m_fragment(0), m_last(true)
+      {}
 
-bind_request_packet     * const udp_bind_request    = (bind_request_packet *)     udp_request_packet_buffer;    ///< udp_bind_request accesses the udp_request_packet_buffer as an rpc bind request
-bind_response_packet    * const udp_bind_response   = (bind_response_packet *)    udp_response_packet_buffer;   ///< udp_bind_response accesses the udp_response_packet_buffer as an rpc bind response
+    /*!
+      @brief  Start a new record by reading the prefix of its first fragment.
 
-rpc_request_packet      * const tcp_request         = (rpc_request_packet *)      tcp_request_packet_buffer;    ///< tcp_request accesses the tcp_request_packet_buffer as a generic rpc request
-rpc_response_packet     * const tcp_response        = (rpc_response_packet *)     tcp_response_packet_buffer;   ///< tcp_response accesses the tcp_response_packet_buffer as a generic rpc response
+      @param  tcp     The WiFiClient connection from which to read.
+      @param  prefix  Where to store the 4-byte prefix.
 
-tcp_prefix_packet       * const tcp_request_prefix  = (tcp_prefix_packet *)       tcp_request_prefix_buffer;    ///< tcp_request_prefix accesses the tcp_request_prefix_buffer as a tcp prefix
-tcp_prefix_packet       * const tcp_response_prefix = (tcp_prefix_packet *)       tcp_response_prefix_buffer;   ///< tcp_response_prefix accesses the tcp_response_prefix_buffer as a tcp prefix
+      @return True if the prefix was read.
+    */
+    bool      begin ( WiFiClient & tcp, uint8_t * prefix );
 
-bind_request_packet     * const tcp_bind_request    = (bind_request_packet *)     tcp_request_packet_buffer;    ///< tcp_bind_request accesses the tcp_request_packet_buffer as an rpc bind request
-bind_response_packet    * const tcp_bind_response   = (bind_response_packet *)    tcp_response_packet_buffer;   ///< tcp_bind_response accesses the tcp_response_packet_buffer as an rpc bind response
+    /*!
+      @brief  Read record data, crossing fragment boundaries as needed.
 
-rpc_request_packet      * const vxi_request         = (rpc_request_packet *)      vxi_request_packet_buffer;    ///< vxi_request accesses the vxi_request_packet_buffer as a generic rpc request
-rpc_response_packet     * const vxi_response        = (rpc_response_packet *)     vxi_response_packet_buffer;   ///< vxi_response accesses the vxi_response_packet_buffer as a generic rpc response
+      @param  tcp     The WiFiClient connection from which to read.
+      @param  buffer  Where to store the data.
+      @param  len     The most data to read.
 
-tcp_prefix_packet       * const vxi_request_prefix  = (tcp_prefix_packet *)       vxi_request_prefix_buffer;    ///< vxi_request_prefix accesses the vxi_request_prefix_buffer as a tcp prefix
-tcp_prefix_packet       * const vxi_response_prefix = (tcp_prefix_packet *)       vxi_response_prefix_buffer;   ///< vxi_response_prefix accesses the vxi_response_prefix_buffer as a tcp prefix
+      @return The length of data read; less than len if the record ended (or the read timed out).
+    */
+    uint32_t  read ( WiFiClient & tcp, uint8_t * buffer, uint32_t len );
 
-create_request_packet   * const create_request      = (create_request_packet *)   vxi_request_packet_buffer;    ///< create_request accesses the vxi_request_packet_buffer as a create link request
-create_response_packet  * const create_response     = (create_response_packet *)  vxi_response_packet_buffer;   ///< create_response accesses the vxi_response_packet_buffer as a create link response
+    /*!
+      @brief  Read and discard the rest of the record.
 
-destroy_request_packet  * const destroy_request     = (destroy_request_packet *)  vxi_request_packet_buffer;    ///< destroy_request accesses the vxi_request_packet_buffer as a destroy link request
-destroy_response_packet * const destroy_response    = (destroy_response_packet *) vxi_response_packet_buffer;   ///< destroy_response accesses the vxi_response_packet_buffer as a destroy link response
+      @param  tcp     The WiFiClient connection from which to read.
+    */
+    void      skip ( WiFiClient & tcp );
 
-read_request_packet     * const read_request        = (read_request_packet *)     vxi_request_packet_buffer;    ///< read_request accesses the vxi_request_packet_buffer as a read request
-read_response_packet    * const read_response       = (read_response_packet *)    vxi_response_packet_buffer;   ///< read_response accesses the vxi_response_packet_buffer as a read response
+    /*!
+      @brief  True if all of the record has been read.
+    */
+    bool      complete ()
+      { return m_fragment == 0 && m_last; }
 
-write_request_packet    * const write_request       = (write_request_packet *)    vxi_request_packet_buffer;    ///< write_request accesses the vxi_request_packet_buffer as a write request
-write_response_packet   * const write_response      = (write_response_packet *)   vxi_response_packet_buffer;   ///< write_response accesses the vxi_response_packet_buffer as a write response
+  private:
+
+    uint32_t  m_fragment;   ///< Data left to read in the current fragment
+    bool      m_last;       ///< True if the current fragment is the last of the record
+};
 
-#endif
\ No newline at end of file
+#endif
@@ -45,7 +45,9 @@ enum initiator_id {
 */
 const char * const commands[] = { "OUTP",     // output on or off
                                   "BSWV?",    // request for current wave parameter settings
-                                  "BSWV"      // set wave parameters
+                                  "BSWV",     // set wave parameters
+                                  "WVDT",     // upload arbitrary wave data
+                                  "SWWV"      // set sweep parameters
                                 };
 
 /*!
@@ -55,16 +57,21 @@ enum command_id {
   SET_OUTPUT      = 0,    ///< Turn channel output on or off
   GET_PARAMETERS  = 1,    ///< Return the current channel wave parameters
   SET_PARAMETERS  = 2,    ///< Set wave parameters on the current channel
-  command_id_cnt  = 3     ///< The number of command id's
+  UPLOAD_WAVE     = 3,    ///< Upload an arbitrary wave (binary data follows the wave_data marker)
+  SET_SWEEP       = 4,    ///< Set the sweep parameters on the current channel
+  command_id_cnt  = 5     ///< The number of command id's
 };
 
 /*!
   @brief  Parameters that can follow the "channel commands."
 
-  The first two parameters may follow the OUTP command, while
-  the rest may follow the BSWV command. Note that there are
-  other possible parameters, but these are the only ones we will
-  process.
+  The first two parameters may follow the OUTP command, and the
+  next five may follow the BSWV command (wave_parameter_count in
+  all); the rest may follow the SWWV command, always as name,value
+  pairs. They are ordered so that, when the settings are restored,
+  the sweep is started (STATE) after its other parameters. Note that
+  there are other possible parameters, but these are the only ones
+  we will process.
 */
 const char * const parameters[] = { "OFF",    // output off
                                     "ON",     // output on
@@ -72,7 +79,12 @@ const char * const parameters[] = { "OFF",    // output off
                                     "FRQ",    // set frequency
                                     "AMP",    // set amplitude
                                     "OFST",   // set offset
-                                    "PHSE"    // set phase
+                                    "PHSE",   // set phase
+                                    "TIME",   // set sweep time
+                                    "START",  // set sweep start frequency
+                                    "STOP",   // set sweep stop frequency
+                                    "SWMD",   // set sweep mode
+                                    "STATE"   // start or stop the sweep
                                   };
 
 /*!
@@ -86,9 +98,78 @@ enum parameter_id {
   AMPLITUDE         = 4,    ///< Value following AMP will be voltage as floating point number, e.g., 3.5
   OFFSET            = 5,    ///< Value following OFST will be voltage as floating point number, e.g., -1.375
   PHASE             = 6,    ///< Value following PHSE will be degrees as floating point number, e.g., 27.5
-  parameter_count   = 7     ///< The number of parameter id's
+  SWWV_TIME         = 7,    ///< Value following TIME will be seconds as floating point number, e.g., 1.5S
+  SWWV_START        = 8,    ///< Value following START will be Hz as floating point number, e.g., 100HZ
+  SWWV_STOP         = 9,    ///< Value following STOP will be Hz as floating point number, e.g., 10000HZ
+  SWWV_MODE         = 10,   ///< Value following SWMD will be LINE or LOG (set as 0 or 1)
+  SWWV_STATE        = 11,   ///< Value following STATE will be OFF or ON (set as 0 or 1)
+  parameter_count   = 12,   ///< The number of parameter id's
+  wave_parameter_count = 7  ///< The number of parameter id's that may follow OUTP and BSWV
 };
 
+/*!
+  @brief  Parameters that can follow the WVDT command.
+
+  These are kept apart from scpi::parameters, whose ids also
+  index the AWG settings. Other WVDT parameters (FREQ, AMPL,
+  etc.) are ignored. The binary wave data follows the
+  wave_data marker and ends the command.
+*/
+const char * const upload_parameters[] = { "WVNM",     // wave name; a trailing number selects the AWG memory slot
+                                            "LENGTH"    // number of points in the wave data
+                                          };
+
+/*!
+  @brief  Enumeration to provide id's for the entries in scpi::upload_parameters array.
+*/
+enum upload_parameter_id {
+  WAVE_NAME               = 0,    ///< Value following WVNM will be the wave name, e.g., wave2
+  WAVE_LENGTH             = 1,    ///< Value following LENGTH will be the number of points, e.g., 8192
+  upload_parameter_count  = 2     ///< The number of upload parameter id's
+};
+
+/*!
+  @brief  Commands of the sweep engine (see Sweep_Engine), served
+          by the SCPI_Server only.
+
+  These are not Siglent commands: they let a PC upload the plan
+  of a sweep and have espBode step the AWG through it. The
+  arguments follow a space, separated by commas.
+*/
+const char * const sweep_commands[] = { "SWEEP:CLEAR",      // empty the plan
+                                        "SWEEP:POINT",      // add a point: frequency[,amplitude]
+                                        "SWEEP:LIN",        // a linear range: start,stop,points
+                                        "SWEEP:LOG",        // a logarithmic range: start,stop,points
+                                        "SWEEP:DWELL",      // time at each point in ms
+                                        "SWEEP:CHANNEL",    // channel to sweep
+                                        "SWEEP:START",      // start the sweep
+                                        "SWEEP:STOP",       // stop the sweep
+                                        "SWEEP?"            // report the state of the sweep
+                                      };
+
+/*!
+  @brief  Enumeration to provide id's for the entries in scpi::sweep_commands array.
+*/
+enum sweep_command_id {
+  SWEEP_CLEAR         = 0,    ///< Empty the plan
+  SWEEP_POINT         = 1,    ///< Add a point to the list
+  SWEEP_LINEAR        = 2,    ///< Set a linear range
+  SWEEP_LOG           = 3,    ///< Set a logarithmic range
+  SWEEP_DWELL         = 4,    ///< Set the dwell time
+  SWEEP_CHANNEL       = 5,    ///< Set the channel
+  SWEEP_START         = 6,    ///< Start the sweep
+  SWEEP_STOP          = 7,    ///< Stop the sweep
+  SWEEP_QUERY         = 8,    ///< Report the state of the sweep
+  sweep_command_cnt   = 9     ///< The number of sweep command id's
+};
+
+/*!
+  @brief  Marks the start of the binary data in a WVDT command.
+
+  The data are 16-bit signed little-endian points.
+*/
+const char * const wave_data_marker = "WAVEDATA,";
+
 /*!
   @brief  Characters used to separate parts of the SCPI command line.
   
@@ -0,0 +1,307 @@
+/*!
+  @file   scpi_parser.cpp
+  @brief  Definitions of the SCPI_Parser methods.
+*/
+
+#include "scpi_parser.h"
+#include "siglent_waves.h"
+
+/*** parse_scpi() ******************************************
+
+  This method parses the SCPI commands and issues the
+  appropriate commands to the AWG.
+
+  The logic is as follows:
+
+  First, tokenize the initiator. If the initiator is the
+  identification request, set the flag for the next read
+  request and return. If it is the channel initiator,
+  get the channel and proceed to the next step.
+
+  Second, tokenize the remainder of the buffer to look
+  for a command. If it has parameters (OUTP and BSWV),
+  call process_parameters to get the parameters (ON, OFF,
+  or <parameter name>,<value> pairs), and set the AWG
+  accordingly. If the command is BSWV?, set the flag
+  for the next read request.
+
+  Repeat step 2 until there are no more commands left
+  to process.
+
+  Note that this function uses the re-entrant strtok_r,
+  not to be thread-safe (we do not anticipate multi-
+  threading on the ESP-01), but to allow an inner and
+  outer loop to work simultaneously.
+
+***********************************************************/
+
+void SCPI_Parser::parse_scpi ( char * buffer )
+{
+  char *  initiator;
+  char *  command_line;
+  char *  command;
+  char *  command_context;
+  char *  parameter_context;
+  int     id;
+
+  rw_channel = 0;
+  read_type = rt_none;
+
+  // first, get the initiator and its id
+
+  initiator = strtok_r(buffer, scpi::delimiters[scpi::INITIATOR], &command_context);
+  id = get_id(initiator, scpi::initiators, scpi::initiator_id_cnt);
+
+  // process according to the id of the initiator
+  switch ( id )
+  {
+    /*  if initializer = IDN-SGLT-PRI? then set read_type flag and
+        return - no further processing needed  */
+
+    case scpi::ID_REQUEST:
+
+      read_type = rt_identification;
+      return;
+
+    /*  if initializer = C, extract the channel and drop down
+        to do further processing  */
+
+    case scpi::CHANNEL:
+
+      sscanf(initiator+1, "%d", &rw_channel);
+      break;
+
+    // if neither, we don't recognize this initiator, so we simply return
+
+    default:
+
+      return;
+
+  } // end switch ( initiator id )
+
+  /*  If we get to this point, we have received the channel and are ready
+      to process command lines. The format of each command_line will be
+      COMMAND<space>PARAMETER,VALUE[,PARAMETER,VALUE ...]  */
+
+  command_line = strtok_r(NULL, scpi::delimiters[scpi::COMMAND], &command_context);
+
+  while ( command_line != NULL )
+  {
+    // extract the actual command from the command_line and get its id
+
+    command = strtok_r(command_line, scpi::delimiters[scpi::PRE_PARAMETERS], &parameter_context);
+    id = get_id(command, scpi::commands, scpi::command_id_cnt);
+
+    switch ( id )
+    {
+      /*  if id = OUTP, process parameters looking for "ON" or "OFF"
+          and set AWG accordingly  */
+
+      case scpi::SET_OUTPUT:
+
+        process_parameters(parameter_context);
+        break;
+
+      // if id = BSWV, process wave parameters and set AWG accordingly
+
+      case scpi::SET_PARAMETERS:
+
+        process_parameters(parameter_context);
+        break;
+
+      // if id = SWWV, process sweep parameters and set AWG accordingly
+
+      case scpi::SET_SWEEP:
+
+        process_sweep_parameters(parameter_context);
+        break;
+
+      // if id = BSWV?, set flag so that next read retrieves wave parameters
+
+      case scpi::GET_PARAMETERS:
+
+        read_type = rt_parameters;
+        break;
+
+      // if none of the above, we don't recognize the command, so we ignore it
+
+      default:
+
+        break;
+
+    } // end switch ( command id )
+
+    // extract the next command_line; if any, cycle back through the loop
+
+    command_line = strtok_r(NULL, scpi::delimiters[scpi::COMMAND], &command_context);
+
+  } // end while ( command_line != NULL )
+
+}
+
+/*** process_parameters()********************************
+
+  This method continues to tokenize the command_line via
+  the supplied parameter_context. It expects to see
+  either ON, OFF, or a parameter pair (name,value). If
+  it recognizes the parameter, it sets the AWG accordingly.
+  It continues until there are no more parameters to
+  process.
+
+********************************************************/
+
+void SCPI_Parser::process_parameters ( char * parameter_context )
+{
+  char *  parameter;
+  char *  s_val;
+  double  value;
+  int     id;
+
+  /*  Note that strtok_r here usese NULL for the initial argument,
+      because it is continuing to tokenize the line begun in
+      parse_scpi and pointed to by the parameter_context. This
+      also means that we can get the parameter in the while test. */
+
+//  Debug.Progress() << "Setting AWG Channel " << rw_channel << ": ";
+
+  while ( ( parameter = strtok_r ( NULL, scpi::delimiters[scpi::PARAMETERS], &parameter_context ) ) != NULL ) {
+
+    // translate the parameter into a parameter id or -1 if not one we know
+
+    id = get_id ( parameter, scpi::parameters, scpi::wave_parameter_count );
+
+    // if the parameter is one we recognize, process it
+
+    if ( id >= 0 )
+    {
+      switch ( id )
+      {
+        case scpi::OUTPUT_OFF:
+        case scpi::OUTPUT_ON:
+
+          value = id;   // if id is ON or OFF, let value = 0 (OFF) or 1 (ON)
+//        Debug.Progress() << "OUTPUT = " << ( id == scpi::OUTPUT_ON ? "ON" : "OFF" ) << "; ";
+
+          break;
+
+        case scpi::WAVE:
+
+          // read the following value ... but discard it and set value = siglent::Sine
+
+          s_val = strtok_r ( NULL, scpi::delimiters[scpi::PARAMETERS], &parameter_context );
+          value = siglent::Sine;
+
+          break;
+
+        default:
+
+          // if the parameter is not ON, OFF, or WAVE, we need to read the following value
+
+          s_val = strtok_r ( NULL, scpi::delimiters[scpi::PARAMETERS], &parameter_context );
+
+          if ( s_val == NULL || sscanf(s_val, "%lf", &value) != 1 )
+          {
+            return;     // a malformed line (e.g., from a client of the SCPI socket): stop here
+          }
+
+//        Debug.Progress() << parameter << " = " << value << "; ";
+
+          break;
+      }
+
+      queue_set(rw_channel,id,value);
+
+    } // end if valid id
+
+  } // end while parameter != NULL
+
+//  Debug.Progress() << "\n";
+}
+
+/*** process_sweep_parameters() ************************
+
+  This method continues to tokenize the command_line via
+  the supplied parameter_context, as process_parameters()
+  does, but for the SWWV command: every parameter comes
+  with a value, so the pairs are taken two at a time, and
+  the names we do not process (DIR, TRSR, MARK_STATE, ...)
+  are skipped along with their values. The words ON, OFF,
+  LINE and LOG are translated into 1 or 0.
+
+********************************************************/
+
+void SCPI_Parser::process_sweep_parameters ( char * parameter_context )
+{
+  char *  parameter;
+  char *  s_val;
+  double  value;
+  int     id;
+
+  while ( ( parameter = strtok_r ( NULL, scpi::delimiters[scpi::PARAMETERS], &parameter_context ) ) != NULL ) {
+
+    s_val = strtok_r ( NULL, scpi::delimiters[scpi::PARAMETERS], &parameter_context );
+
+    if ( s_val == NULL )
+    {
+      break;
+    }
+
+    // only an exact name will do, so that MARK_STATE is not taken for STATE
+
+    id = get_id ( parameter, scpi::parameters + scpi::SWWV_TIME, scpi::parameter_count - scpi::SWWV_TIME );
+
+    if ( id < 0 || strcmp ( parameter, scpi::parameters[scpi::SWWV_TIME + id] ) != 0 )
+    {
+      continue;
+    }
+
+    id += scpi::SWWV_TIME;
+
+    switch ( id )
+    {
+      case scpi::SWWV_MODE:
+
+        value = ( strcmp ( s_val, "LOG" ) == 0 ) ? 1 : 0;
+        break;
+
+      case scpi::SWWV_STATE:
+
+        value = ( strcmp ( s_val, "ON" ) == 0 ) ? 1 : 0;
+        break;
+
+      default:
+
+        if ( sscanf(s_val, "%lf", &value) != 1 )
+        {
+          return;     // a malformed value: stop here, rather than start a sweep with what follows
+        }
+
+        break;
+    }
+
+    queue_set(rw_channel,id,value);
+
+  } // end while parameter != NULL
+}
+
+/*** get_id() ******************************************
+
+  This method matches the id against one of the ids in
+  the supplied list. IF there is a match, it returns its
+  index; otherwise, it returns -1.
+
+********************************************************/
+
+int SCPI_Parser::get_id ( const char * id_text, const char * const id_list[], size_t id_cnt )
+{
+  int id = -1;
+
+  for ( int i = 0; i < id_cnt; i++ ) {
+    if ( strncmp(id_text, id_list[i], strlen(id_list[i])) == 0 ) {
+      id = i;
+      break;
+    }
+  }
+
+  return id;
+}
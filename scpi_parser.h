@@ -0,0 +1,68 @@
+#ifndef SCPI_PARSER_H
+#define SCPI_PARSER_H
+
+/*!
+  @file   scpi_parser.h
+  @brief  Declaration of the SCPI_Parser class.
+*/
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "scpi.h"
+
+/*!
+  @brief  Parses the Siglent SCPI commands sent by the scope.
+
+  This is the parser shared by the servers that receive SCPI: the
+  VXI_Server (over VXI-11) and the SCPI_Server (over a raw socket).
+  parse_scpi() passes each parameter set on to queue_set(), which
+  each of them implements to suit its transport, and leaves the
+  kind of response asked for (if any) in read_type, for the
+  channel in rw_channel.
+*/
+class SCPI_Parser
+{
+  public:
+
+    enum Read_Type {
+      rt_none           = 0,
+      rt_identification = 1,
+      rt_parameters     = 2
+    };
+
+    virtual ~SCPI_Parser ()     ///< Virtual destructor does nothing
+      {}
+
+  protected:
+
+    SCPI_Parser ()      ///< Constructor starts with no response asked for
+      : read_type(rt_none), rw_channel(0)
+      {}
+
+    /*!
+      @brief  Parse a line of SCPI commands, and pass each parameter on to queue_set().
+
+      @param  buffer  The null-terminated line, which is modified.
+    */
+    void      parse_scpi ( char * buffer );
+
+    void      process_parameters ( char * parameter_context );
+
+    void      process_sweep_parameters ( char * parameter_context );
+
+    int       get_id ( const char * id_text, const char * const id_list[], size_t id_cnt );
+
+    /*!
+      @brief  Apply a parameter parsed by parse_scpi().
+
+      @param  channel   The AWG channel (1-based)
+      @param  param_id  The id of the parameter (see scpi::parameter_id)
+      @param  value     The value of the parameter
+    */
+    virtual void  queue_set ( uint32_t channel, uint32_t param_id, double value ) = 0;
+
+    Read_Type       read_type;    ///< The response asked for by the last line parsed
+    uint32_t        rw_channel;   ///< The channel of the last line parsed
+};
+
+#endif
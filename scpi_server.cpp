@@ -0,0 +1,317 @@
+/*!
+  @file   scpi_server.cpp
+  @brief  Definitions of the SCPI_Server methods.
+*/
+
+#include "scpi_server.h"
+#include "Streaming.h"
+#include "debug.h"
+#include "scpi.h"
+
+
+void SCPI_Server::begin ( uint16_t port )
+{
+  m_server.begin(port);
+
+  Debug.Progress() << "Listening for SCPI commands on TCP port " << port << "\n";
+}
+
+
+void SCPI_Server::loop ()
+{
+  WiFiClient  client = m_server.accept();
+
+  if ( client )
+  {
+    if ( m_b_open )
+    {
+      close();    // the newest client wins
+    }
+
+    m_client = client;
+    m_client.setNoDelay(true);
+    m_b_open = true;
+    m_line_len = 0;
+    m_b_cut = false;
+    m_source = NULL;
+    m_out_head = m_out_len = 0;
+    m_b_line_ended = false;
+    m_lines = m_queries = 0;
+
+    Debug.Progress() << "SCPI connection established\n";
+  }
+
+  m_sweep.loop();
+
+  if ( ! m_b_open )
+  {
+    return;
+  }
+
+  if ( ! m_client.connected() )
+  {
+    close();
+    return;
+  }
+
+  /*  Read the lines one at a time: the next one only once the
+      response to the last one (and the sweep events) has been
+      sent; none while someone else has the AWG.  */
+
+  while ( send_response() && ! m_task.lent() && ! m_awg.uploading() && m_client.available() > 0 )
+  {
+    char  c = m_client.read();
+
+    if ( c == '\n' )
+    {
+      execute();
+    }
+    else if ( c != '\r' )
+    {
+      if ( m_line_len < sizeof(m_line) - 1 )
+      {
+        m_line[m_line_len++] = c;
+      }
+      else
+      {
+        m_b_cut = true;
+      }
+    }
+  }
+}
+
+
+void SCPI_Server::execute ()
+{
+  m_line[m_line_len] = 0;
+
+  if ( m_b_cut )
+  {
+    Debug.Error() << "SCPI line too long (more than " << (uint32_t) sizeof(m_line) - 1 << " bytes); discarded\n";
+  }
+  else if ( m_line_len > 0 )
+  {
+    Debug.Progress() << "SCPI = " << m_line << "\n";
+
+    m_lines++;
+
+    if ( strncmp(m_line, "SWEEP", 5) == 0 )
+    {
+      sweep_command();
+      m_line_len = 0;
+      return;
+    }
+
+    parse_scpi(m_line);
+
+    /*  Answer a query only once the AWG has caught up; otherwise,
+        unless in write-behind mode, do not read the next line until
+        the AWG output has settled.  */
+
+    if ( read_type != rt_none || ! m_b_write_behind )
+    {
+      m_task.complete(m_task.queue().pushed());
+    }
+
+    if ( read_type == rt_parameters )
+    {
+      m_parameter_source.begin(m_awg, m_task, rw_channel);
+      m_source = &m_parameter_source;
+      m_queries++;
+    }
+    else if ( read_type == rt_identification )
+    {
+      m_text_source.begin(m_awg.id());
+      m_source = &m_text_source;
+      m_queries++;
+    }
+  }
+
+  m_line_len = 0;
+  m_b_cut = false;
+}
+
+
+void SCPI_Server::sweep_command ()
+{
+  const char *  args = strchr(m_line, ' ');
+  double        start = 0, stop = 0, value = 0;
+  unsigned      points = 0;
+  bool          b_ok = true;
+  int           id = get_id(m_line, scpi::sweep_commands, scpi::sweep_command_cnt);
+
+  args = args ? args + 1 : "";
+
+  switch ( id )
+  {
+    case scpi::SWEEP_CLEAR:
+
+      m_sweep.clear();
+      break;
+
+    case scpi::SWEEP_POINT:
+
+      value = -1;
+      b_ok = sscanf(args, "%lf,%lf", &start, &value) >= 1 && m_sweep.add(start, value);
+      break;
+
+    case scpi::SWEEP_LINEAR:
+    case scpi::SWEEP_LOG:
+
+      b_ok = sscanf(args, "%lf,%lf,%u", &start, &stop, &points) == 3
+             && m_sweep.range(start, stop, points, id == scpi::SWEEP_LOG);
+      break;
+
+    case scpi::SWEEP_DWELL:
+
+      b_ok = sscanf(args, "%lf", &value) == 1 && value >= 0 && value * 1000 <= SWEEP_MAX_DWELL_US;
+      if ( b_ok )
+      {
+        m_sweep.dwell(value * 1000);
+      }
+      break;
+
+    case scpi::SWEEP_CHANNEL:
+
+      b_ok = sscanf(args, "%u", &points) == 1 && points >= 1 && points <= m_awg.channels();
+      if ( b_ok )
+      {
+        m_sweep.channel(points);
+      }
+      break;
+
+    case scpi::SWEEP_START:
+
+      b_ok = m_sweep.start();
+      break;
+
+    case scpi::SWEEP_STOP:
+
+      m_sweep.stop();
+      break;
+
+    case scpi::SWEEP_QUERY:
+
+      snprintf(m_status, sizeof(m_status), "#SWEEP %u,%u,%u,%u,%u", m_sweep.running() ? 1 : 0, (unsigned) m_sweep.step(),
+               (unsigned) m_sweep.points(), (unsigned) m_sweep.dwell(), (unsigned) m_sweep.dropped());
+      m_text_source.begin(m_status);
+      m_source = &m_text_source;
+      m_queries++;
+      break;
+
+    default:
+
+      b_ok = false;
+      break;
+  }
+
+  if ( ! b_ok )
+  {
+    Debug.Error() << "Invalid sweep command: " << m_line << "\n";
+  }
+}
+
+
+void SCPI_Server::queue_set ( uint32_t channel, uint32_t param_id, double value )
+{
+  if ( channel < 1 || channel > m_awg.channels() )
+  {
+    Debug.Error() << "Invalid channel " << channel << "; command not queued\n";
+    return;
+  }
+
+  m_task.push(channel, param_id, value);
+}
+
+
+bool SCPI_Server::send_response ()
+{
+  for ( ;; )
+  {
+    if ( m_out_head == m_out_len )
+    {
+      Sweep_Engine::sweep_event   e;
+
+      if ( m_source == NULL )
+      {
+        if ( ! m_sweep.event(e) )
+        {
+          return true;
+        }
+
+        m_out_len = format_event(e);
+      }
+      else if ( m_source->done() )
+      {
+        // the response ends with a newline, unless the source ends it already (as BSWV? does)
+
+        m_out[0] = '\n';
+        m_out_len = m_b_line_ended ? 0 : 1;
+        m_b_line_ended = false;
+        m_source = NULL;
+      }
+      else
+      {
+        m_out_len = m_source->read(m_out, sizeof(m_out));
+
+        if ( m_out_len > 0 )
+        {
+          m_b_line_ended = ( m_out[m_out_len-1] == '\n' );
+        }
+      }
+
+      m_out_head = 0;
+    }
+
+    int   room = m_client.availableForWrite();
+
+    if ( room <= 0 )
+    {
+      return false;
+    }
+
+    m_out_head += m_client.write((const uint8_t *) m_out + m_out_head, std::min((size_t) room, m_out_len - m_out_head));
+
+    if ( m_out_head < m_out_len )
+    {
+      return false;
+    }
+  }
+}
+
+
+size_t SCPI_Server::format_event ( const Sweep_Engine::sweep_event & e )
+{
+  int   len;
+
+  switch ( e.kind )
+  {
+    case Sweep_Engine::EVENT_STEP:
+
+      len = snprintf(m_out, sizeof(m_out), "#STEP %u,%u,%.6f\n", (unsigned) e.index, (unsigned) e.time_us, e.frequency);
+      break;
+
+    case Sweep_Engine::EVENT_DONE:
+
+      len = snprintf(m_out, sizeof(m_out), "#DONE %u,%u,%u\n", (unsigned) e.index, (unsigned) e.time_us, (unsigned) m_sweep.dropped());
+      break;
+
+    default:
+
+      len = snprintf(m_out, sizeof(m_out), "#STOP %u,%u\n", (unsigned) e.index, (unsigned) e.time_us);
+      break;
+  }
+
+  return std::min((size_t) len, sizeof(m_out) - 1);
+}
+
+
+void SCPI_Server::close ()
+{
+  m_sweep.stop();
+  m_client.stop();
+  m_b_open = false;
+  m_source = NULL;
+
+  Debug.Progress() << "SCPI connection closed; " << m_lines << " lines, " << m_queries << " queries\n";
+}
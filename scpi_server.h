@@ -0,0 +1,151 @@
+#ifndef SCPI_SERVER_H
+#define SCPI_SERVER_H
+
+/*!
+  @file   scpi_server.h
+  @brief  Declaration of the SCPI_Server class.
+*/
+
+#include <ESP8266WiFi.h>
+#include "wifi_ext.h"
+#include "awg_server.h"
+#include "awg_task.h"
+#include "scpi_parser.h"
+#include "response_source.h"
+#include "sweep_engine.h"
+
+const int       SCPI_PORT = 5025;           ///< Port on which the SCPI_Server listens (the LXI raw socket port)
+const size_t    SCPI_LINE_SIZE = 128;       ///< Longest line received (longer lines are discarded)
+
+/*!
+  @brief  Serves SCPI over a raw socket, one command line per newline.
+
+  For PC automation, VXI-11 costs a portmap lookup, a connection,
+  CREATE_LINK and DESTROY_LINK around each exchange; over a raw
+  socket, a client keeps one connection and just writes lines:
+
+    - Each line is parsed by the same parser as the VXI_Server (see
+      SCPI_Parser), and the parameters are applied to the AWG through
+      the same AWG_Task, so the commands of both servers are applied
+      in order, one at a time.
+    - A query (IDN-SGLT-PRI? or C1:BSWV?) is answered inline, with
+      the same response as a DEV_READ, ending with a newline.
+    - The next line is read only once the AWG has applied the
+      previous one (unless write_behind() is set) and its response
+      has been sent, so a client may send many lines at once and is
+      held up, through the TCP window, only at the speed of the
+      serial line.
+    - While the AWG is lent (e.g., to the Serial_Bridge) or an upload
+      is in progress, the lines wait.
+    - The SWEEP commands (see scpi::sweep_commands) drive a
+      Sweep_Engine; as it steps, a line is sent for each step
+      ("#STEP index,time_us,frequency"), and one at the end
+      ("#DONE steps,time_us,dropped" or "#STOP steps,time_us").
+      SWEEP? is answered with "#SWEEP running,step,points,dwell_us,dropped".
+
+  One client is served at a time; a new client replaces the current one.
+*/
+class SCPI_Server : public SCPI_Parser
+{
+  public:
+
+    /*!
+      @brief  Constructor saves the AWG and its AWG_Task; nothing listens until begin().
+
+      @param  awg   The AWG_Server to which the commands are applied
+      @param  task  The AWG_Task through which they are applied (see VXI_Server::awg_task())
+    */
+    SCPI_Server ( AWG_Server & awg, AWG_Task & task )
+      : m_awg(awg), m_task(task), m_sweep(awg, task), m_b_open(false), m_b_write_behind(false), m_line_len(0),
+        m_b_cut(false), m_source(NULL), m_out_head(0), m_out_len(0), m_b_line_ended(false), m_lines(0), m_queries(0)
+      {}
+
+    /*!
+      @brief  Start listening.
+
+      @param  port  The port to listen on (normally SCPI_PORT)
+    */
+    void    begin ( uint16_t port = SCPI_PORT );
+
+    /*!
+      @brief  Call this at least once per main loop to serve the client.
+    */
+    void    loop ();
+
+    /*!
+      @brief  Select whether the next line is read before the AWG has applied the previous one.
+
+      A query still waits for the AWG to catch up before it is answered.
+
+      @param  enable  True to read ahead.
+    */
+    void    write_behind ( bool enable )
+      { m_b_write_behind = enable; }
+
+    bool    write_behind ()     ///< @return True if the next line is read before the AWG has caught up
+      { return m_b_write_behind; }
+
+    Sweep_Engine &  sweep ()    ///< @return The Sweep_Engine driven by the SWEEP commands
+      { return m_sweep; }
+
+  protected:
+
+    virtual void  queue_set ( uint32_t channel, uint32_t param_id, double value );
+
+  private:
+
+    /*!
+      @brief  Parse and apply a complete line, and start its response, if any.
+    */
+    void    execute ();
+
+    /*!
+      @brief  Apply a SWEEP command, and start its response, if any.
+    */
+    void    sweep_command ();
+
+    /*!
+      @brief  Send as much of the response as the client takes without waiting.
+
+      @return True once the whole response has been sent.
+    */
+    bool    send_response ();
+
+    /*!
+      @brief  Format a sweep event into the output buffer.
+
+      @return The length of the line.
+    */
+    size_t  format_event ( const Sweep_Engine::sweep_event & e );
+
+    /*!
+      @brief  Close the connection, and report what it served.
+    */
+    void    close ();
+
+    AWG_Server &      m_awg;                ///< The AWG to which the commands are applied
+    AWG_Task &        m_task;               ///< Applies the commands
+    Sweep_Engine      m_sweep;              ///< Steps the AWG through a sweep
+    WiFiServer_ext    m_server;             ///< Listens for a client
+    WiFiClient        m_client;             ///< The client, if any
+    bool              m_b_open;             ///< True while a client is served (until close())
+    bool              m_b_write_behind;     ///< True to read the next line before the AWG has caught up
+
+    char              m_line[SCPI_LINE_SIZE];   ///< The line being received
+    size_t            m_line_len;               ///< Length of the line so far
+    bool              m_b_cut;                  ///< True if the line is too long
+
+    Text_Source       m_text_source;        ///< Generates the response to IDN-SGLT-PRI? and SWEEP?
+    Parameter_Source  m_parameter_source;   ///< Generates the response to BSWV?
+    Response_Source * m_source;             ///< The response being sent, or NULL
+    char              m_out[64];            ///< The part of the response being sent
+    size_t            m_out_head;           ///< Position of the next byte to send
+    size_t            m_out_len;            ///< Length of the part being sent
+    bool              m_b_line_ended;       ///< True if the response so far ends with a newline
+    char              m_status[64];         ///< The response to SWEEP?
+
+    uint32_t          m_lines;              ///< Number of lines served for this client
+    uint32_t          m_queries;            ///< Number of queries answered for this client
+};
+
+#endif
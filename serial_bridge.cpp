@@ -0,0 +1,566 @@
+/*!
+  @file   serial_bridge.cpp
+  @brief  Definitions of the Serial_Bridge methods.
+*/
+
+#include "serial_bridge.h"
+#include "Streaming.h"
+#include "debug.h"
+#include "telnet_service.h"
+
+/*  Telnet commands (besides TELNET_IAC) and options, and the COM-PORT-OPTION
+    commands of RFC 2217 (the answer of the server to each is command + 100).  */
+
+const uint8_t   TELNET_DONT = 254;
+const uint8_t   TELNET_DO   = 253;
+const uint8_t   TELNET_WONT = 252;
+const uint8_t   TELNET_WILL = 251;
+const uint8_t   TELNET_SB   = 250;
+const uint8_t   TELNET_SE   = 240;
+
+const uint8_t   OPTION_BINARY   = 0;
+const uint8_t   OPTION_SGA      = 3;    ///< Suppress go-ahead
+const uint8_t   OPTION_COM_PORT = 44;
+
+enum com_port_command {
+  CPO_SIGNATURE           = 0,
+  CPO_SET_BAUDRATE        = 1,
+  CPO_SET_DATASIZE        = 2,
+  CPO_SET_PARITY          = 3,
+  CPO_SET_STOPSIZE        = 4,
+  CPO_SET_CONTROL         = 5,
+  CPO_FLOWCONTROL_SUSPEND = 8,
+  CPO_FLOWCONTROL_RESUME  = 9,
+  CPO_SET_LINESTATE_MASK  = 10,
+  CPO_SET_MODEMSTATE_MASK = 11,
+  CPO_PURGE_DATA          = 12,
+  CPO_SERVER_OFFSET       = 100
+};
+
+enum bridge_iac_state {
+  IAC_NONE    = 0,    ///< Not in a command
+  IAC_COMMAND = 1,    ///< After IAC
+  IAC_OPTION  = 2,    ///< After IAC WILL / WONT / DO / DONT
+  IAC_SUB     = 3,    ///< In a subnegotiation
+  IAC_SUB_IAC = 4     ///< After IAC in a subnegotiation
+};
+
+/*!
+  @brief  Answer a SET-CONTROL command.
+
+  The serial line has no flow control, no break, and no modem
+  lines, so a request for the state reports that, and a request to
+  change DTR or RTS is accepted (and has no effect).
+
+  @param  request   The value of the command
+  @return The value of the answer
+*/
+static uint8_t control_state ( uint8_t request )
+{
+  switch ( request )
+  {
+    case 4: case 5: case 6:       return 6;         // break: off
+    case 7:                       return 8;         // DTR: on
+    case 8: case 9:               return request;   // DTR set on / off
+    case 10:                      return 11;        // RTS: on
+    case 11: case 12:             return request;   // RTS set on / off
+    default:                      return ( request >= 13 ) ? 14 : 1;    // inbound / outbound flow control: none
+  }
+}
+
+
+void Serial_Bridge::begin ( uint16_t port )
+{
+  m_server.begin(port);
+
+  Debug.Progress() << "Serial bridge listening on port " << port << "\n";
+}
+
+
+void Serial_Bridge::loop ()
+{
+  WiFiClient  client = m_server.accept();
+
+  if ( client )
+  {
+    if ( m_b_open )
+    {
+      close();    // the newest client wins
+    }
+
+    m_client = client;
+    m_b_open = true;
+    m_since = millis();
+    m_mode = MODE_UNKNOWN;
+    m_b_suspended = false;
+    m_iac = IAC_NONE;
+    m_sub_len = 0;
+    m_baud = 0;
+    m_in_head = m_in_len = m_out_head = m_out_len = 0;
+    m_to_awg = m_from_awg = m_holds = m_dropped = 0;
+
+    Debug.Progress() << "Serial bridge connection established\n";
+  }
+
+  if ( ! m_b_open )
+  {
+    return;
+  }
+
+  if ( ! m_client.connected() )
+  {
+    close();
+    return;
+  }
+
+  /*  Borrow the AWG only when the client has something for it;
+      until it can be borrowed, the input waits in the connection.  */
+
+  if ( ! m_b_holding )
+  {
+    if ( m_in_head == m_in_len && m_client.available() <= 0 )
+    {
+      send();     // what is left of the output
+      return;
+    }
+
+    if ( ! m_task.lend() )
+    {
+      return;
+    }
+
+    m_b_holding = true;
+    m_holds++;
+    m_since = m_last_active = millis();
+
+    while ( m_awg.port().available() > 0 )
+    {
+      m_awg.port().read();    // left over from the VXI_Server (e.g., a response it gave up on)
+    }
+
+    if ( m_baud != 0 )
+    {
+      apply_baud(m_baud);
+    }
+  }
+
+  bool  b_active = receive();
+
+  if ( m_in_head < m_in_len )
+  {
+    int   room = m_awg.port().availableForWrite();
+
+    if ( room > 0 )
+    {
+      size_t  n = m_awg.port().write(m_in + m_in_head, std::min((size_t) room, m_in_len - m_in_head));
+
+      m_in_head += n;
+      m_to_awg += n;
+      b_active |= ( n > 0 );
+    }
+  }
+
+  b_active |= read_awg();
+
+  send();
+
+  if ( b_active )
+  {
+    m_last_active = millis();
+  }
+  else if ( m_in_head == m_in_len )
+  {
+    /*  Give the AWG back once the traffic stops; after a turn of
+        SERIAL_BRIDGE_TURN_MS, also at a shorter gap (e.g., between
+        a response and the next command), so that a client that
+        keeps talking does not shut out the VXI_Server.  */
+
+    uint32_t  quiet = millis() - m_last_active;
+
+    if ( quiet >= SERIAL_BRIDGE_IDLE_MS || ( quiet >= SERIAL_BRIDGE_GAP_MS && millis() - m_since >= SERIAL_BRIDGE_TURN_MS ) )
+    {
+      give_back();
+    }
+  }
+}
+
+
+bool Serial_Bridge::receive ()
+{
+  size_t  n = 0;
+
+  if ( m_in_head < m_in_len )
+  {
+    return false;     // the AWG has not taken the previous input yet
+  }
+
+  while ( n < sizeof(m_in) && m_client.available() > 0 )
+  {
+    m_in[n++] = m_client.read();
+  }
+
+  m_in_head = m_in_len = 0;
+
+  if ( n == 0 )
+  {
+    return false;
+  }
+
+  if ( m_mode == MODE_UNKNOWN )
+  {
+    m_mode = ( m_in[0] == TELNET_IAC ) ? MODE_RFC2217 : MODE_RAW;
+
+    Debug.Progress() << "Serial bridge: " << ( m_mode == MODE_RFC2217 ? "RFC 2217" : "raw" ) << " client\n";
+  }
+
+  if ( m_mode == MODE_RFC2217 )
+  {
+    decode(n);
+  }
+  else
+  {
+    m_in_len = n;
+  }
+
+  return true;
+}
+
+
+void Serial_Bridge::decode ( size_t len )
+{
+  /*  The data are moved down over the Telnet commands; m_in_len is
+      the length of the data so far (never beyond the byte read).  */
+
+  for ( size_t i = 0; i < len; i++ )
+  {
+    uint8_t   byte = m_in[i];
+
+    switch ( m_iac )
+    {
+      case IAC_NONE:
+        if ( byte == TELNET_IAC )
+        {
+          m_iac = IAC_COMMAND;
+        }
+        else
+        {
+          m_in[m_in_len++] = byte;
+        }
+
+        break;
+
+      case IAC_COMMAND:
+        if ( byte == TELNET_IAC )
+        {
+          m_in[m_in_len++] = byte;      // an escaped data byte
+          m_iac = IAC_NONE;
+        }
+        else if ( byte >= TELNET_WILL && byte <= TELNET_DONT )
+        {
+          m_verb = byte;
+          m_iac = IAC_OPTION;
+        }
+        else if ( byte == TELNET_SB )
+        {
+          m_sub_len = 0;
+          m_iac = IAC_SUB;
+        }
+        else
+        {
+          m_iac = IAC_NONE;             // e.g., NOP
+        }
+
+        break;
+
+      case IAC_OPTION:
+        negotiate(byte);
+        m_iac = IAC_NONE;
+        break;
+
+      case IAC_SUB:
+        if ( byte == TELNET_IAC )
+        {
+          m_iac = IAC_SUB_IAC;
+        }
+        else if ( m_sub_len < sizeof(m_sub) )
+        {
+          m_sub[m_sub_len++] = byte;
+        }
+
+        break;
+
+      default:      // IAC_SUB_IAC
+        if ( byte == TELNET_IAC )
+        {
+          if ( m_sub_len < sizeof(m_sub) )
+          {
+            m_sub[m_sub_len++] = byte;
+          }
+
+          m_iac = IAC_SUB;
+        }
+        else
+        {
+          if ( byte == TELNET_SE && m_sub_len >= 2 && m_sub[0] == OPTION_COM_PORT )
+          {
+            com_port_option();
+          }
+
+          m_iac = IAC_NONE;
+        }
+
+        break;
+    }
+  }
+}
+
+
+void Serial_Bridge::negotiate ( uint8_t option )
+{
+  uint8_t   answer[3] = { TELNET_IAC, 0, option };
+
+  /*  Binary transmission and no go-ahead both ways, and the
+      COM-PORT-OPTION from the client; nothing else.  */
+
+  if ( m_verb == TELNET_WILL )
+  {
+    answer[1] = ( option == OPTION_BINARY || option == OPTION_SGA || option == OPTION_COM_PORT ) ? TELNET_DO : TELNET_DONT;
+  }
+  else if ( m_verb == TELNET_DO )
+  {
+    answer[1] = ( option == OPTION_BINARY || option == OPTION_SGA ) ? TELNET_WILL : TELNET_WONT;
+  }
+  else
+  {
+    return;     // WONT and DONT need no answer: nothing else was agreed
+  }
+
+  reply(answer, sizeof(answer));
+}
+
+
+void Serial_Bridge::com_port_option ()
+{
+  uint8_t   command = m_sub[1];
+  uint8_t * value = m_sub + 2;
+  size_t    len = m_sub_len - 2;
+  uint8_t   answer[4];
+
+  switch ( command )
+  {
+    case CPO_SIGNATURE:
+      if ( len == 0 )
+      {
+        reply_sub(command, (const uint8_t *) "espBode", 7);    // else it is the signature of the client
+      }
+
+      break;
+
+    case CPO_SET_BAUDRATE:
+      if ( len >= 4 )
+      {
+        uint32_t  baud = ( (uint32_t) value[0] << 24 ) | ( (uint32_t) value[1] << 16 ) | ( (uint32_t) value[2] << 8 ) | value[3];
+
+        if ( baud != 0 && m_baud_hook && ( ! m_b_holding || apply_baud(baud) ) )
+        {
+          m_baud = baud;
+        }
+      }
+
+      {
+        uint32_t  baud = ( m_baud != 0 ) ? m_baud : m_awg.baud_rate();
+
+        answer[0] = baud >> 24;
+        answer[1] = baud >> 16;
+        answer[2] = baud >> 8;
+        answer[3] = baud;
+        reply_sub(command, answer, 4);
+      }
+
+      break;
+
+    case CPO_SET_DATASIZE:
+      answer[0] = 8;
+      reply_sub(command, answer, 1);
+      break;
+
+    case CPO_SET_PARITY:
+    case CPO_SET_STOPSIZE:
+      answer[0] = 1;      // no parity; one stop bit
+      reply_sub(command, answer, 1);
+      break;
+
+    case CPO_SET_CONTROL:
+      answer[0] = control_state(len > 0 ? value[0] : 0);
+      reply_sub(command, answer, 1);
+      break;
+
+    case CPO_FLOWCONTROL_SUSPEND:
+    case CPO_FLOWCONTROL_RESUME:
+      m_b_suspended = ( command == CPO_FLOWCONTROL_SUSPEND );
+      break;
+
+    case CPO_SET_LINESTATE_MASK:
+    case CPO_SET_MODEMSTATE_MASK:
+      answer[0] = 0;      // no state is ever notified
+      reply_sub(command, answer, 1);
+      break;
+
+    case CPO_PURGE_DATA:
+      if ( len > 0 && ( value[0] == 1 || value[0] == 3 ) )
+      {
+        while ( m_awg.port().available() > 0 )
+        {
+          m_awg.port().read();    // received from the AWG, not yet sent
+        }
+      }
+
+      if ( len > 0 && ( value[0] == 2 || value[0] == 3 ) )
+      {
+        m_in_len = 0;             // received from the client, not yet sent to the AWG
+      }
+
+      reply_sub(command, value, std::min(len, (size_t) 1));
+      break;
+
+    default:
+      break;
+  }
+}
+
+
+bool Serial_Bridge::read_awg ()
+{
+  Stream &  port = m_awg.port();
+  size_t    room = sizeof(m_out) - m_out_len;
+  size_t    limit = ( m_mode == MODE_RFC2217 ) ? room / 2 : room;    // each byte may need escaping
+  size_t    n;
+
+  for ( n = 0; n < limit && port.available() > 0; n++ )
+  {
+    uint8_t   byte = port.read();
+
+    m_out[m_out_len++] = byte;
+
+    if ( byte == TELNET_IAC && m_mode == MODE_RFC2217 )
+    {
+      m_out[m_out_len++] = byte;
+    }
+  }
+
+  m_from_awg += n;
+
+  return ( n > 0 );
+}
+
+
+void Serial_Bridge::send ()
+{
+  if ( m_out_head == m_out_len || m_b_suspended )
+  {
+    return;
+  }
+
+  int   room = m_client.availableForWrite();
+
+  if ( room > 0 )
+  {
+    m_out_head += m_client.write(m_out + m_out_head, std::min((size_t) room, m_out_len - m_out_head));
+  }
+
+  if ( m_out_head == m_out_len )
+  {
+    m_out_head = m_out_len = 0;
+  }
+  else if ( m_out_head > 0 )
+  {
+    memmove(m_out, m_out + m_out_head, m_out_len - m_out_head);    // make room at the end
+    m_out_len -= m_out_head;
+    m_out_head = 0;
+  }
+}
+
+
+void Serial_Bridge::reply ( const uint8_t * data, size_t len )
+{
+  if ( m_out_len + len > sizeof(m_out) )
+  {
+    m_dropped++;
+    return;
+  }
+
+  memcpy(m_out + m_out_len, data, len);
+  m_out_len += len;
+}
+
+
+void Serial_Bridge::reply_sub ( uint8_t command, const uint8_t * value, size_t len )
+{
+  uint8_t   answer[4 + 2 * 8 + 2];
+  size_t    n = 0;
+
+  answer[n++] = TELNET_IAC;
+  answer[n++] = TELNET_SB;
+  answer[n++] = OPTION_COM_PORT;
+  answer[n++] = command + CPO_SERVER_OFFSET;
+
+  for ( size_t i = 0; i < len && i < 8; i++ )
+  {
+    answer[n++] = value[i];
+
+    if ( value[i] == TELNET_IAC )
+    {
+      answer[n++] = TELNET_IAC;
+    }
+  }
+
+  answer[n++] = TELNET_IAC;
+  answer[n++] = TELNET_SE;
+
+  reply(answer, n);
+}
+
+
+bool Serial_Bridge::apply_baud ( uint32_t baud )
+{
+  if ( ! m_baud_hook )
+  {
+    return false;
+  }
+
+  m_awg.port().flush();     // let the bytes already sent go out at the old rate
+
+  if ( ! m_baud_hook(baud) )
+  {
+    Debug.Error() << "Serial bridge: baud rate " << baud << " cannot be used\n";
+    return false;
+  }
+
+  return true;
+}
+
+
+void Serial_Bridge::give_back ()
+{
+  if ( m_b_holding )
+  {
+    if ( m_baud != 0 && m_baud != m_awg.baud_rate() )
+    {
+      apply_baud(m_awg.baud_rate());
+    }
+
+    m_task.take_back();
+    m_b_holding = false;
+  }
+}
+
+
+void Serial_Bridge::close ()
+{
+  give_back();
+  m_client.stop();
+  m_b_open = false;
+
+  Debug.Progress() << "Serial bridge connection closed; " << m_to_awg << " bytes to the AWG, " << m_from_awg
+                   << " bytes from the AWG; the AWG was borrowed " << m_holds << " times; " << m_dropped << " replies dropped\n";
+}
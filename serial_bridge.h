@@ -0,0 +1,205 @@
+#ifndef SERIAL_BRIDGE_H
+#define SERIAL_BRIDGE_H
+
+/*!
+  @file   serial_bridge.h
+  @brief  Declaration of the Serial_Bridge class.
+*/
+
+#include <ESP8266WiFi.h>
+#include "wifi_ext.h"
+#include "awg_server.h"
+#include "awg_task.h"
+
+const int       SERIAL_BRIDGE_PORT = 2217;          ///< Port on which the Serial_Bridge listens
+const size_t    SERIAL_BRIDGE_BUFFER = 256;         ///< Size of the buffer for each direction
+const uint32_t  SERIAL_BRIDGE_IDLE_MS = 100;        ///< Quiet time after which the AWG is given back
+const uint32_t  SERIAL_BRIDGE_TURN_MS = 500;        ///< Time the AWG is held before a shorter gap is enough
+const uint32_t  SERIAL_BRIDGE_GAP_MS = 20;          ///< Quiet time that ends a turn
+
+/*!
+  @brief  Bridges a TCP connection to the serial line of the AWG.
+
+  This lets PC software (e.g., the vendor software of the AWG, or a
+  script) talk to the AWG over the network as if it were connected
+  to a local serial port. It takes the place of the Telnet
+  PASSTHROUGH command, which forwards one line at a time:
+
+    - Data are moved in bulk in both directions, through a buffer
+      of SERIAL_BRIDGE_BUFFER bytes each way. Data are read from one
+      side only when there is room for them on the other, so a slow
+      reader holds up the writer (through the TCP window, or the
+      serial input buffer) instead of losing data.
+    - A connection whose first byte is a Telnet IAC speaks RFC 2217
+      (e.g., pySerial "rfc2217://host:2217"): the baud rate can be
+      set and read, the line settings are reported (always 8N1, no
+      flow control), the client can suspend and resume the output,
+      and data bytes of 255 are escaped. Any other connection is a
+      raw byte stream (e.g., "socket://host:2217").
+    - The AWG is shared with the VXI_Server: the bridge borrows the
+      AWG through AWG_Task::lend() while there is traffic, and gives
+      it back after SERIAL_BRIDGE_IDLE_MS without any, so that the
+      two never interleave commands. A client that never stops
+      gives the AWG back at the first gap of SERIAL_BRIDGE_GAP_MS
+      after a turn of SERIAL_BRIDGE_TURN_MS, so that the VXI_Server
+      can serve a waiting request. While the VXI_Server holds the
+      AWG (e.g., during an upload), the client waits. As the client
+      may have changed the AWG settings, the AWG_Server forgets the
+      values it remembered when the AWG is given back, so BSWV? no
+      longer reports them, and the health monitor does not restore them.
+
+  One client is served at a time; a new client replaces the current
+  one. When a baud rate is set, the baud hook applies it to the
+  serial line while the bridge holds the AWG; the rate of the AWG
+  (see AWG_Server::baud_rate()) is restored when it is given back.
+*/
+class Serial_Bridge
+{
+  public:
+
+    /*!
+      @brief  Constructor saves the AWG and its AWG_Task; nothing listens until begin().
+
+      @param  awg   The AWG_Server whose serial line (see AWG_Server::port()) is bridged
+      @param  task  The AWG_Task through which the AWG is borrowed
+    */
+    Serial_Bridge ( AWG_Server & awg, AWG_Task & task )
+      : m_awg(awg), m_task(task), m_baud_hook(NULL), m_b_open(false), m_mode(MODE_UNKNOWN), m_b_holding(false), m_b_suspended(false),
+        m_iac(0), m_verb(0), m_sub_len(0), m_baud(0), m_last_active(0), m_since(0), m_in_head(0), m_in_len(0), m_out_head(0), m_out_len(0),
+        m_to_awg(0), m_from_awg(0), m_holds(0), m_dropped(0)
+      {}
+
+    /*!
+      @brief  Start listening.
+
+      @param  port  The port to listen on (normally SERIAL_BRIDGE_PORT)
+    */
+    void    begin ( uint16_t port = SERIAL_BRIDGE_PORT );
+
+    /*!
+      @brief  Call this at least once per main loop to move the data.
+    */
+    void    loop ();
+
+    /*!
+      @brief  Set the function that changes the baud rate of the serial line.
+
+      @param  hook  Called with the baud rate; returns false if it
+                    cannot be used. NULL (the default) keeps the rate
+                    of the AWG.
+    */
+    void    baud_hook ( bool (*hook)( uint32_t baud ) )
+      { m_baud_hook = hook; }
+
+  private:
+
+    /*!
+      @brief  The protocol spoken by the client, known from its first byte.
+    */
+    enum bridge_mode {
+      MODE_UNKNOWN  = 0,    ///< Nothing received yet
+      MODE_RAW      = 1,    ///< A plain byte stream
+      MODE_RFC2217  = 2     ///< Telnet with the COM-PORT-OPTION
+    };
+
+    /*!
+      @brief  Read the client input into the input buffer (once the AWG has taken the previous input), and decode it.
+
+      @return True if anything was read.
+    */
+    bool    receive ();
+
+    /*!
+      @brief  Decode the Telnet commands in the input, in place.
+
+      @param  len   The number of bytes read
+    */
+    void    decode ( size_t len );
+
+    /*!
+      @brief  Answer a WILL or DO from the client.
+
+      @param  option  The option negotiated (the verb is in m_verb)
+    */
+    void    negotiate ( uint8_t option );
+
+    /*!
+      @brief  Act on a COM-PORT-OPTION subnegotiation received in m_sub.
+    */
+    void    com_port_option ();
+
+    /*!
+      @brief  Read the output of the AWG into the output buffer, as far as it has room.
+
+      @return True if anything was read.
+    */
+    bool    read_awg ();
+
+    /*!
+      @brief  Send as much of the output as the client takes without waiting.
+    */
+    void    send ();
+
+    /*!
+      @brief  Add a Telnet command to the output, or count it as dropped.
+    */
+    void    reply ( const uint8_t * data, size_t len );
+
+    /*!
+      @brief  Add an answer to a COM-PORT-OPTION command to the output.
+
+      @param  command   The command answered (the answer is command + 100)
+      @param  value     The value, most significant byte first
+      @param  len       The length of the value
+    */
+    void    reply_sub ( uint8_t command, const uint8_t * value, size_t len );
+
+    /*!
+      @brief  Apply a baud rate to the serial line, if there is a baud hook.
+
+      @return False if there is no baud hook, or it refused the rate.
+    */
+    bool    apply_baud ( uint32_t baud );
+
+    /*!
+      @brief  Give the AWG back to the VXI_Server.
+    */
+    void    give_back ();
+
+    /*!
+      @brief  Close the connection, and report what it moved.
+    */
+    void    close ();
+
+    AWG_Server &    m_awg;              ///< The AWG whose serial line is bridged
+    AWG_Task &      m_task;             ///< Lends the AWG to the bridge
+    bool            (*m_baud_hook)( uint32_t baud );    ///< Changes the baud rate, or NULL
+    WiFiServer_ext  m_server;           ///< Listens for a client
+    WiFiClient      m_client;           ///< The client, if any
+    bool            m_b_open;           ///< True while a client is served (until close())
+
+    bridge_mode     m_mode;             ///< The protocol spoken by the client
+    bool            m_b_holding;        ///< True while the bridge holds the AWG
+    bool            m_b_suspended;      ///< True while the client has suspended the output (RFC 2217)
+    uint8_t         m_iac;              ///< Position in a Telnet command of the input
+    uint8_t         m_verb;             ///< WILL, WONT, DO, or DONT of the option negotiated
+    uint8_t         m_sub[8];           ///< The subnegotiation being received (cut if longer)
+    size_t          m_sub_len;          ///< Length of the subnegotiation so far
+    uint32_t        m_baud;             ///< Baud rate set by the client, or 0
+    uint32_t        m_last_active;      ///< Time (millis) of the latest data moved
+    uint32_t        m_since;            ///< Time (millis) at which the AWG was borrowed
+
+    uint8_t         m_in[SERIAL_BRIDGE_BUFFER];         ///< Data for the AWG (decoded in place)
+    size_t          m_in_head;                          ///< Position of the next byte for the AWG
+    size_t          m_in_len;                           ///< Length of the data for the AWG
+    uint8_t         m_out[2 * SERIAL_BRIDGE_BUFFER];    ///< Data for the client (with room to escape)
+    size_t          m_out_head;                         ///< Position of the next byte for the client
+    size_t          m_out_len;                          ///< Length of the data for the client
+
+    uint32_t        m_to_awg;           ///< Number of bytes sent to the AWG by this client
+    uint32_t        m_from_awg;         ///< Number of bytes received from the AWG for this client
+    uint32_t        m_holds;            ///< Number of times this client has borrowed the AWG
+    uint32_t        m_dropped;          ///< Number of Telnet replies dropped for want of room
+};
+
+#endif
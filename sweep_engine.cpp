@@ -0,0 +1,220 @@
+/*!
+  @file   sweep_engine.cpp
+  @brief  Definitions of the Sweep_Engine methods.
+*/
+
+#include "sweep_engine.h"
+#include <math.h>
+#include "Streaming.h"
+#include "debug.h"
+#include "scpi.h"
+
+
+void Sweep_Engine::clear ()
+{
+  stop();
+
+  m_b_range = false;
+  m_points = 0;
+}
+
+
+bool Sweep_Engine::add ( double frequency, double amplitude )
+{
+  stop();
+
+  if ( m_b_range )
+  {
+    m_b_range = false;
+    m_points = 0;
+  }
+
+  if ( m_points >= SWEEP_MAX_POINTS || frequency <= 0 )
+  {
+    return false;
+  }
+
+  m_frequencies[m_points] = frequency;
+  m_amplitudes[m_points] = amplitude;
+  m_points++;
+
+  return true;
+}
+
+
+bool Sweep_Engine::range ( double start, double stop_frequency, uint32_t points, bool b_log )
+{
+  stop();
+
+  if ( points < 2 || start <= 0 || stop_frequency <= 0 )
+  {
+    return false;
+  }
+
+  m_b_range = true;
+  m_b_log = b_log;
+  m_start = start;
+  m_stop = stop_frequency;
+  m_points = points;
+
+  return true;
+}
+
+
+double Sweep_Engine::frequency ( uint32_t index )
+{
+  if ( ! m_b_range )
+  {
+    return m_frequencies[index];
+  }
+
+  double  fraction = (double) index / ( m_points - 1 );
+
+  return m_b_log ? m_start * pow(m_stop / m_start, fraction) : m_start + ( m_stop - m_start ) * fraction;
+}
+
+
+bool Sweep_Engine::start ()
+{
+  stop();
+
+  if ( m_points == 0 )
+  {
+    return false;
+  }
+
+  m_b_running = true;
+  m_step = 0;
+  m_dropped = 0;      // the events not yet sent (e.g., the end of the last sweep) are kept
+  m_start_us = m_next_us = micros();
+
+  Debug.Progress() << "Sweep of " << m_points << " points started on channel " << m_channel << "; dwell = " << m_dwell_us << " us\n";
+
+  return true;
+}
+
+
+void Sweep_Engine::stop ()
+{
+  if ( m_b_running )
+  {
+    m_b_running = false;
+    notify(EVENT_STOPPED, m_step, 0);
+
+    Debug.Progress() << "Sweep stopped after " << m_step << " of " << m_points << " points\n";
+  }
+}
+
+
+void Sweep_Engine::loop ()
+{
+  if ( ! m_b_running || (int32_t)( micros() - m_next_us ) < 0 )
+  {
+    return;
+  }
+
+  if ( m_step == m_points )
+  {
+    m_b_running = false;      // the dwell of the last step has elapsed
+    notify(EVENT_DONE, m_step, 0);
+
+    Debug.Progress() << "Sweep of " << m_points << " points done in " << ( micros() - m_start_us ) << " us; "
+                     << m_dropped << " events dropped\n";
+    return;
+  }
+
+  if ( m_task.lent() || m_awg.uploading() )
+  {
+    return;     // the step waits until the AWG is back
+  }
+
+  double  f = frequency(m_step);
+
+  if ( ! m_b_range && m_amplitudes[m_step] >= 0 )
+  {
+    m_task.push(m_channel, scpi::AMPLITUDE, m_amplitudes[m_step]);
+  }
+
+  m_task.push(m_channel, scpi::FREQUENCY, f);
+
+  /*  The dwell starts once the output has settled at the new point.  */
+
+  m_task.complete(m_task.queue().pushed());
+
+  uint32_t  now = micros();
+
+  notify(EVENT_STEP, m_step, f);
+
+  m_step++;
+  m_next_us = now + m_dwell_us;
+}
+
+
+uint32_t Sweep_Engine::due_us ()
+{
+  if ( ! m_b_running )
+  {
+    return 0xFFFFFFFF;
+  }
+
+  int32_t   remaining = (int32_t)( m_next_us - micros() );
+
+  return ( remaining > 0 ) ? remaining : 0;
+}
+
+
+void Sweep_Engine::notify ( uint8_t kind, uint32_t index, double frequency )
+{
+  if ( m_event_count == SWEEP_EVENTS )
+  {
+    /*  Drop the oldest step, so that the end of a sweep (#DONE or
+        #STOP) is never lost, even when a sweep is restarted before
+        the client has read it (if only ends are queued, the oldest
+        goes).  */
+
+    uint32_t  n = 0;
+
+    while ( n < m_event_count && m_events[( m_event_head + n ) % SWEEP_EVENTS].kind != EVENT_STEP )
+    {
+      n++;
+    }
+
+    if ( n == m_event_count )
+    {
+      n = 0;
+    }
+
+    for ( ; n > 0; n-- )
+    {
+      m_events[( m_event_head + n ) % SWEEP_EVENTS] = m_events[( m_event_head + n - 1 ) % SWEEP_EVENTS];
+    }
+
+    m_event_head = ( m_event_head + 1 ) % SWEEP_EVENTS;
+    m_event_count--;
+    m_dropped++;
+  }
+
+  sweep_event & e = m_events[( m_event_head + m_event_count ) % SWEEP_EVENTS];
+
+  e.kind = kind;
+  e.index = index;
+  e.time_us = micros() - m_start_us;
+  e.frequency = frequency;
+
+  m_event_count++;
+}
+
+
+bool Sweep_Engine::event ( sweep_event & event )
+{
+  if ( m_event_count == 0 )
+  {
+    return false;
+  }
+
+  event = m_events[m_event_head];
+  m_event_head = ( m_event_head + 1 ) % SWEEP_EVENTS;
+  m_event_count--;
+
+  return true;
+}
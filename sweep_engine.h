@@ -0,0 +1,219 @@
+#ifndef SWEEP_ENGINE_H
+#define SWEEP_ENGINE_H
+
+/*!
+  @file   sweep_engine.h
+  @brief  Declaration of the Sweep_Engine class.
+*/
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "awg_server.h"
+#include "awg_task.h"
+
+const int   SWEEP_MAX_POINTS = 128;     ///< Most points in an uploaded list
+const int   SWEEP_EVENTS = 16;          ///< Step notifications kept until they are sent
+const uint32_t  SWEEP_MAX_DWELL_US = 0x7fffffff;   ///< Longest dwell (the deadline is compared as a signed 32-bit difference)
+
+/*!
+  @brief  Steps the AWG through a sweep on its own, one point per dwell time.
+
+  When a PC drives a measurement one frequency at a time, each point
+  costs a network round trip, and the WiFi jitter decides when the
+  output changes. Instead, the client uploads the plan of the sweep
+  once (through the SCPI_Server), and the engine steps the AWG itself:
+
+    - The plan is either a list of up to SWEEP_MAX_POINTS points
+      (a frequency and, optionally, an amplitude each), or a range
+      from a start to a stop frequency in a number of points, spaced
+      linearly or logarithmically (computed as needed, so a range
+      may have any number of points).
+    - Each step is applied through the AWG_Task, in order with the
+      commands of the other servers, and once it has been applied and
+      the AWG output has settled (see AWG_Server::settling()), the
+      step is timestamped and the next one is due a dwell time later.
+      The dwell is thus the time the output stays stable at each
+      point, whatever the serial line takes.
+    - Each step produces a sweep_event (its index, the time since the
+      start in microseconds, and the frequency), which the SCPI_Server
+      sends to the client, so that the PC can match its captures to
+      the steps. If the client falls behind by more than SWEEP_EVENTS
+      steps, the oldest steps are dropped (and counted); the end of a
+      sweep is always kept, also when a new sweep is started before
+      the client has read it.
+
+  The engine runs in loop(), on the network side. A step due while the
+  AWG is lent (e.g., to the Serial_Bridge) or an upload is in progress
+  waits until it is back.
+*/
+class Sweep_Engine
+{
+  public:
+
+    /*!
+      @brief  What a sweep_event reports.
+    */
+    enum event_kind {
+      EVENT_STEP    = 0,    ///< A step has been applied
+      EVENT_DONE    = 1,    ///< The last step has been applied, and the dwell has elapsed
+      EVENT_STOPPED = 2     ///< The sweep was stopped before the end
+    };
+
+    /*!
+      @brief  A notification of the progress of a sweep.
+    */
+    struct sweep_event
+    {
+      uint8_t   kind;         ///< An event_kind
+      uint32_t  index;        ///< The step (0-based); for DONE and STOPPED, the number of steps applied
+      uint32_t  time_us;      ///< Time since the start of the sweep
+      double    frequency;    ///< The frequency of the step (0 for DONE and STOPPED)
+    };
+
+    /*!
+      @brief  Constructor starts with an empty plan, on channel 1, with a dwell of 10 ms.
+
+      @param  awg   The AWG_Server that is swept
+      @param  task  The AWG_Task through which the steps are applied
+    */
+    Sweep_Engine ( AWG_Server & awg, AWG_Task & task )
+      : m_awg(awg), m_task(task), m_channel(1), m_dwell_us(10000), m_b_range(false), m_b_log(false),
+        m_start(0), m_stop(0), m_points(0), m_b_running(false), m_step(0), m_start_us(0), m_next_us(0),
+        m_event_head(0), m_event_count(0), m_dropped(0)
+      {}
+
+    /*!
+      @brief  Empty the plan (and stop the sweep).
+    */
+    void      clear ();
+
+    /*!
+      @brief  Add a point to the list (and stop the sweep).
+
+      A range set by range() is replaced by the list.
+
+      @param  frequency   The frequency in Hz
+      @param  amplitude   The amplitude in V, or a negative value to leave it as is
+
+      @return False if the list is full.
+    */
+    bool      add ( double frequency, double amplitude = -1 );
+
+    /*!
+      @brief  Set the plan to a range of frequencies (and stop the sweep).
+
+      @param  start           The first frequency in Hz
+      @param  stop_frequency  The last frequency in Hz
+      @param  points          The number of points (at least 2)
+      @param  b_log           True to space the points logarithmically
+
+      @return False if the range is not valid.
+    */
+    bool      range ( double start, double stop_frequency, uint32_t points, bool b_log );
+
+    /*!
+      @brief  Set the time the output stays at each point.
+
+      @param  us  The dwell time in microseconds (at most SWEEP_MAX_DWELL_US)
+    */
+    void      dwell ( uint32_t us )
+      { m_dwell_us = std::min(us, SWEEP_MAX_DWELL_US); }
+
+    uint32_t  dwell ()      ///< @return The dwell time in microseconds
+      { return m_dwell_us; }
+
+    /*!
+      @brief  Set the channel that is swept.
+
+      @param  ch  The AWG channel (1-based)
+    */
+    void      channel ( uint32_t ch )
+      { m_channel = ch; }
+
+    uint32_t  channel ()    ///< @return The channel that is swept
+      { return m_channel; }
+
+    uint32_t  points ()     ///< @return The number of points in the plan
+      { return m_points; }
+
+    uint32_t  step ()       ///< @return The number of steps applied in the current (or last) sweep
+      { return m_step; }
+
+    uint32_t  dropped ()    ///< @return The number of events dropped in the current (or last) sweep
+      { return m_dropped; }
+
+    bool      running ()    ///< @return True while a sweep is in progress
+      { return m_b_running; }
+
+    /*!
+      @brief  Start the sweep from the first point.
+
+      @return False if the plan is empty.
+    */
+    bool      start ();
+
+    /*!
+      @brief  Stop the sweep (an EVENT_STOPPED is added if one was in progress).
+    */
+    void      stop ();
+
+    /*!
+      @brief  Call this at least once per main loop to apply the steps that are due.
+    */
+    void      loop ();
+
+    /*!
+      @brief  Return the time until the next step is due.
+
+      The Linux main loop uses this to wake up in time.
+
+      @return The time in microseconds (0 if due; 0xFFFFFFFF if no sweep is in progress)
+    */
+    uint32_t  due_us ();
+
+    /*!
+      @brief  Take the oldest event not yet sent.
+
+      @param  event   Receives the event
+
+      @return False if there is none.
+    */
+    bool      event ( sweep_event & event );
+
+  private:
+
+    /*!
+      @brief  Return the frequency of a point of the plan.
+    */
+    double    frequency ( uint32_t index );
+
+    /*!
+      @brief  Add an event, dropping the oldest one if there is no room.
+    */
+    void      notify ( uint8_t kind, uint32_t index, double frequency );
+
+    AWG_Server &    m_awg;              ///< The AWG that is swept
+    AWG_Task &      m_task;             ///< Applies the steps
+    uint32_t        m_channel;          ///< The channel that is swept
+    uint32_t        m_dwell_us;         ///< Time the output stays at each point
+
+    bool            m_b_range;          ///< True if the plan is a range rather than a list
+    bool            m_b_log;            ///< True if the range is logarithmic
+    double          m_start;            ///< First frequency of the range
+    double          m_stop;             ///< Last frequency of the range
+    uint32_t        m_points;           ///< Number of points in the plan
+    double          m_frequencies[SWEEP_MAX_POINTS];    ///< Frequencies of the list
+    float           m_amplitudes[SWEEP_MAX_POINTS];     ///< Amplitudes of the list (negative = as is)
+
+    bool            m_b_running;        ///< True while a sweep is in progress
+    uint32_t        m_step;             ///< Next step to apply
+    uint32_t        m_start_us;         ///< Time (micros) of the start of the sweep
+    uint32_t        m_next_us;          ///< Time (micros) at which the next step is due
+
+    sweep_event     m_events[SWEEP_EVENTS];   ///< Events not yet sent
+    uint32_t        m_event_head;             ///< Position of the oldest event
+    uint32_t        m_event_count;            ///< Number of events not yet sent
+    uint32_t        m_dropped;                ///< Number of events dropped
+};
+
+#endif
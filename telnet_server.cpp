@@ -4,12 +4,51 @@
 */
 
 #include "telnet_server.h"
+#include "packet_pool.h"
 
 
-ESPTelnet Telnet;     ///< Definition of global instance of ESPTelnet used by Telnet_Server
+/*!
+  @brief  Adapter that allows any function expecting a Print
+          object (such as AWG_Server::report()) to reply over Telnet.
+
+  Output is collected in a buffer and sent when it is full or
+  flushed, so that the reply is not sent one byte (or one line)
+  at a time (see Telnet_Service::reply()).
+*/
+class Telnet_Print : public Print
+{
+  public:
+
+    Telnet_Print ()
+      : index(0)
+      {}
+
+    virtual size_t  write ( uint8_t byte )
+      { buffer[index++] = byte;
+        if ( index >= sizeof(buffer) ) flush();
+        return 1; }
 
+    virtual void    flush ()
+      { if ( index > 0 ) Telnet.reply().write(buffer, index);
+        index = 0; }
 
-bool Telnet_Server::pass_through = false;
+  private:
+
+    uint8_t   buffer[256];    ///< Output buffer
+    size_t    index;          ///< Position for next entry into the buffer
+};
+
+static Telnet_Print telnet_print;   ///< Print adapter used for reports
+
+static_assert(TRACE_PIECE_SIZE <= TELNET_PIECE_SIZE, "a piece of the trace must fit a piece of a Telnet reply");
+
+
+bool          Telnet_Server::pass_through = false;
+AWG_Server *  Telnet_Server::awg_server = NULL;
+AWG_Task *    Telnet_Server::awg_task = NULL;
+Trace_Recorder *  Telnet_Server::trace_recorder = NULL;
+Heap_Monitor *    Telnet_Server::heap_monitor = NULL;
+Trace_Recorder::trace_cursor  Telnet_Server::trace_cursors[TELNET_MAX_CLIENTS];
 
 
 void Telnet_Server::begin ()
@@ -25,49 +64,142 @@ void Telnet_Server::loop ()
 
   Telnet.loop();
 
-  //  Copy data from the serial port if passthrough is enabled
+  //  Copy data from the AWG's serial port if passthrough is enabled
 
   if ( pass_through ) {
-    while ( Serial.available() > 0 ) {
-      char c = Serial.read();
+    uint8_t   buffer[64];
+    size_t    len = 0;
 
-      Telnet << c;
+    while ( len < sizeof(buffer) && awg_server->port().available() > 0 ) {
+      buffer[len++] = awg_server->port().read();
     }
+
+    Telnet.write(buffer, len);    // sent as a whole with the next flush
   }
 }
 
 /*!
-  @brief  Callback function used by the ESPTelnet library.
+  @brief  Callback function used by the Telnet_Service.
 
-  @param  input   Line of text received by the ESPTelnet library
+  @param  input   Line of text received by the Telnet_Service
+  @param  client  The client that sent it
 
-  The Telnet library will call this callback function whenever a line of data (terminated
-  with an \\n) is received. The callback function converts the string to upper case and trims
-  leading/trailing whitespace. It then tests the string to see if it consists of a recognized
-  command. If so, the command is processed and the results are reported back to the telnet client.
+  The Telnet_Service will call this callback function whenever a line of data (terminated
+  with an \\n) is received. The callback function copies the line, converts the copy to upper
+  case and trims leading/trailing whitespace. It then tests the copy to see if it consists of a
+  recognized command. If so, the command is processed and the results are reported back to the
+  telnet client that sent it.
 
   Recognized commands:
 
     PASSTHROUGH - toggles the pass_through state
+    STATUS      - reports the AWG settings, learned latencies, command queue, packet buffer usage, Telnet, and heap
+    TRACE       - writes the trace of the latest VXI requests and AWG commands as CSV
+    TRACE BIN   - writes the same trace as binary (see Trace_Recorder::begin_write())
+    TRACE CLEAR - forgets the trace recorded so far
+    DETECT      - probes the AWG model and firmware again (see AWG_Server::identify()), and reports the AWG
 
   If the string of data is not a recognized command, the callback function will either discard
   the string (if ! pass_through) or pass the string via the serial interface to the connected
   AWG (if pass_through).
 */
-void Telnet_Server::onTelnetInput ( String input ) {
+void Telnet_Server::onTelnetInput ( char * input, int client ) {
 
-  String s(input); 
-  s.trim();
-  s.toUpperCase();
+  char      line[TELNET_LINE_SIZE];
+  char *    s = line;
+  size_t    len;
 
-  if ( s == "PASSTHROUGH" ) {
+  while ( isspace((unsigned char) *input ) ) {
+    input++;
+  }
+
+  for ( len = 0; input[len] && len < sizeof(line) - 1; len++ ) {
+    line[len] = toupper((unsigned char) input[len]);
+  }
+
+  while ( len > 0 && isspace((unsigned char) line[len-1]) ) {
+    len--;
+  }
+
+  line[len] = 0;
+
+  if ( strcmp(s, "PASSTHROUGH") == 0 ) {
     pass_through = ! pass_through;
 
     Telnet.flush();
 
-    Telnet << "\n" << s << ( pass_through ? " ON" : " OFF" ) << "\n";
+    telnet_print << "\n" << s << ( pass_through ? " ON" : " OFF" ) << "\n";
+    telnet_print.flush();
+
+  } else if ( strcmp(s, "STATUS") == 0 ) {
+    telnet_print << "\n";
+
+    // the AWG is claimed, so that a threaded consumer does not update what is reported meanwhile
+
+    if ( awg_task )
+    {
+      awg_task->claim();
+    }
+
+    awg_server->report(telnet_print);
+
+    if ( awg_task )
+    {
+      awg_task->release();
+      awg_task->report(telnet_print);
+    }
+
+    packet_pool.report(telnet_print);
+    Telnet.report(telnet_print);
+
+    if ( heap_monitor )
+    {
+      heap_monitor->report(telnet_print);
+    }
+
+    telnet_print.flush();
+
+  } else if ( trace_recorder && ( strcmp(s, "TRACE") == 0 || strcmp(s, "TRACE CSV") == 0 || strcmp(s, "TRACE BIN") == 0 ) ) {
+
+    // the trace is written as the client takes it (see writeTrace())
+
+    trace_recorder->begin_write(trace_cursors[client], strcmp(s, "TRACE BIN") == 0);
+    Telnet.continue_reply(writeTrace);
+
+  } else if ( trace_recorder && strcmp(s, "TRACE CLEAR") == 0 ) {
+    trace_recorder->clear();
+    telnet_print << "\nTRACE CLEARED\n";
+    telnet_print.flush();
+
+  } else if ( strcmp(s, "DETECT") == 0 ) {
+
+    // the AWG is claimed so that no queued command is sent meanwhile, nor the report updated
+
+    if ( awg_task == NULL || awg_task->claim() )
+    {
+      awg_server->identify(true);
+    }
+
+    telnet_print << "\n";
+    awg_server->report(telnet_print);
+
+    if ( awg_task )
+    {
+      awg_task->release();
+    }
+
+    telnet_print.flush();
 
   } else if ( pass_through ) {
-    Serial.println(input);
+    awg_server->port().println(input);
   }
 }
+
+bool Telnet_Server::writeTrace ( int client ) {
+
+  bool  b_more = trace_recorder->write_next(trace_cursors[client], telnet_print);
+
+  telnet_print.flush();
+
+  return b_more;
+}
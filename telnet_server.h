@@ -6,27 +6,41 @@
   @brief  Declaration of the Telnet_Server class.
 */
 
-#include "ESPTelnet.h"
-
-extern ESPTelnet  Telnet;   ///< Global instance of ESPTelnet used by Telnet_Server
+#include "telnet_service.h"
+#include "awg_server.h"
+#include "awg_task.h"
+#include "trace_recorder.h"
+#include "heap_monitor.h"
 
 /*!
   @brief  The Telnet_Server class implements command checking
-          and passthrough using the ESPTelnet Telnet service.
+          and passthrough using the Telnet_Service.
 */
 class Telnet_Server {
 
   public:
 
-    Telnet_Server ()  ///< Default constructor does nothing
-      {}
+    /*!
+      @brief  Constructor saves a reference to the AWG_Server (and
+              the AWG_Task, if given) so that its status can be reported.
+
+      @param  awg   A reference to the AWG_Server
+      @param  task  The AWG_Task that applies the commands, or NULL
+      @param  trace The Trace_Recorder written out by TRACE, or NULL
+      @param  heap  The Heap_Monitor reported by STATUS, or NULL
+    */
+    Telnet_Server ( AWG_Server & awg, AWG_Task * task = NULL, Trace_Recorder * trace = NULL, Heap_Monitor * heap = NULL )
+      { awg_server = &awg;
+        awg_task = task;
+        trace_recorder = trace;
+        heap_monitor = heap; }
     
     ~Telnet_Server () ///< Default destructor does nothing
       {}
 
     /*!
       @brief  Sets up the onTelnetInput callback and
-              initiates the Telnet service.
+              starts the Telnet_Service.
     */
     void  begin ();
 
@@ -39,9 +53,19 @@ class Telnet_Server {
 
   protected:
 
-    static  void onTelnetInput ( String s );
+    static  void onTelnetInput ( char * line, int client );
+
+    /*!
+      @brief  Continuation of a TRACE reply: writes the next line or entry (see Telnet_Service::continue_reply()).
+    */
+    static  bool writeTrace ( int client );
 
-    static  bool  pass_through;   ///< State variable shows whether PASSTHROUGH is enabled
+    static  bool          pass_through;   ///< State variable shows whether PASSTHROUGH is enabled
+    static  AWG_Server *  awg_server;     ///< The AWG_Server whose status is reported by STATUS
+    static  AWG_Task *    awg_task;       ///< The AWG_Task whose queue is reported by STATUS, or NULL
+    static  Trace_Recorder *  trace_recorder;   ///< The trace written out by TRACE, or NULL
+    static  Heap_Monitor *    heap_monitor;     ///< The heap figures reported by STATUS, or NULL
+    static  Trace_Recorder::trace_cursor  trace_cursors[TELNET_MAX_CLIENTS];  ///< The TRACE reply to each client
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,347 @@
+/*!
+  @file   telnet_service.cpp
+  @brief  Definitions of the Telnet_Service methods.
+*/
+
+#include "telnet_service.h"
+#include "Streaming.h"
+
+Telnet_Service  Telnet;     ///< Definition of the global Telnet_Service
+
+/*  Telnet negotiation: IAC starts a command, WILL to DONT take
+    an option byte, and SB starts a subnegotiation ended by SE.  */
+
+const uint8_t   TELNET_WILL = 251;
+const uint8_t   TELNET_DONT = 254;
+const uint8_t   TELNET_SB   = 250;
+const uint8_t   TELNET_SE   = 240;
+
+enum telnet_iac_state {
+  IAC_NONE    = 0,    ///< Not in a command
+  IAC_COMMAND = 1,    ///< After IAC
+  IAC_OPTION  = 2,    ///< After IAC WILL / WONT / DO / DONT
+  IAC_SUB     = 3,    ///< In a subnegotiation
+  IAC_SUB_IAC = 4     ///< After IAC in a subnegotiation
+};
+
+
+void Telnet_Service::loop ()
+{
+  WiFiClient  client = m_server.accept();
+
+  if ( client )
+  {
+    telnet_client * slot = &m_clients[0];
+
+    for ( auto & c : m_clients )
+    {
+      if ( ! c.client.connected() )
+      {
+        slot = &c;
+        break;
+      }
+
+      if ( c.age < slot->age )
+      {
+        slot = &c;
+      }
+    }
+
+    if ( slot->client.connected() )
+    {
+      slot->client.stop();    // the newest client wins
+      m_replaced++;
+    }
+
+    reset(*slot);
+    slot->client = client;
+    slot->age = m_next_age++;
+    m_connections++;
+  }
+
+  for ( int i = 0; i < TELNET_MAX_CLIENTS; i++ )
+  {
+    telnet_client & c = m_clients[i];
+
+    if ( ! c.client.connected() )
+    {
+      c.client.stop();      // release a connection closed by the client
+      c.out_len = 0;
+      c.more = NULL;
+      continue;
+    }
+
+    serve_reply(i);
+
+    // the next line waits until the reply to the last one has been sent
+
+    while ( c.out_len == 0 && c.more == NULL && c.client.available() > 0 )
+    {
+      receive(i, c.client.read());
+    }
+  }
+
+  flush();
+}
+
+
+void Telnet_Service::receive ( int index, uint8_t byte )
+{
+  telnet_client & c = m_clients[index];
+
+  switch ( c.iac )
+  {
+    case IAC_COMMAND:
+      c.iac = ( byte >= TELNET_WILL && byte <= TELNET_DONT ) ? IAC_OPTION : ( byte == TELNET_SB ) ? IAC_SUB : IAC_NONE;
+      return;
+
+    case IAC_OPTION:
+      c.iac = IAC_NONE;
+      return;
+
+    case IAC_SUB:
+      c.iac = ( byte == TELNET_IAC ) ? IAC_SUB_IAC : IAC_SUB;
+      return;
+
+    case IAC_SUB_IAC:
+      c.iac = ( byte == TELNET_SE ) ? IAC_NONE : IAC_SUB;
+      return;
+
+    default:
+      break;
+  }
+
+  if ( byte == TELNET_IAC )
+  {
+    c.iac = IAC_COMMAND;
+  }
+  else if ( byte == '\n' )
+  {
+    c.line[c.line_len] = 0;
+    m_lines++;
+    m_cut += c.b_cut ? 1 : 0;
+
+    if ( m_on_input )
+    {
+      m_replying = index;
+      m_on_input(c.line, index);
+      m_replying = -1;
+
+      serve_reply(index);
+    }
+
+    c.line_len = 0;
+    c.b_cut = false;
+  }
+  else if ( byte != '\r' && byte != 0 )
+  {
+    if ( c.line_len < TELNET_LINE_SIZE - 1 )
+    {
+      c.line[c.line_len++] = (char) byte;
+    }
+    else
+    {
+      c.b_cut = true;
+    }
+  }
+}
+
+
+bool Telnet_Service::isConnected ()
+{
+  for ( auto & c : m_clients )
+  {
+    if ( c.client.connected() )
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+size_t Telnet_Service::write ( const uint8_t * buffer, size_t len )
+{
+  if ( memchr(buffer, TELNET_IAC, len) )
+  {
+    for ( size_t i = 0; i < len; i++ )
+    {
+      write(buffer[i]);     // doubles each IAC
+    }
+
+    return len;
+  }
+
+  if ( m_out_len + len > TELNET_OUTPUT_SIZE )
+  {
+    flush();
+  }
+
+  if ( len >= TELNET_OUTPUT_SIZE )
+  {
+    for ( auto & c : m_clients )
+    {
+      send(c, buffer, len);
+    }
+  }
+  else
+  {
+    memcpy(m_out + m_out_len, buffer, len);
+    m_out_len += len;
+  }
+
+  return len;
+}
+
+
+void Telnet_Service::flush ()
+{
+  if ( m_out_len > 0 )
+  {
+    for ( auto & c : m_clients )
+    {
+      send(c, m_out, m_out_len);
+    }
+
+    m_out_len = 0;
+  }
+}
+
+
+bool Telnet_Service::send ( telnet_client & c, const uint8_t * buffer, size_t len )
+{
+  if ( ! c.client.connected() )
+  {
+    return true;
+  }
+
+  if ( c.out_len > 0 || c.more != NULL || c.client.availableForWrite() < (int) len )
+  {
+    m_dropped += len;
+    m_drops++;
+    return false;
+  }
+
+  m_sent += c.client.write(buffer, len);
+
+  return true;
+}
+
+
+void Telnet_Service::continue_reply ( bool (*more)( int client ) )
+{
+  if ( m_replying >= 0 )
+  {
+    m_clients[m_replying].more = more;
+  }
+}
+
+
+void Telnet_Service::serve_reply ( int index )
+{
+  telnet_client & c = m_clients[index];
+
+  send_reply(c);
+
+  if ( c.more == NULL )
+  {
+    return;
+  }
+
+  // each piece may take twice its size, as IAC bytes are doubled
+
+  m_replying = index;
+
+  while ( c.more != NULL && c.out_len + 2 * TELNET_PIECE_SIZE <= TELNET_REPLY_SIZE )
+  {
+    if ( ! c.more(index) )
+    {
+      c.more = NULL;
+    }
+
+    send_reply(c);
+  }
+
+  m_replying = -1;
+}
+
+
+void Telnet_Service::send_reply ( telnet_client & c )
+{
+  int     room = c.client.availableForWrite();
+  size_t  n;
+
+  if ( c.out_len == 0 || room <= 0 )
+  {
+    return;
+  }
+
+  n = c.client.write(c.out, std::min((size_t) room, c.out_len));
+
+  memmove(c.out, c.out + n, c.out_len - n);
+  c.out_len -= n;
+  m_sent += n;
+}
+
+
+size_t Telnet_Service::write_reply ( const uint8_t * buffer, size_t len )
+{
+  if ( m_replying < 0 )
+  {
+    return write(buffer, len);
+  }
+
+  telnet_client & c = m_clients[m_replying];
+  size_t          done = 0;
+
+  flush();      // what was printed before goes first
+
+  /*  The data are copied up to and including each IAC, which is then
+      copied once more; when the buffer is full, what the client can
+      take is sent, and what still does not fit is dropped.  */
+
+  while ( done < len )
+  {
+    if ( c.out_len + 2 > TELNET_REPLY_SIZE )
+    {
+      send_reply(c);
+    }
+
+    if ( c.out_len + 2 > TELNET_REPLY_SIZE )
+    {
+      m_dropped += len - done;
+      m_drops++;
+      break;
+    }
+
+    const uint8_t * iac = (const uint8_t *) memchr(buffer + done, TELNET_IAC, len - done);
+    size_t          part = std::min(iac ? iac - ( buffer + done ) + 1 : len - done, TELNET_REPLY_SIZE - 1 - c.out_len);
+
+    memcpy(c.out + c.out_len, buffer + done, part);
+    c.out_len += part;
+    done += part;
+
+    if ( iac && buffer + done == iac + 1 )
+    {
+      c.out[c.out_len++] = TELNET_IAC;
+    }
+  }
+
+  return len;
+}
+
+
+void Telnet_Service::report ( Print & out )
+{
+  int   connected = 0;
+
+  for ( auto & c : m_clients )
+  {
+    connected += c.client.connected() ? 1 : 0;
+  }
+
+  out << "Telnet: clients = " << connected << " of " << TELNET_MAX_CLIENTS << "; accepted = " << m_connections
+      << " (" << m_replaced << " replaced); lines = " << m_lines << " (" << m_cut << " cut); sent = " << m_sent
+      << " bytes; dropped = " << m_dropped << " bytes in " << m_drops << " writes\n";
+}
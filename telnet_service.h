@@ -0,0 +1,235 @@
+#ifndef TELNET_SERVICE_H
+#define TELNET_SERVICE_H
+
+/*!
+  @file   telnet_service.h
+  @brief  Declaration of the Telnet_Service class.
+*/
+
+#include <ESP8266WiFi.h>
+#include "wifi_ext.h"
+
+const int       TELNET_PORT = 23;               ///< Port on which the Telnet_Service listens
+const int       TELNET_MAX_CLIENTS = 2;         ///< Number of clients served at once
+const size_t    TELNET_LINE_SIZE = 96;          ///< Longest line received (longer lines are cut)
+const size_t    TELNET_OUTPUT_SIZE = 256;       ///< Size of the buffer that gathers the output
+const size_t    TELNET_REPLY_SIZE = 512;        ///< Size of the buffer that holds a reply until its client takes it
+const size_t    TELNET_PIECE_SIZE = 128;        ///< Most bytes a reply continuation writes per call (see continue_reply())
+const uint8_t   TELNET_IAC = 255;               ///< Telnet "interpret as command"; doubled when sent as data
+
+/*!
+  @brief  A line-oriented Telnet service that allocates nothing.
+
+  It takes the place of the ESPTelnet library, whose String callbacks
+  and small writes fragment the heap and slow down the main loop:
+
+    - Each client has a fixed line buffer; each complete line is
+      passed to the input callback as a C string (which it may
+      modify). Telnet negotiation (IAC sequences) is skipped, and a
+      line longer than the buffer is cut. A data byte of 255 (IAC)
+      is sent doubled, as the protocol requires, so that binary
+      output (e.g., TRACE BIN) is not taken for a Telnet command.
+    - Up to TELNET_MAX_CLIENTS clients are served at once; a new
+      client beyond that replaces the oldest one.
+    - What is printed (e.g., the Debug output, or the AWG output in
+      PASSTHROUGH mode) is gathered in a buffer and sent to every
+      client in one write, when the buffer is full or at the next
+      loop() or flush(). A client that cannot take it at once (a
+      slow reader) misses it, and the bytes are counted as dropped;
+      nothing ever waits for a client, so Debug output at any level
+      cannot hold up a sweep.
+    - A reply to a command (see reply()) goes only to the client
+      that sent the command. What the client cannot take at once is
+      kept in a buffer of TELNET_REPLY_SIZE bytes for that client and
+      sent at the next loops; meanwhile no more input is read from
+      it, and it misses the output sent to every client. A reply too
+      long for that is written a piece at a time, as the client takes
+      it (see continue_reply()). A reply that overflows the buffer
+      is cut, and the rest counted as dropped. So a slow client
+      never holds up the main loop either.
+*/
+class Telnet_Service : public Print
+{
+  public:
+
+    /*!
+      @brief  Constructor starts with no clients; nothing listens until begin().
+    */
+    Telnet_Service ()
+      : m_on_input(NULL), m_reply(*this), m_replying(-1), m_out_len(0), m_next_age(0),
+        m_connections(0), m_replaced(0), m_lines(0), m_cut(0), m_sent(0), m_dropped(0), m_drops(0)
+      { for ( auto & c : m_clients ) reset(c); }
+
+    /*!
+      @brief  Start listening.
+
+      @param  port  The port to listen on (normally TELNET_PORT)
+    */
+    void    begin ( uint16_t port = TELNET_PORT )
+      { m_server.begin(port); }
+
+    /*!
+      @brief  Call this at least once per main loop to accept clients,
+              read their input, and send the gathered output.
+    */
+    void    loop ();
+
+    /*!
+      @brief  Set the function called with each line received.
+
+      @param  callback  Called with the line (without the line end) and
+                        the index of the client that sent it.
+    */
+    void    onInputReceived ( void (*callback)( char * line, int client ) )
+      { m_on_input = callback; }
+
+    /*!
+      @brief  Check whether any client is connected.
+    */
+    bool    isConnected ();
+
+    /*!
+      @brief  Return a Print that writes to the client whose line is being handled.
+
+      Only valid within the input callback; elsewhere, what is printed
+      to it is sent to every client, as with the Telnet_Service itself.
+    */
+    Print & reply ()
+      { return m_reply; }
+
+    /*!
+      @brief  Have the reply continued later, a piece at a time.
+
+      Only valid within the input callback. At each loop(), as long
+      as the client has room in its reply buffer, the continuation is
+      called with the index of the client; it writes the next piece
+      of the reply (at most TELNET_PIECE_SIZE bytes) to reply(), and
+      returns false once there is nothing left. Meanwhile no more
+      input is read from the client.
+
+      @param  more  The continuation.
+    */
+    void    continue_reply ( bool (*more)( int client ) );
+
+    /*!
+      @brief  Write the counters of the service.
+
+      @param  out   The Print object to which to write the report.
+    */
+    void    report ( Print & out );
+
+    // Print
+
+    virtual size_t  write ( uint8_t byte )
+      { if ( m_out_len + 2 > TELNET_OUTPUT_SIZE ) flush();
+        m_out[m_out_len++] = byte;
+        if ( byte == TELNET_IAC ) m_out[m_out_len++] = byte;
+        return 1; }
+
+    virtual size_t  write ( const uint8_t * buffer, size_t len );
+
+    /*!
+      @brief  Send the gathered output to every client now.
+    */
+    virtual void    flush ();
+
+    using Print::write;
+
+  private:
+
+    /*!
+      @brief  The state of one client.
+    */
+    struct telnet_client
+    {
+      WiFiClient  client;                       ///< The connection (none if the slot is free)
+      char        line[TELNET_LINE_SIZE];       ///< The line being received
+      size_t      line_len;                     ///< Length of the line so far
+      uint8_t     iac;                          ///< Position in a Telnet negotiation sequence (0 = none)
+      bool        b_cut;                        ///< True if the line has been cut
+      uint32_t    age;                          ///< Order of connection (the lowest is the oldest)
+      uint8_t     out[TELNET_REPLY_SIZE];       ///< The reply not yet sent
+      size_t      out_len;                      ///< Length of the reply not yet sent
+      bool        (*more)( int client );        ///< The continuation of the reply, or NULL (see continue_reply())
+    };
+
+    /*!
+      @brief  Writes the replies to the client that sent the command.
+    */
+    class Reply_Print : public Print
+    {
+      public:
+
+        Reply_Print ( Telnet_Service & service )
+          : m_service(service)
+          {}
+
+        virtual size_t  write ( uint8_t byte )
+          { return write(&byte, 1); }
+
+        virtual size_t  write ( const uint8_t * buffer, size_t len )
+          { return m_service.write_reply(buffer, len); }
+
+        using Print::write;
+
+      private:
+
+        Telnet_Service &  m_service;    ///< The service whose client is replied to
+    };
+
+    /*!
+      @brief  Start a client slot afresh.
+    */
+    static void reset ( telnet_client & c )
+      { c.line_len = 0; c.iac = 0; c.b_cut = false; c.age = 0; c.out_len = 0; c.more = NULL; }
+
+    /*!
+      @brief  Continue the reply to a client, and send what it can take of it.
+    */
+    void    serve_reply ( int index );
+
+    /*!
+      @brief  Send as much of the buffered reply as the client can take now.
+    */
+    void    send_reply ( telnet_client & c );
+
+    /*!
+      @brief  Pass a byte received from a client on to its line.
+    */
+    void    receive ( int index, uint8_t byte );
+
+    /*!
+      @brief  Send data to one client if it can take all of it at once,
+              and is not still taking a reply.
+
+      @return False if the data were dropped.
+    */
+    bool    send ( telnet_client & c, const uint8_t * buffer, size_t len );
+
+    /*!
+      @brief  Add to the reply in the buffer of the client, escaping IAC bytes (see reply()).
+    */
+    size_t  write_reply ( const uint8_t * buffer, size_t len );
+
+    WiFiServer_ext  m_server;                         ///< Listens for clients
+    telnet_client   m_clients[TELNET_MAX_CLIENTS];    ///< The clients
+    void            (*m_on_input)( char * line, int client );   ///< Called with each line received
+    Reply_Print     m_reply;                          ///< See reply()
+    int             m_replying;                       ///< The client whose line is being handled, or -1
+
+    uint8_t         m_out[TELNET_OUTPUT_SIZE];        ///< The output gathered for every client
+    size_t          m_out_len;                        ///< Length of the gathered output
+    uint32_t        m_next_age;                       ///< Order given to the next client
+
+    uint32_t        m_connections;    ///< Number of clients accepted
+    uint32_t        m_replaced;       ///< Number of clients replaced by a newer one
+    uint32_t        m_lines;          ///< Number of lines received
+    uint32_t        m_cut;            ///< Number of lines cut
+    uint32_t        m_sent;           ///< Number of bytes sent
+    uint32_t        m_dropped;        ///< Number of bytes dropped because a client had no room
+    uint32_t        m_drops;          ///< Number of writes dropped
+};
+
+extern Telnet_Service   Telnet;     ///< The Telnet service used by the Telnet_Server and by Debug
+
+#endif
@@ -0,0 +1,206 @@
+/*!
+  @file   trace_recorder.cpp
+  @brief  Definitions of the Trace_Recorder methods.
+*/
+
+#include "trace_recorder.h"
+#include "Streaming.h"
+#include "rpc_enums.h"
+#include "scpi.h"
+
+/*!
+  @brief  Return the name of a VXI procedure or AWG parameter for the CSV output.
+
+  @return The name, or NULL if the code is not known.
+*/
+static const char * code_name ( const trace_entry & e )
+{
+  if ( e.kind == TRACE_AWG )
+  {
+    return ( e.code < scpi::parameter_count ) ? scpi::parameters[e.code] : NULL;
+  }
+
+  switch ( e.code )
+  {
+    case rpc::VXI_11_CREATE_LINK:   return "CREATE_LINK";
+    case rpc::VXI_11_DEV_WRITE:     return "DEV_WRITE";
+    case rpc::VXI_11_DEV_READ:      return "DEV_READ";
+    case rpc::VXI_11_DESTROY_LINK:  return "DESTROY_LINK";
+    default:                        return NULL;
+  }
+}
+
+void Trace_Recorder::start ( trace_cursor & cursor, uint32_t vxi_from, uint32_t awg_from )
+{
+  cursor.vxi_to = m_vxi_count.load(std::memory_order_acquire);
+  cursor.awg_to = m_awg_count.load(std::memory_order_acquire);
+
+  // only the last TRACE_SIZE entries of each ring are still there
+
+  cursor.vxi = ( cursor.vxi_to - vxi_from > TRACE_SIZE ) ? cursor.vxi_to - TRACE_SIZE : vxi_from;
+  cursor.awg = ( cursor.awg_to - awg_from > TRACE_SIZE ) ? cursor.awg_to - TRACE_SIZE : awg_from;
+}
+
+bool Trace_Recorder::next ( trace_cursor & cursor, trace_entry & entry )
+{
+  uint32_t  vxi_count = m_vxi_count.load(std::memory_order_acquire);
+  uint32_t  awg_count = m_awg_count.load(std::memory_order_acquire);
+
+  /*  Skip the entries overwritten since the cursor was started (a
+      write of the trace may take many loops), but never beyond the
+      entries that were there then.  */
+
+  if ( vxi_count - cursor.vxi > TRACE_SIZE )
+  {
+    cursor.vxi = ( vxi_count - cursor.vxi_to >= TRACE_SIZE ) ? cursor.vxi_to : vxi_count - TRACE_SIZE;
+  }
+
+  if ( awg_count - cursor.awg > TRACE_SIZE )
+  {
+    cursor.awg = ( awg_count - cursor.awg_to >= TRACE_SIZE ) ? cursor.awg_to : awg_count - TRACE_SIZE;
+  }
+
+  if ( cursor.vxi == cursor.vxi_to && cursor.awg == cursor.awg_to )
+  {
+    return false;
+  }
+
+  const trace_entry & v = m_vxi[cursor.vxi & ( TRACE_SIZE - 1 )];
+  const trace_entry & a = m_awg[cursor.awg & ( TRACE_SIZE - 1 )];
+
+  if ( cursor.awg == cursor.awg_to || ( cursor.vxi != cursor.vxi_to && (int32_t)( v.time_us - a.time_us ) <= 0 ) )
+  {
+    entry = v;
+    cursor.vxi++;
+  }
+  else
+  {
+    entry = a;
+    cursor.awg++;
+  }
+
+  return true;
+}
+
+template <typename F> void Trace_Recorder::merge ( uint32_t vxi_from, uint32_t awg_from, F visit )
+{
+  trace_cursor  cursor;
+  trace_entry   e;
+
+  start(cursor, vxi_from, awg_from);
+
+  while ( next(cursor, e) )
+  {
+    visit(e);
+  }
+}
+
+void Trace_Recorder::summary ( Print & out )
+{
+  uint32_t  requests = 0, failed = 0, commands = 0, retries = 0, failures = 0, bytes = 0;
+  uint32_t  ack_total = 0, ack_max = 0, port = 0;
+  float     f_min = 0, f_max = 0;
+  bool      b_partial = ( m_vxi_count.load(std::memory_order_acquire) - m_sweep_vxi > TRACE_SIZE )
+                        || ( m_awg_count.load(std::memory_order_acquire) - m_sweep_awg > TRACE_SIZE );
+
+  merge(m_sweep_vxi, m_sweep_awg, [&] ( const trace_entry & e )
+  {
+    if ( e.kind == TRACE_VXI )
+    {
+      requests++;
+      failed += ( e.status & TRACE_FAILED ) ? 1 : 0;
+      port = e.port;
+      return;
+    }
+
+    commands++;
+    retries += e.status & ~TRACE_FAILED;
+    failures += ( e.status & TRACE_FAILED ) ? 1 : 0;
+    bytes += e.bytes;
+    ack_total += e.duration_us;
+    ack_max = std::max(ack_max, e.duration_us);
+
+    if ( e.code == scpi::FREQUENCY )
+    {
+      f_min = ( f_min == 0 ) ? e.value : std::min(f_min, e.value);
+      f_max = std::max(f_max, e.value);
+    }
+  });
+
+  out << "Sweep on port " << port << ": " << requests << " requests (" << failed << " failed) in "
+      << ( micros() - m_sweep_start ) / 1000 << " ms; " << commands << " AWG commands (" << failures << " failed, "
+      << retries << " retries, " << bytes << " bytes); ack mean " << ( commands ? ack_total / commands : 0 )
+      << " us, max " << ack_max << " us; FRQ " << f_min << " to " << f_max << " Hz"
+      << ( b_partial ? " (last entries only)" : "" ) << "\n";
+}
+
+void Trace_Recorder::begin_write ( trace_cursor & cursor, bool b_binary )
+{
+  start(cursor, m_vxi_from, m_awg_from);
+
+  cursor.left = ( cursor.vxi_to - cursor.vxi ) + ( cursor.awg_to - cursor.awg );
+  cursor.b_binary = b_binary;
+  cursor.b_started = false;
+}
+
+bool Trace_Recorder::write_next ( trace_cursor & cursor, Print & out )
+{
+  trace_entry   e = {};     // zeros in place of an entry overwritten meanwhile (binary)
+
+  if ( ! cursor.b_started )
+  {
+    cursor.b_started = true;
+
+    if ( cursor.b_binary )
+    {
+      uint16_t  header[] = { 'E' | 'S' << 8, 'P' | 'T' << 8, 1, sizeof(trace_entry) };
+
+      out.write((const uint8_t *) header, sizeof(header));
+      out.write((const uint8_t *) &cursor.left, sizeof(cursor.left));
+    }
+    else
+    {
+      out << "time_us,kind,port,channel,code,value,bytes,duration_us,retries,failed\n";
+    }
+
+    return true;
+  }
+
+  if ( cursor.b_binary )
+  {
+    if ( cursor.left == 0 )
+    {
+      return false;
+    }
+
+    next(cursor, e);
+    cursor.left--;
+
+    out.write((const uint8_t *) &e, sizeof(e));
+
+    return true;
+  }
+
+  if ( ! next(cursor, e) )
+  {
+    return false;
+  }
+
+  const char *  name = code_name(e);
+
+  out << e.time_us << ( e.kind == TRACE_VXI ? ",VXI," : ",AWG," ) << e.port << "," << (uint32_t) e.channel << ",";
+
+  if ( name )
+  {
+    out << name;
+  }
+  else
+  {
+    out << (uint32_t) e.code;
+  }
+
+  out << "," << _FLOAT(e.value, 3) << "," << e.bytes << "," << e.duration_us << ","
+      << (uint32_t)( e.status & ~TRACE_FAILED ) << "," << ( ( e.status & TRACE_FAILED ) ? 1 : 0 ) << "\n";
+
+  return true;
+}
@@ -0,0 +1,222 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+/*!
+  @file   trace_recorder.h
+  @brief  Declaration of the Trace_Recorder class and the trace_entry structure.
+*/
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+
+/*!
+  @brief  One recorded VXI transaction or AWG command.
+
+  The same 20-byte record serves both kinds; the fields whose
+  meaning differs are marked VXI / AWG.
+*/
+struct trace_entry
+{
+  uint32_t  time_us;      ///< Time (micros) at which the transaction or command started
+  uint32_t  duration_us;  ///< VXI: time to serve the request; AWG: ack latency of the last attempt
+  float     value;        ///< VXI: frequency set by a DEV_WRITE (0 if none); AWG: the value set
+  uint16_t  port;         ///< VXI: port of the link; AWG: 0
+  uint16_t  bytes;        ///< VXI: length of the request; AWG: serial bytes sent (all attempts)
+  uint8_t   kind;         ///< TRACE_VXI or TRACE_AWG
+  uint8_t   code;         ///< VXI: the procedure (see rpc::procedures); AWG: the parameter (see scpi::parameter_id)
+  uint8_t   channel;      ///< The AWG channel (VXI: 0)
+  uint8_t   status;       ///< Number of retries, plus TRACE_FAILED if the request or command failed
+};
+
+const uint8_t   TRACE_VXI     = 1;      ///< trace_entry::kind of a VXI transaction
+const uint8_t   TRACE_AWG     = 2;      ///< trace_entry::kind of an AWG command
+const uint8_t   TRACE_FAILED  = 0x80;   ///< Bit of trace_entry::status set on failure
+
+/*!
+  @brief  Number of entries kept for each side (VXI and AWG).
+
+  It must be a power of two, so that the counters may wrap around.
+  Each entry takes 20 bytes, so the two rings take 2.5 kB.
+*/
+const size_t  TRACE_SIZE = 64;
+
+static_assert(( TRACE_SIZE & ( TRACE_SIZE - 1 ) ) == 0, "TRACE_SIZE must be a power of two");
+
+const size_t  TRACE_PIECE_SIZE = 128;   ///< Most bytes written by one Trace_Recorder::write_next()
+
+/*!
+  @brief  Fixed-size RAM record of the latest VXI transactions and AWG commands.
+
+  When a sweep is slow or a point is wrong, the trace shows what
+  happened: the VXI_Server adds an entry for each request it serves
+  (see VXI_Server::trace()) and the AWG_FY one for each command it
+  sends (see AWG_Server::trace()). Nothing is allocated; the oldest
+  entries are overwritten.
+
+  The two kinds are kept in separate rings, each written by one
+  side only, so that the AWG side may run in a task of its own
+  (see AWG_Task::threaded()) without a lock; the rings are merged
+  by time when they are written out. An entry that is overwritten
+  while it is being written out may come out mixed, which does not
+  matter for a diagnostic record.
+
+  At each CREATE_LINK the VXI_Server marks the start of a sweep, and
+  at each DESTROY_LINK it writes a summary of the entries since
+  then (see summary()). The Telnet TRACE command writes the whole
+  trace as CSV or binary, a line or an entry at a time as the client
+  takes them (see begin_write() and write_next()).
+*/
+class Trace_Recorder
+{
+  public:
+
+    /*!
+      @brief  The position of a write of the trace (see begin_write()).
+    */
+    struct trace_cursor
+    {
+      uint32_t  vxi;          ///< Count of the VXI ring of the next entry
+      uint32_t  awg;          ///< Count of the AWG ring of the next entry
+      uint32_t  vxi_to;       ///< Count of the VXI ring at which to stop
+      uint32_t  awg_to;       ///< Count of the AWG ring at which to stop
+      uint32_t  left;         ///< Number of entries still to write (binary)
+      bool      b_binary;     ///< True to write binary, false for CSV
+      bool      b_started;    ///< True once the header has been written
+    };
+
+    /*!
+      @brief  Constructor starts with empty rings.
+    */
+    Trace_Recorder ()
+      : m_vxi_count(0), m_awg_count(0), m_vxi_from(0), m_awg_from(0),
+        m_sweep_vxi(0), m_sweep_awg(0), m_sweep_start(0)
+      {}
+
+    /*!
+      @brief  Record a VXI transaction (network side).
+
+      @param  port        The port of the link
+      @param  procedure   The procedure requested
+      @param  len         The length of the request
+      @param  start_us    Time (micros) at which the request was received
+      @param  frequency   The frequency set by a DEV_WRITE, or 0
+      @param  b_ok        False if the request failed
+    */
+    void      vxi ( uint32_t port, uint32_t procedure, uint32_t len, uint32_t start_us, double frequency, bool b_ok )
+      { add(m_vxi, m_vxi_count, { start_us, (uint32_t) micros() - start_us, (float) frequency, (uint16_t) port,
+                                  (uint16_t) len, TRACE_VXI, (uint8_t) procedure, 0, (uint8_t)( b_ok ? 0 : TRACE_FAILED ) }); }
+
+    /*!
+      @brief  Record an AWG command (AWG side).
+
+      @param  channel     The channel
+      @param  param_id    The parameter
+      @param  value       The value set
+      @param  bytes       The serial bytes sent, over all attempts
+      @param  start_us    Time (micros) at which the command started
+      @param  ack_us      Ack latency of the last attempt
+      @param  retries     Number of attempts after the first
+      @param  b_ok        False if the command failed
+    */
+    void      awg ( uint32_t channel, uint32_t param_id, double value, uint32_t bytes,
+                    uint32_t start_us, uint32_t ack_us, uint32_t retries, bool b_ok )
+      { add(m_awg, m_awg_count, { start_us, ack_us, (float) value, 0, (uint16_t) bytes, TRACE_AWG, (uint8_t) param_id,
+                                  (uint8_t) channel, (uint8_t)( std::min(retries, (uint32_t) 0x7f) | ( b_ok ? 0 : TRACE_FAILED ) ) }); }
+
+    /*!
+      @brief  Mark the start of a sweep, i.e., a CREATE_LINK (network side).
+    */
+    void      begin_sweep ()
+      { m_sweep_vxi = m_vxi_count.load(std::memory_order_acquire);
+        m_sweep_awg = m_awg_count.load(std::memory_order_acquire);
+        m_sweep_start = micros(); }
+
+    /*!
+      @brief  Write a one-line summary of the sweep since begin_sweep() (network side).
+
+      @param  out   The Print object to which to write the summary.
+    */
+    void      summary ( Print & out );
+
+    /*!
+      @brief  Start writing the trace, oldest entry first (network side).
+
+      The entries recorded so far are then written by write_next(),
+      so that the trace can be sent a piece at a time. As CSV, the
+      first line names the columns. As binary, a header of 12 bytes
+      (the letters ESPT, the version 1 and the size of an entry as
+      16-bit integers, and the number of entries as a 32-bit integer)
+      is followed by the trace_entry records, as they are stored
+      (little-endian, 20 bytes each). An entry overwritten before it
+      is written is skipped; in binary, a record of zeros takes its
+      place at the end, so that the count in the header holds.
+
+      @param  cursor    The position of the write, set up by this call.
+      @param  b_binary  True to write binary, false for CSV.
+    */
+    void      begin_write ( trace_cursor & cursor, bool b_binary );
+
+    /*!
+      @brief  Write the header, or the next entry (network side).
+
+      This writes at most TRACE_PIECE_SIZE bytes.
+
+      @param  cursor    The position of the write (see begin_write()).
+      @param  out       The Print object to which to write.
+
+      @return False if there was nothing left to write.
+    */
+    bool      write_next ( trace_cursor & cursor, Print & out );
+
+    /*!
+      @brief  Forget the entries recorded so far (network side).
+    */
+    void      clear ()
+      { m_vxi_from = m_vxi_count.load(std::memory_order_acquire);
+        m_awg_from = m_awg_count.load(std::memory_order_acquire); }
+
+  private:
+
+    /*!
+      @brief  Add an entry to a ring (by the side that writes it).
+    */
+    static void add ( trace_entry * ring, std::atomic<uint32_t> & count, const trace_entry & entry )
+      { uint32_t n = count.load(std::memory_order_relaxed);
+        ring[n & ( TRACE_SIZE - 1 )] = entry;
+        count.store(n + 1, std::memory_order_release); }
+
+    /*!
+      @brief  Start a cursor at given counts of the two rings, to the entries recorded so far.
+    */
+    void      start ( trace_cursor & cursor, uint32_t vxi_from, uint32_t awg_from );
+
+    /*!
+      @brief  Copy the oldest entry of either ring at the cursor, and step past it.
+
+      @return False if there is none left.
+    */
+    bool      next ( trace_cursor & cursor, trace_entry & entry );
+
+    /*!
+      @brief  Walk the entries of both rings from given counts, merged by time.
+
+      @param  vxi_from    Count of the VXI ring from which to start
+      @param  awg_from    Count of the AWG ring from which to start
+      @param  visit       Called with each entry, oldest first
+    */
+    template <typename F> void  merge ( uint32_t vxi_from, uint32_t awg_from, F visit );
+
+    trace_entry             m_vxi[TRACE_SIZE];    ///< The VXI transactions (written by the network side)
+    trace_entry             m_awg[TRACE_SIZE];    ///< The AWG commands (written by the AWG side)
+    std::atomic<uint32_t>   m_vxi_count;          ///< Number of VXI transactions recorded so far
+    std::atomic<uint32_t>   m_awg_count;          ///< Number of AWG commands recorded so far
+    uint32_t                m_vxi_from;           ///< Value of m_vxi_count at the last clear()
+    uint32_t                m_awg_from;           ///< Value of m_awg_count at the last clear()
+    uint32_t                m_sweep_vxi;          ///< Value of m_vxi_count at the start of the sweep
+    uint32_t                m_sweep_awg;          ///< Value of m_awg_count at the start of the sweep
+    uint32_t                m_sweep_start;        ///< Time (micros) at which the sweep started
+};
+
+#endif
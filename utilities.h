@@ -8,8 +8,22 @@
 */
 
 #include <stdint.h>
+#include <atomic>
 #include "Streaming.h"
 
+/*!
+  @brief  Storage class of the globals that each bench needs its own copy of.
+
+  On the ESP-01 there is only one bench (one scope / AWG pair), and
+  this is empty. The Linux build can serve several benches, each in
+  its own worker thread (see linux/bench.h); it defines BENCH_LOCAL
+  as thread_local, so that every worker has its own Debug buffer and
+  packet_pool and the servers need no locks.
+*/
+#ifndef BENCH_LOCAL
+  #define BENCH_LOCAL
+#endif
+
 #ifdef USE_LED
 
   /*!
@@ -27,28 +41,6 @@
 
 #endif
 
-/*!
-  @brief  Wait for serial input to become available.
-
-  @param  b_consume If true, read all available input and discard it.
-*/
-inline void wait_for_serial ( bool b_consume = false )
-{
-  // wait until something is available
-
-  while ( ! Serial.available() );
-
-  // if b_consume is set, clear the Serial input
-
-  if ( b_consume )
-  {
-    while ( Serial.available() )
-    {
-      Serial.read();
-    }
-  }
-}
-
 /*!
   @brief  A quick way to get a power of 10 up to +/-9.
 
@@ -92,6 +84,10 @@ inline double pow10 ( int p )
   std::byteswap is available in C++23. However,
   the Arduino ESP8266 package does not support
   C++23. Therefore, we must supply the function.
+  GCC (used by the ESP8266 package) provides the
+  __builtin_bswap32 intrinsic, which compiles to
+  the shortest sequence the target allows; the
+  portable version is kept for other compilers.
 
   @param  data  4-byte integer for which the bytes should be swapped
 
@@ -99,6 +95,12 @@ inline double pow10 ( int p )
 */
 inline uint32_t byteswap ( uint32_t data )
 {
+#if defined(__GNUC__)
+
+  return __builtin_bswap32(data);
+
+#else
+
   uint32_t  result;
 
   result = ( ( data & 0x000000ff ) << 24 );
@@ -107,6 +109,8 @@ inline uint32_t byteswap ( uint32_t data )
   result |= ( ( data & 0xff000000 ) >> 24 );
 
   return result;
+
+#endif
 }
 
 /*!
@@ -148,6 +152,166 @@ class big_endian_32_t
       { return byteswap(b_e_data); }
 };
 
+/*!
+  @brief  Tracks the average and deviation of a latency and derives a timeout.
+
+  The latency_tracker class keeps an exponentially weighted moving
+  average (EWMA) of the latency samples it is given, along with an
+  EWMA of the absolute deviation from that average, in the manner of
+  the TCP retransmission timer (RFC 6298). Integer arithmetic is used
+  throughout: the average is stored scaled by 8 and the deviation
+  scaled by 4, so that the update requires only shifts and additions.
+  The timeout is the average plus k times the deviation, limited to
+  the range given to the constructor. Each timeout that occurs doubles
+  the timeout (up to the maximum) until the next good sample arrives.
+*/
+class latency_tracker
+{
+  private:
+
+    uint32_t  m_avg8;         ///< Average latency in microseconds, scaled by 8
+    uint32_t  m_dev4;         ///< Average deviation in microseconds, scaled by 4
+    uint32_t  m_samples;      ///< Number of samples received
+    uint32_t  m_timeouts;     ///< Number of timeouts reported
+    uint8_t   m_backoff;      ///< Number of consecutive timeouts (doubles the timeout)
+    uint32_t  m_min_us;       ///< Smallest timeout to return
+    uint32_t  m_max_us;       ///< Largest timeout to return (also used before the first sample)
+
+  public:
+
+    /*!
+      @brief  The constructor optionally sets the limits of the timeout.
+
+      @param  min_us  Smallest timeout in microseconds (default 2 ms)
+      @param  max_us  Largest timeout in microseconds (default 1 s)
+    */
+    latency_tracker ( uint32_t min_us = 2000, uint32_t max_us = 1000000 )
+      : m_avg8(0), m_dev4(0), m_samples(0), m_timeouts(0), m_backoff(0),
+        m_min_us(min_us), m_max_us(max_us)
+      {}
+
+    /*!
+      @brief  Add a latency sample.
+
+      @param  us  The measured latency in microseconds
+    */
+    void      sample ( uint32_t us )
+      { if ( m_samples++ == 0 ) {
+          m_avg8 = us << 3;
+          m_dev4 = us << 1;
+        } else {
+          int32_t err = (int32_t)us - (int32_t)(m_avg8 >> 3);
+          m_avg8 += err;                                      // avg += err / 8
+          m_dev4 += ( err < 0 ? -err : err ) - ( m_dev4 >> 2 ); // dev += ( |err| - dev ) / 4
+        }
+        m_backoff = 0; }
+
+    /*!
+      @brief  Report that a timeout occurred.
+    */
+    void      timed_out ()
+      { m_timeouts++;
+        if ( m_backoff < 8 ) m_backoff++; }
+
+    /*!
+      @brief  Return the timeout derived from the samples.
+
+      @param  k   The number of deviations to add to the average
+
+      @return The timeout in microseconds
+    */
+    uint32_t  timeout ( uint32_t k = 4 )
+      { if ( m_samples == 0 ) return m_max_us;
+        uint64_t  t = ( (uint64_t)average() + (uint64_t)k * deviation() ) << m_backoff;
+        return t < m_min_us ? m_min_us : ( t > m_max_us ? m_max_us : (uint32_t)t ); }
+
+    uint32_t  average ()    ///< @return The average latency in microseconds
+      { return m_avg8 >> 3; }
+
+    uint32_t  deviation ()  ///< @return The average deviation in microseconds
+      { return m_dev4 >> 2; }
+
+    uint32_t  samples ()    ///< @return The number of samples received
+      { return m_samples; }
+
+    uint32_t  timeouts ()   ///< @return The number of timeouts reported
+      { return m_timeouts; }
+};
+
+/*!
+  @brief  Number of finite buckets of a latency_histogram.
+*/
+const int   LATENCY_BUCKETS = 12;
+
+/*!
+  @brief  Counts latency samples in fixed buckets, for the /metrics endpoint.
+
+  The buckets are those of a Prometheus histogram: a sample falls in
+  the first bucket whose upper bound (see bound_us()) it does not
+  exceed, or in the last, unbounded one. The sum is kept in whole
+  milliseconds plus a remainder in microseconds, so that it takes
+  49 days of accumulated latency to wrap.
+
+  Nothing is allocated, and every field is written by one side only
+  (see AWG_Task), so that another task may read the histogram while
+  samples are added; a reading taken meanwhile may be one sample
+  behind in some fields, which a scrape does not mind.
+*/
+class latency_histogram
+{
+  private:
+
+    std::atomic<uint32_t>   m_bucket[LATENCY_BUCKETS+1];    ///< Samples per bucket (not cumulative)
+    std::atomic<uint32_t>   m_sum_ms;                       ///< Sum of the samples, whole milliseconds
+    std::atomic<uint32_t>   m_sum_us;                       ///< Sum of the samples, remainder (0 - 999 us)
+
+    static void   add ( std::atomic<uint32_t> & field, uint32_t n )
+      { field.store(field.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+  public:
+
+    /*!
+      @brief  Constructor starts with no samples.
+    */
+    latency_histogram ()
+      : m_sum_ms(0), m_sum_us(0)
+      { for ( auto & b : m_bucket ) b.store(0, std::memory_order_relaxed); }
+
+    /*!
+      @brief  Read the upper bound of a bucket.
+
+      @param  bucket  The bucket, 0 to LATENCY_BUCKETS - 1 (the last one has no bound)
+
+      @return The bound in microseconds.
+    */
+    static uint32_t  bound_us ( int bucket )
+      { static const uint32_t  bounds[LATENCY_BUCKETS] = { 100, 250, 500, 1000, 2500, 5000,
+                                                          10000, 25000, 50000, 100000, 250000, 1000000 };
+        return bounds[bucket]; }
+
+    /*!
+      @brief  Add a sample (by the side that owns the histogram).
+
+      @param  latency_us  The latency in microseconds
+    */
+    void      sample ( uint32_t latency_us )
+      { int b = 0;
+        while ( b < LATENCY_BUCKETS && latency_us > bound_us(b) ) b++;
+        add(m_bucket[b], 1);
+        uint32_t  us = m_sum_us.load(std::memory_order_relaxed) + latency_us % 1000;
+        add(m_sum_ms, latency_us / 1000 + us / 1000);
+        m_sum_us.store(us % 1000, std::memory_order_relaxed); }
+
+    uint32_t  bucket ( int b ) const  ///< @return The number of samples in bucket b (0 to LATENCY_BUCKETS)
+      { return m_bucket[b].load(std::memory_order_relaxed); }
+
+    uint32_t  sum_ms () const         ///< @return The sum of the samples, whole milliseconds
+      { return m_sum_ms.load(std::memory_order_relaxed); }
+
+    uint32_t  sum_us () const         ///< @return The sum of the samples, remainder in microseconds
+      { return m_sum_us.load(std::memory_order_relaxed); }
+};
+
 /*!
   @brief  4-byte integer that cycles through a defined range.
 
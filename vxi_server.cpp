@@ -4,12 +4,22 @@
 #include "debug.h"
 #include "scpi.h"
 #include "awg_server.h"
-#include "siglent_waves.h"
 
 
-VXI_Server::VXI_Server ( AWG_Server & awg )
-  : vxi_port(rpc::VXI_PORT_START, rpc::VXI_PORT_END),
-    awg_server(awg)
+VXI_Server::VXI_Server ( AWG_Server & awg, uint32_t port_start, uint32_t port_end, uint32_t abort_port )
+  : vxi_port(port_start, port_end),
+    abort_port(abort_port),
+    awg_server(awg),
+    task(awg),
+    b_busy(false),
+    b_write_behind(false),
+    held_end(0),
+    b_uploading(false),
+    read_source(NULL),
+    trace_recorder(NULL),
+    trace_frequency(0),
+    created_links(0),
+    destroyed_links(0)
 {
   /*  We do not start the tcp_server port here, because
       WiFi has likely not yet been initialized. Instead,
@@ -50,6 +60,14 @@ void VXI_Server::begin ( bool bNext )
 
     vxi_port++;
   }
+  else
+  {
+    // the abort channel keeps the same port for every link
+
+    abort_server.begin(abort_port);
+
+    Debug.Progress() << "Listening for VXI aborts on TCP port " << abort_port << "\n";
+  }
   
   tcp_server.begin(vxi_port);
 
@@ -59,15 +77,50 @@ void VXI_Server::begin ( bool bNext )
 
 void VXI_Server::loop ()
 {
+  poll_abort();
+
+  if ( task.lent() )
+  {
+    return;     // the AWG is lent (e.g., to the Serial_Bridge); requests wait until it is back
+  }
+
   if ( client )      // if a connection has been established on port
   {
     bool  bClose = false;
-    int   len = get_vxi_packet(client);
+    int   len = 0;
+
+    /*  If there are commands waiting in the write-behind queue, only
+        read the next packet once it has actually arrived; otherwise
+        use the time to send the next queued command to the AWG
+        (unless the AWG_Task does that in a task of its own).  */
+
+    if ( task.threaded() || task.queue().empty() || client.available() )
+    {
+      /*  The request and response buffers are borrowed from the
+          packet_pool only for the duration of this request.  */
+
+      if ( request.acquire() && response.acquire() )
+      {
+        len = get_vxi_packet(client, request, record);
+      }
+    }
+    else
+    {
+      b_busy = true;
+      task.step();
+      b_busy = false;
+      task.clear_abort();
+    }
 
     if ( len > 0 )
     {
-      bClose = handle_packet();
+      bClose = handle_packet(len);
     }
+
+    record.skip(client);    // discard whatever the handler did not read (e.g., padding)
+
+    request.release();
+    response.release();
     
     if ( bClose )
     {
@@ -88,16 +141,41 @@ void VXI_Server::loop ()
     {
       Debug.Progress() << "\nVXI connection established on port " << vxi_port << "\n";
     }
+    else
+    {
+      end_upload();   // complete any upload cut off by a lost connection
+
+      if ( ! task.threaded() )
+      {
+        task.step();  // finish any queued commands left over from the last link
+      }
+    }
   }
 }
 
 
-bool VXI_Server::handle_packet ()
+bool VXI_Server::handle_packet ( uint32_t len )
 {
   bool      bClose = false;
   uint32_t  rc = rpc::SUCCESS;
+  uint32_t  start = micros();
+  uint32_t  port = vxi_port;
+
+  rpc_request_packet *  vxi_request = request.as<rpc_request_packet>();
+  rpc_response_packet * vxi_response = response.as<rpc_response_packet>();
 
-  if ( vxi_request->program != rpc::VXI_11_CORE )
+  trace_frequency = 0;
+  b_busy = true;     // until the response has been prepared, a device_abort applies to this request
+
+  if ( ! valid_vxi_request(request, len, record.complete()) )
+  {
+    rc = rpc::GARBAGE_ARGS;
+
+    Debug.Error() << "Invalid or truncated VXI request (" << len << " bytes)\n";
+
+    record.skip(client);
+  }
+  else if ( vxi_request->program != rpc::VXI_11_CORE )
   {
     rc = rpc::PROG_UNAVAIL;
 
@@ -119,7 +197,7 @@ bool VXI_Server::handle_packet ()
 
     case rpc::VXI_11_DEV_WRITE:
 
-      write();
+      write(len);
       break;
 
     case rpc::VXI_11_DESTROY_LINK:
@@ -136,6 +214,11 @@ bool VXI_Server::handle_packet ()
       break;
   }
 
+  /*  An abort only applies to the command that was in progress.  */
+
+  b_busy = false;
+  task.clear_abort();
+
   /*  Response messages will be sent by the various routines above
       when the program and procedure are recognized (and therefore
       rc == rpc::SUCCESS). We only need to send a response here
@@ -144,7 +227,19 @@ bool VXI_Server::handle_packet ()
   if ( rc != rpc::SUCCESS )
   {
     vxi_response->rpc_status = rc;
-    send_vxi_packet(client, sizeof(rpc_response_packet));
+    send_vxi_packet(client, request, response, sizeof(rpc_response_packet));
+  }
+
+  service_latency.sample(micros() - start);
+
+  if ( trace_recorder )
+  {
+    trace_recorder->vxi(port, vxi_request->procedure, len, start, trace_frequency, rc == rpc::SUCCESS);
+
+    if ( bClose )
+    {
+      trace_recorder->summary(Debug.Progress());
+    }
   }
 
   /*  signal to caller whether the connection should be close (i.e., DESTROY_LINK)  */
@@ -155,67 +250,217 @@ bool VXI_Server::handle_packet ()
 
 void VXI_Server::create_link ()
 {
+  create_request_packet *   create_request = request.as<create_request_packet>();
+  create_response_packet *  create_response = response.as<create_response_packet>();
+
   /*  The data field in a link request should contain a string
       with the name of the requesting device. It may already
       be null-terminated, but just in case, we will put in
-      the terminator.  */
+      the terminator. Note that handle_packet() has already
+      checked data_len (see valid_vxi_request()), so the
+      terminator always falls within the buffer.  */
   
   create_request->data[create_request->data_len] = 0;
 
   Debug.Progress() << "CREATE LINK request from \"" << create_request->data << "\" on port " << vxi_port << "\n";
 
+  created_links++;
+
+  if ( trace_recorder )
+  {
+    trace_recorder->begin_sweep();
+  }
+
   /*  Generate the response  */
 
   create_response->rpc_status = rpc::SUCCESS;
   create_response->error = rpc::NO_ERROR;
   create_response->link_id = 0;
-  create_response->abort_port = 0;
-  create_response->max_receive_size = VXI_READ_SIZE - 4;
+  create_response->abort_port = abort_port;
+  create_response->max_receive_size = VXI_STREAM_SIZE;   // text commands must still fit the buffer; see write()
 
-  send_vxi_packet(client, sizeof(create_response_packet));
+  send_vxi_packet(client, request, response, sizeof(create_response_packet));
 }
 
 
 void VXI_Server::destroy_link ()
 {
+  destroy_response_packet * destroy_response = response.as<destroy_response_packet>();
+
   Debug.Progress() << "DESTROY LINK on port " << vxi_port << "\n";
 
+  destroyed_links++;
+
+  end_upload();
+  read_source = NULL;
+
   destroy_response->rpc_status = rpc::SUCCESS;
   destroy_response->error = rpc::NO_ERROR;
-  send_vxi_packet(client, sizeof(destroy_response_packet));
+  send_vxi_packet(client, request, response, sizeof(destroy_response_packet));
 }
 
 
 void VXI_Server::read ()
 {
-  /*  We could and should respond to a BSWV? command with the current
-      AWG settings. The scpi_parse command does identify the type
-      of read needed using the read_type member variable. However,
-      the actual read response seems to be ignored except when the
-      scope asks for the AWG identification string. Since that string
-      can satisfy every read request, we will just generate it every
-      time.  */
+  read_request_packet *   read_request = request.as<read_request_packet>();
+  read_response_packet *  read_response = response.as<read_response_packet>();
+  uint32_t                request_size = read_request->request_size;
+  bool                    b_term = ( read_request->flags & rpc::FLAG_TERMCHRSET ) != 0;
+  char                    term_char = (char)(uint32_t)(read_request->term_char);
+  uint32_t                reason = 0;
+  uint32_t                len = 0;
+
+  /*  Leave room in the buffer for the XDR padding and
+      for a terminator for the Debug output.  */
 
-  const char *  AWG_ID = awg_server.id();
-  uint32_t      len = strlen(AWG_ID);
+  const uint32_t  capacity = ( VXI_SEND_SIZE - 4 - sizeof(read_response_packet) - 1 ) & ~3;
 
-  Debug.Progress() << "READ DATA on port " << vxi_port << "; data sent = " << AWG_ID << "\n";  
+  /*  In write-behind mode, the read must not be answered until
+      the AWG has caught up with the preceding writes.  */
+
+  drain(rw_channel);
+
+  if ( task.aborted() )
+  {
+    Debug.Progress() << "READ DATA on port " << vxi_port << " aborted\n";
+
+    read_response->rpc_status = rpc::SUCCESS;
+    read_response->error = rpc::ABORT;
+    read_response->reason = 0;
+    read_response->data_len = 0;
+
+    send_vxi_packet(client, request, response, sizeof(read_response_packet));
+    return;
+  }
+
+  /*  Start the response to the most recent query, unless part of
+      it is still waiting to be read. A BSWV? is answered with the
+      current wave parameters; anything else with the AWG id, since
+      the scope seems to ignore the response except when it asks
+      for the id.  */
+
+  if ( read_source == NULL || read_source->done() )
+  {
+    if ( read_type == rt_parameters )
+    {
+      parameter_source.begin(awg_server, task, rw_channel);
+      read_source = &parameter_source;
+    }
+    else
+    {
+      id_source.begin(awg_server.id());
+      read_source = &id_source;
+    }
+  }
+
+  uint32_t  limit = std::min(request_size, capacity);
+
+  if ( b_term )
+  {
+    // one byte at a time, so as to stop right after the terminating character
+
+    while ( len < limit && read_source->read(read_response->data + len, 1) == 1 )
+    {
+      if ( read_response->data[len++] == term_char )
+      {
+        reason |= rpc::CHR;
+        break;
+      }
+    }
+  }
+  else
+  {
+    len = read_source->read(read_response->data, limit);
+  }
+
+  if ( read_source->done() )
+  {
+    reason |= rpc::END;
+  }
+  else if ( len == request_size )
+  {
+    reason |= rpc::REQCNT;
+  }
+
+  read_response->data[len] = 0;
+
+  Debug.Progress() << "READ DATA on port " << vxi_port << "; data sent = " << read_response->data << " (reason = " << reason << ")\n";
 
   read_response->rpc_status = rpc::SUCCESS;
   read_response->error = rpc::NO_ERROR;
-  read_response->reason = rpc::END;
+  read_response->reason = reason;
   read_response->data_len = len;
-  strcpy(read_response->data,AWG_ID);
 
-  send_vxi_packet(client, sizeof(read_response_packet) + len);
+  send_vxi_packet(client, request, response, sizeof(read_response_packet) + len);
 }
 
 
-void VXI_Server::write ()
+void VXI_Server::write ( uint32_t len )
 {
-  uint32_t  wlen = write_request->data_len;
-  uint32_t  len = wlen;
+  write_request_packet *  write_request = request.as<write_request_packet>();
+  write_response_packet * write_response = response.as<write_response_packet>();
+  uint32_t                wlen = write_request->data_len;
+  uint32_t                held = std::min(wlen, len - (uint32_t) offsetof(write_request_packet, data));
+  bool                    b_end = ( write_request->flags & rpc::FLAG_END ) != 0;
+  int32_t                 offset = 0;
+  uint32_t                error;
+
+  /*  If an upload is in progress, all of the data are wave data;
+      otherwise, look for the start of wave data in a WVDT command.  */
+
+  if ( ! b_uploading )
+  {
+    offset = -1;
+
+    for ( uint32_t i = 0, n = strlen(scpi::wave_data_marker); i + n <= held && write_request->data[i] != 0; i++ )
+    {
+      if ( memcmp(write_request->data + i, scpi::wave_data_marker, n) == 0 )
+      {
+        offset = i + n;
+        break;
+      }
+    }
+  }
+
+  if ( offset >= 0 )
+  {
+    error = write_wave(write_request->data, held, wlen, offset, b_end);
+  }
+  else if ( ! record.complete() )
+  {
+    /*  Only wave data can be streamed; any other command
+        must fit in the buffer.  */
+
+    Debug.Error() << "WRITE DATA on port " << vxi_port << " too long (" << wlen << " bytes)\n";
+
+    record.skip(client);
+    error = rpc::OUT_OF_RESOURCES;
+  }
+  else
+  {
+    error = write_text(write_request->data, wlen);
+  }
+
+  /*  Generate the response  */
+
+  write_response->rpc_status = rpc::SUCCESS;
+  write_response->error = error;
+  write_response->size = wlen;
+
+  send_vxi_packet(client, request, response, sizeof(write_response_packet));
+}
+
+/*** write_text() ***************************************
+
+  This method handles a DEV_WRITE holding SCPI text
+  commands (i.e., anything but wave data).
+
+  @return The error code for the response.
 
+********************************************************/
+
+uint32_t VXI_Server::write_text ( char * data, uint32_t len )
+{
   /*  The data field in a write request should contain a string
       with the command for the AWG. It may end with '\n', which
       we will filter out to avoid inconsistent formatting in our
@@ -223,247 +468,378 @@ void VXI_Server::write ()
       in case, or in case we have filtered out '\n', we will add
       in the terminator.  */
 
-  while ( len > 0 && write_request->data[len-1] == '\n' )
+  while ( len > 0 && data[len-1] == '\n' )
   {
     len--;
   }
 
-  write_request->data[len] = 0;
+  data[len] = 0;
 
-  Debug.Progress() << "WRITE DATA on port " << vxi_port << " = " << write_request->data << "\n";
+  Debug.Progress() << "WRITE DATA on port " << vxi_port << " = " << data << "\n";
 
-  /*  Parse and respond to the SCPI command  */
+  /*  Parse and respond to the SCPI command. In write-behind mode,
+      any commands already in the queue at this point belong to
+      earlier writes; held_end lets queue_set() tell them apart
+      from the commands generated by this write.  */
 
-  parse_scpi(write_request->data);
+  held_end = task.queue().pushed();
 
-  /*  Generate the response  */
+  /*  If the AWG is down, the commands are still parsed (so that the
+      AWG_Server remembers them for when the AWG returns), but they
+      fail immediately and the response reports the error.  */
 
-  write_response->rpc_status = rpc::SUCCESS;
-  write_response->error = rpc::NO_ERROR;
-  write_response->size = wlen;
+  bool  b_was_down = ! task.available();
 
-  send_vxi_packet(client, sizeof(write_response_packet));
-}
+  parse_scpi(data);
 
-/*** parse_scpi() ******************************************
+  read_source = NULL;     // a new command discards any response not yet read
 
-  This method parses the SCPI commands and issues the
-  appropriate commands to the AWG.
+  /*  Unless the commands are still waiting in the queue, do not
+      respond until the AWG output has settled, so that the scope
+      never measures while the output is still changing.  */
 
-  The logic is as follows:
+  if ( ! b_write_behind )
+  {
+    task.complete(task.queue().pushed());
+  }
 
-  First, tokenize the initiator. If the initiator is the
-  identification request, set the flag for the next read
-  request and return. If it is the channel initiator,
-  get the channel and proceed to the next step.
+  if ( task.aborted() )
+  {
+    return rpc::ABORT;
+  }
 
-  Second, tokenize the remainder of the buffer to look
-  for a command. If it has parameters (OUTP and BSWV),
-  call process_parameters to get the parameters (ON, OFF,
-  or <parameter name>,<value> pairs), and set the AWG
-  accordingly. If the command is BSWV?, set the flag
-  for the next read request.
+  return task.available() ? rpc::NO_ERROR : ( b_was_down ? rpc::NO_CHANNEL : rpc::IO_TIMEOUT );
+}
+
+/*** write_wave() ***************************************
 
-  Repeat step 2 until there are no more commands left
-  to process.
+  This method handles a DEV_WRITE holding wave data,
+  i.e., a WVDT command or the continuation of one.
 
-  Note that this function uses the re-entrant strtok_r,
-  not to be thread-safe (we do not anticipate multi-
-  threading on the ESP-01), but to allow an inner and
-  outer loop to work simultaneously.
+  The first <held> bytes of the data are in the request
+  buffer, and the wave data start at <offset> (if this
+  is the WVDT command, the header comes before). The
+  rest of the <len> bytes are read from the client in
+  small pieces and passed on to the AWG as they arrive,
+  so that the wave never needs to be held in memory.
 
-***********************************************************/
+  @return The error code for the response.
 
-void VXI_Server::parse_scpi ( char * buffer )
+********************************************************/
+
+uint32_t VXI_Server::write_wave ( char * data, uint32_t held, uint32_t len, int32_t offset, bool b_end )
 {
-  char *  initiator;
-  char *  command_line;
-  char *  command;
-  char *  command_context;
-  char *  parameter_context;
-  int     id;
+  uint8_t   chunk[64];
+  uint32_t  remaining = len - offset;
+  uint32_t  n = held - offset;
+  bool      b_ok;
 
-  rw_channel = 0;
-  read_type = rt_none;
+  if ( ! b_uploading )
+  {
+    data[offset - strlen(scpi::wave_data_marker)] = 0;   // terminate the header before the marker
 
-  // first, get the initiator and its id
+    Debug.Progress() << "WAVE UPLOAD on port " << vxi_port << " = " << data << "\n";
 
-  initiator = strtok_r(buffer, scpi::delimiters[scpi::INITIATOR], &command_context);
-  id = get_id(initiator, scpi::initiators, scpi::initiator_id_cnt);
+    if ( ! begin_upload(data) )
+    {
+      record.skip(client);
+      return task.aborted() ? rpc::ABORT : ( task.available() ? rpc::PARAMETER_ERROR : rpc::NO_CHANNEL );
+    }
+  }
+
+  b_ok = awg_server.upload((uint8_t *)(data + offset), n);
 
-  // process according to the id of the initiator
-  switch ( id )
+  for ( remaining -= n; remaining > 0 && b_ok && ! task.aborted(); remaining -= n )
   {
-    /*  if initializer = IDN-SGLT-PRI? then set read_type flag and
-        return - no further processing needed  */
+    n = record.read(client, chunk, std::min(remaining, (uint32_t) sizeof(chunk)));
 
-    case scpi::ID_REQUEST:
+    if ( n == 0 )
+    {
+      Debug.Error() << "Wave data cut short (" << remaining << " bytes missing)\n";
+      break;
+    }
 
-      read_type = rt_identification;
-      return;
+    b_ok = awg_server.upload(chunk, n);
 
-    /*  if initializer = C, extract the channel and drop down
-        to do further processing  */
+    poll_abort();
+    yield();
+  }
 
-    case scpi::CHANNEL:
+  record.skip(client);
 
-      sscanf(initiator+1, "%d", &rw_channel);
-      break;
+  if ( b_end || ! b_ok || remaining > 0 )
+  {
+    b_uploading = false;
+    b_ok = awg_server.end_upload() && b_ok && remaining == 0;
+    task.release();
+  }
 
-    // if neither, we don't recognize this initiator, so we simply return
+  if ( task.aborted() )
+  {
+    return rpc::ABORT;
+  }
 
-    default:
+  return b_ok ? rpc::NO_ERROR : rpc::IO_TIMEOUT;
+}
 
-      return;
+/*** begin_upload() *************************************
 
-  } // end switch ( initiator id )
+  This method parses the header of a WVDT command (e.g.,
+  C1:WVDT WVNM,wave2,LENGTH,1024,) and starts the upload
+  on the AWG. The slot is taken from the number at the
+  end of the wave name (default 1). LENGTH is taken as
+  the number of points; if it is missing, the points
+  are sent to the AWG one for one.
+
+  @return True if the AWG is ready to receive the wave data.
+
+********************************************************/
 
-  /*  If we get to this point, we have received the channel and are ready
-      to process command lines. The format of each command_line will be
-      COMMAND<space>PARAMETER,VALUE[,PARAMETER,VALUE ...]  */
+bool VXI_Server::begin_upload ( char * header )
+{
+  char *    context;
+  char *    token;
+  char *    value;
+  uint32_t  slot = 1;
+  uint32_t  points = 0;
 
-  command_line = strtok_r(NULL, scpi::delimiters[scpi::COMMAND], &command_context);
+  token = strtok_r(header, scpi::delimiters[scpi::INITIATOR], &context);
 
-  while ( command_line != NULL )
+  if ( token == NULL || get_id(token, scpi::initiators, scpi::initiator_id_cnt) != scpi::CHANNEL )
   {
-    // extract the actual command from the command_line and get its id
+    return false;
+  }
 
-    command = strtok_r(command_line, scpi::delimiters[scpi::PRE_PARAMETERS], &parameter_context);
-    id = get_id(command, scpi::commands, scpi::command_id_cnt);
+  sscanf(token+1, "%d", &rw_channel);
 
-    switch ( id )
-    {
-      /*  if id = OUTP, process parameters looking for "ON" or "OFF"
-          and set AWG accordingly  */
+  token = strtok_r(NULL, scpi::delimiters[scpi::PRE_PARAMETERS], &context);
 
-      case scpi::SET_OUTPUT:
+  if ( token == NULL || get_id(token, scpi::commands, scpi::command_id_cnt) != scpi::UPLOAD_WAVE )
+  {
+    return false;
+  }
 
-        process_parameters(parameter_context);
-        break;
+  while ( ( token = strtok_r(NULL, scpi::delimiters[scpi::PARAMETERS], &context) ) != NULL
+          && ( value = strtok_r(NULL, scpi::delimiters[scpi::PARAMETERS], &context) ) != NULL )
+  {
+    switch ( get_id(token, scpi::upload_parameters, scpi::upload_parameter_count) )
+    {
+      case scpi::WAVE_NAME:
+      {
+        char *  digits = value + strlen(value);
 
-      // if id = BSWV, process wave parameters and set AWG accordingly
+        while ( digits > value && isdigit(digits[-1]) )
+        {
+          digits--;
+        }
 
-      case scpi::SET_PARAMETERS:
+        if ( *digits != 0 )
+        {
+          slot = atoi(digits);
+        }
 
-        process_parameters(parameter_context);
         break;
+      }
 
-      // if id = BSWV?, set flag so that next read retrieves wave parameters
-
-      case scpi::GET_PARAMETERS:
+      case scpi::WAVE_LENGTH:
 
-        read_type = rt_parameters;
+        sscanf(value, "%u", &points);
         break;
 
-      // if none of the above, we don't recognize the command, so we ignore it
-
       default:
 
         break;
+    }
+  }
 
-    } // end switch ( command id )
-
-    // extract the next command_line; if any, cycle back through the loop
+  /*  Nothing else may be sent to the AWG during the upload, so
+      finish the commands that are still queued, and take the AWG
+      from the AWG_Task until the upload ends.  */
 
-    command_line = strtok_r(NULL, scpi::delimiters[scpi::COMMAND], &command_context);
+  b_uploading = task.claim() && awg_server.begin_upload(rw_channel, slot, points);
 
-  } // end while ( command_line != NULL )
+  if ( ! b_uploading )
+  {
+    task.release();
+  }
 
+  return b_uploading;
 }
 
-/*** process_parameters()********************************
+/*** end_upload() ***************************************
 
-  This method continues to tokenize the command_line via
-  the supplied parameter_context. It expects to see
-  either ON, OFF, or a parameter pair (name,value). If
-  it recognizes the parameter, it sets the AWG accordingly.
-  It continues until there are no more parameters to
-  process.
+  This method completes an upload that is still in
+  progress (e.g., if the link is destroyed before the
+  last DEV_WRITE), so that the AWG is ready for other
+  commands again.
 
 ********************************************************/
 
-void VXI_Server::process_parameters ( char * parameter_context )
+void VXI_Server::end_upload ()
 {
-  char *  parameter;
-  char *  s_val;
-  double  value;
-  int     id;
+  if ( b_uploading )
+  {
+    b_uploading = false;
+    awg_server.end_upload();
+    task.release();
+  }
+}
 
-  /*  Note that strtok_r here usese NULL for the initial argument,
-      because it is continuing to tokenize the line begun in
-      parse_scpi and pointed to by the parameter_context. This
-      also means that we can get the parameter in the while test. */
+/*** poll_abort() ***************************************
 
-//  Debug.Progress() << "Setting AWG Channel " << rw_channel << ": ";
+  This method accepts a connection on the abort port and
+  answers a device_abort request, if one has arrived. It
+  uses its own packet buffers, since it may be called
+  while the buffers of the link are in use.
 
-  while ( ( parameter = strtok_r ( NULL, scpi::delimiters[scpi::PARAMETERS], &parameter_context ) ) != NULL ) {
+********************************************************/
 
-    // translate the parameter into a parameter id or -1 if not one we know
+void VXI_Server::poll_abort ()
+{
+  if ( ! abort_client )
+  {
+    abort_client = abort_server.accept();
+  }
 
-    id = get_id ( parameter, scpi::parameters, scpi::parameter_count );
+  if ( ! abort_client || ! abort_client.available() )
+  {
+    return;
+  }
 
-    // if the parameter is one we recognize, process it
+  rpc_buffer  abort_request, abort_response;    // returned to the packet_pool when poll_abort() ends
+  rpc_record  abort_record;
+  uint32_t    len;
+  uint32_t    rc = rpc::SUCCESS;
 
-    if ( id >= 0 )
-    {
-      switch ( id )
-      {
-        case scpi::OUTPUT_OFF:
-        case scpi::OUTPUT_ON:
+  if ( ! abort_request.acquire() || ! abort_response.acquire() )
+  {
+    return;     // leave the request unread; try again on the next call
+  }
 
-          value = id;   // if id is ON or OFF, let value = 0 (OFF) or 1 (ON)
-//        Debug.Progress() << "OUTPUT = " << ( id == scpi::OUTPUT_ON ? "ON" : "OFF" ) << "; ";
+  len = get_vxi_packet(abort_client, abort_request, abort_record);
 
-          break;
+  abort_record.skip(abort_client);
 
-        case scpi::WAVE:
+  if ( len == 0 )
+  {
+    return;
+  }
 
-          // read the following value ... but discard it and set value = siglent::Sine
+  rpc_request_packet *    vxi_request = abort_request.as<rpc_request_packet>();
+  abort_response_packet * vxi_response = abort_response.as<abort_response_packet>();
 
-          s_val = strtok_r ( NULL, scpi::delimiters[scpi::PARAMETERS], &parameter_context );
-          value = siglent::Sine;
+  if ( ! valid_vxi_request(abort_request, len) )
+  {
+    rc = rpc::GARBAGE_ARGS;
+  }
+  else if ( vxi_request->program != rpc::VXI_11_ASYNC )
+  {
+    rc = rpc::PROG_UNAVAIL;
+  }
+  else if ( vxi_request->procedure != rpc::VXI_11_DEVICE_ABORT )
+  {
+    rc = rpc::PROC_UNAVAIL;
+  }
 
-          break;
+  if ( rc != rpc::SUCCESS )
+  {
+    Debug.Error() << "Invalid request on the abort channel (rpc status " << rc << ")\n";
 
-        default:
+    vxi_response->rpc_status = rc;
+    send_vxi_packet(abort_client, abort_request, abort_response, sizeof(rpc_response_packet));
+    return;
+  }
 
-          // if the parameter is not ON, OFF, or WAVE, we need to read the following value
+  vxi_response->rpc_status = rpc::SUCCESS;
 
-          s_val = strtok_r ( NULL, scpi::delimiters[scpi::PARAMETERS], &parameter_context );
-          sscanf(s_val, "%lf", &value);
+  if ( abort_request.as<abort_request_packet>()->link_id != 0 )   // see create_link()
+  {
+    vxi_response->error = rpc::INVALID_LINK;
+  }
+  else
+  {
+    abort();
+    vxi_response->error = rpc::NO_ERROR;
+  }
 
-//        Debug.Progress() << parameter << " = " << value << "; ";
+  send_vxi_packet(abort_client, abort_request, abort_response, sizeof(abort_response_packet));
+}
 
-          break;
-      }
+/*** abort() ********************************************
 
-      awg_server.set(rw_channel,id,value);
+  This method discards the commands waiting in the queue
+  and, if a command is in progress, cancels it. The AWG
+  abort is cleared again once the command in progress
+  has returned (see handle_packet() and loop()).
 
-    } // end if valid id
+********************************************************/
 
-  } // end while parameter != NULL
+void VXI_Server::abort ()
+{
+  Debug.Progress() << "DEVICE ABORT on port " << vxi_port << ( b_busy ? "" : " (nothing in progress)" ) << "\n";
 
-//  Debug.Progress() << "\n";
+  task.abort(b_busy);
 }
 
-/*** get_id() ******************************************
+/*** queue_set() ****************************************
 
-  This method matches the id against one of the ids in
-  the supplied list. IF there is a match, it returns its
-  index; otherwise, it returns -1.
+  This method passes a parsed command on to the AWG. If
+  write-behind is disabled (and the AWG_Task runs inline),
+  it simply calls set() on the awg_server. Otherwise, it
+  validates the channel and adds the command to the queue
+  of the AWG_Task, to be applied later by loop() (or by
+  the AWG_Task itself, if threaded). If commands from an
+  earlier write are still pending for the same channel,
+  those are completed first, so that a channel never runs
+  more than one write ahead of the AWG.
 
 ********************************************************/
 
-int VXI_Server::get_id ( const char * id_text, const char * const id_list[], size_t id_cnt )
+void VXI_Server::queue_set ( uint32_t channel, uint32_t param_id, double value )
 {
-  int id = -1;
+  uint32_t  until;
 
-  for ( int i = 0; i < id_cnt; i++ ) {
-    if ( strncmp(id_text, id_list[i], strlen(id_list[i])) == 0 ) {
-      id = i;
-      break;
-    }
+  if ( task.aborted() )
+  {
+    return;     // the rest of an aborted write is dropped
   }
 
-  return id;
+  if ( param_id == scpi::FREQUENCY )
+  {
+    trace_frequency = value;
+  }
+
+  if ( ! task.threaded() && ( ! b_write_behind || ! awg_server.available() ) )
+  {
+    awg_server.set(channel, param_id, value);
+    return;
+  }
+
+  if ( channel < 1 || channel > awg_server.channels() )
+  {
+    Debug.Error() << "Invalid channel " << channel << "; command not queued\n";
+    return;
+  }
+
+  if ( task.queue().pending(channel, held_end, until) )
+  {
+    task.complete(until);
+  }
+
+  task.push(channel, param_id, value);
+}
+
+/*** drain() ********************************************
+
+  This method completes the queued commands for the given
+  channel, and waits for the AWG output to settle.
+
+********************************************************/
+
+void VXI_Server::drain ( uint32_t channel )
+{
+  uint32_t  until = task.queue().popped();
+
+  task.queue().pending(channel, task.queue().pushed(), until);
+  task.complete(until);
 }
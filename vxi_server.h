@@ -5,21 +5,27 @@
 #include "wifi_ext.h"
 #include "utilities.h"
 #include "awg_server.h"
+#include "awg_task.h"
+#include "rpc_packets.h"
+#include "rpc_enums.h"
+#include "response_source.h"
+#include "trace_recorder.h"
+#include "scpi_parser.h"
 
 
-class VXI_Server {
+class VXI_Server : public SCPI_Parser {
 
   public:
-  
-    enum Read_Type {
-      rt_none           = 0,
-      rt_identification = 1,
-      rt_parameters     = 2
-    };
 
-  public:
+    /*  Each VXI_Server listens on its own block of ports: one
+        for the abort channel, and a range through which the link
+        port rotates. The defaults are those of the ESP-01; the
+        Linux build gives each bench its own block.  */
 
-    VXI_Server ( AWG_Server & awg );
+    VXI_Server ( AWG_Server & awg,
+                 uint32_t port_start = rpc::VXI_PORT_START,
+                 uint32_t port_end = rpc::VXI_PORT_END,
+                 uint32_t abort_port = rpc::VXI_ABORT_PORT );
 
     ~VXI_Server ();
 
@@ -38,23 +44,113 @@ class VXI_Server {
     uint32_t  port ()
       { return vxi_port; }
 
+    /*  In write-behind mode, a DEV_WRITE is parsed and its
+        commands are queued; the response is sent immediately,
+        and the commands are applied to the AWG from loop().
+        Note that the AWG settle time (see AWG_Server::settling())
+        is then only enforced before a following DEV_READ or
+        DEV_WRITE to the same channel, not before the response.  */
+
+    void      write_behind ( bool enable )
+      { b_write_behind = enable; }
+
+    bool      write_behind ()
+      { return b_write_behind; }
+
+    /*  The parsed commands pass through the AWG_Task, which applies
+        them to the AWG: inline (from loop(), as on the ESP8266), or
+        in a task of its own (see AWG_Task::threaded()). Threaded,
+        every command is queued, and write_behind() only selects
+        whether the response waits for the AWG.  */
+
+    AWG_Task &  awg_task ()
+      { return task; }
+
+    /*  Each request served can be added to a Trace_Recorder; a
+        summary of the link is then written to Debug (PROGRESS)
+        at each DESTROY_LINK.  */
+
+    void      trace ( Trace_Recorder * recorder )
+      { trace_recorder = recorder; }
+
+    Trace_Recorder *  trace ()
+      { return trace_recorder; }
+
+    /*  Counters and the service time of the requests, for the
+        /metrics endpoint (see Metrics_Server).  */
+
+    uint32_t  links_created ()
+      { return created_links; }
+
+    uint32_t  links_destroyed ()
+      { return destroyed_links; }
+
+    const latency_histogram & request_latency ()
+      { return service_latency; }
+
+    /*  The abort channel: the scope may connect to the abort port
+        (given in the CREATE_LINK response) and send a device_abort
+        while a DEV_WRITE or DEV_READ is blocked waiting for the AWG.
+        poll_abort() is called from loop() and, through the AWG
+        wait hook (see AWG_Server::wait_hook()), while the AWG is
+        being waited for. An abort discards the queued commands and
+        cancels the one in progress, whose call then returns
+        rpc::ABORT.  */
+
+    void      poll_abort ();
+
+    void      abort ();
+
+    /*  The response to a query is generated as it is read (see
+        Response_Source), in pieces of at most request_size bytes
+        per DEV_READ, until it is done (END) or, if the client
+        asks for it, up to the terminating character (CHR). A
+        following DEV_WRITE discards any part not yet read.  */
+
+    /*  A DEV_WRITE whose data do not fit in a packet buffer is
+        accepted only for a WVDT (arbitrary wave) command: the
+        header is read into the buffer, and the binary wave data
+        are passed on to the AWG in small pieces as they arrive
+        (see write_wave()). The wave may also be split over several
+        DEV_WRITEs; the last one carries the END flag.  */
+
   protected:
 
-    void  create_link ();
-    void  destroy_link ();
-    void  read ();
-    void  write ();
-    bool  handle_packet ();
-    void  parse_scpi ( char * buffer );
-    void  process_parameters ( char * parameter_context );
-    int   get_id ( const char * id_text, const char * const id_list[], size_t id_cnt );
+    void      create_link ();
+    void      destroy_link ();
+    void      read ();
+    void      write ( uint32_t len );
+    uint32_t  write_text ( char * data, uint32_t len );
+    uint32_t  write_wave ( char * data, uint32_t held, uint32_t len, int32_t offset, bool b_end );
+    bool      begin_upload ( char * header );
+    void      end_upload ();
+    bool      handle_packet ( uint32_t len );
+    virtual void  queue_set ( uint32_t channel, uint32_t param_id, double value );
+    void      drain ( uint32_t channel );
 
     WiFiServer_ext  tcp_server;
     WiFiClient      client;
-    Read_Type       read_type;
-    uint32_t        rw_channel;
+    WiFiServer_ext  abort_server;   ///< Listens on the abort port
+    WiFiClient      abort_client;   ///< The connection on the abort port, if any
+    rpc_buffer      request;      ///< Buffer holding the current request (borrowed from the packet_pool)
+    rpc_buffer      response;     ///< Buffer holding the current response (borrowed from the packet_pool)
+    rpc_record      record;       ///< Keeps track of the fragments of the current request
     cyclic_uint32_t vxi_port;
+    uint32_t        abort_port;   ///< Port of the abort channel
     AWG_Server &    awg_server;    
+    AWG_Task        task;         ///< Applies the parsed commands to the AWG
+    bool            b_busy;       ///< True while a command is in progress (i.e., can be aborted)
+    bool            b_write_behind;
+    uint32_t        held_end;     ///< Value of pushed() before the current write (see queue_set())
+    bool            b_uploading;  ///< True while the data of a WVDT command spans several DEV_WRITEs
+    Text_Source       id_source;          ///< Generates the response to IDN-SGLT-PRI?
+    Parameter_Source  parameter_source;   ///< Generates the response to BSWV?
+    Response_Source * read_source;        ///< The response being read, or NULL
+    Trace_Recorder *  trace_recorder;     ///< Records each request served, or NULL
+    double            trace_frequency;    ///< Frequency set by the current request (for the trace), or 0
+    uint32_t          created_links;      ///< Number of CREATE_LINK requests served
+    uint32_t          destroyed_links;    ///< Number of DESTROY_LINK requests served
+    latency_histogram service_latency;    ///< Time to serve each request
 };
 
 